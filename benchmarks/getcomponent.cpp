@@ -0,0 +1,119 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Entity::get_component<T> against the previous lookup, which kept a
+ * std::map<std::string, unsigned int> per Entity and resolved the cache by
+ * class string on every call. The old path is rebuilt here on top of the
+ * string based Engine API.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../include/cashley.h"
+
+class PositionComponent : public CAshley::Component {
+public:
+    float x, y;
+    CASHLEY_COMPONENT
+};
+
+class VelocityComponent : public CAshley::Component {
+public:
+    float x, y;
+    CASHLEY_COMPONENT
+};
+
+class HealthComponent : public CAshley::Component {
+public:
+    int hp;
+    CASHLEY_COMPONENT
+};
+
+class BenchEntity : public CAshley::Entity {
+public:
+    CASHLEY_ENTITY
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double ns_per_op(Clock::time_point start, unsigned long long ops) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ops;
+}
+
+int main() {
+    const unsigned int entities = 100000, rounds = 50;
+    CAshley::Engine engine;
+    std::vector<BenchEntity *> v;
+    std::vector<std::map<std::string, unsigned int> > maps(entities);
+    for (unsigned int i = 0; i < entities; i++) {
+        BenchEntity * e = new BenchEntity;
+        engine.add_entity(e);
+        e->add_component<HealthComponent>();
+        e->add_component<PositionComponent>();
+        e->add_component<VelocityComponent>();
+        e->activate();
+        v.push_back(e);
+    }
+    // Old layout: class string -> UID. Fresh caches give UIDs in allocation
+    // order, so the components of entity i have UID i.
+    for (unsigned int i = 0; i < entities; i++) {
+        HealthComponent h;
+        PositionComponent p;
+        VelocityComponent vel;
+        maps[i][h.get_name()] = i;
+        maps[i][p.get_name()] = i;
+        maps[i][vel.get_name()] = i;
+    }
+
+    float sum = 0;
+    Clock::time_point start = Clock::now();
+    for (unsigned int r = 0; r < rounds; r++) {
+        for (unsigned int i = 0; i < entities; i++) {
+            PositionComponent x;
+            std::map<std::string, unsigned int> & m = maps[i];
+            if (m.find(x.get_name()) == m.end()) {
+                return 1;
+            }
+            sum += static_cast<PositionComponent *>(engine.get_component(x.get_name(), m[x.get_name()]))->x;
+        }
+    }
+    double old_ns = ns_per_op(start, (unsigned long long)entities * rounds);
+
+    start = Clock::now();
+    for (unsigned int r = 0; r < rounds; r++) {
+        for (unsigned int i = 0; i < entities; i++) {
+            sum += v[i]->get_component<PositionComponent>()->x;
+        }
+    }
+    double new_ns = ns_per_op(start, (unsigned long long)entities * rounds);
+
+    printf("get_component<T>, %u entities x %u rounds\n", entities, rounds);
+    printf("  string map lookup: %8.2f ns/op\n", old_ns);
+    printf("  slot table:        %8.2f ns/op\n", new_ns);
+    printf("  speedup:           %8.2fx\n", old_ns / new_ns);
+
+    for (unsigned int i = 0; i < entities; i++) {
+        delete v[i];
+    }
+    return sum == 12345.f;
+}
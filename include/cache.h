@@ -21,15 +21,26 @@
 #ifndef __CASHLEY_CACHE_H
 #define __CASHLEY_CACHE_H
 
+#include <algorithm>
 #include <iostream>
 #include <cstring>
-#include <map>
+#include <new>
+#include <type_traits>
+#include <vector>
 
+#include "component.h"
 #include "exceptions.h"
+#include "schema.h"
+#include "snapshot.h"
 
 // TODO: Remove or rework?
 #define __CASHLEY_DEBUG_MSG(x)
 
+/**
+ * \brief Marks a free UID or position in the Cache tables.
+ */
+#define CACHE_NONE 0xFFFFFFFFu
+
 namespace CAshley {
 
     /**
@@ -38,17 +49,259 @@ namespace CAshley {
      */
     class _Cache {
     public:
+        virtual ~_Cache() {}
         virtual void block_activate(unsigned int i) = 0;
         virtual void block_deactivate(unsigned int i) = 0;
         virtual void block_free(unsigned int i) = 0;
+        virtual void block_free_n(const unsigned int * uids, unsigned int n) = 0;
+        virtual void block_activate_n(const unsigned int * uids, unsigned int n) = 0;
+        virtual void block_deactivate_n(const unsigned int * uids, unsigned int n) = 0;
         virtual std::pair<void *, unsigned int> get_active_blocks() = 0;
+        virtual unsigned int get_block_size() = 0;
+        /**
+         * \brief Write the used components and the UID tables to a snapshot.
+         * Block copyable components are written bitwise, the rest with Component::save().
+         */
+        virtual void save(SnapshotWriter & w) = 0;
+        /**
+         * \brief Read the components and the UID tables written by save().
+         * The cache must have no used components. UIDs are kept.
+         */
+        virtual void load(SnapshotReader & r) = 0;
+        /**
+         * \brief Write a used component to the stream of a snapshot, as save_value().
+         */
+        virtual void save_block(unsigned int uid, SnapshotWriter & w) = 0;
+        /**
+         * \brief Read a component written by save_block() over a used one.
+         */
+        virtual void load_block(unsigned int uid, SnapshotReader & r) = 0;
+        /**
+         * \brief Create a copy of the cache, with the same UIDs and order.
+         * Block copyable components are copied in bulk with memcpy, the rest with their
+         * copy constructor. Copies have no owner.
+         */
+        virtual _Cache * clone() = 0;
+
+        /**
+         * \brief Write a single component to the stream of a snapshot.
+         * Block copyable components are written bitwise, described ones (CASHLEY_FIELDS)
+         * field by field, the rest with Component::save().
+         */
+        template <class T>
+        static void save_value(SnapshotWriter & w, T & x) {
+            _save_value(w, x, is_block_copyable<T>());
+        }
+        /**
+         * \brief Read a component written by save_value() over another one.
+         * The Component part of x, with its owner, is kept.
+         */
+        template <class T>
+        static void load_value(SnapshotReader & r, T & x) {
+            _load_value(r, x, is_block_copyable<T>());
+        }
+        /**
+         * \brief Copy the bytes of a block copyable component over another one.
+         * The Component part of x, with its owner, is kept.
+         */
+        template <class T>
+        static void copy_value(T & x, const char * data) {
+            char old[sizeof(T)];
+            memcpy(old, (const void *)&x, sizeof(T));
+            memcpy((void *)&x, (const void *)data, sizeof(T));
+            _keep_header(x, old, std::is_base_of<Component, T>());
+        }
+
+    protected:
+        template <class T>
+        static void _save_value(SnapshotWriter & w, T & x, std::true_type) {
+            w.write((const void *)&x, sizeof(T));
+        }
+        template <class T>
+        static void _save_value(SnapshotWriter & w, T & x, std::false_type) {
+            _save_fields(w, x, has_fields<T>());
+        }
+        template <class T>
+        static void _load_value(SnapshotReader & r, T & x, std::true_type) {
+            char old[sizeof(T)];
+            memcpy(old, (const void *)&x, sizeof(T));
+            r.read((void *)&x, sizeof(T));
+            _keep_header(x, old, std::is_base_of<Component, T>());
+        }
+        template <class T>
+        static void _load_value(SnapshotReader & r, T & x, std::false_type) {
+            Entity * owner = x.get_owner();
+            _load_fields(r, x, has_fields<T>());
+            x.set_owner(owner);
+        }
+        /**
+         * \brief Write a component that is not block copyable.
+         * Described components are written by their schema, without virtual calls.
+         */
+        template <class T>
+        static void _save_fields(SnapshotWriter & w, T & x, std::true_type) {
+            component_schema<T>().save(w, &x);
+        }
+        template <class T>
+        static void _save_fields(SnapshotWriter & w, T & x, std::false_type) {
+            x.save(w);
+        }
+        template <class T>
+        static void _load_fields(SnapshotReader & r, T & x, std::true_type) {
+            component_schema<T>().load(r, &x);
+        }
+        template <class T>
+        static void _load_fields(SnapshotReader & r, T & x, std::false_type) {
+            x.load(r);
+        }
+        /**
+         * \brief Put back the Component part of a component read bitwise.
+         * \param old Bytes of the component before reading.
+         */
+        template <class T>
+        static void _keep_header(T & x, const char * old, std::true_type) {
+            size_t offset = (const char *)static_cast<Component *>(&x) - (const char *)&x;
+            memcpy((void *)static_cast<Component *>(&x), old + offset, sizeof(Component));
+        }
+        template <class T>
+        static void _keep_header(T &, const char *, std::false_type) {
+        }
+        /**
+         * \brief Write a run of components bitwise, as a blob.
+         */
+        template <class T>
+        static void _save_blocks(SnapshotWriter & w, T * blocks, unsigned int n, std::true_type) {
+            char * copy = w.write_blob((const void *)blocks, sizeof(T) * n);
+            _save_header<T>(w, copy, n, std::is_base_of<Component, T>());
+        }
+        /**
+         * \brief Write a run of components one by one, as save_value().
+         */
+        template <class T>
+        static void _save_blocks(SnapshotWriter & w, T * blocks, unsigned int n, std::false_type) {
+            for (unsigned int i = 0; i < n; i++) {
+                _save_fields(w, blocks[i], has_fields<T>());
+            }
+        }
+        /**
+         * \brief Read a run of components written bitwise, in one copy.
+         */
+        template <class T>
+        static void _load_blocks(SnapshotReader & r, T * blocks, unsigned int n, std::true_type) {
+            const char * blob = r.read_blob(sizeof(T) * (size_t)n);
+            bool same = _load_header<T>(r, std::is_base_of<Component, T>());
+            memcpy((void *)blocks, (const void *)blob, sizeof(T) * n);
+            if (!same) {
+                _reset_components(blocks, n, std::is_base_of<Component, T>());
+            }
+        }
+        /**
+         * \brief Read a run of components written one by one.
+         */
+        template <class T>
+        static void _load_blocks(SnapshotReader & r, T * blocks, unsigned int n, std::false_type) {
+            for (unsigned int i = 0; i < n; i++) {
+                _load_fields(r, blocks[i], has_fields<T>());
+                blocks[i].set_owner(NULL);
+            }
+        }
+        /**
+         * \brief Write the Component part of a blob, and set it on its components.
+         * Owners are meaningless on a snapshot, so the components of a blob get the
+         * Component part of a default constructed one, without owner. It is written on
+         * the stream, so loading runs with the same virtual tables can skip rebuilding it.
+         * \param blocks Copy of the components on the blob, maybe unaligned.
+         */
+        template <class T>
+        static void _save_header(SnapshotWriter & w, char * blocks, unsigned int n, std::true_type) {
+            T x;
+            x.set_owner(NULL);
+            const char * header = (const char *)static_cast<Component *>(&x);
+            size_t offset = header - (const char *)&x;
+            w.write(header, sizeof(Component));
+            for (unsigned int i = 0; i < n; i++) {
+                memcpy(blocks + sizeof(T) * i + offset, header, sizeof(Component));
+            }
+        }
+        template <class T>
+        static void _save_header(SnapshotWriter &, char *, unsigned int, std::false_type) {
+        }
+        /**
+         * \brief Read the Component part of a blob.
+         * \return true if it is the one of this run, so the blob is ready to use.
+         */
+        template <class T>
+        static bool _load_header(SnapshotReader & r, std::true_type) {
+            T x;
+            x.set_owner(NULL);
+            char header[sizeof(Component)];
+            r.read(header, sizeof(Component));
+            return !memcmp(header, (const void *)static_cast<Component *>(&x), sizeof(Component));
+        }
+        template <class T>
+        static bool _load_header(SnapshotReader &, std::false_type) {
+            return true;
+        }
+        /**
+         * \brief Rebuild the Component part of components read bitwise.
+         * The virtual table of another run may be different, so it is copied from a
+         * default constructed component, without owner.
+         */
+        template <class T>
+        static void _reset_components(T * blocks, unsigned int n, std::true_type) {
+            T x;
+            x.set_owner(NULL);
+            for (unsigned int i = 0; i < n; i++) {
+                memcpy((void *)static_cast<Component *>(&blocks[i]), (const void *)static_cast<Component *>(&x), sizeof(Component));
+            }
+        }
+        template <class T>
+        static void _reset_components(T *, unsigned int, std::false_type) {
+        }
+        /**
+         * \brief Copy a run of components over default constructed ones, in one memcpy.
+         */
+        template <class T>
+        static void _copy_blocks(T * to, T * from, unsigned int n, std::true_type) {
+            memcpy((void *)to, (const void *)from, sizeof(T) * n);
+            _clear_owners(to, n, std::is_base_of<Component, T>());
+        }
+        /**
+         * \brief Copy a run of components over default constructed ones, one by one.
+         */
+        template <class T>
+        static void _copy_blocks(T * to, T * from, unsigned int n, std::false_type) {
+            _copy_construct(to, from, n, std::is_copy_constructible<T>());
+        }
+        template <class T>
+        static void _copy_construct(T * to, T * from, unsigned int n, std::true_type) {
+            for (unsigned int i = 0; i < n; i++) {
+                to[i].~T();
+                new (&to[i]) T(from[i]);
+                to[i].set_owner(NULL);
+            }
+        }
+        template <class T>
+        static void _copy_construct(T *, T *, unsigned int, std::false_type) {
+            CacheError e("Component can not be copied.");
+            throw e;
+        }
+        template <class T>
+        static void _clear_owners(T * blocks, unsigned int n, std::true_type) {
+            for (unsigned int i = 0; i < n; i++) {
+                blocks[i].set_owner(NULL);
+            }
+        }
+        template <class T>
+        static void _clear_owners(T *, unsigned int, std::false_type) {
+        }
     };
 
     /**
      * \brief Class to ensure data locality.
      *
      * This class ensure that enabled components are store together to
-     * accelerate memory access.
+     * accelerate memory access. UIDs of freed components are reused.
      */
     template<class T>
     class Cache : public _Cache {
@@ -56,14 +309,25 @@ namespace CAshley {
         /**
          * \brief Constructor to preallocate the memory of the cache.
          * \param s Size of the preallocated memory.
+         * \param growable If true, the memory is doubled when full instead of throwing.
          */
-        Cache(unsigned int s) {
-            _size = s;
-            _cache = new T[s];
+        Cache(unsigned int s, bool growable=false) {
+            _size = 0;
+            _cache = NULL;
             _active = 0;
             _allocated = 0;
-            _next_id = 0;
             _typesize = sizeof(T);
+            _growable = growable;
+            _mapped = false;
+            _grow(s);
+        }
+
+        /**
+         * \brief Default destructor.
+         * Destroys all the preallocated components.
+         */
+        virtual ~Cache() {
+            _release();
         }
 
         /**
@@ -74,17 +338,76 @@ namespace CAshley {
          */
         unsigned int block_alloc() {
             if (_allocated == _size) {
-                CacheError e("Cache is full.");
-                throw e;
+                if (!_growable) {
+                    CacheError e("Cache is full.");
+                    throw e;
+                }
+                _grow(_size ? _size * 2 : 1);
+            }
+            unsigned int id;
+            if (_free_ids.empty()) {
+                id = _id2idx.size();
+                _id2idx.push_back(CACHE_NONE);
+            } else {
+                id = _free_ids.back();
+                _free_ids.pop_back();
             }
-            unsigned int id = _next_id;
-            _next_id++;
             _id2idx[id] = _allocated;
             _idx2id[_allocated] = id;
             _allocated++;
             return id;
         }
 
+        /**
+         * \brief Mark several components as used at once.
+         *
+         * The new components are contiguous and in UID order. If active, they are
+         * placed at the end of the active components, moving at most n inactive ones.
+         * \param n Count of components.
+         * \param uids Output, UIDs of the components.
+         * \param active Allocate the components as active.
+         * \return Pointer to the first new component.
+         */
+        T *block_alloc_n(unsigned int n, unsigned int * uids, bool active=false) {
+            if (_size - _allocated < n) {
+                if (!_growable) {
+                    CacheError e("Cache is full.");
+                    throw e;
+                }
+                unsigned int s = _size ? _size : 1;
+                while (s - _allocated < n) {
+                    s *= 2;
+                }
+                _grow(s);
+            }
+            unsigned int first = _allocated;
+            if (active) {
+                // Free the positions after the active components.
+                unsigned int inactive = _allocated - _active;
+                unsigned int moved = inactive < n ? inactive : n;
+                for (unsigned int i = 0; i < moved; i++) {
+                    _swap_blocks(_active + i, _allocated + n - moved + i);
+                }
+                first = _active;
+                _active += n;
+            }
+            for (unsigned int i = 0; i < n; i++) {
+                unsigned int id;
+                if (_free_ids.empty()) {
+                    id = _id2idx.size();
+                    _id2idx.push_back(CACHE_NONE);
+                } else {
+                    id = _free_ids.back();
+                    _free_ids.pop_back();
+                }
+                _id2idx[id] = first + i;
+                _idx2id[first + i] = id;
+                uids[i] = id;
+            }
+            _allocated += n;
+            return &_cache[first];
+        }
+
         /**
          * \brief Try to mark a component as not used.
          *
@@ -104,8 +427,52 @@ namespace CAshley {
             _allocated--;
             _swap_ids(i, _idx2id[_allocated]);
             // Remove old references.
-            _idx2id.erase(_allocated);
-            _id2idx.erase(i);
+            _idx2id[_allocated] = CACHE_NONE;
+            _id2idx[i] = CACHE_NONE;
+            _free_ids.push_back(i);
+        }
+
+        /**
+         * \brief Mark several components as not used at once.
+         *
+         * Holes are filled with the last components of their region (active or
+         * inactive), so at most one move per freed component is done.
+         * \param uids UIDs of the components to free.
+         * \param n Count of UIDs.
+         */
+        void block_free_n(const unsigned int * uids, unsigned int n) {
+            for (unsigned int i = 0; i < n; i++) {
+                if (!_block_is_allocated(uids[i])) {
+                    CacheError e("Trying to free an unknown block.");
+                    throw e;
+                }
+            }
+            std::vector<unsigned int> active_holes, inactive_holes;
+            for (unsigned int i = 0; i < n; i++) {
+                unsigned int idx = _id2idx[uids[i]];
+                if (idx == CACHE_NONE) {
+                    // Repeated UID.
+                    continue;
+                }
+                if (idx < _active) {
+                    active_holes.push_back(idx);
+                } else {
+                    inactive_holes.push_back(idx);
+                }
+                _idx2id[idx] = CACHE_NONE;
+                _id2idx[uids[i]] = CACHE_NONE;
+                _free_ids.push_back(uids[i]);
+            }
+            unsigned int active = _active;
+            _active = _fill_holes(active_holes, _active);
+            // The end of the old active region is now a hole of the inactive one.
+            std::vector<unsigned int> holes;
+            holes.reserve(active - _active + inactive_holes.size());
+            for (unsigned int idx = _active; idx < active; idx++) {
+                holes.push_back(idx);
+            }
+            holes.insert(holes.end(), inactive_holes.begin(), inactive_holes.end());
+            _allocated = _fill_holes(holes, _allocated);
         }
 
         /**
@@ -149,6 +516,28 @@ namespace CAshley {
             _swap_ids(i, _idx2id[_active]);
         }
 
+        /**
+         * \brief Enables several components at once.
+         *
+         * The active region grows by the count of inactive components given, and only
+         * the given components outside that new part are moved, once each.
+         * \param uids UIDs of the components to enable. Active or repeated ones are skipped.
+         * \param n Count of UIDs.
+         */
+        void block_activate_n(const unsigned int * uids, unsigned int n) {
+            _repartition(uids, n, true);
+        }
+
+        /**
+         * \brief Disables several components at once.
+         * \param uids UIDs of the components to disable. Inactive or repeated ones are skipped.
+         * \param n Count of UIDs.
+         * \see block_activate_n().
+         */
+        void block_deactivate_n(const unsigned int * uids, unsigned int n) {
+            _repartition(uids, n, false);
+        }
+
         /**
          * \brief Get a component.
          *
@@ -156,12 +545,11 @@ namespace CAshley {
          * \return Pointer to the component.
          */
         T *get_block(unsigned int i) {
-
-            if (!_id2idx.count(i)) {
+            if (!_block_is_allocated(i)) {
                 CacheError e("Getting an unknown block.");
                 throw e;
             }
-            return (T *)((char *)(_cache) + _typesize * _id2idx[i]);
+            return &_cache[_id2idx[i]];
         }
 
         /**
@@ -175,6 +563,96 @@ namespace CAshley {
             return pair;
         };
 
+        /**
+         * \brief Get the size in bytes of a component.
+         * \return Size of a block.
+         */
+        virtual unsigned int get_block_size() {
+            return _typesize;
+        }
+
+        /**
+         * \brief Write the used components and the UID tables to a snapshot.
+         * Used components are packed at the start of _cache, so they are written in one
+         * copy if block copyable.
+         */
+        virtual void save(SnapshotWriter & w) {
+            w.write(_allocated);
+            w.write(_active);
+            w.write_vector(_id2idx);
+            w.write_vector(_free_ids);
+            _save_blocks(w, _cache, _allocated, is_block_copyable<T>());
+        }
+
+        virtual void save_block(unsigned int uid, SnapshotWriter & w) {
+            save_value(w, *get_block(uid));
+        }
+
+        virtual void load_block(unsigned int uid, SnapshotReader & r) {
+            load_value(r, *get_block(uid));
+        }
+
+        virtual _Cache * clone() {
+            Cache<T> * c = new Cache<T>(_size, _growable);
+            _copy_blocks(c->_cache, _cache, _allocated, is_block_copyable<T>());
+            c->_id2idx = _id2idx;
+            c->_idx2id = _idx2id;
+            c->_free_ids = _free_ids;
+            c->_active = _active;
+            c->_allocated = _allocated;
+            return c;
+        }
+
+        /**
+         * \brief Read the components and the UID tables written by save().
+         * The cache must have no used components.
+         */
+        virtual void load(SnapshotReader & r) {
+            if (_allocated) {
+                CacheError e("Loading into a used cache.");
+                throw e;
+            }
+            unsigned int allocated = r.read<unsigned int>();
+            unsigned int active = r.read<unsigned int>();
+            std::vector<unsigned int> id2idx, free_ids;
+            r.read_vector(id2idx);
+            r.read_vector(free_ids);
+            if (active > allocated || allocated > id2idx.size()) {
+                SnapshotError e("Snapshot is corrupt.");
+                throw e;
+            }
+            if (allocated > _size && !_growable) {
+                CacheError e("Cache is full.");
+                throw e;
+            }
+            // Positions are rebuilt from the UIDs.
+            std::vector<unsigned int> idx2id(allocated, CACHE_NONE);
+            unsigned int used = 0;
+            for (unsigned int id = 0; id < id2idx.size(); id++) {
+                unsigned int idx = id2idx[id];
+                if (idx == CACHE_NONE) {
+                    continue;
+                }
+                if (idx >= allocated || idx2id[idx] != CACHE_NONE) {
+                    SnapshotError e("Snapshot is corrupt.");
+                    throw e;
+                }
+                idx2id[idx] = id;
+                used++;
+            }
+            if (used != allocated) {
+                SnapshotError e("Snapshot is corrupt.");
+                throw e;
+            }
+            _load_packed(r, allocated, is_block_copyable<T>());
+            idx2id.resize(_size, CACHE_NONE);
+            _id2idx.swap(id2idx);
+            _idx2id.swap(idx2id);
+            _free_ids.swap(free_ids);
+            _allocated = allocated;
+            _active = active;
+        }
+
         /**
          * \brief Checks if a component is active.
          * \param i UID of the component to check.
@@ -190,7 +668,155 @@ namespace CAshley {
          * \return true if the component exists, false otherwise.
          */
         bool _block_is_allocated(unsigned int i) {
-            return _id2idx.count(i);
+            return i < _id2idx.size() && _id2idx[i] != CACHE_NONE;
+        }
+
+        /**
+         * \brief Move components across the active boundary in a single pass.
+         *
+         * The k components that change status are placed in the window of k positions
+         * next to the boundary, swapping with the components of the window that do not
+         * change. Then the boundary is moved over the window.
+         * \param uids UIDs of the components.
+         * \param n Count of UIDs.
+         * \param activate Enable (true) or disable (false) them.
+         */
+        void _repartition(const unsigned int * uids, unsigned int n, bool activate) {
+            for (unsigned int i = 0; i < n; i++) {
+                if (!_block_is_allocated(uids[i])) {
+                    CacheError e("Trying to change an unknown block.");
+                    throw e;
+                }
+            }
+            // Positions that change status, without repetitions.
+            std::vector<unsigned int> moving;
+            for (unsigned int i = 0; i < n; i++) {
+                unsigned int idx = _id2idx[uids[i]];
+                if ((idx < _active) != activate) {
+                    moving.push_back(idx);
+                }
+            }
+            std::sort(moving.begin(), moving.end());
+            moving.erase(std::unique(moving.begin(), moving.end()), moving.end());
+            unsigned int k = moving.size();
+            // Window of k positions next to the boundary, relative to the boundary.
+            std::vector<unsigned char> in_window(k, 0);
+            for (unsigned int i = 0; i < k; i++) {
+                unsigned int rel = activate ? moving[i] - _active : _active - 1 - moving[i];
+                if (rel < k) {
+                    in_window[rel] = 1;
+                }
+            }
+            unsigned int free = 0;
+            for (unsigned int i = 0; i < k; i++) {
+                unsigned int rel = activate ? moving[i] - _active : _active - 1 - moving[i];
+                if (rel < k) {
+                    continue;
+                }
+                while (in_window[free]) {
+                    free++;
+                }
+                _swap_blocks(moving[i], activate ? _active + free : _active - 1 - free);
+                free++;
+            }
+            if (activate) {
+                _active += k;
+            } else {
+                _active -= k;
+            }
+        }
+
+        /**
+         * \brief Move the last components of a region into its holes.
+         * \param holes Unused positions of the region, marked as CACHE_NONE on _idx2id.
+         * \param end End of the region.
+         * \return New end of the region.
+         */
+        unsigned int _fill_holes(const std::vector<unsigned int> & holes, unsigned int end) {
+            for (unsigned int i = 0; i < holes.size(); i++) {
+                while (end > holes[i] && _idx2id[end - 1] == CACHE_NONE) {
+                    end--;
+                }
+                if (holes[i] < end) {
+                    _swap_blocks(holes[i], end - 1);
+                    end--;
+                }
+            }
+            return end;
+        }
+
+        /**
+         * \brief Read the used components of a snapshot, bitwise.
+         * From a mapped snapshot, the blob is used in place if its Component part is the
+         * one of this run, and the kernel copies its pages on first write.
+         * \param n Count of components.
+         */
+        void _load_packed(SnapshotReader & r, unsigned int n, std::true_type) {
+            const char * blob = r.read_blob(sizeof(T) * (size_t)n);
+            bool same = _load_header<T>(r, std::is_base_of<Component, T>());
+            if (r.is_mapped() && same && n && !((size_t)blob % alignof(T))) {
+                _release();
+                _cache = reinterpret_cast<T *>(const_cast<char *>(blob));
+                _size = n;
+                _mapped = true;
+                return;
+            }
+            if (n > _size) {
+                _grow(n);
+            }
+            memcpy((void *)_cache, (const void *)blob, sizeof(T) * n);
+            if (!same) {
+                _reset_components(_cache, n, std::is_base_of<Component, T>());
+            }
+        }
+
+        /**
+         * \brief Read the used components of a snapshot with Component::load().
+         */
+        void _load_packed(SnapshotReader & r, unsigned int n, std::false_type) {
+            if (n > _size) {
+                _grow(n);
+            }
+            _load_blocks(r, _cache, n, std::false_type());
+        }
+
+        /**
+         * \brief Destroy the internal buffer.
+         * Components of a mapped snapshot are left to the mapping.
+         */
+        void _release() {
+            if (!_mapped) {
+                for (unsigned int i = 0; i < _size; i++) {
+                    _cache[i].~T();
+                }
+                ::operator delete(_cache);
+            }
+            _cache = NULL;
+            _size = 0;
+            _mapped = false;
+        }
+
+        /**
+         * \brief Resize the internal buffer.
+         * Components are moved bitwise, as in _swap_ids. New components are default constructed.
+         * Components of a mapped snapshot are moved to memory of the cache.
+         * \param s New size, bigger than the current one.
+         */
+        void _grow(unsigned int s) {
+            T * cache = static_cast<T *>(::operator new(sizeof(T) * s));
+            if (_cache) {
+                memcpy((void *)cache, (void *)_cache, sizeof(T) * _size);
+                if (!_mapped) {
+                    ::operator delete(_cache);
+                }
+                _mapped = false;
+            }
+            for (unsigned int i = _size; i < s; i++) {
+                new (&cache[i]) T();
+            }
+            _cache = cache;
+            _size = s;
+            _idx2id.resize(s, CACHE_NONE);
         }
 
         /**
@@ -201,22 +827,32 @@ namespace CAshley {
          * \param j UID of the second component.
          */
         void _swap_ids(unsigned int i, unsigned int j) {
-            // Get index.
-            unsigned int idx_i, idx_j;
-            idx_i = _id2idx[i];
-            idx_j = _id2idx[j];
+            _swap_blocks(_id2idx[i], _id2idx[j]);
+        }
+
+        /**
+         * \brief Swap 2 positions of the internal buffer.
+         * Positions may be unused.
+         * \param idx_i First position.
+         * \param idx_j Second position.
+         */
+        void _swap_blocks(unsigned int idx_i, unsigned int idx_j) {
+            unsigned int i = _idx2id[idx_i], j = _idx2id[idx_j];
             // Swap blocks. We copy directly instead of call copy constructor
             // to prevent a call to destructor.
-            unsigned char *buffer = new unsigned char[_typesize];
-            memcpy(buffer, &_cache[idx_i], _typesize);
-            memcpy(&_cache[idx_i], &_cache[idx_j], _typesize);
-            memcpy(&_cache[idx_j], buffer, _typesize);
-            delete buffer;
+            alignas(T) unsigned char buffer[sizeof(T)];
+            memcpy((void *)buffer, (void *)&_cache[idx_i], sizeof(T));
+            memcpy((void *)&_cache[idx_i], (void *)&_cache[idx_j], sizeof(T));
+            memcpy((void *)&_cache[idx_j], (void *)buffer, sizeof(T));
             // Swap references.
             _idx2id[idx_i] = j;
             _idx2id[idx_j] = i;
-            _id2idx[i] = idx_j;
-            _id2idx[j] = idx_i;
+            if (i != CACHE_NONE) {
+                _id2idx[i] = idx_j;
+            }
+            if (j != CACHE_NONE) {
+                _id2idx[j] = idx_i;
+            }
         }
 
         /**
@@ -233,12 +869,18 @@ namespace CAshley {
         unsigned int _typesize;
         /**
          * \brief This maps the UID of a component with his position on _cache.
+         * CACHE_NONE for free UIDs.
          */
-        std::map<unsigned int, unsigned int> _id2idx;
+        std::vector<unsigned int> _id2idx;
         /**
          * \brief This maps the position on _cache of a component with his UID.
+         * CACHE_NONE for unused positions.
          */
-        std::map<unsigned int, unsigned int> _idx2id;
+        std::vector<unsigned int> _idx2id;
+        /**
+         * \brief Freed UIDs, reused by block_alloc.
+         */
+        std::vector<unsigned int> _free_ids;
         /**
          * \brief Count of active components.
          */
@@ -247,14 +889,448 @@ namespace CAshley {
          * \brief Count of used components.
          */
         unsigned int _allocated;
-        /**
-         * \brief UID of the next component.
-         */
-        unsigned int _next_id;
         /**
          * \brief Length of the _cache. AKA max of simultaneus used components.
          */
         unsigned int _size;
+        /**
+         * \brief Grow _cache when full instead of throwing.
+         */
+        bool _growable;
+        /**
+         * \brief _cache points to the blob of a mapped snapshot.
+         */
+        bool _mapped;
+    };
+
+    /**
+     * \brief Cache whose components never move.
+     *
+     * Components are stored in pages that are never reallocated, and stay in place
+     * when activated, deactivated or freed, so pointers to them are valid until they
+     * are freed. A UID resolves to its component with a single load. Active components
+     * are not contiguous: get_active_blocks() returns no blocks.
+     */
+    template<class T>
+    class StableCache : public _Cache {
+    public:
+        /**
+         * \brief Constructor to preallocate the first page.
+         * \param s Size of the pages.
+         * \param growable If true, pages are added when full instead of throwing.
+         */
+        StableCache(unsigned int s, bool growable=false) {
+            _page_size = s ? s : 1;
+            _growable = growable;
+            _tail = NULL;
+            _tail_left = 0;
+            _active = 0;
+            _add_page(_page_size);
+        }
+
+        /**
+         * \brief Default destructor.
+         * Destroys all the preallocated components.
+         */
+        virtual ~StableCache() {
+            _clear();
+        }
+
+        /**
+         * \brief Mark a component as used.
+         * \return UID of the component.
+         */
+        unsigned int block_alloc() {
+            if (!_free_ids.empty()) {
+                unsigned int id = _free_ids.back();
+                _free_ids.pop_back();
+                _state[id] = _ALLOCATED;
+                return id;
+            }
+            if (!_tail_left) {
+                _add_page(_page_size);
+            }
+            return _take_tail(_ALLOCATED);
+        }
+
+        /**
+         * \brief Mark several components as used at once.
+         * The new components are contiguous and in UID order.
+         * \param n Count of components.
+         * \param uids Output, UIDs of the components.
+         * \param active Allocate the components as active.
+         * \return Pointer to the first new component.
+         */
+        T *block_alloc_n(unsigned int n, unsigned int * uids, bool active=false) {
+            if (_tail_left < n) {
+                _add_page(n > _page_size ? n : _page_size);
+            }
+            T * first = _tail;
+            for (unsigned int i = 0; i < n; i++) {
+                uids[i] = _take_tail(active ? _ACTIVE : _ALLOCATED);
+            }
+            if (active) {
+                _active += n;
+            }
+            return first;
+        }
+
+        /**
+         * \brief Mark a component as not used.
+         * \param i UID of the component to free.
+         */
+        void block_free(unsigned int i) {
+            if (!_block_is_allocated(i)) {
+                CacheError e("Trying to free an unknown block.");
+                throw e;
+            }
+            if (_state[i] == _ACTIVE) {
+                _active--;
+            }
+            _state[i] = _FREE;
+            _free_ids.push_back(i);
+        }
+
+        /**
+         * \brief Mark several components as not used.
+         * \param uids UIDs of the components.
+         * \param n Count of UIDs.
+         */
+        void block_free_n(const unsigned int * uids, unsigned int n) {
+            for (unsigned int i = 0; i < n; i++) {
+                if (!_block_is_allocated(uids[i])) {
+                    CacheError e("Trying to free an unknown block.");
+                    throw e;
+                }
+            }
+            for (unsigned int i = 0; i < n; i++) {
+                block_free(uids[i]);
+            }
+        }
+
+        /**
+         * \brief Mark a component as active.
+         * \param i UID of the component.
+         */
+        void block_activate(unsigned int i) {
+            if (!_block_is_allocated(i)) {
+                CacheError e("Trying to activate an unknown block.");
+                throw e;
+            }
+            if (_state[i] != _ACTIVE) {
+                _state[i] = _ACTIVE;
+                _active++;
+            }
+        }
+
+        /**
+         * \brief Mark a component as inactive.
+         * \param i UID of the component.
+         */
+        void block_deactivate(unsigned int i) {
+            if (!_block_is_allocated(i)) {
+                CacheError e("Trying to deactivate an unknown block.");
+                throw e;
+            }
+            if (_state[i] == _ACTIVE) {
+                _state[i] = _ALLOCATED;
+                _active--;
+            }
+        }
+
+        /**
+         * \brief Mark several components as active.
+         */
+        void block_activate_n(const unsigned int * uids, unsigned int n) {
+            for (unsigned int i = 0; i < n; i++) {
+                block_activate(uids[i]);
+            }
+        }
+
+        /**
+         * \brief Mark several components as inactive.
+         */
+        void block_deactivate_n(const unsigned int * uids, unsigned int n) {
+            for (unsigned int i = 0; i < n; i++) {
+                block_deactivate(uids[i]);
+            }
+        }
+
+        /**
+         * \brief Get a component.
+         * \param i UID of the component to get.
+         * \return Pointer to the component, valid until it is freed.
+         */
+        T *get_block(unsigned int i) {
+            if (!_block_is_allocated(i)) {
+                CacheError e("Getting an unknown block.");
+                throw e;
+            }
+            return _blocks[i];
+        }
+
+        /**
+         * \brief Active components are not contiguous.
+         * \return A std::pair with NULL and 0.
+         */
+        virtual std::pair<void *, unsigned int> get_active_blocks() {
+            return std::pair<void *, unsigned int>((void *)NULL, 0);
+        }
+
+        /**
+         * \brief Get the size in bytes of a component.
+         */
+        virtual unsigned int get_block_size() {
+            return sizeof(T);
+        }
+
+        /**
+         * \brief Get the count of active components.
+         */
+        inline unsigned int get_active_count() { return _active; }
+
+        /**
+         * \brief Write the status of the UIDs and the used components to a snapshot.
+         * Block copyable components are written page by page, free ones included.
+         */
+        virtual void save(SnapshotWriter & w) {
+            w.write(_active);
+            w.write_vector(_state);
+            _save_pages(w, is_block_copyable<T>());
+        }
+
+        virtual void save_block(unsigned int uid, SnapshotWriter & w) {
+            save_value(w, *get_block(uid));
+        }
+
+        virtual void load_block(unsigned int uid, SnapshotReader & r) {
+            load_value(r, *get_block(uid));
+        }
+
+        virtual _Cache * clone() {
+            unsigned int n = _state.size();
+            StableCache<T> * c = new StableCache<T>(n > _page_size ? n : _page_size, _growable);
+            c->_page_size = _page_size;
+            for (unsigned int i = 0; i < n; i++) {
+                c->_take_tail(_state[i]);
+            }
+            // Blocks are taken in UID order through the pages, so each page is a run.
+            unsigned int done = 0;
+            for (unsigned int p = 0; p < _pages.size(); p++) {
+                unsigned int used = p + 1 < _pages.size() ? _pages[p].second : _pages[p].second - _tail_left;
+                _copy_blocks(c->_pages[0].first + done, _pages[p].first, used, is_block_copyable<T>());
+                done += used;
+            }
+            c->_free_ids = _free_ids;
+            c->_active = _active;
+            return c;
+        }
+
+        /**
+         * \brief Read the status of the UIDs and the components written by save().
+         * The cache must have no used components. They are loaded on a single page.
+         */
+        virtual void load(SnapshotReader & r) {
+            if (_free_ids.size() != _state.size()) {
+                CacheError e("Loading into a used cache.");
+                throw e;
+            }
+            unsigned int active = r.read<unsigned int>();
+            std::vector<unsigned char> state;
+            r.read_vector(state);
+            unsigned int n = state.size();
+            if (n > _page_size && !_growable) {
+                CacheError e("Cache is full.");
+                throw e;
+            }
+            unsigned int count = 0;
+            for (unsigned int i = 0; i < n; i++) {
+                if (state[i] > _ACTIVE) {
+                    SnapshotError e("Snapshot is corrupt.");
+                    throw e;
+                }
+                count += state[i] == _ACTIVE;
+            }
+            if (count != active) {
+                SnapshotError e("Snapshot is corrupt.");
+                throw e;
+            }
+            _clear();
+            _add_page(n > _page_size ? n : _page_size);
+            for (unsigned int i = 0; i < n; i++) {
+                _take_tail(state[i]);
+            }
+            for (unsigned int i = n; i > 0; i--) {
+                if (state[i - 1] == _FREE) {
+                    _free_ids.push_back(i - 1);
+                }
+            }
+            _load_pages(r, is_block_copyable<T>());
+            _active = active;
+        }
+
+    private:
+        /**
+         * \brief Status of a free UID.
+         */
+        static const unsigned char _FREE = 0;
+        /**
+         * \brief Status of a used, inactive UID.
+         */
+        static const unsigned char _ALLOCATED = 1;
+        /**
+         * \brief Status of an active UID.
+         */
+        static const unsigned char _ACTIVE = 2;
+
+        bool _block_is_allocated(unsigned int i) {
+            return i < _state.size() && _state[i] != _FREE;
+        }
+
+        /**
+         * \brief Give a UID to the next unused component of the last page.
+         */
+        unsigned int _take_tail(unsigned char state) {
+            unsigned int id = _blocks.size();
+            _blocks.push_back(_tail);
+            _state.push_back(state);
+            _tail++;
+            _tail_left--;
+            return id;
+        }
+
+        /**
+         * \brief Write the components bitwise. UIDs follow the order of the pages.
+         */
+        void _save_pages(SnapshotWriter & w, std::true_type) {
+            w.write((unsigned int)_pages.size());
+            for (unsigned int p = 0; p < _pages.size(); p++) {
+                unsigned int n = p + 1 < _pages.size() ? _pages[p].second : _pages[p].second - _tail_left;
+                w.write(n);
+                _save_blocks(w, _pages[p].first, n, std::true_type());
+            }
+        }
+
+        /**
+         * \brief Write the used components with Component::save().
+         */
+        void _save_pages(SnapshotWriter & w, std::false_type) {
+            for (unsigned int i = 0; i < _state.size(); i++) {
+                if (_state[i] != _FREE) {
+                    _save_blocks(w, _blocks[i], 1, std::false_type());
+                }
+            }
+        }
+
+        /**
+         * \brief Read the components written by _save_pages() on the only page.
+         */
+        void _load_pages(SnapshotReader & r, std::true_type) {
+            unsigned int pages = r.read<unsigned int>();
+            unsigned int done = 0;
+            for (unsigned int p = 0; p < pages; p++) {
+                unsigned int n = r.read<unsigned int>();
+                if (n > _state.size() - done) {
+                    SnapshotError e("Snapshot is corrupt.");
+                    throw e;
+                }
+                _load_blocks(r, _pages[0].first + done, n, std::true_type());
+                done += n;
+            }
+            if (done != _state.size()) {
+                SnapshotError e("Snapshot is corrupt.");
+                throw e;
+            }
+        }
+
+        /**
+         * \brief Read the used components with Component::load().
+         */
+        void _load_pages(SnapshotReader & r, std::false_type) {
+            for (unsigned int i = 0; i < _state.size(); i++) {
+                if (_state[i] != _FREE) {
+                    _load_blocks(r, _blocks[i], 1, std::false_type());
+                }
+            }
+        }
+
+        /**
+         * \brief Destroy all the pages and forget all the UIDs.
+         */
+        void _clear() {
+            for (unsigned int i = 0; i < _pages.size(); i++) {
+                for (unsigned int j = 0; j < _pages[i].second; j++) {
+                    _pages[i].first[j].~T();
+                }
+                ::operator delete(_pages[i].first);
+            }
+            _pages.clear();
+            _blocks.clear();
+            _state.clear();
+            _free_ids.clear();
+            _tail = NULL;
+            _tail_left = 0;
+            _active = 0;
+        }
+
+        /**
+         * \brief Add a page of default constructed components.
+         * Unused components of the previous page are given UIDs and left free.
+         * \param s Size of the page.
+         */
+        void _add_page(unsigned int s) {
+            if (!_pages.empty() && !_growable) {
+                CacheError e("Cache is full.");
+                throw e;
+            }
+            while (_tail_left) {
+                _free_ids.push_back(_take_tail(_FREE));
+            }
+            T * page = static_cast<T *>(::operator new(sizeof(T) * s));
+            for (unsigned int i = 0; i < s; i++) {
+                new (&page[i]) T();
+            }
+            _pages.push_back(std::pair<T *, unsigned int>(page, s));
+            _tail = page;
+            _tail_left = s;
+        }
+
+        /**
+         * \brief Pages of components and their sizes.
+         */
+        std::vector<std::pair<T *, unsigned int> > _pages;
+        /**
+         * \brief Address of the component of each UID.
+         */
+        std::vector<T *> _blocks;
+        /**
+         * \brief Status of each UID.
+         */
+        std::vector<unsigned char> _state;
+        /**
+         * \brief Freed UIDs, reused by block_alloc.
+         */
+        std::vector<unsigned int> _free_ids;
+        /**
+         * \brief First component of the last page without a UID.
+         */
+        T * _tail;
+        /**
+         * \brief Count of components of the last page without a UID.
+         */
+        unsigned int _tail_left;
+        /**
+         * \brief Size of the pages.
+         */
+        unsigned int _page_size;
+        /**
+         * \brief Count of active components.
+         */
+        unsigned int _active;
+        /**
+         * \brief Add pages when full instead of throwing.
+         */
+        bool _growable;
     };
 }
 
@@ -26,5 +26,24 @@
 #include "engine.h"
 #include "entity.h"
 #include "entitylistener.h"
+#include "eventbus.h"
+#include "hierarchy.h"
+#include "journal.h"
+#include "pipeline.h"
+#include "prefab.h"
+#include "registry.h"
+#include "replication.h"
+#include "resource.h"
+#include "rollback.h"
+#include "schema.h"
+#include "sharedexport.h"
+#include "slicedprocessor.h"
+#include "snapshot.h"
+#include "streaming.h"
+#include "taskqueue.h"
+
+#if __cplusplus >= 202002L
+#include "task.h"
+#endif
 
 #endif //__CASHLEY_CASHLEY_H
@@ -21,6 +21,8 @@
 #ifndef __CASHLEY_COMPONENT_H
 #define __CASHLEY_COMPONENT_H
 
+#include <type_traits>
+
 #include "common.h"
 
 /**
@@ -29,11 +31,114 @@
  * When create new components, you have to add this on public section of the new components.
  */
 #define CASHLEY_COMPONENT \
-__CASHLEY_COMMON_METHOD
+virtual std::string get_name() { \
+    return CAshley::component_name(this); \
+}
+
+/**
+ * \brief Mark a component as copyable with memcpy.
+ *
+ * Components are polymorphic, so the compiler never sees them as trivially copyable.
+ * Add this on the public section of components whose members are all trivially
+ * copyable. Subclasses are not marked.
+ * \see is_block_copyable.
+ */
+#define CASHLEY_BLOCK_COPYABLE(C) \
+typedef C cashley_block_copyable;
+
+/**
+ * \brief Mark a component as a tag.
+ *
+ * Tags are markers without data, like Enemy or Frozen. They have no cache nor UIDs:
+ * an entity only keeps a bit per tag, so adding or removing one is a bit flip.
+ * Add this on the public section of components without members. Subclasses are not
+ * marked.
+ * \see is_tag.
+ */
+#define CASHLEY_TAG(C) \
+typedef C cashley_tag;
+
+/**
+ * \brief Mark a component as shared.
+ *
+ * Each distinct value of a shared component is stored once, and the entities
+ * reference it, like meshes or stat tables. Values are compared with operator==,
+ * and found by a hash of their described fields (CASHLEY_FIELDS): describe them so
+ * equal values have equal fields, or all the values are compared. The hash is taken
+ * when a value is stored: a value written through a pointer must be marked with
+ * Engine::mark_changed(), which hashes it again, or it is not found by its new fields.
+ * Add this on the public section of the component. Subclasses are not marked.
+ * \see is_shared, Engine::set_shared().
+ */
+#define CASHLEY_SHARED(C) \
+typedef C cashley_shared;
+
+/**
+ * \brief Store a component in a StableCache.
+ *
+ * Pointers to stable components stay valid until the component is removed, at the
+ * cost of not keeping the active components together. Add this on the public section
+ * of the component. Subclasses are not marked.
+ * \see is_stable.
+ */
+#define CASHLEY_STABLE(C) \
+typedef C cashley_stable;
+
+/**
+ * \brief Set the layout version of a component.
+ *
+ * Snapshots record it for each component type, and refuse to load components of
+ * another version. Increase it when the members change but not the size. Add this
+ * on the public section of the component. Components without it have version 0.
+ * \see layout_version.
+ */
+#define CASHLEY_LAYOUT_VERSION(n) \
+static const unsigned int cashley_layout_version = n;
+
+/**
+ * \brief Give a component a stable name.
+ *
+ * The name is used instead of the compiler name of the class by get_name(), so
+ * families, snapshots and journals do not depend on the build. Add this on the
+ * public section of the component. Subclasses are not marked.
+ * \see has_schema, ComponentSchema.
+ */
+#define CASHLEY_SCHEMA(C, n) \
+typedef C cashley_schema; \
+static const char * cashley_schema_name() { return n; }
+
+/**
+ * \brief Describe the fields of a component in the schema registry.
+ *
+ * Opens the body that lists them, with CASHLEY_FIELD:
+ * \code
+ * CASHLEY_FIELDS(Position) {
+ *     CASHLEY_FIELD(x);
+ *     CASHLEY_FIELD(y);
+ * }
+ * \endcode
+ * Described components that are not block copyable are saved field by field, so
+ * all their state must be described. Add this on the public section of the
+ * component. Subclasses are not marked.
+ * \see has_fields, ComponentSchema.
+ */
+#define CASHLEY_FIELDS(C) \
+typedef C cashley_fields_of; \
+static void cashley_describe(CAshley::SchemaBuilder<C> & cashley_fields)
+
+/**
+ * \brief Describe a member of a component, inside CASHLEY_FIELDS.
+ */
+#define CASHLEY_FIELD(f) \
+cashley_fields.field(#f, &cashley_fields_of::f)
 
 namespace CAshley {
 
     class Entity;
+    class SnapshotReader;
+    class SnapshotWriter;
+    template <class T>
+    class SchemaBuilder;
 
     /**
      * \brief Individual component of an entity.
@@ -78,10 +183,116 @@ namespace CAshley {
          * This method will be called when an component is deallocated.
          */
         virtual void shutdown();
+        /**
+         * \brief Write the component to a snapshot.
+         * Only called for components that are not block copyable, which are saved
+         * bitwise, nor described with CASHLEY_FIELDS, which are saved field by field.
+         * Throws a SnapshotError unless overridden.
+         * \param w Snapshot.
+         */
+        virtual void save(SnapshotWriter & w);
+        /**
+         * \brief Read the component from a snapshot.
+         * Counterpart of save(), called on a default constructed component.
+         * \param r Snapshot.
+         */
+        virtual void load(SnapshotReader & r);
     private:
         /** Owner of the component */
         Entity *_owner;
     };
+
+    /**
+     * \brief Tells if copies of a component can be made with memcpy.
+     * True for trivially copyable types and components marked with CASHLEY_BLOCK_COPYABLE.
+     */
+    template <class T, class = void>
+    struct is_block_copyable : std::integral_constant<bool, std::is_trivially_copyable<T>::value> {};
+
+    template <class T>
+    struct is_block_copyable<T, typename std::enable_if<std::is_same<typename T::cashley_block_copyable, T>::value>::type> : std::true_type {};
+
+    /**
+     * \brief Tells if a component is a tag.
+     * True for components marked with CASHLEY_TAG. Marked components must not add members.
+     */
+    template <class T, class = void>
+    struct is_tag : std::false_type {};
+
+    template <class T>
+    struct is_tag<T, typename std::enable_if<std::is_same<typename T::cashley_tag, T>::value>::type> : std::true_type {
+        static_assert(sizeof(T) == sizeof(Component), "A tag can not have members.");
+    };
+
+    /**
+     * \brief Tells if a component is shared.
+     * True for components marked with CASHLEY_SHARED.
+     */
+    template <class T, class = void>
+    struct is_shared : std::false_type {};
+
+    template <class T>
+    struct is_shared<T, typename std::enable_if<std::is_same<typename T::cashley_shared, T>::value>::type> : std::true_type {};
+
+    /**
+     * \brief Tells if a component is stored in a StableCache.
+     * True for components marked with CASHLEY_STABLE.
+     */
+    template <class T, class = void>
+    struct is_stable : std::false_type {};
+
+    template <class T>
+    struct is_stable<T, typename std::enable_if<std::is_same<typename T::cashley_stable, T>::value>::type> : std::true_type {};
+
+    /**
+     * \brief Layout version of a component.
+     * Set with CASHLEY_LAYOUT_VERSION, 0 otherwise.
+     */
+    template <class T, class = void>
+    struct layout_version : std::integral_constant<unsigned int, 0> {};
+
+    template <class T>
+    struct layout_version<T, typename std::enable_if<std::is_same<decltype(T::cashley_layout_version), const unsigned int>::value>::type> : std::integral_constant<unsigned int, T::cashley_layout_version> {};
+
+    /**
+     * \brief Tells if a component has a stable name.
+     * True for components marked with CASHLEY_SCHEMA.
+     */
+    template <class T, class = void>
+    struct has_schema : std::false_type {};
+
+    template <class T>
+    struct has_schema<T, typename std::enable_if<std::is_same<typename T::cashley_schema, T>::value>::type> : std::true_type {};
+
+    /**
+     * \brief Tells if the fields of a component are described.
+     * True for components marked with CASHLEY_FIELDS.
+     */
+    template <class T, class = void>
+    struct has_fields : std::false_type {};
+
+    template <class T>
+    struct has_fields<T, typename std::enable_if<std::is_same<typename T::cashley_fields_of, T>::value>::type> : std::true_type {};
+
+    template <class T>
+    std::string _component_name(T *, std::true_type) {
+        return T::cashley_schema_name();
+    }
+
+    template <class T>
+    std::string _component_name(T * c, std::false_type) {
+        std::string name = typeid(c).name();
+        return name;
+    }
+
+    /**
+     * \brief Class string of a component, returned by its get_name().
+     * The name given with CASHLEY_SCHEMA, or the compiler name of the class.
+     */
+    template <class T>
+    std::string component_name(T * c) {
+        return _component_name(c, has_schema<T>());
+    }
 }
 
 #endif //__CASHLEY_COMPONENT_H
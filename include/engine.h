@@ -19,11 +19,14 @@
 #ifndef __CASHLEY_ENGINE_H
 #define __CASHLEY_ENGINE_H
 
+#include <cstddef>
 #include <vector>
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 
 #include "cache.h"
 #include "component.h"
@@ -32,10 +35,34 @@
 #include "inmutablearray.h"
 #include "family.h"
 #include "entitylistener.h"
+#include "hierarchy.h"
+#include "journal.h"
+#include "eventbus.h"
+#include "pipeline.h"
+#include "registry.h"
+#include "resource.h"
+#include "rollback.h"
+#include "schema.h"
+#include "sharedexport.h"
+#include "snapshot.h"
+#include "span.h"
+#include "streaming.h"
+#include "taskqueue.h"
+#include "typeid.h"
 
 namespace CAshley {
 
     class Entity;
+    class Prefab;
+
+    /**
+     * \brief Cache class of a component type.
+     * StableCache for components marked with CASHLEY_STABLE, Cache for the rest.
+     */
+    template <class T>
+    struct CacheOf {
+        typedef typename std::conditional<is_stable<T>::value, StableCache<T>, Cache<T> >::type type;
+    };
 
     /**
      * \brief Core of the system.
@@ -56,17 +83,15 @@ namespace CAshley {
          */
         template <class T>
         std::pair<std::string, unsigned int> get_component() {
-            T x;
-            std::pair<std::string, unsigned int> r;
-            r.first = x.get_name();
-            _Cache * c;
-            if (_components.find(r.first) == _components.end()) {
-                c = new Cache<T>(100);
-                _components[r.first] = c;
-            } else {
-                c = _components.find(x.get_name())->second;
+            if (is_tag<T>::value) {
+                ComponentError e("Tags have no UID.");
+                throw e;
             }
-            r.second = static_cast<Cache<T> *>(c)->block_alloc();
+            unsigned int type = _component_type<T>();
+            std::pair<std::string, unsigned int> r;
+            r.first = _component_types[type].name;
+            r.second = _get_cache<T>(type)->block_alloc();
+            _version++;
             return r;
         }
 
@@ -74,7 +99,7 @@ namespace CAshley {
          * \brief Get a pointer to a component.
          *
          * Get a pointer to the instance in internal cache. Important! this pointer can change,
-         * do not maintain it between 2 ticks.
+         * do not maintain it between 2 ticks, unless the component is stable (CASHLEY_STABLE).
          * \param uid UID of the component.
          * \return Pointer to a component with UID i and type T.
          */
@@ -84,15 +109,12 @@ namespace CAshley {
                 ComponentError e("Invalid component class");
                 throw e;
             }
-            T x;
-            _Cache * c;
-            if (_components.find(x.get_name()) == _components.end()) {
+            unsigned int type = TypeId<Component, T>::get();
+            if (type >= _component_types.size() || !_component_types[type].cache) {
                 ComponentError e("Component not found");
                 throw e;
-            } else {
-                c = _components.find(x.get_name())->second;
             }
-            return static_cast<Cache<T> *>(c)->get_block(uid);
+            return _get_cache<T>(type)->get_block(uid);
         }
 
         /**
@@ -158,6 +180,525 @@ namespace CAshley {
          */
         EntityArray get_entities_for(Family f);
 
+        /**
+         * \brief Get the ids of the entities of a Family.
+         *
+         * Unlike get_entities_for(), plain entities are returned too. Only active
+         * entities will be returned.
+         * \param f Family of entities.
+         * \return An inmutable array of ids, in slot order.
+         */
+        EntityIdArray get_ids_for(Family f);
+
+        /**
+         * \brief Create a plain entity.
+         *
+         * Plain entities live only in the engine registry: they cost a few bytes plus
+         * their components, and are handled through their EntityId. EntityListeners are
+         * not notified for them.
+         * \return Id of the new entity, inactive.
+         */
+        EntityId create_entity();
+
+        /**
+         * \brief Destroy an entity and its components.
+         * If the id belongs to an Entity, it is unlinked as in remove_entity().
+         * During a tick, the destruction is delayed until all processors are called.
+         * \param id Id of the entity.
+         */
+        void destroy_entity(EntityId id);
+
+        /**
+         * \brief Create a batch of plain entities with the same components.
+         *
+         * Entity records and the components of each type are allocated in contiguous
+         * blocks, components are initialized in one pass per type, and each listener
+         * is notified once for the whole batch.
+         * Usage: engine.spawn_n<Position, Velocity>(50000);
+         * \param count Count of entities.
+         * \param active Create the entities as active.
+         * \return Ids of the new entities, in the order of their components.
+         */
+        template <class... T>
+        std::vector<EntityId> spawn_n(unsigned int count, bool active=true) {
+            bool components[] = {std::is_base_of<Component, T>::value..., true};
+            for (unsigned int i = 0; i < sizeof...(T); i++) {
+                if (!components[i]) {
+                    ComponentError e("Invalid component class");
+                    throw e;
+                }
+            }
+            std::vector<EntityId> ids(count);
+            if (!count) {
+                return ids;
+            }
+            _registry.create_n(count, &ids[0], active);
+            _journal_mute++;
+            unsigned int types[] = {_spawn_components<T>(&ids[0], count, active)..., NO_COMPONENT};
+            _journal_mute--;
+            _journal_spawn(&ids[0], count, active, types, sizeof...(T));
+            _version++;
+            _call_listeners(Span<const EntityId>(&ids[0], count), types, sizeof...(T));
+            return ids;
+        }
+
+        /**
+         * \brief Register a prefab.
+         * The engine stores a copy of the prefab.
+         * \param p Prefab.
+         * \return Identifier of the prefab, for instantiate().
+         */
+        unsigned int add_prefab(const Prefab & p);
+
+        /**
+         * \brief Create a batch of plain entities from a prefab.
+         *
+         * Like spawn_n(), but components are copies of the prefab ones instead of being
+         * initialized: a block copy for block copyable components (see is_block_copyable),
+         * the copy constructor for the rest.
+         * \param prefab Identifier returned by add_prefab().
+         * \param count Count of entities.
+         * \param active Create the entities as active.
+         * \return Ids of the new entities, in the order of their components.
+         */
+        std::vector<EntityId> instantiate(unsigned int prefab, unsigned int count, bool active=true);
+
+        /**
+         * \brief Destroy a batch of entities and their components.
+         *
+         * Components are freed type by type, and each listener is notified once for
+         * the whole batch. Ids of Entity objects are unlinked as in remove_entity().
+         * During a tick, the destruction is delayed until all processors are called.
+         * \param ids Ids of living entities.
+         */
+        void despawn(Span<const EntityId> ids);
+
+        /**
+         * \brief Check if an id names a living entity.
+         * \param id Id of the entity.
+         * \return true if alive, false otherwise.
+         */
+        inline bool is_alive(EntityId id) { return _registry.is_alive(id); }
+
+        /**
+         * \brief Get the Entity of an id.
+         * \param id Id of the entity.
+         * \return The Entity, or NULL for plain entities.
+         */
+        Entity * get_entity(EntityId id);
+
+        /**
+         * \brief Get the count of living entities, plain or not.
+         */
+        inline unsigned int get_entity_count() { return _registry.size(); }
+
+        /**
+         * \brief Preallocate the registry for a count of entities.
+         * \param n Count of entities.
+         */
+        inline void reserve_entities(unsigned int n) { _registry.reserve(n); }
+
+        /**
+         * \brief Activate an entity and its components.
+         * \param id Id of the entity.
+         */
+        void activate(EntityId id);
+
+        /**
+         * \brief Deactivate an entity and its components.
+         * \param id Id of the entity.
+         */
+        void deactivate(EntityId id);
+
+        /**
+         * \brief Activate a batch of entities and their components.
+         *
+         * Components are grouped by type, and the active region of each cache is
+         * repartitioned once for the whole batch.
+         * \param ids Ids of the entities. Active ones are skipped.
+         */
+        void activate(Span<const EntityId> ids);
+
+        /**
+         * \brief Activate a batch of Entity objects.
+         * \param entities Entities linked to this engine.
+         * \see activate(Span<const EntityId>).
+         */
+        void activate(Span<Entity * const> entities);
+
+        /**
+         * \brief Deactivate a batch of entities and their components.
+         * \param ids Ids of the entities. Inactive ones are skipped.
+         * \see activate(Span<const EntityId>).
+         */
+        void deactivate(Span<const EntityId> ids);
+
+        /**
+         * \brief Deactivate a batch of Entity objects.
+         * \param entities Entities linked to this engine.
+         * \see activate(Span<const EntityId>).
+         */
+        void deactivate(Span<Entity * const> entities);
+
+        /**
+         * \brief Get the activation status of an entity.
+         * \param id Id of the entity.
+         * \return true if active, false otherwise.
+         */
+        bool is_active(EntityId id);
+
+        /**
+         * \brief Add a component to an entity.
+         * An entity can not own 2 components of the same type. The component is
+         * initialized, and activated if the entity is active. Tags are only flagged,
+         * and shared components reference the value of an initialized component.
+         * \param id Id of the entity.
+         * \return Pointer to the component. Do not maintain it between 2 ticks. All the
+         * entities with a tag share the same instance.
+         */
+        template <class T>
+        T * add_component(EntityId id) {
+            if (! std::is_base_of<Component, T>::value) {
+                ComponentError e("Invalid component class");
+                throw e;
+            }
+            _check_entity(id);
+            unsigned int type = _component_type<T>();
+            if (_has_component(type, id.index)) {
+                EntityError e("Component duplicate.");
+                throw e;
+            }
+            return _add_component<T>(type, id);
+        }
+
+        /**
+         * \brief Make a component type known by the engine, creating its cache.
+         * Types are created on first use, but load_snapshot() needs them known in advance.
+         */
+        template <class T>
+        void register_component() {
+            if (! std::is_base_of<Component, T>::value) {
+                ComponentError e("Invalid component class");
+                throw e;
+            }
+            _component_type<T>();
+        }
+
+        /**
+         * \brief Get the schemas of the component types known by the engine.
+         * \see component_schema().
+         */
+        std::vector<const ComponentSchema *> get_schemas();
+
+        /**
+         * \brief Get a component of an entity by class string, for generic code and tools.
+         * Walk it with the schema of its type.
+         * \param c class string of the component.
+         * \param id Id of the entity.
+         * \return Pointer to the component. Do not maintain it between 2 ticks.
+         */
+        Component * get_component(std::string c, EntityId id);
+
+        /**
+         * \brief Check if an entity has a component.
+         * \param id Id of the entity.
+         * \return true if has this component, false otherwise.
+         */
+        template <class T>
+        bool has_component(EntityId id) {
+            return _registry.is_alive(id) && _has_component(TypeId<Component, T>::get(), id.index);
+        }
+
+        /**
+         * \brief Get a component of an entity.
+         * \param id Id of the entity.
+         * \return Pointer to the component. Do not maintain it between 2 ticks, unless the
+         * component is stable (CASHLEY_STABLE): then it is valid until the component is removed.
+         */
+        template <class T>
+        T * get_component(EntityId id) {
+            _check_entity(id);
+            unsigned int type = TypeId<Component, T>::get();
+            if (!_has_component(type, id.index)) {
+                ComponentError e("Component not found");
+                throw e;
+            }
+            unsigned int uid = is_tag<T>::value ? 0 : _registry.get_slot(type, id.index);
+            return _get_cache<T>(type)->get_block(uid);
+        }
+
+        /**
+         * \brief Remove a component from an entity.
+         * \param id Id of the entity.
+         */
+        template <class T>
+        void remove_component(EntityId id) {
+            _check_entity(id);
+            unsigned int type = TypeId<Component, T>::get();
+            if (!_has_component(type, id.index)) {
+                ComponentError e("Component not found");
+                throw e;
+            }
+            if (is_tag<T>::value) {
+                _set_tag(id.index, type, false);
+            } else {
+                _detach_component(id.index, type);
+            }
+        }
+
+        /**
+         * \brief Set the value of a shared component of an entity.
+         *
+         * Each distinct value is stored once, and released when no entity references it.
+         * A previous value of the entity is released.
+         * \param id Id of the entity.
+         * \param value Value of the component.
+         * \return Pointer to the shared value. Changes affect all the entities sharing it,
+         * and must be marked with mark_changed() so the value is found again.
+         * \see CASHLEY_SHARED.
+         */
+        template <class T>
+        T * set_shared(EntityId id, const T & value) {
+            return set_shared<T>(Span<const EntityId>(&id, 1), value);
+        }
+
+        /**
+         * \brief Set the value of a shared component of several entities.
+         * The value is looked up once for the whole batch.
+         * \param ids Ids of the entities.
+         * \param value Value of the component.
+         * \return Pointer to the shared value, NULL if ids is empty.
+         */
+        template <class T>
+        T * set_shared(Span<const EntityId> ids, const T & value) {
+            static_assert(is_shared<T>::value, "Not a shared component.");
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                _check_entity(ids[i]);
+            }
+            if (ids.empty()) {
+                return NULL;
+            }
+            return _share_n<T>(_component_type<T>(), ids.begin(), ids.size(), value, is_shared<T>());
+        }
+
+        /**
+         * \brief Get the count of distinct values of a shared component.
+         */
+        template <class T>
+        unsigned int get_shared_count() {
+            static_assert(is_shared<T>::value, "Not a shared component.");
+            unsigned int type = TypeId<Component, T>::get();
+            if (type >= _component_types.size()) {
+                return 0;
+            }
+            unsigned int count = 0;
+            for (unsigned int uid = 0; uid < _component_types[type].refs.size(); uid++) {
+                count += _component_types[type].refs[uid] != 0;
+            }
+            return count;
+        }
+
+        /**
+         * \brief Iterate the active entities grouped by the value of a shared component.
+         *
+         * Calls f(T & value, Span<const EntityId> ids) once per value, so the per value
+         * data stays hot while its entities are processed.
+         * \param f Function or functor.
+         */
+        template <class T, class F>
+        void each_shared(F f) {
+            static_assert(is_shared<T>::value, "Not a shared component.");
+            unsigned int type = TypeId<Component, T>::get();
+            if (type >= _component_types.size() || !_component_types[type].cache) {
+                return;
+            }
+            // Counting sort of the entities by value.
+            std::vector<unsigned int> begin(_component_types[type].refs.size() + 1, 0);
+            for (unsigned int index = 0; index < _registry.capacity(); index++) {
+                unsigned int uid = _registry.get_slot(type, index);
+                if (uid != NO_COMPONENT && _registry.is_active(index)) {
+                    begin[uid + 1]++;
+                }
+            }
+            for (unsigned int uid = 1; uid < begin.size(); uid++) {
+                begin[uid] += begin[uid - 1];
+            }
+            if (!begin.back()) {
+                return;
+            }
+            std::vector<EntityId> ids(begin.back());
+            std::vector<unsigned int> next(begin.begin(), begin.end() - 1);
+            for (unsigned int index = 0; index < _registry.capacity(); index++) {
+                unsigned int uid = _registry.get_slot(type, index);
+                if (uid != NO_COMPONENT && _registry.is_active(index)) {
+                    ids[next[uid]++] = _registry.get_id(index);
+                }
+            }
+            typename CacheOf<T>::type * c = _get_cache<T>(type);
+            for (unsigned int uid = 0; uid + 1 < begin.size(); uid++) {
+                if (begin[uid] != begin[uid + 1]) {
+                    f(*c->get_block(uid), Span<const EntityId>(&ids[begin[uid]], begin[uid + 1] - begin[uid]));
+                }
+            }
+        }
+
+        /**
+         * \brief Set a resource of the engine, replacing the previous one of its type.
+         * \param value Value of the resource.
+         * \return The stored resource. Do not maintain it after replacing or removing it.
+         * \see Processor::reads(), Processor::writes().
+         */
+        template <class T>
+        T & set_resource(const T & value) {
+            return _resources.set<T>(value);
+        }
+
+        /**
+         * \brief Set a default constructed resource of the engine.
+         * \return The stored resource.
+         */
+        template <class T>
+        T & set_resource() {
+            return _resources.set<T>(T());
+        }
+
+        /**
+         * \brief Get a resource of the engine, in constant time.
+         * \return The stored resource. Throws ResourceError if not set.
+         */
+        template <class T>
+        T & resource() {
+            return _resources.get<T>();
+        }
+
+        /**
+         * \brief Check if a resource of the engine is set.
+         */
+        template <class T>
+        bool has_resource() {
+            return _resources.has<T>();
+        }
+
+        /**
+         * \brief Destroy a resource of the engine, if set.
+         */
+        template <class T>
+        void remove_resource() {
+            _resources.remove<T>();
+        }
+
+        /**
+         * \brief Set the parent of an entity.
+         *
+         * Destroying an entity destroys its descendants too. A child is visited by the
+         * next propagate() after changing its parent.
+         * \param child Id of the child.
+         * \param parent Id of the parent, or a null id to unlink the child.
+         */
+        void set_parent(EntityId child, EntityId parent);
+
+        /**
+         * \brief Get the parent of an entity.
+         * \return Id of the parent, null if it is a root.
+         */
+        EntityId get_parent(EntityId id);
+
+        /**
+         * \brief Get the first child of an entity.
+         * Usage: for (c = get_first_child(id); !c.is_null(); c = get_next_sibling(c))
+         * \return Id of the child, null if none.
+         */
+        EntityId get_first_child(EntityId id);
+
+        /**
+         * \brief Get the next child of the parent of an entity.
+         * \return Id of the sibling, null if none.
+         */
+        EntityId get_next_sibling(EntityId id);
+
+        /**
+         * \brief Get the count of ancestors of an entity.
+         */
+        unsigned int get_depth(EntityId id);
+
+        /**
+         * \brief Mark an entity as changed, so propagate() visits its subtree.
+         */
+        void mark_dirty(EntityId id);
+
+        /**
+         * \brief Rebuild the propagation order of the hierarchy if it changed.
+         * Needed before get_root_count() and propagate_root().
+         */
+        inline void update_hierarchy() { _hierarchy.update(); }
+
+        /**
+         * \brief Get the count of root trees of the hierarchy.
+         * \see propagate_root().
+         */
+        inline unsigned int get_root_count() { return _hierarchy.get_root_count(); }
+
+        /**
+         * \brief Propagate a component from parents to children.
+         *
+         * Calls f(T & node, const T * parent) for every changed entity and all its
+         * descendants, parents before children, in a linear scan of the dense hierarchy
+         * order. Trees without changes are skipped. parent is NULL for roots and for
+         * parents without the component. Entities without the component are not passed
+         * to f, but their descendants are.
+         * \param f Function or functor.
+         * \see mark_dirty().
+         */
+        template <class T, class F>
+        void propagate(F f) {
+            _hierarchy.update();
+            for (unsigned int r = 0; r < _hierarchy.get_root_count(); r++) {
+                propagate_root<T>(r, f);
+            }
+        }
+
+        /**
+         * \brief Propagate a component on one root tree.
+         *
+         * Calls to different roots touch different entities, so they can run on
+         * different threads. Call update_hierarchy() first, and do not change entities
+         * meanwhile.
+         * \param r Root, below get_root_count().
+         * \param f Function or functor.
+         * \see propagate().
+         */
+        template <class T, class F>
+        void propagate_root(unsigned int r, F f) {
+            Hierarchy & h = _hierarchy;
+            unsigned int root = h._roots[r];
+            if (!h._dirty_tree[root]) {
+                return;
+            }
+            h._dirty_tree[root] = 0;
+            unsigned int type = TypeId<Component, T>::get();
+            typename CacheOf<T>::type * c = type < _component_types.size() ? _get_cache<T>(type) : NULL;
+            for (unsigned int pos = h._root_begin[r]; pos < h._root_begin[r + 1]; pos++) {
+                Hierarchy::_Node & node = h._order[pos];
+                node.visit = h._dirty[node.index] || (node.parent != NO_COMPONENT && h._order[node.parent].visit);
+                if (!node.visit) {
+                    continue;
+                }
+                h._dirty[node.index] = 0;
+                unsigned int uid = c ? _registry.get_slot(type, node.index) : NO_COMPONENT;
+                if (uid == NO_COMPONENT) {
+                    continue;
+                }
+                const T * parent = NULL;
+                if (node.parent != NO_COMPONENT) {
+                    unsigned int parent_uid = _registry.get_slot(type, h._order[node.parent].index);
+                    if (parent_uid != NO_COMPONENT) {
+                        parent = c->get_block(parent_uid);
+                    }
+                }
+                f(*c->get_block(uid), parent);
+            }
+        }
+
         /**
          * \brief Add a processor with a priority to the engine.
          * Only one processor per type is allowed.
@@ -179,7 +720,13 @@ namespace CAshley {
                 }
             }
             p->_engine = this;
+            p->_priority = priority;
+            p->_order = _processor_order++;
             _processors.insert(std::pair<unsigned int, Processor *>(priority, p));
+            // Activated by its constructor, before it had an engine.
+            if (p->_running) {
+                _schedule_processor(p);
+            }
         }
 
         /**
@@ -216,6 +763,7 @@ namespace CAshley {
             std::multimap<unsigned int, Processor *>::iterator it = _processors.begin(), end = _processors.end();
             for (; it != end; it++) {
                 if (p.get_name() == it->second->get_name()) {
+                    _unschedule_processor(it->second);
                     delete it->second;
                     _processors.erase(it);
                     return;
@@ -242,35 +790,1168 @@ namespace CAshley {
         /**
          * \brief Run a tick over all the active processors.
          * Processors run_tick method is called on priority asc order.
+         * Only processors whose schedule is due on this tick are visited.
          * Important! If any entity is removed, it will not be succesfully removed until all processors
          * are called.
          * \param delay Delay to pass to active processors run_tick method.
+         * \see Processor::schedule_interval(), Processor::schedule_fixed_step(),
+         * Processor::schedule_every_n_ticks().
          */
         void run_tick(unsigned int delay);
-        friend class Family;
-    private:
+
         /**
-         * \brief Remove all entities that are waiting to be removed.
-         *
-         * This method is called at the end of a run_tick call. This succesfully remove entites,
-         * calling the EntityListeners.
+         * \brief Emit an event for other processors.
+         * Safe to call from several threads. Events can be read until the end
+         * of the next tick.
+         * \param e Event.
+         * \see get_events(), get_last_events().
          */
-        void _remove_entities();
+        template <class T>
+        void emit(const T & e) {
+            _events.emit<T>(e);
+        }
+
         /**
-         * \brief Remove an Entity.
-         *
-         * Call the EntityListeners, remove components and remove the Entity.
+         * \brief Get the events of a type emitted on the current tick.
+         * \return Queue of events. Read it with EventQueue::spans() and EventQueue::span().
          */
-        void _remove_entity(Entity * e);
+        template <class T>
+        EventQueue<T> & get_events() {
+            return _events.get_events<T>();
+        }
+
         /**
-         * \brief Call the listeners for an Entity.
-         * \param e Entity added / removed.
-         * \param add Determine if the Entity was Added (true) or removed (false).
+         * \brief Get the events of a type emitted on the previous tick.
+         * \return Queue of events. Read it with EventQueue::spans() and EventQueue::span().
          */
-        void _call_listeners(Entity * e, bool add=true);
+        template <class T>
+        EventQueue<T> & get_last_events() {
+            return _events.get_last_events<T>();
+        }
+
         /**
-         * \brief Determines if  the engine is ticking processors.
-         * If the engine is ticking processors, the deletion of entities will be
+         * \brief Start the pipelined mode.
+         * At the end of each tick, the active components of the extracted types are
+         * copied into a snapshot that the output stage consumes on other threads,
+         * while the next ticks run. The engine waits if depth snapshots are in flight.
+         * An exception thrown by the stage is rethrown by the next run_tick() or
+         * flush_pipeline().
+         * \param stage Output stage, not owned.
+         * \param depth Max snapshots in flight.
+         * \param threads Count of threads running the stage.
+         * \see extract().
+         */
+        void start_pipeline(OutputStage * stage, unsigned int depth=2, unsigned int threads=1);
+
+        /**
+         * \brief Stop the pipelined mode.
+         * Pending snapshots are consumed before returning.
+         */
+        void stop_pipeline();
+
+        /**
+         * \brief Wait until the output stage has consumed all the published snapshots.
+         */
+        void flush_pipeline();
+
+        /**
+         * \brief Add a component type to the pipeline snapshots.
+         * Components are copied bitwise: snapshot readers must not follow pointers owned by them.
+         * Stable components can not be extracted.
+         */
+        template <class T>
+        void extract() {
+            if (! std::is_base_of<Component, T>::value || is_stable<T>::value) {
+                ComponentError e("Invalid component class");
+                throw e;
+            }
+            unsigned int type = _component_type<T>();
+            for (unsigned int i = 0; i < _extracted.size(); i++) {
+                if (_extracted[i].second == _component_types[type].cache) {
+                    return;
+                }
+            }
+            _extracted.push_back(std::pair<std::string, _Cache *>(_component_types[type].name, _component_types[type].cache));
+        }
+
+        /**
+         * \brief Export the extracted types to a POSIX shared memory segment.
+         * At the end of each tick, the active components of the types extracted so far
+         * are copied to the segment, for tools running on other processes. Readers map
+         * it read-only and never stop the tick, see SharedExportReader.
+         * \param name Name of the segment, like "/cashley-debug".
+         * \param capacity Max components exported per type.
+         * \see extract(), SharedExport.
+         */
+        void start_export(const std::string & name, unsigned int capacity=1 << 16);
+
+        /**
+         * \brief Stop exporting and remove the segment.
+         */
+        void stop_export();
+
+        /**
+         * \brief Copy the exported types to the segment now.
+         * Done at the end of each tick, and useful after changes between ticks.
+         */
+        void publish_export();
+
+        /**
+         * \brief Run a task on the engine.
+         * The engine takes ownership of the task. Engine tasks are resumed at the
+         * start of each run_tick, before the processors.
+         * \param task Task to run (see Task on task.h).
+         */
+        template <class T>
+        void spawn(T task) {
+            _tasks.spawn(task.release());
+        }
+
+        /**
+         * \brief Get the task queue of the engine.
+         * \return Task queue run at the start of each tick.
+         */
+        inline TaskQueue & get_tasks() { return _tasks; }
+
+        /**
+         * \brief Get the sum of the delays passed to run_tick.
+         * \return Engine clock.
+         */
+        inline unsigned long long get_clock() { return _clock; }
+
+        /**
+         * \brief Get the number of ticks run.
+         * \return Tick count.
+         */
+        inline unsigned long long get_tick() { return _tick; }
+
+        /**
+         * \brief Save the world to a snapshot.
+         *
+         * The snapshot holds the entity records, the hierarchy, the clock and, for each
+         * component type, the tables and packed components of its cache and the
+         * component of each entity. Each of them is written with one copy, and block
+         * copyable components too; the rest are written with Component::save().
+         * Entity objects are saved as plain entities. Processors, listeners, prefabs and
+         * resources are not saved. Call it between ticks.
+         * \param out Buffer. The snapshot is appended to it.
+         */
+        void save_snapshot(std::vector<char> & out);
+
+        /**
+         * \brief Save the world to a snapshot file.
+         * \param path Path of the file, replaced if it exists.
+         * \see save_snapshot(std::vector<char> &).
+         */
+        void save_snapshot(const std::string & path);
+
+        /**
+         * \brief Load the world from a snapshot.
+         *
+         * The engine must have no entities, and all the component types of the
+         * snapshot must be known (see register_component()) with the same size. Ids
+         * of the saved entities are valid on this engine. Listeners are not notified,
+         * and processors are rescheduled from the loaded clock.
+         * \param data First byte of the snapshot.
+         * \param size Count of bytes.
+         */
+        void load_snapshot(const char * data, size_t size);
+
+        /**
+         * \brief Load the world from a snapshot file.
+         * \param path Path of the file.
+         * \see load_snapshot(const char *, size_t).
+         */
+        void load_snapshot(const std::string & path);
+
+        /**
+         * \brief Load the world from a snapshot file mapped in memory.
+         *
+         * Like load_snapshot(), but block copyable components of a Cache are used in
+         * place from the mapped file, and the kernel copies each page on its first
+         * write, so the cost of loading does not depend on the size of the components.
+         * That needs components saved by the same executable at the same address
+         * (virtual tables are compared): otherwise they are copied. Tables and entity
+         * records are copied. The file is unmapped with the engine.
+         * \param path Path of the file.
+         * \param verify Check the checksums of the components too, reading all the file.
+         * The rest of the snapshot is always checked.
+         */
+        void map_snapshot(const std::string & path, bool verify=false);
+
+        /**
+         * \brief Start or stop tracking the changes of the world, for deltas.
+         * The current tick is the base of the next delta.
+         * \param on Track changes. If false, tracked changes are dropped.
+         */
+        void track_changes(bool on=true);
+
+        /**
+         * \brief Record that a component of an entity was written.
+         * The engine sees structural changes, but not writes through pointers: written
+         * components must be marked to be on the next delta, or on the journal if
+         * written outside a tick. Values of shared components are indexed again by
+         * their new fields, so set_shared() finds them.
+         * \param id Id of the entity.
+         */
+        template <class T>
+        void mark_changed(EntityId id) {
+            _check_entity(id);
+            if (is_shared<T>::value) {
+                _reindex_shared(TypeId<Component, T>::get(), id.index);
+            }
+            _registry.mark_changed(TypeId<Component, T>::get(), id.index);
+            _journal_values(TypeId<Component, T>::get(), &id, 1);
+        }
+
+        /**
+         * \brief Record that a component of several entities was written.
+         * \see mark_changed(EntityId).
+         */
+        template <class T>
+        void mark_changed(Span<const EntityId> ids) {
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                mark_changed<T>(ids[i]);
+            }
+        }
+
+        /**
+         * \brief Save the changes of the world since the base tick to a delta.
+         *
+         * A delta holds the record of each created, destroyed or changed entity (status,
+         * parent and tags), and the components added, removed or marked as changed,
+         * written like on a snapshot. Its size and cost depend on the count of changes,
+         * not on the size of the world. The current tick becomes the base of the next
+         * delta, so a snapshot at the first base and the following deltas rebuild every
+         * tick. Call it between ticks, with changes tracked (see track_changes()).
+         * \param out Buffer. The delta is appended to it.
+         */
+        void save_delta(std::vector<char> & out);
+
+        /**
+         * \brief Apply a delta saved by another engine.
+         *
+         * The engine must be at the base tick of the delta, with the world of the saving
+         * engine at that tick: loaded from its snapshot, then the previous deltas applied.
+         * Afterwards ids of the saving engine are valid on this one, and the clock and
+         * tick are the ones of the delta. Listeners are notified of destroyed entities
+         * only, and children may be visited in another order.
+         * \param data First byte of the delta.
+         * \param size Count of bytes.
+         */
+        void apply_delta(const char * data, size_t size);
+
+        /**
+         * \brief Start recording the commands applied to the world on a journal file.
+         *
+         * The journal starts with a snapshot of the world, then records the structural
+         * changes done outside ticks: created and destroyed entities, added and removed
+         * components and tags, activation and parents, whatever the call that does
+         * them, and the delay of each tick. Changes done by processors and tasks are
+         * not recorded: replaying runs them again. Components are recorded with their
+         * value at the start of the next tick, so later writes outside ticks must be
+         * marked with mark_changed(). Deltas and snapshots loaded meanwhile are not
+         * recorded.
+         * \param path Path of the file, replaced if it exists.
+         * \param buffer Size in bytes of the buffer of records.
+         * \see Replay.
+         */
+        void start_journal(const std::string & path, unsigned int buffer=1 << 16);
+
+        /**
+         * \brief Stop recording, and write the pending records to the journal file.
+         */
+        void stop_journal();
+
+        /**
+         * \brief Keep what is needed to roll the world back to one of the last ticks.
+         *
+         * The engine keeps the bytes of the components and the metadata of the entities
+         * as they were at the last tick. After each tick, the changed ones are copied
+         * from it to a frame of a ring, and taken again from the world. Frames reuse
+         * their buffers, so saving a tick does not allocate once they have grown, and
+         * saving and rolling back cost as much as the changes, not the size of the
+         * world. Components are copied bytewise, so they must be block copyable (tags
+         * are kept as bits). Changes are tracked for it, so deltas can not be saved
+         * meanwhile, and writes through pointers must be marked with mark_changed().
+         * \param ticks Count of ticks that can be undone.
+         * \see rollback().
+         */
+        void start_rollback(unsigned int ticks);
+
+        /**
+         * \brief Stop keeping ticks to roll back, and free the frames.
+         */
+        void stop_rollback();
+
+        /**
+         * \brief Restore the world as it was at the end of a previous tick.
+         *
+         * Changes done after that tick are undone, including the ones done since the
+         * last tick, and the tick and clock go back to their values then. Ids of the
+         * restored entities are the same, and new entities get the ids they got then,
+         * so running the same ticks again gives the same world. Like with
+         * apply_delta(), listeners are notified of destroyed entities only, Entity
+         * objects of restored entities are not restored, and components may be in
+         * another order on their caches, so new components must be set up by their
+         * init() to get the same world. Resources, events and processors are not
+         * rolled back. The frames of the undone ticks are dropped.
+         * \param tick Tick to restore, from get_rollback_tick() to the current one.
+         */
+        void rollback(unsigned long long tick);
+
+        /**
+         * \brief Get the oldest tick rollback() can restore.
+         */
+        unsigned long long get_rollback_tick();
+
+        /**
+         * \brief Create an independent copy of the engine.
+         *
+         * Caches are copied in bulk (see _Cache::clone()), with the entity records,
+         * hierarchy, resources, prefabs and processors, copied with their families and
+         * schedule. Entity objects are copied as plain entities. Listeners, events,
+         * tasks, the pipeline, the export, the journal, rollback and streaming are not copied. Copies share
+         * nothing with the engine, so each one can run on its own thread.
+         * \return The copy, owned by the caller.
+         */
+        Engine * clone();
+
+        /**
+         * \brief Create several lazy copies of the engine.
+         *
+         * Like clone(), but the world is saved once to an unlinked temporary file that
+         * each copy maps in memory (see map_snapshot()). Block copyable components of
+         * a Cache are shared with the page cache, and the kernel copies a page on its
+         * first write, so copies that change little are cheap. Components must be
+         * snapshot friendly.
+         * \param count Count of copies.
+         * \return The copies, owned by the caller.
+         */
+        std::vector<Engine *> fork(unsigned int count);
+
+        /**
+         * \brief Start paging regions of entities in and out from disk.
+         *
+         * A region is a set of plain entities, see assign_region(). Unloaded regions
+         * are saved on a region file and despawned. Loaded ones are read by a
+         * background thread, and committed at the start of the next ticks, in batches
+         * of entities with the same components, each one with a single allocation per
+         * type. Unloading runs the other way: the components of a batch are copied
+         * and the entities despawned at the start of a tick, and the file is encoded
+         * and written on the background thread. Regions do not keep the hierarchy,
+         * and can not be streamed while a journal or rollback is on.
+         * \param directory Directory of the region files.
+         * \param budget Max count of entities committed or copied per tick, for all
+         * the regions. At least one batch (up to REGION_BATCH entities) is done per
+         * tick, so regions always make progress.
+         */
+        void start_streaming(const std::string & directory, unsigned int budget=4 * REGION_BATCH);
+
+        /**
+         * \brief Stop streaming. Regions being loaded or unloaded are finished, and
+         * pending writes are done.
+         */
+        void stop_streaming();
+
+        /**
+         * \brief Set the entities of a loaded region.
+         * \param region Identifier of the region.
+         * \param ids Entities of the region, replacing the previous ones.
+         */
+        void assign_region(unsigned int region, Span<const EntityId> ids);
+
+        /**
+         * \brief Start loading a region from its file.
+         * Its entities exist once get_region_state() returns REGION_LOADED.
+         */
+        void load_region(unsigned int region);
+
+        /**
+         * \brief Start unloading a region to its file.
+         * Its entities are despawned batch by batch, within the budget of the next
+         * ticks, and the region is REGION_UNLOADED once they all are.
+         */
+        void unload_region(unsigned int region);
+
+        /**
+         * \brief Get the state of a region.
+         */
+        RegionState get_region_state(unsigned int region);
+
+        /**
+         * \brief Get the entities of a region.
+         * Entities of a loading region are the ones of the batches committed so far,
+         * with all their components. References to entities of the next batches are
+         * null until those are committed. Entities of a loading region must not be
+         * destroyed.
+         */
+        std::vector<EntityId> get_region(unsigned int region);
+
+        /**
+         * \brief Commit the read regions and copy the unloading ones, up to the
+         * budget of entities. Called at the start of every tick.
+         */
+        void commit_regions();
+
+        /**
+         * \brief Load and unload the pending regions without budget, blocking on the
+         * reads and writes.
+         */
+        void wait_regions();
+
+        friend class Family;
+        friend class Entity;
+        friend class Processor;
+        friend class Prefab;
+        friend class Replay;
+    private:
+        /**
+         * \brief A component type known by the engine.
+         */
+        struct _ComponentType {
+            /** Class string of the component. */
+            std::string name;
+            /** Cache of the components. NULL if the type is unknown. */
+            _Cache * cache;
+            /** Typed access to a component of the cache. */
+            Component * (*get)(_Cache * c, unsigned int uid);
+            /** Bit of the tag, NO_COMPONENT for components with UIDs. */
+            unsigned int tag;
+            /** The component is shared: UIDs name values, not components. */
+            bool shared;
+            /** Count of entities referencing each value of a shared component, by UID. */
+            std::vector<unsigned int> refs;
+            /** Stored values of a shared component, by hash of their described fields. */
+            std::unordered_multimap<unsigned long long, unsigned int> values;
+            /** Hash of each stored value of a shared component when it was stored, by UID. */
+            std::vector<unsigned long long> hashes;
+            /** Layout version of the component. */
+            unsigned int layout;
+            /** Typed read of a component written by _Cache::save_block(), for an entity. */
+            void (*load)(Engine & e, unsigned int type, unsigned int index, SnapshotReader & r);
+            /** Typed add_component(), for replays. */
+            void (*add)(Engine & e, unsigned int type, EntityId id);
+            /** Typed spawn of the components of new entities, for replays. */
+            unsigned int (*spawn)(Engine & e, const EntityId * ids, unsigned int count, bool active);
+            /** Typed register_component(), for engines copying this one. */
+            void (*declare)(Engine & e);
+            /** Bytes of a block copyable component, 0 for the rest. */
+            unsigned int size;
+            /** Typed copy of the bytes of a component, for rollback. */
+            void (*copy)(_Cache * c, unsigned int uid, char * out);
+            /** Typed write of bytes taken by copy() over the component of an entity, added if missing. */
+            void (*paste)(Engine & e, unsigned int type, unsigned int index, const char * data);
+            /** Schema of the component. */
+            const ComponentSchema * schema;
+        };
+        /**
+         * \brief Typed access to a component of a cache.
+         */
+        template <class T>
+        static Component * _get_block(_Cache * c, unsigned int uid) {
+            return static_cast<typename CacheOf<T>::type *>(c)->get_block(uid);
+        }
+        /**
+         * \brief Add an initialized component to an entity that has none of its type.
+         * \return Pointer to the component.
+         */
+        template <class T>
+        T * _add_component(unsigned int type, EntityId id) {
+            if (is_tag<T>::value) {
+                _set_tag(id.index, type, true);
+                return _get_cache<T>(type)->get_block(0);
+            }
+            if (is_shared<T>::value) {
+                T x;
+                x.init();
+                return _share_n<T>(type, &id, 1, x, is_shared<T>());
+            }
+            typename CacheOf<T>::type * c = _get_cache<T>(type);
+            unsigned int uid = c->block_alloc();
+            T * t = c->get_block(uid);
+            t->set_owner(_registry.get_wrapper(id.index));
+            t->init();
+            _attach_component(id.index, type, uid);
+            return c->get_block(uid);
+        }
+        template <class T>
+        static void _replay_add(Engine & e, unsigned int type, EntityId id) {
+            e._add_component<T>(type, id);
+        }
+        template <class T>
+        static void _declare(Engine & e) {
+            e._component_type<T>();
+        }
+        template <class T>
+        static unsigned int _replay_spawn(Engine & e, const EntityId * ids, unsigned int count, bool active) {
+            return e._spawn_components<T>(ids, count, active);
+        }
+        /**
+         * \brief Typed read of a component of a delta, added to the entity if missing.
+         */
+        template <class T>
+        static void _load_value(Engine & e, unsigned int type, unsigned int index, SnapshotReader & r) {
+            e._read_value<T>(type, index, r, is_shared<T>());
+        }
+        template <class T>
+        void _read_value(unsigned int type, unsigned int index, SnapshotReader & r, std::true_type) {
+            T x;
+            x.set_owner(NULL);
+            _Cache::load_value(r, x);
+            EntityId id = _registry.get_id(index);
+            _share_n<T>(type, &id, 1, x, std::true_type());
+        }
+        template <class T>
+        void _read_value(unsigned int type, unsigned int index, SnapshotReader & r, std::false_type) {
+            typename CacheOf<T>::type * c = _get_cache<T>(type);
+            unsigned int uid = _registry.get_slot(type, index);
+            if (uid != NO_COMPONENT) {
+                _Cache::load_value(r, *c->get_block(uid));
+                return;
+            }
+            uid = c->block_alloc();
+            T * t = c->get_block(uid);
+            t->set_owner(_registry.get_wrapper(index));
+            _Cache::load_value(r, *t);
+            _attach_component(index, type, uid);
+        }
+        /**
+         * \brief Set the byte copies of a block copyable component type, for rollback.
+         */
+        template <class T>
+        void _set_bytes(unsigned int type, std::true_type) {
+            _component_types[type].size = sizeof(T);
+            _component_types[type].copy = &_copy_bytes<T>;
+            _component_types[type].paste = &_paste_bytes<T>;
+        }
+        template <class T>
+        void _set_bytes(unsigned int, std::false_type) {
+        }
+        template <class T>
+        static void _copy_bytes(_Cache * c, unsigned int uid, char * out) {
+            memcpy(out, (const void *)static_cast<typename CacheOf<T>::type *>(c)->get_block(uid), sizeof(T));
+        }
+        /**
+         * \brief Typed write of the bytes of a component, added to the entity if missing.
+         */
+        template <class T>
+        static void _paste_bytes(Engine & e, unsigned int type, unsigned int index, const char * data) {
+            e._paste_value<T>(type, index, data, is_shared<T>());
+        }
+        template <class T>
+        void _paste_value(unsigned int type, unsigned int index, const char * data, std::true_type) {
+            T x;
+            _Cache::copy_value(x, data);
+            EntityId id = _registry.get_id(index);
+            _share_n<T>(type, &id, 1, x, std::true_type());
+        }
+        template <class T>
+        void _paste_value(unsigned int type, unsigned int index, const char * data, std::false_type) {
+            typename CacheOf<T>::type * c = _get_cache<T>(type);
+            unsigned int uid = _registry.get_slot(type, index);
+            if (uid != NO_COMPONENT) {
+                _Cache::copy_value(*c->get_block(uid), data);
+                return;
+            }
+            uid = c->block_alloc();
+            T * t = c->get_block(uid);
+            t->set_owner(_registry.get_wrapper(index));
+            _Cache::copy_value(*t, data);
+            _attach_component(index, type, uid);
+        }
+        /**
+         * \brief Get the type of a component, creating its cache on first use.
+         * The cache of a tag only holds the instance shared by its entities, with UID 0.
+         * \return TypeId<Component, T> of the component.
+         */
+        template <class T>
+        unsigned int _component_type() {
+            unsigned int type = TypeId<Component, T>::get();
+            if (type >= _component_types.size() || !_component_types[type].cache) {
+                if (_rollback && !is_tag<T>::value && !is_block_copyable<T>::value) {
+                    RollbackError e("Components must be block copyable while rollback is on.");
+                    throw e;
+                }
+                const ComponentSchema & schema = component_schema<T>();
+                if (is_tag<T>::value) {
+                    typename CacheOf<T>::type * c = new typename CacheOf<T>::type(1);
+                    c->block_alloc();
+                    _add_component_type(type, schema.name, c, &_get_block<T>, true);
+                } else if (is_shared<T>::value) {
+                    _add_component_type(type, schema.name, new typename CacheOf<T>::type(16, true), &_get_block<T>, false, true);
+                } else {
+                    _add_component_type(type, schema.name, new typename CacheOf<T>::type(100, true), &_get_block<T>);
+                }
+                _component_types[type].layout = layout_version<T>::value;
+                _component_types[type].load = &_load_value<T>;
+                _component_types[type].add = &_replay_add<T>;
+                _component_types[type].spawn = &_replay_spawn<T>;
+                _component_types[type].declare = &_declare<T>;
+                _component_types[type].schema = &schema;
+                _set_bytes<T>(type, std::integral_constant<bool, is_block_copyable<T>::value && !is_tag<T>::value>());
+            }
+            return type;
+        }
+        /**
+         * \brief Get the cache of a known component type.
+         */
+        template <class T>
+        inline typename CacheOf<T>::type * _get_cache(unsigned int type) {
+            return static_cast<typename CacheOf<T>::type *>(_component_types[type].cache);
+        }
+        /**
+         * \brief Register the cache of a component type.
+         * \param tag The type is a tag, a bit is assigned to it.
+         * \param shared The type is shared.
+         */
+        void _add_component_type(unsigned int type, const std::string & name, _Cache * cache, Component * (*get)(_Cache *, unsigned int), bool tag=false, bool shared=false);
+        /**
+         * \brief Check if an entity has a component or tag.
+         * \param type Component type, known or not.
+         * \param index Slot of the entity.
+         */
+        inline bool _has_component(unsigned int type, unsigned int index) {
+            if (type >= _component_types.size()) {
+                return false;
+            }
+            unsigned int tag = _component_types[type].tag;
+            return tag == NO_COMPONENT ? _registry.get_slot(type, index) != NO_COMPONENT : _registry.has_tag(tag, index);
+        }
+        /**
+         * \brief Set or clear a tag of an entity.
+         * Cached entities of processors are updated in place, and waiting tasks are woken.
+         */
+        void _set_tag(unsigned int index, unsigned int type, bool on);
+        /**
+         * \brief Clear all the tags of an entity.
+         */
+        void _remove_tags(unsigned int index);
+        /**
+         * \brief Make several entities reference a value of a shared component.
+         * The value is stored if no equal value is.
+         * \return Pointer to the stored value.
+         */
+        template <class T>
+        T * _share_n(unsigned int type, const EntityId * ids, unsigned int count, const T & value, std::true_type) {
+            typename CacheOf<T>::type * c = _get_cache<T>(type);
+            _ComponentType & shared = _component_types[type];
+            // Only the values with the same hash are compared.
+            unsigned long long h = shared.schema->value_hash(&value);
+            typedef std::unordered_multimap<unsigned long long, unsigned int>::iterator Iterator;
+            std::pair<Iterator, Iterator> found = shared.values.equal_range(h);
+            unsigned int uid = NO_COMPONENT;
+            for (Iterator it = found.first; it != found.second && uid == NO_COMPONENT; it++) {
+                if (*c->get_block(it->second) == value) {
+                    uid = it->second;
+                }
+            }
+            if (uid == NO_COMPONENT) {
+                uid = c->block_alloc();
+                T * t = c->get_block(uid);
+                t->~T();
+                new (t) T(value);
+                if (uid >= shared.refs.size()) {
+                    shared.refs.resize(uid + 1, 0);
+                    shared.hashes.resize(uid + 1, 0);
+                }
+                shared.hashes[uid] = h;
+                shared.values.insert(std::make_pair(h, uid));
+            }
+            for (unsigned int i = 0; i < count; i++) {
+                _set_shared(ids[i].index, type, uid);
+            }
+            return c->get_block(uid);
+        }
+        template <class T>
+        T * _share_n(unsigned int, const EntityId *, unsigned int, const T &, std::false_type) {
+            return NULL;
+        }
+        /**
+         * \brief Make an entity reference a stored value of a shared component.
+         * Its previous value is released.
+         */
+        void _set_shared(unsigned int index, unsigned int type, unsigned int uid);
+        /**
+         * \brief Release a reference to a value of a shared component.
+         * The value is freed with its last reference.
+         */
+        void _unshare(unsigned int type, unsigned int uid);
+        /**
+         * \brief Rebuild the hash index of the stored values of a shared component.
+         */
+        void _index_shared(unsigned int type);
+        /**
+         * \brief Index again the value of a shared component of an entity, after a write.
+         */
+        void _reindex_shared(unsigned int type, unsigned int index);
+        /**
+         * \brief Remove a stored value of a shared component from the hash index.
+         */
+        void _unindex_shared(unsigned int type, unsigned int uid);
+        /**
+         * \brief Get the type of a component from its class string.
+         * \return The type, or NO_COMPONENT if unknown.
+         */
+        unsigned int _find_component_type(const std::string & c);
+        /**
+         * \brief Throw an EntityError if an id does not name a living entity.
+         */
+        void _check_entity(EntityId id);
+        /**
+         * \brief Link an allocated component to an entity.
+         * Updates the registry and the Entity, activates the component if needed and wakes
+         * the waiting tasks.
+         */
+        void _attach_component(unsigned int index, unsigned int type, unsigned int uid);
+        /**
+         * \brief Shut down and free a component of an entity.
+         */
+        void _detach_component(unsigned int index, unsigned int type);
+        /**
+         * \brief Allocate and initialize the components of a spawn_n batch.
+         * \return Type of the components.
+         */
+        template <class T>
+        unsigned int _spawn_components(const EntityId * ids, unsigned int count, bool active) {
+            unsigned int type = _component_type<T>();
+            if (is_tag<T>::value) {
+                for (unsigned int i = 0; i < count; i++) {
+                    _registry.set_tag(_component_types[type].tag, ids[i].index, true);
+                }
+                return type;
+            }
+            if (is_shared<T>::value) {
+                T x;
+                x.init();
+                _share_n<T>(type, ids, count, x, is_shared<T>());
+                return type;
+            }
+            std::vector<unsigned int> uids(count);
+            T * blocks = _get_cache<T>(type)->block_alloc_n(count, &uids[0], active);
+            for (unsigned int i = 0; i < count; i++) {
+                blocks[i].set_owner(NULL);
+                blocks[i].init();
+                _registry.set_slot(type, ids[i].index, uids[i]);
+            }
+            _journal_values(type, ids, count);
+            return type;
+        }
+        /**
+         * \brief Allocate the components of an instantiate() batch as copies of a value.
+         * \return Type of the components.
+         */
+        template <class T>
+        unsigned int _instantiate_components(const T & value, const EntityId * ids, unsigned int count, bool active) {
+            unsigned int type = _component_type<T>();
+            if (is_tag<T>::value) {
+                for (unsigned int i = 0; i < count; i++) {
+                    _registry.set_tag(_component_types[type].tag, ids[i].index, true);
+                }
+                return type;
+            }
+            if (is_shared<T>::value) {
+                _share_n<T>(type, ids, count, value, is_shared<T>());
+                return type;
+            }
+            std::vector<unsigned int> uids(count);
+            T * blocks = _get_cache<T>(type)->block_alloc_n(count, &uids[0], active);
+            if (is_block_copyable<T>::value) {
+                // Copy the value once, then double the copied run.
+                memcpy((void *)blocks, (const void *)&value, sizeof(T));
+                for (unsigned int done = 1; done < count; done *= 2) {
+                    unsigned int n = done < count - done ? done : count - done;
+                    memcpy((void *)(blocks + done), (const void *)blocks, sizeof(T) * n);
+                }
+            } else {
+                for (unsigned int i = 0; i < count; i++) {
+                    blocks[i].~T();
+                    new (&blocks[i]) T(value);
+                }
+            }
+            for (unsigned int i = 0; i < count; i++) {
+                _registry.set_slot(type, ids[i].index, uids[i]);
+            }
+            _journal_values(type, ids, count);
+            return type;
+        }
+        /**
+         * \brief Kind of a component type on a snapshot.
+         */
+        unsigned char _snapshot_kind(unsigned int type);
+        /**
+         * \brief Write the table of known component types: name, kind, size, layout and
+         * schema hash.
+         */
+        void _save_types(SnapshotWriter & w);
+        /**
+         * \brief Read a table written by _save_types(), checking it against this engine.
+         * \return The type of each entry.
+         */
+        std::vector<unsigned int> _load_types(SnapshotReader & r);
+        /**
+         * \brief Get the type of an entry of a type table, checking it against this engine.
+         */
+        unsigned int _check_type(const std::string & name, unsigned char kind, unsigned int block_size, unsigned int layout, unsigned long long hash);
+        /**
+         * \brief Check if a command has to be recorded on the journal.
+         * Changes done during ticks are not, nor the ones done inside a recorded command.
+         */
+        inline bool _journaling() const { return _journal && !_ticking && !_journal_mute; }
+        /**
+         * \brief Record created, destroyed, activated or deactivated entities.
+         * \param record JOURNAL_CREATE, JOURNAL_DESTROY or JOURNAL_ACTIVE.
+         * \param flag Active flag of created or changed entities.
+         */
+        void _journal_entities(unsigned char record, const EntityId * ids, unsigned int n, bool flag=false);
+        /**
+         * \brief Record a spawn_n() batch.
+         */
+        void _journal_spawn(const EntityId * ids, unsigned int count, bool active, const unsigned int * types, unsigned int n);
+        /**
+         * \brief Reference to an entity of a batch of a region not committed yet.
+         */
+        struct _RegionLink {
+            /** Entity with the reference. */
+            EntityId holder;
+            /** Component type with the reference. */
+            unsigned int type;
+            /** Position of the reference from the Component part of the component. */
+            ptrdiff_t offset;
+            /** Position of the referenced entity on the region file. */
+            unsigned int position;
+        };
+        /**
+         * \brief A streamed region.
+         */
+        struct _Region {
+            /** State of the region. */
+            RegionState state;
+            /** Entities of the region. */
+            std::vector<EntityId> ids;
+            /** Region file being committed. */
+            std::vector<char> data;
+            /** Reader of the file, NULL until its first batch. */
+            SnapshotReader * reader;
+            /** Type of each entry of the type table of the file. */
+            std::vector<unsigned int> types;
+            /** Entities of the file, sorted by their old ids. */
+            std::vector<RegionEntity> entities;
+            /** Count of entities of each batch of the file. */
+            std::vector<unsigned int> sizes;
+            /** Position of the first entity of each batch of the file. */
+            std::vector<unsigned int> firsts;
+            /** References to the entities of each batch, until it is committed. */
+            std::vector<std::vector<_RegionLink> > links;
+            /** Next batch. */
+            unsigned int batch;
+            /** Components of the batch being committed. */
+            std::vector<unsigned int> batch_types;
+            /** Writer of the copies of an unloading region, NULL until its first batch. */
+            SnapshotWriter * writer;
+            /** Copies of an unloading region. */
+            RegionStage stage;
+            /** Next entity of ids to copy. */
+            unsigned int next;
+            /** Entities copied by the last batch. */
+            std::vector<EntityId> staged;
+            _Region() : state(REGION_UNLOADED), reader(NULL), batch(0), writer(NULL), next(0) {}
+        };
+        /**
+         * \brief Commit batches of the read regions, in order, then copy batches of the
+         * unloading ones, up to a count of entities. The first batch is always done.
+         */
+        void _commit_regions(unsigned int budget);
+        /**
+         * \brief Read the index of a region file.
+         */
+        void _open_region(_Region & region);
+        /**
+         * \brief Commit the next batch of a read region.
+         * \return Count of entities committed.
+         */
+        unsigned int _commit_batch(_Region & region);
+        /**
+         * \brief Copy and despawn the next entities of an unloading region, and queue
+         * its file once all are.
+         * \param n Max count of entities.
+         * \return Count of entities copied.
+         */
+        unsigned int _stage_batch(unsigned int region, unsigned int n);
+        /**
+         * \brief Take the finished jobs of the streamer.
+         * \param block Wait for the reads of the loading regions.
+         */
+        void _take_regions(bool block);
+        /**
+         * \brief Record a component or tag of an entity.
+         * \param record JOURNAL_ADD, JOURNAL_REMOVE or JOURNAL_VALUE, which writes its value.
+         * \param uid UID of the value, if not the one of the entity.
+         */
+        void _journal_component(unsigned char record, unsigned int type, EntityId id, unsigned int uid=NO_COMPONENT);
+        /**
+         * \brief Remember components that may be written before the next tick.
+         * Their values are recorded then. Shared values and tags are not.
+         */
+        void _journal_values(unsigned int type, const EntityId * ids, unsigned int n);
+        /**
+         * \brief Record the values of the remembered components.
+         */
+        void _journal_flush();
+        /**
+         * \brief Get the id of a component type on the journal, defining it on first use.
+         */
+        unsigned int _journal_type(unsigned int type);
+        /**
+         * \brief Apply the records of a journal frame.
+         * \param types Type of each type id of the journal, defined by the records.
+         */
+        void _replay(SnapshotReader & r, std::vector<unsigned int> & types);
+        /**
+         * \brief Read the count and the ids of the entities of a journal record.
+         */
+        static void _replay_ids(SnapshotReader & r, std::vector<EntityId> & ids);
+        /**
+         * \brief Load the world from a snapshot.
+         * \see load_snapshot().
+         */
+        void _load_snapshot(SnapshotReader & r);
+        /**
+         * \brief Save the changes since the base tick.
+         * \see save_delta().
+         */
+        void _save_delta(std::vector<char> & out);
+        /**
+         * \brief Make the component types of this engine known by another one.
+         */
+        void _declare_types(Engine & e);
+        /**
+         * \brief Copy the resources, prefabs and processors to an engine copying this one.
+         */
+        void _copy_setup(Engine & e);
+        /**
+         * \brief Write the frame to undo the last tick.
+         */
+        void _rollback_save();
+        /**
+         * \brief Fill a frame with the changes as they are on the world of the last tick,
+         * and bring it to the current one.
+         */
+        void _rollback_frame(RollbackFrame & f);
+        /**
+         * \brief Add a component of an entity to a frame, and bring it on the world of the last tick.
+         */
+        void _rollback_block(RollbackFrame & f, unsigned int type, unsigned int index);
+        /**
+         * \brief Size the world of the last tick for the slots, tags and types of the engine.
+         */
+        void _rollback_grow();
+        /**
+         * \brief Undo the changes of a frame, on the engine and on the world of the last tick.
+         */
+        void _rollback_apply(RollbackFrame & f);
+        /**
+         * \brief Change the status of a batch of entities.
+         * \param ids Ids of the entities.
+         * \param active New status.
+         */
+        void _set_active(Span<const EntityId> ids, bool active);
+        /**
+         * \brief Get the ids of a batch of Entity objects of this engine.
+         */
+        std::vector<EntityId> _get_ids(Span<Entity * const> entities);
+        /**
+         * \brief Destroy a batch of entities and their descendants.
+         * \param ids Living entities, plain or not, without repetitions.
+         */
+        void _despawn(Span<const EntityId> ids);
+        /**
+         * \brief Destroy a batch of entities, plain or not, without their descendants.
+         */
+        void _destroy(Span<const EntityId> ids);
+        /**
+         * \brief Notify the listeners of a batch of plain entities, and destroy them.
+         * Components are freed type by type.
+         */
+        void _despawn_plain(Span<const EntityId> ids);
+        /**
+         * \brief Unlink an Entity, without its descendants.
+         */
+        void _unlink_entity(Entity * e);
+        /**
+         * \brief A processor waiting on a schedule queue.
+         */
+        struct _ScheduledProcessor {
+            /** Clock or tick when the processor is due. */
+            unsigned long long due;
+            /** The processor. */
+            Processor * processor;
+        };
+        /**
+         * \brief A processor due on the current tick.
+         */
+        struct _DueProcessor {
+            /** The processor, NULL if removed during the tick. */
+            Processor * processor;
+            /** Delay to pass to run_tick. */
+            unsigned int delay;
+            /** Times run_tick has to be called. */
+            unsigned int steps;
+        };
+        /**
+         * \brief Heap order of schedule queues. Earliest due on top.
+         */
+        static bool _due_later(const _ScheduledProcessor & a, const _ScheduledProcessor & b);
+        /**
+         * \brief Run order of due processors. Priority asc, then insertion order.
+         */
+        static bool _run_before(const _DueProcessor & a, const _DueProcessor & b);
+        /**
+         * \brief Put an active processor on its schedule queue.
+         */
+        void _schedule_processor(Processor * p);
+        /**
+         * \brief Take a processor out of its schedule queue.
+         */
+        void _unschedule_processor(Processor * p);
+        /**
+         * \brief Move the processors due at now from a queue to _due, and requeue them.
+         * \param queue Schedule queue.
+         * \param now Current tick or clock, depending on the queue.
+         * \param delay Delay of the current tick.
+         */
+        void _pop_due(std::vector<_ScheduledProcessor> & queue, unsigned long long now, unsigned int delay);
+        /**
+         * \brief Remove all entities that are waiting to be removed.
+         *
+         * This method is called at the end of a run_tick call. This succesfully remove entites,
+         * calling the EntityListeners.
+         */
+        void _remove_entities();
+        /**
+         * \brief Remove an Entity.
+         *
+         * Call the EntityListeners, remove components and remove the Entity.
+         */
+        void _remove_entity(Entity * e);
+        /**
+         * \brief Call the listeners for an Entity.
+         * \param e Entity added / removed.
+         * \param add Determine if the Entity was Added (true) or removed (false).
+         */
+        void _call_listeners(Entity * e, bool add=true);
+        /**
+         * \brief Call the listeners for a batch of added plain entities.
+         * \param ids Entities added.
+         * \param types Component types owned by all the entities.
+         * \param n Count of types.
+         */
+        void _call_listeners(Span<const EntityId> ids, const unsigned int * types, unsigned int n);
+        /**
+         * \brief Call the listeners for a batch of plain entities about to be removed.
+         * \param ids Entities removed.
+         */
+        void _call_listeners(Span<const EntityId> ids);
+        /**
+         * \brief Sum of the delays passed to run_tick.
+         */
+        unsigned long long _clock;
+        /**
+         * \brief Count of ticks run.
+         */
+        unsigned long long _tick;
+        /**
+         * \brief Incremented on every change of entities or components.
+         * Used to know when cached family results are stale.
+         */
+        unsigned long long _version;
+        /**
+         * \brief Base tick of the next delta.
+         */
+        unsigned long long _delta_tick;
+        /**
+         * \brief Journal of the commands, NULL if not recording.
+         */
+        Journal * _journal;
+        /**
+         * \brief Recorded commands in progress: the changes they do are not recorded.
+         */
+        unsigned int _journal_mute;
+        /**
+         * \brief Components added or written since the last tick (type, entity).
+         */
+        std::vector<std::pair<unsigned int, EntityId> > _journal_pending;
+        /**
+         * \brief A journal is being replayed: listeners are not called.
+         */
+        bool _replaying;
+        /**
+         * \brief Frames to undo the last ticks, NULL if rollback is off.
+         */
+        RollbackBuffer * _rollback;
+        /**
+         * \brief I/O thread of the regions, NULL if not streaming.
+         */
+        RegionStreamer * _streamer;
+        /**
+         * \brief Max entities committed per tick.
+         */
+        unsigned int _stream_budget;
+        /**
+         * \brief Streamed regions, by identifier.
+         */
+        std::map<unsigned int, _Region> _regions;
+        /**
+         * \brief Regions being loaded, in order.
+         */
+        std::deque<unsigned int> _loading;
+        /**
+         * \brief Regions being unloaded, in order.
+         */
+        std::deque<unsigned int> _unloading;
+        /**
+         * \brief Insertion counter for processors.
+         */
+        unsigned int _processor_order;
+        /**
+         * \brief Processors scheduled by tick count (heap).
+         */
+        std::vector<_ScheduledProcessor> _tick_queue;
+        /**
+         * \brief Processors scheduled by clock (heap).
+         */
+        std::vector<_ScheduledProcessor> _time_queue;
+        /**
+         * \brief Processors due on the current tick.
+         */
+        std::vector<_DueProcessor> _due;
+        /**
+         * \brief Tasks of the engine.
+         */
+        TaskQueue _tasks;
+        /**
+         * \brief Events of the engine.
+         */
+        EventBus _events;
+        /**
+         * \brief Output pipeline. NULL if not in pipelined mode.
+         */
+        Pipeline * _pipeline;
+        /**
+         * \brief Components copied to the pipeline snapshots (class string, cache).
+         */
+        std::vector<std::pair<std::string, _Cache *> > _extracted;
+        /**
+         * \brief Shared memory export. NULL if not exporting.
+         */
+        SharedExport * _export;
+        /**
+         * \brief Caches of the exported types, in the order of the segment.
+         */
+        std::vector<_Cache *> _exported;
+        /**
+         * \brief Determines if  the engine is ticking processors.
+         * If the engine is ticking processors, the deletion of entities will be
          * delayed until we tick all processors.
          */
         bool _ticking;
@@ -282,18 +1963,46 @@ namespace CAshley {
          */
         std::vector<Entity *> _entities_to_remove;
         /**
-         * \brief The set of all entities of the engine.
+         * \brief Plain entities we want to remove during a tick.
+         */
+        std::vector<EntityId> _ids_to_remove;
+        /**
+         * \brief Registry of all the entities, plain or not.
+         */
+        EntityRegistry _registry;
+        /**
+         * \brief Parent / child links of the entities.
+         */
+        Hierarchy _hierarchy;
+        /**
+         * \brief Singleton resources of the engine.
+         */
+        ResourceSet _resources;
+        /**
+         * \brief Mapped snapshots whose components may be in use.
          */
-        std::set<Entity *> _entities;
+        std::vector<SnapshotMapping *> _mappings;
         /**
          * \brief The set of processors of the engine.
          * Key is the priority of the processor.
          */
         std::multimap<unsigned int, Processor *> _processors;
         /**
-         * \brief Component caches of the engine.
+         * \brief Registered prefabs.
+         */
+        std::vector<Prefab *> _prefabs;
+        /**
+         * \brief Component types of the engine, by TypeId<Component, T>.
+         */
+        std::vector<_ComponentType> _component_types;
+        /**
+         * \brief Count of tag types, the next tag bit.
+         */
+        unsigned int _tag_count;
+        /**
+         * \brief Component types of the engine, by class string.
          */
-        std::map<std::string, _Cache *> _components;
+        std::map<std::string, unsigned int> _component_ids;
         /**
          * \brief Set of EntityListeners of the engine.
          * Key is the priority of the EntityListener.
@@ -19,18 +19,27 @@
 #ifndef __CASHLEY_ENTITY_H
 #define __CASHLEY_ENTITY_H
 
-#include <map>
 #include <type_traits>
 
 #include "common.h"
 #include "component.h"
 #include "engine.h"
 #include "exceptions.h"
+#include "smallvector.h"
+#include "typeid.h"
 
 #define CASHLEY_ENTITY friend class CAshley::Engine;
 
+/**
+ * \brief Components an Entity stores without heap allocations.
+ */
+#define ENTITY_INLINE_COMPONENTS 4
+
 namespace CAshley {
 
+    class TaskNode;
+    class TaskQueue;
+
     class Entity {
     public:
         /**
@@ -66,17 +75,7 @@ namespace CAshley {
                 EntityError e("Entity not installed on an engine.");
                 throw e;
             }
-            if (has_component<T>()) {
-                EntityError e("Component duplicate.");
-                throw e;
-            }
-            std::pair<std::string, unsigned int> component_index = _engine->get_component<T>();
-            _components[component_index.first] = component_index.second;
-            _engine->get_component<T>(component_index.second)->set_owner(this);
-            _engine->get_component<T>(component_index.second)->init();
-            if (_active) {
-                _engine->activate_component(component_index.first, component_index.second);
-            }
+            _engine->add_component<T>(_id);
         }
 
         /**
@@ -89,8 +88,10 @@ namespace CAshley {
                 ComponentError e("Invalid component class");
                 throw e;
             }
-            T x;
-            return has_component(x.get_name());
+            if (is_tag<T>::value) {
+                return _engine && _engine->_has_component(TypeId<Component, T>::get(), _id.index);
+            }
+            return _find_slot(TypeId<Component, T>::get()) != NO_COMPONENT;
         }
 
         /**
@@ -110,12 +111,17 @@ namespace CAshley {
                 ComponentError e("Invalid component class");
                 throw e;
             }
-            T x;
-            if (_components.find(x.get_name()) == _components.end()) {
-                ComponentError e("Component not found");
-                throw e;
+            unsigned int type = TypeId<Component, T>::get();
+            if (is_tag<T>::value && has_component<T>()) {
+                return _engine->_get_cache<T>(type)->get_block(0);
+            }
+            for (unsigned int i = 0; i < _components.size(); i++) {
+                if (_components[i].type == type) {
+                    return _engine->_get_cache<T>(type)->get_block(_components[i].uid);
+                }
             }
-            return _engine->get_component<T>(_components[x.get_name()]);
+            ComponentError e("Component not found");
+            throw e;
         }
 
         /**
@@ -127,12 +133,16 @@ namespace CAshley {
                 ComponentError e("Invalid component class");
                 throw e;
             }
-            T x;
-            if (_components.find(x.get_name()) == _components.end()) {
+            unsigned int type = TypeId<Component, T>::get();
+            if (!has_component<T>()) {
                 ComponentError e("Component not found");
                 throw e;
             }
-            _remove_component(x.get_name());
+            if (is_tag<T>::value) {
+                _engine->_set_tag(_id.index, type, false);
+            } else {
+                _engine->_detach_component(_id.index, type);
+            }
         }
 
         /**
@@ -160,14 +170,59 @@ namespace CAshley {
          */
         inline bool is_active() { return _active; }
 
+        /**
+         * \brief Get the id of the Entity in the engine registry.
+         * \return The id, null if not linked to an engine.
+         */
+        inline EntityId get_id() { return _id; }
+
         friend class Engine;
+        friend class TaskQueue;
 
     private:
         /**
-         * \brief Removes a component.
-         * \param s class name of the component.
+         * \brief A component of the Entity.
+         */
+        struct _ComponentSlot {
+            /** Component type (TypeId<Component, T>). */
+            unsigned int type;
+            /** UID of the component in the cache of its type. */
+            unsigned int uid;
+        };
+        /**
+         * \brief Find a component of the Entity.
+         * \param type Component type.
+         * \return Position in _components, or NO_COMPONENT.
+         */
+        inline unsigned int _find_slot(unsigned int type) {
+            for (unsigned int i = 0; i < _components.size(); i++) {
+                if (_components[i].type == type) {
+                    return i;
+                }
+            }
+            return NO_COMPONENT;
+        }
+        /**
+         * \brief Suspend a task until a component of this Entity changes.
+         */
+        void _wait(TaskNode * t);
+        /**
+         * \brief Stop a task from waiting on this Entity.
          */
-        void _remove_component(std::string s);
+        void _unwait(TaskNode * t);
+        /**
+         * \brief Wake up the tasks waiting on a component.
+         * \param type Type of the component.
+         */
+        void _wake_waiters(unsigned int type);
+        /**
+         * \brief Wake up all the waiting tasks, telling them the Entity is gone.
+         */
+        void _wake_all_waiters();
+        /**
+         * \brief Tasks waiting on a component change of this Entity.
+         */
+        TaskNode * _waiters;
         /**
          * \brief Is the Entity active?
          */
@@ -177,9 +232,13 @@ namespace CAshley {
          */
         Engine * _engine;
         /**
-         * \brief Set of components of the Entity (class string, UID).
+         * \brief Id in the registry of the linked engine.
+         */
+        EntityId _id;
+        /**
+         * \brief Components of the Entity, unordered.
          */
-        std::map<std::string, unsigned int> _components;
+        SmallVector<_ComponentSlot, ENTITY_INLINE_COMPONENTS> _components;
     };
 
 }
@@ -19,6 +19,9 @@
 #ifndef __CASHLEY_ENTITYLISTENER_H
 #define __CASHLEY_ENTITYLISTENER_H
 
+#include "registry.h"
+#include "span.h"
+
 namespace CAshley{
 
     class Entity;
@@ -38,6 +41,21 @@ namespace CAshley{
          * \param e Entity removed.
          */
         virtual void entity_removed(Entity * e) = 0;
+        /**
+         * \brief Method called when plain entities are added.
+         * Called once per Engine::create_entity() or Engine::spawn_n() batch, with
+         * the entities of the batch that belong to the family of the listener.
+         * \param ids Entities added. Only valid during the call.
+         */
+        virtual void entities_added(Span<const EntityId> ids) { (void)ids; }
+        /**
+         * \brief Method called when plain entities are removed.
+         * Called once per Engine::destroy_entity() or Engine::despawn() batch, with
+         * the entities of the batch that belong to the family of the listener.
+         * Their components are still available.
+         * \param ids Entities removed. Only valid during the call.
+         */
+        virtual void entities_removed(Span<const EntityId> ids) { (void)ids; }
         virtual ~EntityListener() {};
     };
 }
@@ -0,0 +1,316 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_EVENTBUS_H
+#define __CASHLEY_EVENTBUS_H
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+#include "exceptions.h"
+#include "span.h"
+#include "typeid.h"
+
+/**
+ * \brief Events in the first block of an EventQueue. Each next block doubles the previous one.
+ */
+#define EVENT_QUEUE_BLOCK 1024
+/**
+ * \brief Max blocks of an EventQueue. Its capacity, EVENT_QUEUE_BLOCK * (2^blocks - 1), must fit in 32 bits.
+ */
+#define EVENT_QUEUE_BLOCKS 22
+/**
+ * \brief Max event types of an EventBus.
+ */
+#define EVENT_BUS_TYPES 256
+
+namespace CAshley {
+
+    /**
+     * \brief Abstract class to allow EventBus store EventQueue * together.
+     * @see EventQueue.
+     */
+    class _EventQueue {
+    public:
+        virtual ~_EventQueue() {}
+        virtual void clear() = 0;
+    };
+
+    /**
+     * \brief Append-only queue of events of a type.
+     *
+     * Events are stored on blocks that never move, so appending is lock-free and
+     * safe from several threads: a slot is reserved with an atomic increment and
+     * blocks are installed with a compare and swap. Blocks are kept on clear(), so
+     * once the queue has grown, it does not allocate anymore.
+     *
+     * Readers must not run at the same time as writers.
+     */
+    template <class T>
+    class EventQueue : public _EventQueue {
+    public:
+        /**
+         * \brief Constructor.
+         * \param blocks Max blocks, up to EVENT_QUEUE_BLOCKS.
+         */
+        explicit EventQueue(unsigned int blocks=EVENT_QUEUE_BLOCKS) : _size(0) {
+            _capacity = _block_start(blocks < EVENT_QUEUE_BLOCKS ? blocks : EVENT_QUEUE_BLOCKS);
+            for (unsigned int i = 0; i < EVENT_QUEUE_BLOCKS; i++) {
+                _blocks[i] = NULL;
+            }
+        }
+
+        virtual ~EventQueue() {
+            clear();
+            for (unsigned int i = 0; i < EVENT_QUEUE_BLOCKS; i++) {
+                ::operator delete(_blocks[i].load());
+            }
+        }
+
+        /**
+         * \brief Append an event. Safe to call from several threads.
+         * \param e Event to append.
+         * \throw CAshleyError if the queue is full.
+         */
+        void push(const T & e) {
+            unsigned int i = _size.fetch_add(1);
+            if (i >= _capacity) {
+                // Give the slot back, so the count never wraps.
+                _size.fetch_sub(1);
+                CAshleyError err("Event queue is full.");
+                throw err;
+            }
+            unsigned int b = _block(i);
+            T * block = _blocks[b].load(std::memory_order_acquire);
+            if (!block) {
+                T * n = static_cast<T *>(::operator new(sizeof(T) * _block_size(b)));
+                if (_blocks[b].compare_exchange_strong(block, n, std::memory_order_acq_rel)) {
+                    block = n;
+                } else {
+                    ::operator delete(n);
+                }
+            }
+            new (block + (i - _block_start(b))) T(e);
+        }
+
+        /**
+         * \brief Get the count of events.
+         */
+        inline unsigned int size() { return _size.load(std::memory_order_acquire); }
+
+        /**
+         * \brief Get the count of contiguous spans of events.
+         */
+        unsigned int spans() {
+            unsigned int s = size();
+            return s ? _block(s - 1) + 1 : 0;
+        }
+
+        /**
+         * \brief Get a contiguous span of events.
+         * \param i Index of the span, lower than spans().
+         */
+        Span<T> span(unsigned int i) {
+            unsigned int s = size(), start = _block_start(i), len = _block_size(i);
+            if (start >= s) {
+                return Span<T>();
+            }
+            if (start + len > s) {
+                len = s - start;
+            }
+            return Span<T>(_blocks[i].load(std::memory_order_acquire), len);
+        }
+
+        /**
+         * \brief Get an event.
+         * \param i Index of the event, lower than size().
+         */
+        T & operator[](unsigned int i) {
+            unsigned int b = _block(i);
+            return _blocks[b].load(std::memory_order_relaxed)[i - _block_start(b)];
+        }
+
+        /**
+         * \brief Remove all the events, keeping the memory.
+         */
+        virtual void clear() {
+            if (!std::is_trivially_destructible<T>::value) {
+                unsigned int n = spans();
+                for (unsigned int i = 0; i < n; i++) {
+                    Span<T> s = span(i);
+                    for (unsigned int j = 0; j < s.size(); j++) {
+                        s[j].~T();
+                    }
+                }
+            }
+            _size.store(0, std::memory_order_release);
+        }
+
+    private:
+        /**
+         * \brief Block of an event index.
+         */
+        static unsigned int _block(unsigned int i) {
+            unsigned int j = i / EVENT_QUEUE_BLOCK + 1, b = 0;
+            while (j >>= 1) {
+                b++;
+            }
+            return b;
+        }
+        /**
+         * \brief Index of the first event of a block.
+         */
+        static unsigned int _block_start(unsigned int b) {
+            return (unsigned int)(EVENT_QUEUE_BLOCK * ((1ull << b) - 1));
+        }
+        /**
+         * \brief Count of events of a block.
+         */
+        static unsigned int _block_size(unsigned int b) {
+            return EVENT_QUEUE_BLOCK << b;
+        }
+        /**
+         * \brief Count of events (reserved slots).
+         */
+        std::atomic<unsigned int> _size;
+        /**
+         * \brief Max count of events, that fits in its blocks.
+         */
+        unsigned int _capacity;
+        /**
+         * \brief Blocks of events. NULL until used.
+         */
+        std::atomic<T *> _blocks[EVENT_QUEUE_BLOCKS];
+    };
+
+    /**
+     * \brief Typed events exchanged between processors.
+     *
+     * Each event type has two queues: the events emitted on the current tick and the
+     * events emitted on the previous one. flip() is called by the Engine at the end
+     * of each tick, so processors can read the events of any other processor,
+     * no matter their priorities. Queues are reused, not reallocated.
+     */
+    class EventBus {
+    public:
+        EventBus() {
+            for (unsigned int i = 0; i < EVENT_BUS_TYPES; i++) {
+                _current[i] = NULL;
+                _last[i] = NULL;
+            }
+        }
+
+        ~EventBus() {
+            for (unsigned int i = 0; i < EVENT_BUS_TYPES; i++) {
+                delete _current[i].load();
+                delete _last[i].load();
+            }
+        }
+
+        /**
+         * \brief Emit an event. Safe to call from several threads.
+         * \param e Event.
+         */
+        template <class T>
+        void emit(const T & e) {
+            _queue<T>(_current)->push(e);
+        }
+
+        /**
+         * \brief Get the events of a type emitted on the current tick.
+         * \return Queue of events.
+         */
+        template <class T>
+        EventQueue<T> & get_events() {
+            return *_queue<T>(_current);
+        }
+
+        /**
+         * \brief Get the events of a type emitted on the previous tick.
+         * \return Queue of events.
+         */
+        template <class T>
+        EventQueue<T> & get_last_events() {
+            return *_queue<T>(_last);
+        }
+
+        /**
+         * \brief End a tick: current events become the previous ones.
+         */
+        void flip() {
+            for (unsigned int i = 0; i < EVENT_BUS_TYPES; i++) {
+                _EventQueue * last = _last[i].load(std::memory_order_relaxed);
+                if (last) {
+                    last->clear();
+                    _last[i].store(_current[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    _current[i].store(last, std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        /**
+         * \brief Get (and create if needed) the queue of a type.
+         */
+        template <class T>
+        EventQueue<T> * _queue(std::atomic<_EventQueue *> * queues) {
+            unsigned int id = TypeId<EventBus, T>::get();
+            if (id >= EVENT_BUS_TYPES) {
+                CAshleyError err("Too many event types.");
+                throw err;
+            }
+            _EventQueue * q = queues[id].load(std::memory_order_acquire);
+            if (!q) {
+                _create<T>(id);
+                q = queues[id].load(std::memory_order_acquire);
+            }
+            return static_cast<EventQueue<T> *>(q);
+        }
+
+        /**
+         * \brief Create both queues of a type. Safe to call from several threads.
+         */
+        template <class T>
+        void _create(unsigned int id) {
+            _EventQueue * expected = NULL;
+            _EventQueue * q = new EventQueue<T>;
+            if (!_last[id].compare_exchange_strong(expected, q)) {
+                delete q;
+            }
+            expected = NULL;
+            q = new EventQueue<T>;
+            if (!_current[id].compare_exchange_strong(expected, q)) {
+                delete q;
+            }
+        }
+
+        /**
+         * \brief Queues of the current tick, by event type.
+         */
+        std::atomic<_EventQueue *> _current[EVENT_BUS_TYPES];
+        /**
+         * \brief Queues of the previous tick, by event type.
+         */
+        std::atomic<_EventQueue *> _last[EVENT_BUS_TYPES];
+    };
+}
+
+#endif //__CASHLEY_EVENTBUS_H
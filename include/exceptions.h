@@ -53,6 +53,14 @@ namespace CAshley {
         ComponentError(const char *msg) noexcept;
     };
 
+    /**
+     * \brief Engine errors.
+     */
+    class EngineError : public CAshleyError {
+    public:
+        EngineError(const char *msg) noexcept;
+    };
+
     /**
      * \brief Entity errors.
      */
@@ -84,6 +92,70 @@ namespace CAshley {
     public:
         EntityListenerError(const char *msg) noexcept;
     };
+
+    /**
+     * \brief Resource errors.
+     */
+    class ResourceError : public CAshleyError {
+    public:
+        ResourceError(const char *msg) noexcept;
+    };
+
+    /**
+     * \brief Snapshot errors.
+     */
+    class SnapshotError : public CAshleyError {
+    public:
+        SnapshotError(const char *msg) noexcept;
+    };
+
+    /**
+     * \brief Journal errors.
+     */
+    class JournalError : public CAshleyError {
+    public:
+        JournalError(const char *msg) noexcept;
+    };
+
+    /**
+     * \brief Rollback errors.
+     */
+    class RollbackError : public CAshleyError {
+    public:
+        RollbackError(const char *msg) noexcept;
+    };
+
+    /**
+     * \brief Replication errors.
+     */
+    class ReplicationError : public CAshleyError {
+    public:
+        ReplicationError(const char *msg) noexcept;
+    };
+
+    /**
+     * \brief Region streaming errors.
+     */
+    class StreamingError : public CAshleyError {
+    public:
+        StreamingError(const char *msg) noexcept;
+    };
+
+    /**
+     * \brief Shared memory export errors.
+     */
+    class ExportError : public CAshleyError {
+    public:
+        ExportError(const char *msg) noexcept;
+    };
+
+    /**
+     * \brief Task errors.
+     */
+    class TaskError : public CAshleyError {
+    public:
+        TaskError(const char *msg) noexcept;
+    };
 }
 
 #endif //__CASHLEY_ERRORS_H
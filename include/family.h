@@ -26,10 +26,12 @@
 
 #include "component.h"
 #include "inmutablearray.h"
+#include "registry.h"
 
 namespace CAshley {
 
     class Entity;
+    class Engine;
 
     /**
      * \brief InmutableArray of Entity *, for families.
@@ -122,11 +124,67 @@ namespace CAshley {
         /**
          * \brief Return the entities that are valid for the family.
          */
-        EntityArray _filter_entities(const std::set<Entity *> & entities);
+        EntityArray _filter_entities(const EntityRegistry & registry);
         /**
          * \brief Check if a single Entity is valid for this family.
          */
         bool _filter_entity(Entity * e, bool exclude_inactive=true);
+        /**
+         * \brief Add or remove an Entity from entities filtered before, as it is now.
+         * \param entities Result of _filter_entities(), ordered by slot.
+         */
+        void _update_entity(EntityArray & entities, Entity * e);
+        /**
+         * \brief Return the ids of the active entities of an engine that are valid for the family.
+         */
+        EntityIdArray _filter_ids(Engine & engine);
+        /**
+         * \brief The family conditions as component types of an engine.
+         */
+        struct _Query {
+            /** Types filtered. */
+            std::vector<unsigned int> filter;
+            /** Types excluded. Unknown types are skipped. */
+            std::vector<unsigned int> exclude;
+            /** Sets of ones. Unknown types are skipped. */
+            std::vector<std::vector<unsigned int> > one;
+            /** Tags filtered, as bits by word. */
+            std::vector<unsigned long long> filter_tags;
+            /** Tags excluded, as bits by word. */
+            std::vector<unsigned long long> exclude_tags;
+            /** Tags of each set of ones, as bits by word. */
+            std::vector<std::vector<unsigned long long> > one_tags;
+        };
+        /**
+         * \brief Resolve the class strings of the family to the component types of an engine.
+         * \return false if no entity of the engine can be valid.
+         */
+        bool _resolve(Engine & engine, _Query & q);
+        /**
+         * \brief Check if an entity of a registry is valid for a query. Activation is not checked.
+         */
+        static bool _match(const EntityRegistry & registry, const _Query & q, unsigned int index);
+        /**
+         * \brief Check if an entity owning a set of component types is valid for a query.
+         * Tags are read from the registry.
+         */
+        static bool _match(const _Query & q, const unsigned int * types, unsigned int n, const EntityRegistry & registry, unsigned int index);
+        /**
+         * \brief Order of the entities in the results, by slot.
+         */
+        static bool _before(Entity * a, Entity * b);
+        /**
+         * \brief Check the tags of an entity against bits by word.
+         * \param all Need all the bits (true) or any of them (false).
+         */
+        static bool _match_tags(const EntityRegistry & registry, const std::vector<unsigned long long> & tags, unsigned int index, bool all);
+        /**
+         * \brief Add a condition of a family to a query.
+         * \param types Types of the condition.
+         * \param tags Tags of the condition.
+         * \return false if the type is unknown.
+         */
+        static bool _resolve(Engine & engine, const std::string & c, std::vector<unsigned int> & types, std::vector<unsigned long long> & tags);
         /**
          * Set of components filtered.
          */
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_HIERARCHY_H
+#define __CASHLEY_HIERARCHY_H
+
+#include <vector>
+
+#include "registry.h"
+#include "snapshot.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Parent / child links between the entities of an Engine.
+     *
+     * Links are intrusive lists indexed by entity slot, so changing them never
+     * allocates once the arrays cover the slots. For propagation, the linked
+     * entities are also kept in a dense order: one contiguous run per root tree,
+     * each run in breadth first order, so parents always come before their
+     * children. The order is rebuilt on demand after the links change.
+     * Used through the Engine (Engine::set_parent(), Engine::propagate()...).
+     */
+    class Hierarchy {
+    public:
+        Hierarchy();
+
+        /**
+         * \brief Link an entity to a parent, or unlink it.
+         * \param child Slot of the child.
+         * \param parent Slot of the parent, or NO_COMPONENT to unlink.
+         */
+        void set_parent(unsigned int child, unsigned int parent);
+
+        /**
+         * \brief Unlink an entity from its parent and children.
+         * Children become roots.
+         * \param index Slot of the entity.
+         */
+        void remove(unsigned int index);
+
+        /**
+         * \brief Get the parent of an entity.
+         * \return Slot of the parent, or NO_COMPONENT.
+         */
+        inline unsigned int get_parent(unsigned int index) const {
+            return index < _parent.size() ? _parent[index] : NO_COMPONENT;
+        }
+
+        /**
+         * \brief Get the first child of an entity.
+         * \return Slot of the child, or NO_COMPONENT.
+         */
+        inline unsigned int get_first_child(unsigned int index) const {
+            return index < _first_child.size() ? _first_child[index] : NO_COMPONENT;
+        }
+
+        /**
+         * \brief Get the next child of the parent of an entity.
+         * \return Slot of the sibling, or NO_COMPONENT.
+         */
+        inline unsigned int get_next_sibling(unsigned int index) const {
+            return index < _next_sibling.size() ? _next_sibling[index] : NO_COMPONENT;
+        }
+
+        /**
+         * \brief Check if an entity is an ancestor of another.
+         */
+        bool is_ancestor(unsigned int ancestor, unsigned int index) const;
+
+        /**
+         * \brief Get the count of ancestors of an entity.
+         */
+        unsigned int get_depth(unsigned int index) const;
+
+        /**
+         * \brief Add the descendants of an entity to a list, parents first.
+         * \param index Slot of the entity.
+         * \param out List.
+         */
+        void get_descendants(unsigned int index, std::vector<unsigned int> & out) const;
+
+        /**
+         * \brief Mark an entity as changed. Its subtree will be visited by the next propagation.
+         * \param index Slot of the entity.
+         */
+        void mark_dirty(unsigned int index);
+
+        /**
+         * \brief Rebuild the dense order if the links changed.
+         */
+        void update();
+
+        /**
+         * \brief Get the count of root trees in the dense order.
+         */
+        inline unsigned int get_root_count() const { return _roots.size(); }
+
+        /**
+         * \brief Check if there are linked entities.
+         */
+        inline bool empty() const { return !_links; }
+
+        /**
+         * \brief Write the links to a snapshot.
+         */
+        void save(SnapshotWriter & w) const;
+
+        /**
+         * \brief Read the links written by save().
+         * All the entities are marked as changed.
+         */
+        void load(SnapshotReader & r);
+
+        friend class Engine;
+    private:
+        /**
+         * \brief An entity in the dense order.
+         */
+        struct _Node {
+            /** Slot of the entity. */
+            unsigned int index;
+            /** Position of the parent in the dense order, NO_COMPONENT for roots. */
+            unsigned int parent;
+            /** Visited by the running propagation. */
+            bool visit;
+        };
+        /**
+         * \brief Grow the link arrays to cover a slot.
+         */
+        void _reserve(unsigned int index);
+        /**
+         * \brief Get the root of the tree of an entity.
+         */
+        unsigned int _root(unsigned int index) const;
+        /**
+         * \brief Parent of each slot.
+         */
+        std::vector<unsigned int> _parent;
+        /**
+         * \brief First child of each slot.
+         */
+        std::vector<unsigned int> _first_child;
+        /**
+         * \brief Next child of the parent of each slot.
+         */
+        std::vector<unsigned int> _next_sibling;
+        /**
+         * \brief Previous child of the parent of each slot.
+         */
+        std::vector<unsigned int> _prev_sibling;
+        /**
+         * \brief Changed entities, by slot.
+         */
+        std::vector<unsigned char> _dirty;
+        /**
+         * \brief Trees with changed entities, by slot of the root.
+         */
+        std::vector<unsigned char> _dirty_tree;
+        /**
+         * \brief Dense order, one run per root.
+         */
+        std::vector<_Node> _order;
+        /**
+         * \brief Slot of each root of the dense order.
+         */
+        std::vector<unsigned int> _roots;
+        /**
+         * \brief Start of the run of each root in _order, plus the end.
+         */
+        std::vector<unsigned int> _root_begin;
+        /**
+         * \brief Count of parent links.
+         */
+        unsigned int _links;
+        /**
+         * \brief The links changed since the last update().
+         */
+        bool _changed;
+    };
+}
+
+#endif //__CASHLEY_HIERARCHY_H
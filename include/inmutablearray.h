@@ -61,7 +61,7 @@ namespace CAshley {
             _alloc_size = i._alloc_size;
             _size = i._size;
             _v = new T[_alloc_size];
-            memcpy(_v, i._v, _alloc_size);
+            memcpy(_v, i._v, sizeof(T) * _alloc_size);
         }
 
         /**
@@ -72,7 +72,7 @@ namespace CAshley {
             _alloc_size = i._alloc_size;
             _size = i._size;
             _v = new T[_alloc_size];
-            memcpy(_v, i._v, _alloc_size);
+            memcpy(_v, i._v, sizeof(T) * _alloc_size);
         }
 
         /**
@@ -136,6 +136,23 @@ namespace CAshley {
             _v[_size] = t;
             _size++;
         }
+        /**
+         * \brief Insert a element on a position.
+         * This method can only be called by Family.
+         */
+        void _insert(unsigned int i, T t) {
+            _push_back(t);
+            memmove(_v + i + 1, _v + i, (_size - 1 - i) * sizeof(T));
+            _v[i] = t;
+        }
+        /**
+         * \brief Remove the element on a position.
+         * This method can only be called by Family.
+         */
+        void _erase(unsigned int i) {
+            memmove(_v + i, _v + i + 1, (_size - 1 - i) * sizeof(T));
+            _size--;
+        }
         /**
          * \brief Internal data pointer.
          */
@@ -0,0 +1,247 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_JOURNAL_H
+#define __CASHLEY_JOURNAL_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "registry.h"
+#include "snapshot.h"
+
+/**
+ * \brief First bytes of a journal frame ("CASJ").
+ */
+#define JOURNAL_MAGIC 0x4A534143u
+
+namespace CAshley {
+
+    class Engine;
+
+    /**
+     * \brief Kinds of records of a journal frame.
+     */
+    enum JournalRecord {
+        /** End of the records of a frame. */
+        JOURNAL_END,
+        /** Definition of a component type: id on the journal, name, kind, size and layout. */
+        JOURNAL_TYPE,
+        /** Created entities, without components: active flag, count and ids. */
+        JOURNAL_CREATE,
+        /** Engine::spawn_n(): active flag, count, ids, count of types and types. */
+        JOURNAL_SPAWN,
+        /** Engine::instantiate(): prefab, active flag, count and ids. */
+        JOURNAL_INSTANTIATE,
+        /** Destroyed entities, with their descendants: count and ids. */
+        JOURNAL_DESTROY,
+        /** Component or tag added and initialized: type and entity. */
+        JOURNAL_ADD,
+        /** Removed component or tag: type and entity. */
+        JOURNAL_REMOVE,
+        /** Value of a component, added if missing: type, entity and value. */
+        JOURNAL_VALUE,
+        /** Activated or deactivated entities: active flag, count and ids. */
+        JOURNAL_ACTIVE,
+        /** New parent of an entity: child and parent, null to unlink. */
+        JOURNAL_PARENT
+    };
+
+    /**
+     * \brief Log of the commands applied to an Engine, appended to a file.
+     *
+     * The file holds a snapshot of the world when the journal started, followed by
+     * frames. A frame is a SnapshotWriter container (so it has a checksum) with the
+     * records of the commands run between two ticks, then the delays of the ticks run
+     * until the next command. Finished frames are kept on a buffer, written to the file
+     * when full.
+     * \see Engine::start_journal(), Replay.
+     */
+    class Journal {
+    public:
+        /**
+         * \brief Constructor.
+         * \param path Path of the file, replaced if it exists.
+         * \param buffer Size in bytes of the buffer.
+         */
+        Journal(const std::string & path, unsigned int buffer);
+        ~Journal();
+
+        /**
+         * \brief Write the snapshot the journal starts from.
+         */
+        void write_head(const std::vector<char> & snapshot);
+
+        /**
+         * \brief Start a record on the current frame.
+         * \param record Kind of record, a JournalRecord.
+         * \return Writer of the frame, to write the fields of the record.
+         */
+        SnapshotWriter & record(unsigned char record);
+
+        /**
+         * \brief Record a tick.
+         * \param delay Delay passed to Engine::run_tick().
+         */
+        void tick(unsigned int delay);
+
+        /**
+         * \brief Finish the current frame and write the buffer to the file.
+         */
+        void flush();
+
+        /**
+         * \brief Get the id on the journal of a component type.
+         * \return The id, or NO_COMPONENT if not defined yet.
+         */
+        inline unsigned int get_type(unsigned int type) const {
+            return type < _types.size() ? _types[type] : NO_COMPONENT;
+        }
+
+        /**
+         * \brief Give an id on the journal to a component type.
+         * The caller writes its JOURNAL_TYPE record.
+         * \return The id.
+         */
+        unsigned int add_type(unsigned int type);
+
+    private:
+        Journal(const Journal &);
+        Journal & operator=(const Journal &);
+        /**
+         * \brief Append a finished container to the buffer, with its size.
+         */
+        void _append(const std::vector<char> & data);
+        /**
+         * \brief Finish the current frame.
+         */
+        void _close_frame();
+        /**
+         * \brief Write the buffer to the file.
+         */
+        void _write();
+        /**
+         * \brief Journal file.
+         */
+        std::ofstream _file;
+        /**
+         * \brief Finished frames not written yet.
+         */
+        std::vector<char> _buffer;
+        /**
+         * \brief Size of the buffer that triggers a write.
+         */
+        unsigned int _buffer_size;
+        /**
+         * \brief Container of the current frame.
+         */
+        std::vector<char> _frame;
+        /**
+         * \brief Writer of the current frame, NULL if there is none.
+         */
+        SnapshotWriter * _writer;
+        /**
+         * \brief Delays of the ticks of the current frame.
+         */
+        std::vector<unsigned int> _delays;
+        /**
+         * \brief Id on the journal of each component type.
+         */
+        std::vector<unsigned int> _types;
+        /**
+         * \brief Count of defined component types.
+         */
+        unsigned int _type_count;
+    };
+
+    /**
+     * \brief Rebuilds a session recorded by a Journal.
+     *
+     * The whole file is read on construction, so replaying does no I/O. The engine must
+     * have the processors, listeners, prefabs and resources of the recorded one, and
+     * know its component types (see Engine::register_component()). The recorded
+     * commands are run in order, with the same calls on the registry and the caches,
+     * but without notifying listeners, since their changes were recorded too. Then the
+     * ticks are run with the recorded delays, and deterministic processors make the
+     * same changes. Ids are checked on creation, and a JournalError is thrown if the
+     * replay diverges; the engine is not usable afterwards.
+     */
+    class Replay {
+    public:
+        /**
+         * \brief Read a journal file.
+         * \param path Path of the file.
+         */
+        Replay(const std::string & path);
+
+        /**
+         * \brief Load the world the journal starts from.
+         * \param engine Engine without entities. It must outlive the replay.
+         */
+        void start(Engine & engine);
+
+        /**
+         * \brief Apply the commands recorded before the next tick, and run it.
+         * \return false if the journal has no more ticks.
+         */
+        bool step();
+
+        /**
+         * \brief Fast forward.
+         * \param ticks Max count of ticks to run.
+         * \return Count of ticks run.
+         */
+        unsigned long long run(unsigned long long ticks=~0ull);
+
+    private:
+        /**
+         * \brief Read the size of the next container of the file.
+         * \return Position of its first byte.
+         */
+        size_t _next(size_t & size);
+        /**
+         * \brief Journal file.
+         */
+        std::vector<char> _data;
+        /**
+         * \brief Position of the next frame.
+         */
+        size_t _pos;
+        /**
+         * \brief Engine replaying the journal.
+         */
+        Engine * _engine;
+        /**
+         * \brief Type of the engine of each component type id of the journal.
+         */
+        std::vector<unsigned int> _types;
+        /**
+         * \brief Delays of the ticks of the current frame.
+         */
+        std::vector<unsigned int> _delays;
+        /**
+         * \brief Next tick of the current frame.
+         */
+        unsigned int _tick;
+    };
+}
+
+#endif //__CASHLEY_JOURNAL_H
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_PIPELINE_H
+#define __CASHLEY_PIPELINE_H
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "span.h"
+
+namespace CAshley {
+
+    class Pipeline;
+
+    /**
+     * \brief Immutable copy of the active components of some caches at the end of a tick.
+     *
+     * Snapshots are owned and reused by the Pipeline: do not keep references to
+     * them after OutputStage::consume returns.
+     */
+    class Snapshot {
+    public:
+        Snapshot();
+        ~Snapshot();
+        /**
+         * \brief Get the tick of the snapshot.
+         */
+        inline unsigned long long get_tick() const { return _tick; }
+        /**
+         * \brief Get the engine clock of the snapshot.
+         */
+        inline unsigned long long get_clock() const { return _clock; }
+        /**
+         * \brief Get the active components of a type.
+         * Components are bitwise copies: do not follow pointers owned by them.
+         * \return Span over the copied components. Empty if the type was not extracted.
+         */
+        template <class T>
+        Span<const T> get() const {
+            T x;
+            std::string name = x.get_name();
+            for (unsigned int i = 0; i < _sections.size(); i++) {
+                if (_sections[i].name == name) {
+                    return Span<const T>(reinterpret_cast<const T *>(_sections[i].data), _sections[i].count);
+                }
+            }
+            return Span<const T>();
+        }
+        friend class Pipeline;
+    private:
+        Snapshot(const Snapshot &);
+        Snapshot & operator=(const Snapshot &);
+        /**
+         * \brief Copy of the active blocks of a cache.
+         */
+        struct _Section {
+            /** Class string of the components. */
+            std::string name;
+            /** Count of components. */
+            unsigned int count;
+            /** Bytes copied. */
+            unsigned int size;
+            /** Allocated bytes. Only grows. */
+            unsigned int capacity;
+            /** Copied components. */
+            unsigned char * data;
+        };
+        /**
+         * \brief Copy the active blocks of the caches.
+         */
+        void _fill(unsigned long long tick, unsigned long long clock,
+                   const std::vector<std::pair<std::string, _Cache *> > & caches);
+        /**
+         * \brief Tick of the snapshot.
+         */
+        unsigned long long _tick;
+        /**
+         * \brief Engine clock of the snapshot.
+         */
+        unsigned long long _clock;
+        /**
+         * \brief A section per extracted cache.
+         */
+        std::vector<_Section> _sections;
+    };
+
+    /**
+     * \brief Class to inherit for the output stage of a Pipeline.
+     *
+     * consume is called from the pipeline threads. If the pipeline has more than
+     * one thread, consume has to be thread safe and snapshots may be consumed out of order.
+     */
+    class OutputStage {
+    public:
+        /**
+         * \brief Consume a snapshot (render, send over network...).
+         * \param s Snapshot of a tick.
+         */
+        virtual void consume(const Snapshot & s) = 0;
+        virtual ~OutputStage() {};
+    };
+
+    /**
+     * \brief Overlap the output of a tick with the simulation of the next ones.
+     *
+     * The pipeline owns a fixed pool of snapshots. publish copies the state into a
+     * free snapshot and hands it to the threads of the pipeline. When all the
+     * snapshots are in use, publish waits, so the simulation is never more than
+     * depth ticks ahead of the output.
+     * If consume throws, the first exception is kept and rethrown by the next
+     * publish or flush, on the simulation thread.
+     */
+    class Pipeline {
+    public:
+        /**
+         * \brief Start the pipeline threads.
+         * \param stage Output stage, not owned.
+         * \param depth Max snapshots in flight.
+         * \param threads Count of threads running the stage.
+         */
+        Pipeline(OutputStage * stage, unsigned int depth, unsigned int threads);
+        /**
+         * \brief Default destructor. Consumes the pending snapshots and stops the threads.
+         */
+        ~Pipeline();
+        /**
+         * \brief Copy the caches into a snapshot and queue it for the output stage.
+         * \param tick Engine tick.
+         * \param clock Engine clock.
+         * \param caches Class string and cache of the extracted components. The cache may be NULL.
+         */
+        void publish(unsigned long long tick, unsigned long long clock,
+                     const std::vector<std::pair<std::string, _Cache *> > & caches);
+        /**
+         * \brief Wait until all the published snapshots are consumed.
+         */
+        void flush();
+        /**
+         * \brief Get the max snapshots in flight.
+         */
+        inline unsigned int get_depth() { return _snapshots.size(); }
+    private:
+        Pipeline(const Pipeline &);
+        Pipeline & operator=(const Pipeline &);
+        /**
+         * \brief Loop of the pipeline threads.
+         */
+        void _work();
+        /**
+         * \brief Rethrow the exception thrown by the stage, if any.
+         * Must be called with the lock held.
+         */
+        void _rethrow();
+        /**
+         * \brief Output stage.
+         */
+        OutputStage * _stage;
+        /**
+         * \brief Pool of snapshots.
+         */
+        std::vector<Snapshot *> _snapshots;
+        /**
+         * \brief Snapshots not in use.
+         */
+        std::vector<Snapshot *> _free;
+        /**
+         * \brief Ring of published snapshots waiting for the stage.
+         */
+        std::vector<Snapshot *> _queue;
+        /**
+         * \brief First published snapshot on _queue.
+         */
+        unsigned int _head;
+        /**
+         * \brief Count of published snapshots on _queue.
+         */
+        unsigned int _queued;
+        /**
+         * \brief Are the threads stopping?
+         */
+        bool _stopping;
+        /**
+         * \brief First exception thrown by the stage and not rethrown yet.
+         */
+        std::exception_ptr _exception;
+        /**
+         * \brief Pipeline threads.
+         */
+        std::vector<std::thread> _threads;
+        /**
+         * \brief Protects _free, _queue, _head, _queued, _stopping and _exception.
+         */
+        std::mutex _mutex;
+        /**
+         * \brief Signaled when a snapshot is published or the pipeline stops.
+         */
+        std::condition_variable _published;
+        /**
+         * \brief Signaled when a snapshot is consumed.
+         */
+        std::condition_variable _consumed;
+    };
+}
+
+#endif //__CASHLEY_PIPELINE_H
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_PREFAB_H
+#define __CASHLEY_PREFAB_H
+
+#include <new>
+#include <vector>
+#include <type_traits>
+
+#include "component.h"
+#include "engine.h"
+#include "exceptions.h"
+#include "typeid.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Template of an entity: a set of components with their initial values.
+     *
+     * Register it with Engine::add_prefab() and create entities from it with
+     * Engine::instantiate(). Instances are copies of the stored components: init() is
+     * only called once, when the component is added to the prefab.
+     */
+    class Prefab {
+    public:
+        Prefab();
+        Prefab(const Prefab & p);
+        Prefab & operator=(const Prefab & p);
+        ~Prefab();
+
+        /**
+         * \brief Add a component to the prefab.
+         * A prefab can not own 2 components of the same type. The component is initialized.
+         * \return Pointer to the stored component, to set its initial values.
+         */
+        template <class T>
+        T * add() {
+            if (! std::is_base_of<Component, T>::value) {
+                ComponentError e("Invalid component class");
+                throw e;
+            }
+            unsigned int type = TypeId<Component, T>::get();
+            if (_find(type) != NO_COMPONENT) {
+                ComponentError e("Component duplicate.");
+                throw e;
+            }
+            T * t = new (::operator new(sizeof(T))) T;
+            t->set_owner(NULL);
+            t->init();
+            _Entry entry;
+            entry.type = type;
+            entry.value = t;
+            entry.clone = &_clone<T>;
+            entry.destroy = &_destroy<T>;
+            entry.instantiate = &_instantiate<T>;
+            _entries.push_back(entry);
+            return t;
+        }
+
+        /**
+         * \brief Get a stored component.
+         * \return Pointer to the stored component.
+         */
+        template <class T>
+        T * get() {
+            unsigned int i = _find(TypeId<Component, T>::get());
+            if (i == NO_COMPONENT) {
+                ComponentError e("Component not found");
+                throw e;
+            }
+            return static_cast<T *>(_entries[i].value);
+        }
+
+        /**
+         * \brief Check if the prefab has a component.
+         * \return true if has this component, false otherwise.
+         */
+        template <class T>
+        bool has() {
+            return _find(TypeId<Component, T>::get()) != NO_COMPONENT;
+        }
+
+        /**
+         * \brief Get the count of components of the prefab.
+         */
+        inline unsigned int size() const { return _entries.size(); }
+
+        friend class Engine;
+    private:
+        /**
+         * \brief A stored component.
+         */
+        struct _Entry {
+            /** Component type (TypeId<Component, T>). */
+            unsigned int type;
+            /** The component. */
+            void * value;
+            /** Copy the component. */
+            void * (*clone)(const void * value);
+            /** Delete the component. */
+            void (*destroy)(void * value);
+            /** Copy the component into a batch of entities. Returns the type. */
+            unsigned int (*instantiate)(Engine & engine, const void * value, const EntityId * ids, unsigned int n, bool active);
+        };
+        template <class T>
+        static void * _clone(const void * value) {
+            return new (::operator new(sizeof(T))) T(*static_cast<const T *>(value));
+        }
+        template <class T>
+        static void _destroy(void * value) {
+            // Components have no virtual destructor: destroy them with their exact type.
+            static_cast<T *>(value)->~T();
+            ::operator delete(value);
+        }
+        template <class T>
+        static unsigned int _instantiate(Engine & engine, const void * value, const EntityId * ids, unsigned int n, bool active) {
+            return engine._instantiate_components<T>(*static_cast<const T *>(value), ids, n, active);
+        }
+        /**
+         * \brief Find a stored component.
+         * \return Position in _entries, or NO_COMPONENT.
+         */
+        unsigned int _find(unsigned int type) const;
+        /**
+         * \brief Delete all the stored components.
+         */
+        void _clear();
+        /**
+         * \brief Stored components.
+         */
+        std::vector<_Entry> _entries;
+    };
+}
+
+#endif //__CASHLEY_PREFAB_H
@@ -19,16 +19,44 @@
 #ifndef __CASHLEY_PROCESSOR_H
 #define __CASHLEY_PROCESSOR_H
 
+#include <type_traits>
+#include <vector>
+
 #include "common.h"
+#include "family.h"
+#include "inmutablearray.h"
+#include "resource.h"
+#include "typeid.h"
 
 #define CASHLEY_PROCESSOR \
 __CASHLEY_COMMON_METHOD \
+virtual CAshley::Processor * _clone() { \
+    return new typename std::remove_reference<decltype(*this)>::type(*this); \
+} \
 friend class CAshley::Engine;
 
 namespace CAshley {
 
     class Engine;
 
+    /**
+     * \brief Scheduling policies of a Processor.
+     * \see Processor::schedule_every_tick().
+     * \see Processor::schedule_interval().
+     * \see Processor::schedule_fixed_step().
+     * \see Processor::schedule_every_n_ticks().
+     */
+    enum ScheduleMode {
+        /** Run once on every engine tick. */
+        SCHEDULE_EVERY_TICK,
+        /** Run once when the accumulated delay reaches an interval. */
+        SCHEDULE_INTERVAL,
+        /** Run as many fixed steps as the accumulated delay allows, up to a limit. */
+        SCHEDULE_FIXED_STEP,
+        /** Run once every N engine ticks. */
+        SCHEDULE_EVERY_N_TICKS
+    };
+
     /**
      * \brief Class to inherit for processors.
      */
@@ -65,11 +93,91 @@ namespace CAshley {
          */
         virtual void run_tick(unsigned int delay) = 0;
 
+        /**
+         * \brief Run the processor on every engine tick.
+         * This is the default policy. run_tick receives the delay of the tick.
+         */
+        void schedule_every_tick();
+        /**
+         * \brief Run the processor once the accumulated delay reaches an interval.
+         * run_tick receives the delay accumulated since its last run. The remainder
+         * is carried over, so the processor does not drift.
+         * \param interval Delay between two runs.
+         */
+        void schedule_interval(unsigned int interval);
+        /**
+         * \brief Run the processor with a fixed timestep.
+         * On each engine tick, run_tick is called once per elapsed step, always with
+         * step as delay. If more than max_steps are pending, the backlog is dropped.
+         * \param step Fixed delay of a step.
+         * \param max_steps Max steps run on a single engine tick.
+         */
+        void schedule_fixed_step(unsigned int step, unsigned int max_steps=4);
+        /**
+         * \brief Run the processor once every n engine ticks.
+         * run_tick receives the delay accumulated since its last run.
+         * \param n Ticks between two runs.
+         */
+        void schedule_every_n_ticks(unsigned int n);
+        /**
+         * \brief Get the scheduling policy of the processor.
+         * \return Current scheduling policy.
+         */
+        ScheduleMode get_schedule();
+
+        /**
+         * \brief Set the Family this processor works on.
+         * \param f Family of entities.
+         * \see get_entities().
+         */
+        void set_family(Family f);
+
+        /**
+         * \brief Declare that the processor reads a resource of the engine.
+         * \see conflicts_with().
+         */
+        template <class T>
+        void reads() {
+            _reads.push_back(TypeId<ResourceSet, T>::get());
+        }
+
+        /**
+         * \brief Declare that the processor changes a resource of the engine.
+         * \see conflicts_with().
+         */
+        template <class T>
+        void writes() {
+            _writes.push_back(TypeId<ResourceSet, T>::get());
+        }
+
+        /**
+         * \brief Check if two processors can not run at the same time.
+         * A processor writing a resource conflicts with any other using it.
+         * \param p Other processor.
+         * \return true if a resource written by one is read or written by the other.
+         */
+        bool conflicts_with(const Processor & p) const;
+
+        /**
+         * \brief Get the entities of the processor Family.
+         * The result is cached and only recomputed when the engine entities have
+         * changed since the last call, so processors that are not run do not pay
+         * for rebuilding it.
+         * \return Active entities of the processor Family.
+         */
+        EntityArray & get_entities();
+
         /**
          * \brief Get the class string.
          */
         virtual std::string get_name();
 
+        /**
+         * \brief Create a copy of the processor, for Engine::clone().
+         * Defined by CASHLEY_PROCESSOR with the copy constructor of the class.
+         */
+        virtual Processor * _clone();
+
         friend class Engine;
     protected:
         /**
@@ -77,10 +185,62 @@ namespace CAshley {
          */
         Engine * _engine;
     private:
+        /**
+         * \brief Reschedule the processor on the engine after a policy change.
+         */
+        void _reschedule();
         /**
          * \brief Active status of the Processor.
          */
         bool _running;
+        /**
+         * \brief Scheduling policy.
+         */
+        ScheduleMode _mode;
+        /**
+         * \brief Interval, step or tick count, depending on the policy.
+         */
+        unsigned int _period;
+        /**
+         * \brief Max catch-up steps for SCHEDULE_FIXED_STEP.
+         */
+        unsigned int _max_steps;
+        /**
+         * \brief Engine clock (or tick for SCHEDULE_EVERY_N_TICKS) when the processor is due.
+         */
+        unsigned long long _next_due;
+        /**
+         * \brief Engine clock on the last run.
+         */
+        unsigned long long _last_run;
+        /**
+         * \brief Priority given on Engine::add_processor.
+         */
+        unsigned int _priority;
+        /**
+         * \brief Insertion order on the engine, to break priority ties.
+         */
+        unsigned int _order;
+        /**
+         * \brief Family of the processor.
+         */
+        Family _family;
+        /**
+         * \brief Cached entities of _family.
+         */
+        EntityArray _entities;
+        /**
+         * \brief Engine version when _entities was computed.
+         */
+        unsigned long long _entities_version;
+        /**
+         * \brief Resources read, by TypeId<ResourceSet, T>.
+         */
+        std::vector<unsigned int> _reads;
+        /**
+         * \brief Resources written, by TypeId<ResourceSet, T>.
+         */
+        std::vector<unsigned int> _writes;
     };
 
 }
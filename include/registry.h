@@ -0,0 +1,479 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_REGISTRY_H
+#define __CASHLEY_REGISTRY_H
+
+#include <vector>
+
+#include "inmutablearray.h"
+#include "snapshot.h"
+
+/**
+ * \brief Slot value of an entity without a component of a type.
+ */
+#define NO_COMPONENT 0xFFFFFFFFu
+
+namespace CAshley {
+
+    class Entity;
+
+    /**
+     * \brief Lightweight handle of an entity.
+     *
+     * The index names a slot of the EntityRegistry and the generation tells apart
+     * the entities that reuse that slot, so a stale EntityId never reaches a newer
+     * entity. A default constructed EntityId is null.
+     */
+    class EntityId {
+    public:
+        /**
+         * \brief Null EntityId.
+         */
+        EntityId() {
+            index = 0;
+            generation = 0;
+        }
+
+        /**
+         * \brief EntityId from its parts.
+         */
+        EntityId(unsigned int i, unsigned int g) {
+            index = i;
+            generation = g;
+        }
+
+        /**
+         * \brief Check if the EntityId is null.
+         * \return true if null, false otherwise.
+         */
+        inline bool is_null() const { return generation == 0; }
+
+        /**
+         * \brief Pack the EntityId in a number, to send or store it.
+         * \return Generation on the high half, index on the low half.
+         * \see from_number().
+         */
+        inline unsigned long long to_number() const {
+            return ((unsigned long long)generation << 32) | index;
+        }
+
+        /**
+         * \brief Unpack an EntityId from a number.
+         * \param n Number returned by to_number().
+         * \return The EntityId.
+         */
+        static inline EntityId from_number(unsigned long long n) {
+            return EntityId((unsigned int)(n & 0xFFFFFFFFu), (unsigned int)(n >> 32));
+        }
+
+        inline bool operator==(const EntityId & o) const { return index == o.index && generation == o.generation; }
+        inline bool operator!=(const EntityId & o) const { return !(*this == o); }
+        inline bool operator<(const EntityId & o) const { return to_number() < o.to_number(); }
+
+        /** Slot of the entity. */
+        unsigned int index;
+        /** Generation of the slot when the entity was created. 0 for null. */
+        unsigned int generation;
+    };
+
+    /**
+     * \brief InmutableArray of EntityId, for families.
+     */
+    typedef InmutableArray<EntityId> EntityIdArray;
+
+    /**
+     * \brief Storage of the entities of an Engine.
+     *
+     * Everything is kept in flat arrays indexed by the entity slot: a generation and
+     * a flags byte per entity, and, for each component type, the UID of the component
+     * of each entity (NO_COMPONENT if it has none). Slot arrays of a component type only
+     * span the entities up to the last one that used it. Tags are kept as bits, in
+     * words of 64 tags. Freed slots are reused. Optionally, the changed entities and
+     * components are recorded, for deltas.
+     */
+    class EntityRegistry {
+    public:
+        EntityRegistry();
+
+        /**
+         * \brief Create an entity.
+         * \return Id of the new entity, inactive and without components.
+         */
+        EntityId create();
+
+        /**
+         * \brief Create several entities at once.
+         * \param n Count of entities.
+         * \param ids Output, ids of the new entities.
+         * \param active Create the entities as active.
+         */
+        void create_n(unsigned int n, EntityId * ids, bool active=false);
+
+        /**
+         * \brief Destroy an entity.
+         * Its slots are cleared; components must be freed by the caller first.
+         * \param id Id of the entity.
+         */
+        void destroy(EntityId id);
+
+        /**
+         * \brief Set the generation and status of a slot, as on another registry.
+         * Used to replay deltas. A living entity of the slot must be destroyed first.
+         * \param id Id of the entity. Slots up to its index are created if needed.
+         * \param alive The entity is alive. If not, the slot is free with that generation.
+         */
+        void restore(EntityId id, bool alive);
+
+        /**
+         * \brief Get the free slots, the last one is reused first.
+         * Slots taken by restore() may remain, they are skipped when reached.
+         */
+        inline const std::vector<unsigned int> & get_free() const { return _free; }
+
+        /**
+         * \brief Get the count of free slots not taken since the last clear_changes().
+         * The first entries of get_free() are the same as then, up to it.
+         */
+        inline unsigned int get_free_kept() const { return _free_kept; }
+
+        /**
+         * \brief Put the free slots back as they were on a previous state.
+         * Used to roll back, so the same ids are given again. Slots created since that
+         * state must be free: they are reused in creation order, before growing.
+         * \param keep Count of entries kept, common with the previous state.
+         * \param tail Entries of the previous state after them.
+         * \param n Count of entries of tail.
+         * \param slots Count of slots of the previous state.
+         */
+        void rewind_free(unsigned int keep, const unsigned int * tail, unsigned int n, unsigned int slots);
+
+        /**
+         * \brief Check if an EntityId names a living entity.
+         * \param id Id of the entity.
+         * \return true if alive, false if null, destroyed or unknown.
+         */
+        inline bool is_alive(EntityId id) const {
+            return id.index < _generations.size() && _generations[id.index] == id.generation && (_flags[id.index] & _ALIVE);
+        }
+
+        /**
+         * \brief Check if the entity on a slot is alive.
+         * \param index Slot of the entity.
+         */
+        inline bool is_alive(unsigned int index) const { return index < _flags.size() && (_flags[index] & _ALIVE); }
+
+        /**
+         * \brief Check if the entity on a slot is active.
+         * \param index Slot of the entity.
+         */
+        inline bool is_active(unsigned int index) const { return (_flags[index] & _ACTIVE) != 0; }
+
+        /**
+         * \brief Mark the entity on a slot as active or inactive.
+         * \param index Slot of the entity.
+         * \param active Status.
+         */
+        void set_active(unsigned int index, bool active);
+
+        /**
+         * \brief Get the EntityId of the entity on a slot.
+         * \param index Slot of a living entity.
+         */
+        inline EntityId get_id(unsigned int index) const { return EntityId(index, _generations[index]); }
+
+        /**
+         * \brief Get the component UID of an entity.
+         * \param type Component type (TypeId<Component, T>).
+         * \param index Slot of the entity.
+         * \return UID, or NO_COMPONENT.
+         */
+        inline unsigned int get_slot(unsigned int type, unsigned int index) const {
+            if (type >= _slots.size() || index >= _slots[type].size()) {
+                return NO_COMPONENT;
+            }
+            return _slots[type][index];
+        }
+
+        /**
+         * \brief Set the component UID of an entity.
+         * \param type Component type (TypeId<Component, T>).
+         * \param index Slot of the entity.
+         * \param uid UID, or NO_COMPONENT.
+         */
+        void set_slot(unsigned int type, unsigned int index, unsigned int uid);
+
+        /**
+         * \brief Get the count of component types with slots.
+         * Types equal or above never had a component.
+         */
+        inline unsigned int get_type_count() const { return _slots.size(); }
+
+        /**
+         * \brief Get a word of the tags of an entity.
+         * \param word Tag / 64.
+         * \param index Slot of the entity.
+         * \return Bits of the tags word * 64 to word * 64 + 63.
+         */
+        inline unsigned long long get_tags(unsigned int word, unsigned int index) const {
+            if (word >= _tags.size() || index >= _tags[word].size()) {
+                return 0;
+            }
+            return _tags[word][index];
+        }
+
+        /**
+         * \brief Check if an entity has a tag.
+         * \param tag Bit of the tag.
+         * \param index Slot of the entity.
+         */
+        inline bool has_tag(unsigned int tag, unsigned int index) const {
+            return (get_tags(tag / 64, index) >> (tag % 64)) & 1;
+        }
+
+        /**
+         * \brief Set or clear a tag of an entity.
+         * \param tag Bit of the tag.
+         * \param index Slot of the entity.
+         * \param on New status.
+         */
+        void set_tag(unsigned int tag, unsigned int index, bool on);
+
+        /**
+         * \brief Clear all the tags of an entity.
+         * \param index Slot of the entity.
+         * \return true if the entity had tags.
+         */
+        bool clear_tags(unsigned int index);
+
+        /**
+         * \brief Get the Entity wrapping the entity on a slot.
+         * \param index Slot of the entity.
+         * \return Entity, or NULL for plain entities.
+         */
+        inline Entity * get_wrapper(unsigned int index) const {
+            return index < _wrappers.size() ? _wrappers[index] : NULL;
+        }
+
+        /**
+         * \brief Get the count of slots with an Entity.
+         */
+        inline unsigned int get_wrapped_count() const { return _wrapped.size(); }
+
+        /**
+         * \brief Get a slot with an Entity.
+         * \param i Position, lower than get_wrapped_count(). Positions change when a wrapper is removed.
+         * \return Slot of the entity.
+         */
+        inline unsigned int get_wrapped(unsigned int i) const { return _wrapped[i]; }
+
+        /**
+         * \brief Set the Entity wrapping the entity on a slot.
+         * \param index Slot of the entity.
+         * \param e Entity, or NULL.
+         */
+        void set_wrapper(unsigned int index, Entity * e);
+
+        /**
+         * \brief Get the count of living entities.
+         */
+        inline unsigned int size() const { return _alive; }
+
+        /**
+         * \brief Get the count of slots, living or free.
+         * Valid indexes are below it.
+         */
+        inline unsigned int capacity() const { return _generations.size(); }
+
+        /**
+         * \brief Copy the slots, components and tags of another registry.
+         * Wrappers are not copied, and changes are not tracked.
+         */
+        void copy(const EntityRegistry & o);
+
+        /**
+         * \brief Preallocate the per entity arrays.
+         * \param n Count of entities.
+         */
+        void reserve(unsigned int n);
+
+        /**
+         * \brief Write the generation and flags of every slot, and the free slots.
+         * Component slots and tags are written by type, with save_slots() and save_tag().
+         */
+        void save(SnapshotWriter & w) const;
+
+        /**
+         * \brief Read the slots written by save().
+         * Previous slots are dropped, and with them all component slots, tags and wrappers.
+         */
+        void load(SnapshotReader & r);
+
+        /**
+         * \brief Write the component UIDs of a type, one per slot.
+         * \param type Component type (TypeId<Component, T>).
+         */
+        void save_slots(unsigned int type, SnapshotWriter & w) const;
+
+        /**
+         * \brief Read the component UIDs written by save_slots(), for a type.
+         * \param type Component type of this registry.
+         */
+        void load_slots(unsigned int type, SnapshotReader & r);
+
+        /**
+         * \brief Write the entities with a tag, as a bit per slot.
+         * \param tag Bit of the tag.
+         */
+        void save_tag(unsigned int tag, SnapshotWriter & w) const;
+
+        /**
+         * \brief Read the entities written by save_tag(), for a tag.
+         * \param tag Bit of the tag in this registry.
+         */
+        void load_tag(unsigned int tag, SnapshotReader & r);
+
+        /**
+         * \brief Start or stop recording the changed entities and components.
+         * Recorded changes are dropped.
+         */
+        void set_tracking(bool on);
+
+        /**
+         * \brief Check if changes are recorded.
+         */
+        inline bool is_tracking() const { return _tracking; }
+
+        /**
+         * \brief Record a change of an entity: created, destroyed, activated, tagged...
+         * \param index Slot of the entity.
+         */
+        inline void mark_changed(unsigned int index) {
+            if (_tracking && (index >= _changed_marks.size() || !_changed_marks[index])) {
+                _mark(_changed, _changed_marks, index);
+            }
+        }
+
+        /**
+         * \brief Record a change of a component of an entity: added, removed or written.
+         * \param type Component type.
+         * \param index Slot of the entity.
+         */
+        void mark_changed(unsigned int type, unsigned int index);
+
+        /**
+         * \brief Get the slots of the entities changed since the last clear_changes().
+         */
+        inline const std::vector<unsigned int> & get_changed() const { return _changed; }
+
+        /**
+         * \brief Get the slots of the entities whose component of a type changed.
+         * \param type Component type, below get_changed_type_count().
+         */
+        inline const std::vector<unsigned int> & get_changed(unsigned int type) const { return _changed_slots[type]; }
+
+        /**
+         * \brief Get the count of component types with recorded changes.
+         * Types equal or above have none.
+         */
+        inline unsigned int get_changed_type_count() const { return _changed_slots.size(); }
+
+        /**
+         * \brief Forget the recorded changes, in time proportional to their count.
+         */
+        void clear_changes();
+
+    private:
+        /**
+         * \brief Add a slot to a list of changes.
+         */
+        void _mark(std::vector<unsigned int> & list, std::vector<unsigned char> & marks, unsigned int index);
+        /**
+         * \brief Flag of a living entity.
+         */
+        static const unsigned char _ALIVE = 1;
+        /**
+         * \brief Flag of an active entity.
+         */
+        static const unsigned char _ACTIVE = 2;
+        /**
+         * \brief Generation of each slot.
+         */
+        std::vector<unsigned int> _generations;
+        /**
+         * \brief Flags of each slot.
+         */
+        std::vector<unsigned char> _flags;
+        /**
+         * \brief Free slots.
+         */
+        std::vector<unsigned int> _free;
+        /**
+         * \brief Count of free slots not taken since changes were cleared.
+         */
+        unsigned int _free_kept;
+        /**
+         * \brief Component UIDs, by component type and slot.
+         */
+        std::vector<std::vector<unsigned int> > _slots;
+        /**
+         * \brief Tag bits, by word of 64 tags and slot.
+         */
+        std::vector<std::vector<unsigned long long> > _tags;
+        /**
+         * \brief Entity of each slot, only as long as the last wrapped slot.
+         */
+        std::vector<Entity *> _wrappers;
+        /**
+         * \brief Slots with an Entity, in no order.
+         */
+        std::vector<unsigned int> _wrapped;
+        /**
+         * \brief Position of each wrapped slot in _wrapped, by slot.
+         */
+        std::vector<unsigned int> _wrapped_at;
+        /**
+         * \brief Count of living entities.
+         */
+        unsigned int _alive;
+        /**
+         * \brief Changes are recorded.
+         */
+        bool _tracking;
+        /**
+         * \brief Changed entities.
+         */
+        std::vector<unsigned int> _changed;
+        /**
+         * \brief Changed entities, by slot.
+         */
+        std::vector<unsigned char> _changed_marks;
+        /**
+         * \brief Entities with a changed component, by component type.
+         */
+        std::vector<std::vector<unsigned int> > _changed_slots;
+        /**
+         * \brief Entities with a changed component, by component type and slot.
+         */
+        std::vector<std::vector<unsigned char> > _changed_slot_marks;
+    };
+}
+
+#endif //__CASHLEY_REGISTRY_H
@@ -0,0 +1,340 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_REPLICATION_H
+#define __CASHLEY_REPLICATION_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "component.h"
+#include "engine.h"
+#include "exceptions.h"
+#include "family.h"
+#include "registry.h"
+#include "schema.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Component types replicated between engines, and how.
+     *
+     * The server and its replicas must be built from the same set: types are told
+     * apart by their order. Components are sent through their schema, so they must
+     * be described with CASHLEY_FIELDS, but tags, that are only present or not.
+     * \see Replicator, Replica.
+     */
+    class ReplicationSet {
+    public:
+        ReplicationSet();
+
+        /**
+         * \brief Replicate a component type. Up to 64 types of up to 64 fields.
+         */
+        template <class T>
+        void add() {
+            if (! std::is_base_of<Component, T>::value) {
+                ComponentError e("Invalid component class");
+                throw e;
+            }
+            const ComponentSchema & schema = component_schema<T>();
+            if (!schema.described && !schema.tag) {
+                ReplicationError e("Replicated components must be described.");
+                throw e;
+            }
+            if (schema.shared) {
+                ReplicationError e("Shared components can not be replicated.");
+                throw e;
+            }
+            _Type t;
+            t.find = &_find<T>;
+            t.add = &_add<T>;
+            t.remove = &_remove<T>;
+            _add_type(schema, t);
+        }
+
+        /**
+         * \brief Send a float or double field rounded to a step.
+         * Values are sent as the integer count of steps, and changes smaller than a
+         * step are not sent. Counts must fit in 64 bits.
+         * \param field Name of the field.
+         * \param step Precision, greater than zero.
+         */
+        template <class T>
+        void quantize(const std::string & field, double step) {
+            _quantize(component_schema<T>(), field, step);
+        }
+
+        /**
+         * \brief Get the index of a replicated type.
+         * \return Index, NO_COMPONENT if not replicated.
+         */
+        unsigned int find(const ComponentSchema & schema) const;
+
+        friend class Replicator;
+        friend class Replica;
+    private:
+        /**
+         * \brief A replicated type.
+         * Each entity keeps a record per observer: for each type, a presence byte and
+         * a slot per field, with its sent value. Strings keep a hash instead.
+         */
+        struct _Type {
+            /** Schema of the component. */
+            const ComponentSchema * schema;
+            /** Step of each field, 0 to send it exactly. */
+            std::vector<double> steps;
+            /** Offset of the slot of each field, from the presence byte. */
+            std::vector<size_t> slots;
+            /** Offset of the presence byte in an entity record. */
+            size_t offset;
+            /** Typed lookup. NULL if the entity has no such component. */
+            Component * (*find)(Engine & e, EntityId id);
+            /** Typed add_component(). */
+            Component * (*add)(Engine & e, EntityId id);
+            /** Typed remove_component(). */
+            void (*remove)(Engine & e, EntityId id);
+        };
+        template <class T>
+        static Component * _find(Engine & e, EntityId id) {
+            return e.has_component<T>(id) ? e.get_component<T>(id) : NULL;
+        }
+        template <class T>
+        static Component * _add(Engine & e, EntityId id) {
+            return e.add_component<T>(id);
+        }
+        template <class T>
+        static void _remove(Engine & e, EntityId id) {
+            e.remove_component<T>(id);
+        }
+        void _add_type(const ComponentSchema & schema, _Type & t);
+        void _quantize(const ComponentSchema & schema, const std::string & field, double step);
+        /** Place the slots of every type in the entity record. */
+        void _layout();
+        /** Replicated types, in order. */
+        std::vector<_Type> _types;
+        /** Bytes of an entity record. */
+        size_t _record;
+    };
+
+    /**
+     * \brief Encodes the state of an engine for its observers.
+     *
+     * Each observer sees the active entities of a family, maybe limited to an area.
+     * encode() sends only what changed from the last state the observer acknowledged,
+     * at field granularity. Fields changed by states sent later but not acknowledged
+     * are sent too, so lost packets are harmless: the replica only needs the newest.
+     * Sent states are kept until acknowledged.
+     * \see Replica.
+     */
+    class Replicator {
+    public:
+        /**
+         * \brief Constructor.
+         * \param engine Engine to replicate.
+         * \param set Replicated types. Copied.
+         */
+        Replicator(Engine & engine, const ReplicationSet & set);
+
+        /**
+         * \brief Add an observer.
+         * \param f Family of the entities it sees.
+         * \return Id of the observer.
+         */
+        unsigned int add_observer(const Family & f);
+
+        /**
+         * \brief Limit what an observer sees to a circle.
+         * Entities without the component are out of the area.
+         * \param observer Id of the observer.
+         * \param x Field of T with the x coordinate, of any number type.
+         * \param y Field of T with the y coordinate.
+         * \param radius Radius of the area.
+         */
+        template <class T>
+        void set_area(unsigned int observer, const std::string & x, const std::string & y, double radius) {
+            _set_area(observer, component_schema<T>(), x, y, radius);
+        }
+
+        /**
+         * \brief Move the center of the area of an observer, like to follow its camera.
+         */
+        void set_center(unsigned int observer, double x, double y);
+
+        /**
+         * \brief Write the update of an observer.
+         * \param observer Id of the observer.
+         * \param out Buffer. The packet is appended to it.
+         * \return Sequence number of the packet.
+         */
+        unsigned long long encode(unsigned int observer, std::vector<char> & out);
+
+        /**
+         * \brief Acknowledge a state, returned by Replica::apply().
+         * Older and unknown states are ignored.
+         */
+        void ack(unsigned int observer, unsigned long long seq);
+
+        /**
+         * \brief Get the count of states sent to an observer and not acknowledged.
+         */
+        unsigned int get_pending(unsigned int observer);
+
+    private:
+        /**
+         * \brief State of the entities seen by an observer.
+         */
+        struct _State {
+            /** Sequence number, 0 for the empty state before the first packet. */
+            unsigned long long seq;
+            /** Keys of the entities, index on the high half, sorted. */
+            std::vector<unsigned long long> keys;
+            /** Record of each entity. */
+            std::vector<char> records;
+        };
+        struct _Observer {
+            Family family;
+            /** Index of the type with the coordinates, NO_COMPONENT for no area. */
+            unsigned int area;
+            unsigned int x, y;
+            double cx, cy, radius;
+            /** Acknowledged state, then the sent ones. */
+            std::deque<_State> states;
+        };
+        void _set_area(unsigned int observer, const ComponentSchema & schema, const std::string & x, const std::string & y, double radius);
+        /**
+         * \brief Write the slots of the fields of a component to its record.
+         * Entity fields are kept only if the observer sees their entity.
+         * \param keys Keys of the entities seen by the observer.
+         */
+        static void _store(const ReplicationSet::_Type & t, const Component * c, char * record, const std::vector<unsigned long long> & keys);
+        /**
+         * \brief Write a field to a packet, from its slots. Strings are taken from the component.
+         */
+        static void _write_field(std::vector<char> & out, const ReplicationSet::_Type & t, unsigned int field, const Component * c, const char * record);
+        _Observer & _get_observer(unsigned int observer);
+        /**
+         * \brief Build the current state of an observer.
+         */
+        void _capture(_Observer & o, _State & s);
+        /**
+         * \brief Compare a type of a record to the ones of the states that may be on the replica.
+         * \param presence Set if the component was added or removed since one of them.
+         * \return Mask of the fields to send.
+         */
+        unsigned long long _changes(unsigned int type, const char * record, const std::vector<const char *> & refs, bool & presence);
+        Engine & _engine;
+        ReplicationSet _set;
+        std::vector<_Observer> _observers;
+    };
+
+    /**
+     * \brief Applies the packets of a Replicator to another engine.
+     *
+     * Replicated entities are created as plain active entities of the engine, and
+     * their components added, removed and written as told. Entity fields are
+     * translated to the local ids, and nulled when their entity is not replicated.
+     * Call it between ticks.
+     */
+    class Replica {
+    public:
+        /**
+         * \brief Constructor.
+         * \param engine Engine receiving the entities.
+         * \param set Replicated types, the same as the Replicator ones. Copied.
+         */
+        Replica(Engine & engine, const ReplicationSet & set);
+
+        /**
+         * \brief Apply a packet. Packets older than the last applied are ignored.
+         * \return Sequence number of the newest applied state, to acknowledge.
+         */
+        unsigned long long apply(const char * data, size_t size);
+
+        /**
+         * \brief Get the local id of a replicated entity.
+         * \param id Id on the replicated engine.
+         * \return Local id, null if not replicated.
+         */
+        EntityId get_local(EntityId id);
+
+        /**
+         * \brief Get the count of replicated entities.
+         */
+        unsigned int size();
+
+    private:
+        Engine & _engine;
+        ReplicationSet _set;
+        /** Local ids, by key of the replicated entity. */
+        std::map<unsigned long long, EntityId> _local;
+        /** Sequence number of the last applied packet. */
+        unsigned long long _last;
+    };
+
+    /**
+     * \brief In-process packet queue between a Replicator and its Replica.
+     * Counts the bytes sent through it, to measure the traffic.
+     */
+    class LoopbackChannel {
+    public:
+        LoopbackChannel();
+
+        /**
+         * \brief Queue a packet.
+         */
+        void send(const std::vector<char> & packet);
+
+        /**
+         * \brief Take the oldest packet.
+         * \return false if there was none.
+         */
+        bool receive(std::vector<char> & packet);
+
+        /**
+         * \brief Drop the queued packets, like a lossy link would.
+         */
+        void drop();
+
+        /**
+         * \brief Get the count of queued packets.
+         */
+        unsigned int size();
+
+        /**
+         * \brief Get the count of bytes sent.
+         */
+        unsigned long long get_bytes();
+
+        /**
+         * \brief Get the count of packets sent.
+         */
+        unsigned long long get_packets();
+
+    private:
+        std::deque<std::vector<char> > _queue;
+        unsigned long long _bytes;
+        unsigned long long _packets;
+    };
+}
+
+#endif //__CASHLEY_REPLICATION_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_RESOURCE_H
+#define __CASHLEY_RESOURCE_H
+
+#include <vector>
+
+#include "exceptions.h"
+#include "typeid.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Base of the typed resource holders.
+     */
+    class _Resource {
+    public:
+        virtual ~_Resource() {}
+        /**
+         * \brief Create a holder with a copy of the resource.
+         */
+        virtual _Resource * clone() const = 0;
+    };
+
+    /**
+     * \brief Holder of a resource of type T.
+     */
+    template <class T>
+    class Resource : public _Resource {
+    public:
+        Resource(const T & v) : value(v) {}
+        virtual _Resource * clone() const { return new Resource<T>(value); }
+        /** The resource. */
+        T value;
+    };
+
+    /**
+     * \brief Set of singleton objects, one per type.
+     *
+     * Resources are global state like the clock, a random generator or a spatial grid.
+     * They are found by type in constant time, indexing a flat array by TypeId.
+     */
+    class ResourceSet {
+    public:
+        ResourceSet() {}
+
+        ~ResourceSet() {
+            for (unsigned int i = 0; i < _resources.size(); i++) {
+                delete _resources[i];
+            }
+        }
+
+        /**
+         * \brief Set the resource of a type, replacing the previous one.
+         * \param value Value of the resource.
+         * \return The stored resource.
+         */
+        template <class T>
+        T & set(const T & value) {
+            unsigned int id = TypeId<ResourceSet, T>::get();
+            if (id >= _resources.size()) {
+                _resources.resize(id + 1, NULL);
+            }
+            Resource<T> * r = new Resource<T>(value);
+            delete _resources[id];
+            _resources[id] = r;
+            return r->value;
+        }
+
+        /**
+         * \brief Get the resource of a type.
+         * \return The stored resource. Throws ResourceError if not set.
+         */
+        template <class T>
+        T & get() {
+            unsigned int id = TypeId<ResourceSet, T>::get();
+            if (id >= _resources.size() || !_resources[id]) {
+                ResourceError e("Resource not found.");
+                throw e;
+            }
+            return static_cast<Resource<T> *>(_resources[id])->value;
+        }
+
+        /**
+         * \brief Check if the resource of a type is set.
+         */
+        template <class T>
+        bool has() {
+            unsigned int id = TypeId<ResourceSet, T>::get();
+            return id < _resources.size() && _resources[id];
+        }
+
+        /**
+         * \brief Destroy the resource of a type, if set.
+         */
+        template <class T>
+        void remove() {
+            unsigned int id = TypeId<ResourceSet, T>::get();
+            if (id < _resources.size()) {
+                delete _resources[id];
+                _resources[id] = NULL;
+            }
+        }
+
+        /**
+         * \brief Replace the resources by copies of the ones of another set.
+         */
+        void copy(const ResourceSet & o) {
+            for (unsigned int i = 0; i < _resources.size(); i++) {
+                delete _resources[i];
+            }
+            _resources.assign(o._resources.size(), NULL);
+            for (unsigned int i = 0; i < o._resources.size(); i++) {
+                if (o._resources[i]) {
+                    _resources[i] = o._resources[i]->clone();
+                }
+            }
+        }
+
+    private:
+        ResourceSet(const ResourceSet &);
+        ResourceSet & operator=(const ResourceSet &);
+        /**
+         * \brief Resources by TypeId<ResourceSet, T>. NULL if not set.
+         */
+        std::vector<_Resource *> _resources;
+    };
+}
+
+#endif //__CASHLEY_RESOURCE_H
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_ROLLBACK_H
+#define __CASHLEY_ROLLBACK_H
+
+#include <vector>
+
+#include "registry.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Slot of an entity as it was on a tick.
+     */
+    struct RollbackEntity {
+        /** Slot of the entity. */
+        unsigned int index;
+        /** Generation of the slot. */
+        unsigned int generation;
+        /** The entity is alive. */
+        bool alive;
+        /** The entity is active. */
+        bool active;
+        /** Slot of the parent, NO_COMPONENT if none. */
+        unsigned int parent;
+    };
+
+    /**
+     * \brief Components of a type as they were on a tick, for some entities.
+     */
+    struct RollbackBlocks {
+        /** Slots of the entities. */
+        std::vector<unsigned int> slots;
+        /** The entity had the component, by position on slots. */
+        std::vector<unsigned char> present;
+        /** Bytes of the components it had, one after another. */
+        std::vector<char> data;
+    };
+
+    /**
+     * \brief What is needed to undo a tick: what it changed, as it was before.
+     */
+    struct RollbackFrame {
+        /** Clock before the tick. */
+        unsigned long long clock;
+        /** Changed entities. */
+        std::vector<RollbackEntity> entities;
+        /** Tags of the changed entities, words per entity. */
+        std::vector<unsigned long long> tags;
+        /** Count of tag words of each entity. */
+        unsigned int words;
+        /** Changed components, by component type. */
+        std::vector<RollbackBlocks> blocks;
+        /** Component types with changed components. */
+        std::vector<unsigned int> types;
+        /** Count of free slots common to the world before and after the tick. */
+        unsigned int keep;
+        /** Free slots before the tick, after the common ones. */
+        std::vector<unsigned int> free;
+        /** Count of slots of the registry before the tick. */
+        unsigned int slots;
+
+        /**
+         * \brief Empty the frame, keeping the memory of its buffers.
+         */
+        void clear();
+    };
+
+    /**
+     * \brief The world as it was at the last tick, to take the frames from.
+     *
+     * Only what rollback needs is kept: the bytes of the components and the
+     * metadata of each slot, in arrays indexed by slot.
+     */
+    struct RollbackWorld {
+        /** Entity of each slot. */
+        std::vector<RollbackEntity> entities;
+        /** Tag bits, by word of 64 tags and slot. */
+        std::vector<std::vector<unsigned long long> > tags;
+        /** The entity has a component, by component type and slot. */
+        std::vector<std::vector<unsigned char> > present;
+        /** Bytes of the components, by component type, a block per slot. */
+        std::vector<std::vector<char> > data;
+        /** Free slots. */
+        std::vector<unsigned int> free;
+        /** Count of slots. */
+        unsigned int slots;
+        /** Clock. */
+        unsigned long long clock;
+        /** Slots already taken for the current frame. */
+        std::vector<unsigned char> marks;
+        /** Entities to destroy, activate or deactivate while a frame is applied. */
+        std::vector<EntityId> gone, activated, deactivated;
+    };
+
+    /**
+     * \brief Ring of the frames to undo the last ticks of an Engine.
+     *
+     * Frames are created with the buffer and reused when it wraps, so their buffers
+     * grow to the size of the largest tick and are not allocated again. The buffer
+     * also keeps the world of the last tick, that frames are taken from.
+     * \see Engine::start_rollback().
+     */
+    class RollbackBuffer {
+    public:
+        /**
+         * \brief Constructor.
+         * \param ticks Count of ticks kept.
+         * \param tick Current tick of the engine.
+         */
+        RollbackBuffer(unsigned int ticks, unsigned long long tick);
+
+        /**
+         * \brief Get a frame for a new tick, dropping the oldest one if full.
+         * \param tick The new tick.
+         * \return Frame to fill, with the contents of a previous tick.
+         */
+        RollbackFrame & push(unsigned long long tick);
+
+        /**
+         * \brief Get the frame of the last tick.
+         */
+        RollbackFrame & back();
+
+        /**
+         * \brief Drop the frame of the last tick.
+         */
+        void pop();
+
+        /**
+         * \brief Get a frame not on the ring, for changes done after the last tick.
+         */
+        inline RollbackFrame & get_pending() { return _pending; }
+
+        /**
+         * \brief Get the world of the last tick.
+         */
+        inline RollbackWorld & get_world() { return _world; }
+
+        /**
+         * \brief Get the oldest tick that can be restored.
+         */
+        inline unsigned long long get_first_tick() const { return _last - _count; }
+
+        /**
+         * \brief Get the last tick with a frame.
+         */
+        inline unsigned long long get_last_tick() const { return _last; }
+
+        /**
+         * \brief Get the count of frames.
+         */
+        inline unsigned int size() const { return _count; }
+
+    private:
+        RollbackBuffer(const RollbackBuffer &);
+        RollbackBuffer & operator=(const RollbackBuffer &);
+        /**
+         * \brief Frames, the oldest at _first.
+         */
+        std::vector<RollbackFrame> _frames;
+        /**
+         * \brief Position of the oldest frame.
+         */
+        unsigned int _first;
+        /**
+         * \brief Count of frames.
+         */
+        unsigned int _count;
+        /**
+         * \brief Tick of the last frame.
+         */
+        unsigned long long _last;
+        /**
+         * \brief Frame of the changes after the last tick.
+         */
+        RollbackFrame _pending;
+        /**
+         * \brief World of the last tick.
+         */
+        RollbackWorld _world;
+    };
+}
+
+#endif //__CASHLEY_ROLLBACK_H
@@ -0,0 +1,339 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_SCHEMA_H
+#define __CASHLEY_SCHEMA_H
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "component.h"
+#include "exceptions.h"
+#include "registry.h"
+#include "snapshot.h"
+
+/**
+ * \brief Marks a field not found in a ComponentSchema.
+ */
+#define FIELD_NONE 0xFFFFFFFFu
+
+namespace CAshley {
+
+    /**
+     * \brief Type of a described field.
+     * Integers and enumerations are told by size and sign. Other trivially copyable
+     * types are opaque bytes.
+     */
+    enum FieldType {
+        FIELD_BOOL,
+        FIELD_INT8,
+        FIELD_UINT8,
+        FIELD_INT16,
+        FIELD_UINT16,
+        FIELD_INT32,
+        FIELD_UINT32,
+        FIELD_INT64,
+        FIELD_UINT64,
+        FIELD_FLOAT,
+        FIELD_DOUBLE,
+        FIELD_ENTITY,
+        FIELD_STRING,
+        FIELD_BYTES
+    };
+
+    /**
+     * \brief FieldType of an integer of a size and sign.
+     */
+    constexpr FieldType integer_field(size_t size, bool sign) {
+        return size == 1 ? (sign ? FIELD_INT8 : FIELD_UINT8) :
+               size == 2 ? (sign ? FIELD_INT16 : FIELD_UINT16) :
+               size == 4 ? (sign ? FIELD_INT32 : FIELD_UINT32) :
+               size == 8 ? (sign ? FIELD_INT64 : FIELD_UINT64) : FIELD_BYTES;
+    }
+
+    template <class F, bool E = std::is_enum<F>::value>
+    struct _integer_of {
+        typedef F type;
+    };
+
+    template <class F>
+    struct _integer_of<F, true> {
+        typedef typename std::underlying_type<F>::type type;
+    };
+
+    /**
+     * \brief FieldType of a member type.
+     * Members that are not trivially copyable can not be described, but std::string.
+     */
+    template <class F, class = void>
+    struct field_type : std::integral_constant<FieldType, FIELD_BYTES> {
+        static_assert(std::is_trivially_copyable<F>::value, "Field type can not be described.");
+    };
+
+    template <class F>
+    struct field_type<F, typename std::enable_if<std::is_integral<F>::value || std::is_enum<F>::value>::type> :
+        std::integral_constant<FieldType, integer_field(sizeof(F), std::is_signed<typename _integer_of<F>::type>::value)> {};
+
+    template <>
+    struct field_type<bool> : std::integral_constant<FieldType, FIELD_BOOL> {};
+
+    template <>
+    struct field_type<float> : std::integral_constant<FieldType, FIELD_FLOAT> {};
+
+    template <>
+    struct field_type<double> : std::integral_constant<FieldType, FIELD_DOUBLE> {};
+
+    template <>
+    struct field_type<EntityId> : std::integral_constant<FieldType, FIELD_ENTITY> {};
+
+    template <>
+    struct field_type<std::string> : std::integral_constant<FieldType, FIELD_STRING> {};
+
+    /**
+     * \brief Described member of a component.
+     */
+    struct SchemaField {
+        /** Name of the member. */
+        std::string name;
+        /** Type of the member, or of its elements. */
+        FieldType type;
+        /** Offset of the member from the start of the component. */
+        size_t offset;
+        /** Size of the member, or of its elements. */
+        size_t size;
+        /** Count of elements: 1, or the length of an array member. */
+        unsigned int count;
+    };
+
+    /**
+     * \brief Description of a component type.
+     *
+     * Every component type has one, with its class string, size, alignment and
+     * markers. Components marked with CASHLEY_FIELDS also list their fields, so
+     * serializers, diffs and tools can walk them without virtual calls. Schemas are
+     * built once per process and never change.
+     * \see component_schema(), SchemaRegistry.
+     */
+    class ComponentSchema {
+    public:
+        /** Class string of the component, see Component::get_name(). */
+        std::string name;
+        /** sizeof() of the component. */
+        size_t size;
+        /** alignof() of the component. */
+        size_t alignment;
+        /** Offset of the Component part from the start of the component. */
+        size_t base;
+        /** Layout version, see CASHLEY_LAYOUT_VERSION. */
+        unsigned int layout;
+        /** The component can be copied with memcpy. */
+        bool block_copyable;
+        /** The component is a tag. */
+        bool tag;
+        /** The component is shared. */
+        bool shared;
+        /** The component is stable. */
+        bool stable;
+        /** The component is marked with CASHLEY_FIELDS. */
+        bool described;
+        /** Described fields, in declaration order. */
+        std::vector<SchemaField> fields;
+        /** Hash of the name, size and fields. Snapshots refuse components with another one. */
+        unsigned long long hash;
+
+        /**
+         * \brief Find a field by name.
+         * \return Index of the field, FIELD_NONE if not described.
+         */
+        unsigned int find(const std::string & field) const;
+
+        /**
+         * \brief Get a field of a component.
+         * \param c Component of this type.
+         * \param field Index of the field.
+         * \return Pointer to the field. Throws a ComponentError if F is not its type.
+         */
+        template <class F>
+        F * get(Component * c, unsigned int field) const {
+            if (field >= fields.size() || fields[field].type != field_type<F>::value || fields[field].size != sizeof(F)) {
+                ComponentError e("Invalid field type.");
+                throw e;
+            }
+            return reinterpret_cast<F *>(_field(c, field));
+        }
+
+        /**
+         * \brief Compare a field of 2 components, bitwise but for strings.
+         */
+        bool equal(const Component * a, const Component * b, unsigned int field) const;
+
+        /**
+         * \brief Compare the described fields of 2 components.
+         */
+        bool equal(const Component * a, const Component * b) const;
+
+        /**
+         * \brief Hash the described fields of a component, bitwise but for strings.
+         * Components equal for equal() have the same hash. Components without
+         * described fields all hash the same.
+         */
+        unsigned long long value_hash(const Component * c) const;
+
+        /**
+         * \brief Find the described fields that differ between 2 components.
+         * \param changed Gets the indexes of the fields.
+         * \return Count of changed fields.
+         */
+        unsigned int diff(const Component * a, const Component * b, std::vector<unsigned int> & changed) const;
+
+        /**
+         * \brief Copy a field between 2 components.
+         */
+        void copy(Component * to, const Component * from, unsigned int field) const;
+
+        /**
+         * \brief Write the described fields of a component to a snapshot.
+         */
+        void save(SnapshotWriter & w, const Component * c) const;
+
+        /**
+         * \brief Read the described fields of a component written by save().
+         */
+        void load(SnapshotReader & r, Component * c) const;
+
+        /**
+         * \brief Readable text of a component, for tools and logs.
+         * \return The class string and the described fields, like "Position{x=1, y=2}".
+         */
+        std::string to_string(const Component * c) const;
+
+    private:
+        inline char * _field(Component * c, unsigned int field) const {
+            return (char *)c - base + fields[field].offset;
+        }
+        inline const char * _field(const Component * c, unsigned int field) const {
+            return (const char *)c - base + fields[field].offset;
+        }
+    };
+
+    /**
+     * \brief Fills the fields of a ComponentSchema.
+     * Used through CASHLEY_FIELD. Offsets are measured on a default constructed component.
+     */
+    template <class T>
+    class SchemaBuilder {
+    public:
+        SchemaBuilder(ComponentSchema & schema) : _schema(schema) {}
+
+        /**
+         * \brief Describe a member.
+         */
+        template <class F>
+        void field(const char * name, F T::* member) {
+            _add(name, (const char *)&(_sample.*member), field_type<F>::value, sizeof(F), 1);
+        }
+
+        /**
+         * \brief Describe an array member.
+         */
+        template <class F, size_t N>
+        void field(const char * name, F (T::* member)[N]) {
+            _add(name, (const char *)&(_sample.*member), field_type<F>::value, sizeof(F), N);
+        }
+
+    private:
+        void _add(const char * name, const char * at, FieldType type, size_t size, unsigned int count) {
+            SchemaField f;
+            f.name = name;
+            f.type = type;
+            f.offset = at - (const char *)&_sample;
+            f.size = size;
+            f.count = count;
+            _schema.fields.push_back(f);
+        }
+        ComponentSchema & _schema;
+        T _sample;
+    };
+
+    /**
+     * \brief Schemas of the component types of the process, by class string.
+     * Thread safe.
+     */
+    class SchemaRegistry {
+    public:
+        /**
+         * \brief Keep a schema and set its hash. Throws a ComponentError if its name
+         * is taken.
+         * \return The kept copy, valid until the process ends.
+         */
+        static const ComponentSchema & add(const ComponentSchema & schema);
+
+        /**
+         * \brief Find a schema by class string.
+         * \return The schema, NULL if no component type of that name was used.
+         */
+        static const ComponentSchema * find(const std::string & name);
+
+        /**
+         * \brief Get every schema, in order of first use.
+         */
+        static std::vector<const ComponentSchema *> list();
+    };
+
+    template <class T>
+    void _describe(SchemaBuilder<T> & b, std::true_type) {
+        T::cashley_describe(b);
+    }
+
+    template <class T>
+    void _describe(SchemaBuilder<T> &, std::false_type) {
+    }
+
+    template <class T>
+    const ComponentSchema & _build_schema() {
+        ComponentSchema s;
+        T x;
+        s.name = x.get_name();
+        s.size = sizeof(T);
+        s.alignment = alignof(T);
+        s.base = (const char *)static_cast<Component *>(&x) - (const char *)&x;
+        s.layout = layout_version<T>::value;
+        s.block_copyable = is_block_copyable<T>::value;
+        s.tag = is_tag<T>::value;
+        s.shared = is_shared<T>::value;
+        s.stable = is_stable<T>::value;
+        s.described = has_fields<T>::value;
+        SchemaBuilder<T> b(s);
+        _describe(b, has_fields<T>());
+        return SchemaRegistry::add(s);
+    }
+
+    /**
+     * \brief Get the schema of a component type, building it on first use.
+     */
+    template <class T>
+    const ComponentSchema & component_schema() {
+        static const ComponentSchema & schema = _build_schema<T>();
+        return schema;
+    }
+}
+
+#endif //__CASHLEY_SCHEMA_H
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_SHAREDEXPORT_H
+#define __CASHLEY_SHAREDEXPORT_H
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "schema.h"
+
+/**
+ * \brief First bytes of an export segment ("CASX").
+ */
+#define EXPORT_MAGIC 0x58534143u
+
+/**
+ * \brief Version of the layout of an export segment.
+ */
+#define EXPORT_VERSION 1u
+
+/**
+ * \brief Max length of a name on an export segment, with the terminating zero.
+ */
+#define EXPORT_NAME 64u
+
+/**
+ * \brief Max described fields of a type on an export segment.
+ */
+#define EXPORT_FIELDS 16u
+
+/**
+ * \brief Alignment of the blocks of each type on an export segment.
+ */
+#define EXPORT_ALIGNMENT 64u
+
+namespace CAshley {
+
+    /**
+     * \brief A described field of an exported type.
+     */
+    struct ExportField {
+        /** Name of the member. */
+        char name[EXPORT_NAME];
+        /** FieldType of the member, or of its elements. */
+        unsigned int type;
+        /** Offset of the member from the start of a block. */
+        unsigned int offset;
+        /** Size of the member, or of its elements. */
+        unsigned int size;
+        /** Count of elements. */
+        unsigned int count;
+    };
+
+    /**
+     * \brief An exported component type.
+     */
+    struct ExportType {
+        /** Class string of the components. */
+        char name[EXPORT_NAME];
+        /** Position of the blocks from the start of the segment. */
+        unsigned long long offset;
+        /** Size of a block. */
+        unsigned int block_size;
+        /** Max blocks on the segment. */
+        unsigned int capacity;
+        /** Active components on the engine. */
+        unsigned int active;
+        /** Blocks on the segment, the first active components up to the capacity. */
+        unsigned int count;
+        /** Count of described fields. */
+        unsigned int field_count;
+        /** Described fields, the first EXPORT_FIELDS. */
+        ExportField fields[EXPORT_FIELDS];
+    };
+
+    /**
+     * \brief Start of an export segment, followed by the types and their blocks.
+     */
+    struct ExportHeader {
+        /** EXPORT_MAGIC, written once the layout is filled. */
+        unsigned int magic;
+        /** EXPORT_VERSION. */
+        unsigned int version;
+        /** Odd while the segment is being written. */
+        std::atomic<unsigned long long> sequence;
+        /** Size of the segment. */
+        unsigned long long size;
+        /** Tick of the engine. */
+        unsigned long long tick;
+        /** Clock of the engine. */
+        unsigned long long clock;
+        /** Alive entities. */
+        unsigned int entities;
+        /** Count of exported types. */
+        unsigned int type_count;
+    };
+
+    /**
+     * \brief POSIX shared memory segment mirroring some caches, for other processes.
+     *
+     * The layout is fixed on creation. publish copies the active blocks of the
+     * caches under a sequence counter: readers map the segment read-only and retry
+     * while it is odd or changed while reading, so they never stop the writer.
+     * Blocks are bitwise copies: readers use the described fields and must not
+     * follow pointers. A segment with the same name is replaced, and the segment is
+     * removed when the export is destroyed.
+     * \see SharedExportReader, Engine::start_export().
+     */
+    class SharedExport {
+    public:
+        /**
+         * \brief Create the segment.
+         * \param name Name of the segment, like "/cashley-debug".
+         * \param types Schema of each type.
+         * \param capacity Max blocks of each type.
+         */
+        SharedExport(const std::string & name, const std::vector<const ComponentSchema *> & types, unsigned int capacity);
+        /**
+         * \brief Default destructor. Unmaps and removes the segment.
+         */
+        ~SharedExport();
+        /**
+         * \brief Copy the active blocks of the caches, in the order of the types.
+         */
+        void publish(unsigned long long tick, unsigned long long clock, unsigned int entities,
+                     const std::vector<_Cache *> & caches);
+        /**
+         * \brief Get the header of the segment.
+         */
+        inline const ExportHeader * get_header() const { return _header; }
+    private:
+        SharedExport(const SharedExport &);
+        SharedExport & operator=(const SharedExport &);
+        /**
+         * \brief Name of the segment.
+         */
+        std::string _name;
+        /**
+         * \brief Mapping of the segment.
+         */
+        ExportHeader * _header;
+    };
+
+    /**
+     * \brief Read-only view of an export segment, for other processes.
+     *
+     * Usage:
+     * \code
+     * unsigned long long seq;
+     * do {
+     *     seq = reader.read_begin();
+     *     // Read or copy the blocks.
+     * } while (reader.read_retry(seq));
+     * \endcode
+     */
+    class SharedExportReader {
+    public:
+        /**
+         * \brief Map a segment.
+         * \param name Name of the segment.
+         */
+        SharedExportReader(const std::string & name);
+        /**
+         * \brief Default destructor. Unmaps the segment.
+         */
+        ~SharedExportReader();
+        /**
+         * \brief Get the header of the segment.
+         */
+        inline const ExportHeader * get_header() const { return _header; }
+        /**
+         * \brief Get an exported type.
+         * \param i Position of the type, less than ExportHeader::type_count.
+         */
+        const ExportType * get_type(unsigned int i) const;
+        /**
+         * \brief Find an exported type by class string.
+         * \return The position of the type, or FIELD_NONE if not exported.
+         */
+        unsigned int find_type(const std::string & name) const;
+        /**
+         * \brief Get the blocks of an exported type.
+         */
+        const char * get_blocks(unsigned int i) const;
+        /**
+         * \brief Start a read, waiting while the segment is being written.
+         * \return Sequence to pass to read_retry().
+         */
+        unsigned long long read_begin() const;
+        /**
+         * \brief Check if the segment changed since read_begin().
+         * \return true if the read has to be done again.
+         */
+        bool read_retry(unsigned long long sequence) const;
+    private:
+        SharedExportReader(const SharedExportReader &);
+        SharedExportReader & operator=(const SharedExportReader &);
+        /**
+         * \brief Mapping of the segment.
+         */
+        const ExportHeader * _header;
+        /**
+         * \brief Size of the mapping.
+         */
+        size_t _size;
+    };
+}
+
+#endif //__CASHLEY_SHAREDEXPORT_H
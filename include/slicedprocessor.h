@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_SLICEDPROCESSOR_H
+#define __CASHLEY_SLICEDPROCESSOR_H
+
+#include <utility>
+#include <vector>
+
+#include "processor.h"
+
+namespace CAshley {
+
+    class Entity;
+
+    /**
+     * \brief Class to inherit for processors that spread their entities over several ticks.
+     *
+     * The processor walks the entities of its Family (see Processor::set_family()) in
+     * a fixed order, keeping a cursor between ticks. Each tick, process_entity is
+     * called for the next entities until the budget is spent. When the end of the
+     * entities is reached, a new pass starts from the beginning.
+     *
+     * Entities that stay in the Family are visited at least once every
+     * ceil(n / budget) + 1 ticks, being n the max entity count during that time,
+     * even if other entities are added or removed meanwhile.
+     */
+    class SlicedProcessor : public Processor {
+    public:
+        /**
+         * \brief Default constructor.
+         * By default there is no budget: all entities are processed on each tick.
+         */
+        SlicedProcessor();
+        /**
+         * \brief Limit the entities processed per tick.
+         * \param entities Max entities per tick. 0 means no limit.
+         */
+        void set_entity_budget(unsigned int entities);
+        /**
+         * \brief Limit the time spent per tick.
+         * \param microseconds Max time per tick. 0 means no limit.
+         * \param min_entities Entities processed per tick even if the time is spent,
+         * to guarantee progress.
+         */
+        void set_time_budget(unsigned int microseconds, unsigned int min_entities=1);
+        /**
+         * \brief Process an entity.
+         * \param e Entity to process.
+         * \param delay Engine clock elapsed since the entity was processed on the
+         * previous pass, or the tick delay if it was not.
+         */
+        virtual void process_entity(Entity * e, unsigned int delay) = 0;
+        /**
+         * \brief Run a tick, processing the next slice of entities.
+         * \param delay Delay passed to engine.
+         */
+        virtual void run_tick(unsigned int delay);
+        /**
+         * \brief Get the count of completed passes over the entities.
+         * \return Completed passes.
+         */
+        inline unsigned int get_passes() { return _passes; }
+    private:
+        /**
+         * \brief Start a new pass over the entities.
+         */
+        void _new_pass();
+        /**
+         * \brief Get the delay for an entity from the marks of the previous pass.
+         */
+        unsigned int _entity_delay(unsigned int index, unsigned int delay);
+        /**
+         * \brief Max entities per tick. 0 means no limit.
+         */
+        unsigned int _entity_budget;
+        /**
+         * \brief Max microseconds per tick. 0 means no limit.
+         */
+        unsigned int _time_budget;
+        /**
+         * \brief Entities processed per tick regardless of _time_budget.
+         */
+        unsigned int _min_entities;
+        /**
+         * \brief Slot of the last entity processed on the current pass. NO_COMPONENT at pass start.
+         */
+        unsigned int _cursor;
+        /**
+         * \brief Completed passes.
+         */
+        unsigned int _passes;
+        /**
+         * \brief Slot of the first entity processed on each tick of the current pass, with the clock.
+         */
+        std::vector<std::pair<unsigned int, unsigned long long> > _marks;
+        /**
+         * \brief Marks of the previous pass.
+         */
+        std::vector<std::pair<unsigned int, unsigned long long> > _last_marks;
+        /**
+         * \brief Position on _last_marks of the last entity processed.
+         */
+        unsigned int _last_mark;
+    };
+
+}
+
+#endif //__CASHLEY_SLICEDPROCESSOR_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_SMALLVECTOR_H
+#define __CASHLEY_SMALLVECTOR_H
+
+#include <cstring>
+
+namespace CAshley {
+
+    /**
+     * \brief Vector that keeps its first N elements inline.
+     *
+     * Only heap allocates when it grows past N. Elements are moved bitwise, so T
+     * must be trivially copyable. Erasing does not keep the order.
+     */
+    template <class T, unsigned int N>
+    class SmallVector {
+    public:
+        SmallVector() {
+            _v = _inline;
+            _size = 0;
+            _capacity = N;
+        }
+
+        SmallVector(const SmallVector & o) {
+            _v = _inline;
+            _size = 0;
+            _capacity = N;
+            *this = o;
+        }
+
+        ~SmallVector() {
+            if (_v != _inline) {
+                delete [] _v;
+            }
+        }
+
+        SmallVector & operator=(const SmallVector & o) {
+            if (this != &o) {
+                _size = 0;
+                _reserve(o._size);
+                memcpy((void *)_v, (const void *)o._v, sizeof(T) * o._size);
+                _size = o._size;
+            }
+            return *this;
+        }
+
+        /**
+         * \brief Add an element to the end.
+         */
+        void push_back(const T & t) {
+            if (_size == _capacity) {
+                _reserve(_capacity * 2);
+            }
+            _v[_size] = t;
+            _size++;
+        }
+
+        /**
+         * \brief Remove an element, moving the last one to its position.
+         * \param i Position of the element.
+         */
+        void erase(unsigned int i) {
+            _size--;
+            _v[i] = _v[_size];
+        }
+
+        /**
+         * \brief Remove all the elements. Memory is kept.
+         */
+        inline void clear() { _size = 0; }
+
+        inline unsigned int size() const { return _size; }
+        inline bool empty() const { return _size == 0; }
+        inline T & operator[](unsigned int i) { return _v[i]; }
+        inline const T & operator[](unsigned int i) const { return _v[i]; }
+        inline T * begin() { return _v; }
+        inline T * end() { return _v + _size; }
+
+    private:
+        /**
+         * \brief Grow the storage to hold at least n elements.
+         */
+        void _reserve(unsigned int n) {
+            if (n <= _capacity) {
+                return;
+            }
+            T * v = new T[n];
+            memcpy((void *)v, (const void *)_v, sizeof(T) * _size);
+            if (_v != _inline) {
+                delete [] _v;
+            }
+            _v = v;
+            _capacity = n;
+        }
+        /**
+         * \brief Elements, _inline or heap memory.
+         */
+        T * _v;
+        /**
+         * \brief Count of elements.
+         */
+        unsigned int _size;
+        /**
+         * \brief Count of elements that fit in _v.
+         */
+        unsigned int _capacity;
+        /**
+         * \brief Inline storage.
+         */
+        T _inline[N];
+    };
+}
+
+#endif //__CASHLEY_SMALLVECTOR_H
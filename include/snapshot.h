@@ -0,0 +1,287 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_SNAPSHOT_H
+#define __CASHLEY_SNAPSHOT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "exceptions.h"
+
+/**
+ * \brief First bytes of a snapshot ("CASH").
+ */
+#define SNAPSHOT_MAGIC 0x48534143u
+
+/**
+ * \brief First bytes of a delta ("CASD").
+ */
+#define DELTA_MAGIC 0x44534143u
+
+/**
+ * \brief Version of the snapshot format. Snapshots of other versions are refused.
+ */
+#define SNAPSHOT_VERSION 3u
+
+/**
+ * \brief Alignment of the blobs of a snapshot, from its first byte.
+ */
+#define SNAPSHOT_ALIGNMENT 64u
+
+namespace CAshley {
+
+    /**
+     * \brief Checksum of a snapshot section.
+     * Reads 8 bytes per step, to check big sections at memory speed.
+     */
+    unsigned long long snapshot_checksum(const void * data, size_t size);
+
+    /**
+     * \brief Appends a snapshot to a buffer.
+     *
+     * A snapshot is a fixed header, the blobs and the stream. Blobs are big arrays
+     * written with one copy, aligned so a mapped snapshot can use them in place.
+     * Everything else goes to the stream, which ends with the list of blobs and their
+     * checksums. The stream has a checksum too.
+     * Values are written in the byte order of the machine: snapshots are meant to be
+     * loaded by the same build that saved them.
+     * \see Engine::save_snapshot().
+     */
+    class SnapshotWriter {
+    public:
+        /**
+         * \brief Constructor.
+         * \param out Buffer. The snapshot is appended to it.
+         * \param magic First bytes, SNAPSHOT_MAGIC or DELTA_MAGIC.
+         */
+        SnapshotWriter(std::vector<char> & out, unsigned int magic=SNAPSHOT_MAGIC);
+
+        /**
+         * \brief Write raw bytes to the stream.
+         */
+        void write(const void * data, size_t size);
+
+        /**
+         * \brief Write a value bitwise to the stream.
+         */
+        template <class T>
+        void write(const T & x) {
+            write(&x, sizeof(T));
+        }
+
+        /**
+         * \brief Write the size of an array and its elements bitwise to the stream.
+         */
+        template <class T>
+        void write_vector(const std::vector<T> & v) {
+            write((unsigned int)v.size());
+            if (!v.empty()) {
+                write(&v[0], sizeof(T) * v.size());
+            }
+        }
+
+        /**
+         * \brief Write the size of a string and its characters to the stream.
+         */
+        void write_string(const std::string & s);
+
+        /**
+         * \brief Write a blob.
+         * The stream gets a reference to it.
+         * \return The copy of the blob, valid until the next write. It can be changed
+         * until finish().
+         */
+        char * write_blob(const void * data, size_t size);
+
+        /**
+         * \brief Get the count of bytes written to the stream.
+         */
+        inline size_t get_size() const { return _stream.size(); }
+
+        /**
+         * \brief Append the stream and fill the header.
+         * Nothing can be written afterwards.
+         */
+        void finish();
+
+    private:
+        /**
+         * \brief Buffer.
+         */
+        std::vector<char> & _out;
+        /**
+         * \brief First bytes.
+         */
+        unsigned int _magic;
+        /**
+         * \brief Position of the snapshot on the buffer.
+         */
+        size_t _start;
+        /**
+         * \brief Stream, appended by finish().
+         */
+        std::vector<char> _stream;
+        /**
+         * \brief Position and size of each blob.
+         */
+        std::vector<std::pair<size_t, size_t> > _blobs;
+    };
+
+    /**
+     * \brief Reads a snapshot from memory.
+     *
+     * The header and the checksums are checked on construction, so a bad snapshot is
+     * refused before anything is loaded. The data is not copied: it must outlive the
+     * reader. Reading past the end of the stream throws a SnapshotError.
+     * \see Engine::load_snapshot().
+     */
+    class SnapshotReader {
+    public:
+        /**
+         * \brief Constructor.
+         * \param data First byte of the snapshot.
+         * \param size Count of bytes.
+         * \param mapped The data is a SnapshotMapping that outlives the loaded objects,
+         * so they can use blobs in place.
+         * \param verify Check the checksum of the blobs.
+         * \param magic Expected first bytes, SNAPSHOT_MAGIC or DELTA_MAGIC.
+         */
+        SnapshotReader(const char * data, size_t size, bool mapped=false, bool verify=true, unsigned int magic=SNAPSHOT_MAGIC);
+
+        /**
+         * \brief Read raw bytes from the stream.
+         */
+        void read(void * data, size_t size);
+
+        /**
+         * \brief Read a value written bitwise.
+         */
+        template <class T>
+        T read() {
+            T x;
+            read(&x, sizeof(T));
+            return x;
+        }
+
+        /**
+         * \brief Read an array written by SnapshotWriter::write_vector().
+         */
+        template <class T>
+        void read_vector(std::vector<T> & v) {
+            unsigned int n = read<unsigned int>();
+            _check(sizeof(T) * (size_t)n);
+            v.resize(n);
+            if (n) {
+                read(&v[0], sizeof(T) * n);
+            }
+        }
+
+        /**
+         * \brief Read a string written by SnapshotWriter::write_string().
+         */
+        std::string read_string();
+
+        /**
+         * \brief Read a blob written by SnapshotWriter::write_blob().
+         * \param size Expected size of the blob.
+         * \return The blob, inside the snapshot data.
+         */
+        const char * read_blob(size_t size);
+
+        /**
+         * \brief Check if blobs can be used in place.
+         * \see SnapshotMapping.
+         */
+        inline bool is_mapped() const { return _mapped; }
+
+        /**
+         * \brief Get the count of bytes of the stream not read yet.
+         */
+        inline size_t remaining() const { return _end - _pos; }
+
+    private:
+        /**
+         * \brief Throw a SnapshotError if less than size bytes are left on the stream.
+         */
+        void _check(size_t size);
+        /**
+         * \brief Snapshot.
+         */
+        const char * _data;
+        /**
+         * \brief Count of bytes of the snapshot.
+         */
+        size_t _size;
+        /**
+         * \brief Position of the next byte of the stream.
+         */
+        size_t _pos;
+        /**
+         * \brief End of the stream.
+         */
+        size_t _end;
+        /**
+         * \brief Blobs can be used in place.
+         */
+        bool _mapped;
+    };
+
+    /**
+     * \brief Snapshot file mapped in memory.
+     *
+     * Pages are loaded by the kernel when first read, and the mapping is private:
+     * the first write to a page copies it, and writes never reach the file.
+     */
+    class SnapshotMapping {
+    public:
+        /**
+         * \brief Map a snapshot file.
+         * \param path Path of the file.
+         */
+        SnapshotMapping(const std::string & path);
+        ~SnapshotMapping();
+
+        /**
+         * \brief Get the first byte of the file.
+         */
+        inline const char * data() const { return _data; }
+
+        /**
+         * \brief Get the count of bytes of the file.
+         */
+        inline size_t size() const { return _size; }
+
+    private:
+        SnapshotMapping(const SnapshotMapping &);
+        SnapshotMapping & operator=(const SnapshotMapping &);
+        /**
+         * \brief Mapped file.
+         */
+        char * _data;
+        /**
+         * \brief Count of bytes of the file.
+         */
+        size_t _size;
+    };
+}
+
+#endif //__CASHLEY_SNAPSHOT_H
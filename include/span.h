@@ -0,0 +1,67 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_SPAN_H
+#define __CASHLEY_SPAN_H
+
+#include <cstddef>
+
+namespace CAshley {
+
+    /**
+     * \brief View over contiguous elements. It does not own them.
+     */
+    template <class T>
+    class Span {
+    public:
+        Span() : _data(NULL), _size(0) {}
+        Span(T * data, unsigned int size) : _data(data), _size(size) {}
+
+        /**
+         * \brief Get the count of elements.
+         */
+        inline unsigned int size() const { return _size; }
+        /**
+         * \brief Check if there are not elements.
+         */
+        inline bool empty() const { return !_size; }
+        /**
+         * \brief Get the pointer to the first element.
+         */
+        inline T * data() const { return _data; }
+        inline T * begin() const { return _data; }
+        inline T * end() const { return _data + _size; }
+        /**
+         * \brief Get an element. Not checked.
+         */
+        inline T & operator[](unsigned int i) const { return _data[i]; }
+    private:
+        /**
+         * \brief First element.
+         */
+        T * _data;
+        /**
+         * \brief Count of elements.
+         */
+        unsigned int _size;
+    };
+}
+
+#endif //__CASHLEY_SPAN_H
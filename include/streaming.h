@@ -0,0 +1,207 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_STREAMING_H
+#define __CASHLEY_STREAMING_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "registry.h"
+
+/**
+ * \brief First bytes of a region file ("CASR").
+ */
+#define REGION_MAGIC 0x52534143u
+
+/**
+ * \brief Max entities of a batch of a region file, the unit of a commit.
+ */
+#define REGION_BATCH 256u
+
+namespace CAshley {
+
+    /**
+     * \brief State of a streamed region.
+     * \see Engine::start_streaming().
+     */
+    enum RegionState {
+        /** On disk, or never assigned. */
+        REGION_UNLOADED,
+        /** Being read, or committed to the engine batch by batch. */
+        REGION_LOADING,
+        /** Its entities are on the engine. */
+        REGION_LOADED,
+        /** Copied from the engine batch by batch, then written. */
+        REGION_UNLOADING
+    };
+
+    /**
+     * \brief Entity of a region file: its id when saved, and its position on the file.
+     * Region files list them sorted by id, to find the entities of the region.
+     */
+    struct RegionEntity {
+        /** Id when saved. */
+        EntityId id;
+        /** Position on the batches of the file. */
+        unsigned int position;
+
+        /** Order by id. */
+        inline bool operator<(const RegionEntity & o) const {
+            return id.index < o.id.index || (id.index == o.id.index && id.generation < o.id.generation);
+        }
+    };
+
+    /**
+     * \brief Entities of a region being unloaded, as copied by the engine.
+     *
+     * The engine only copies the components of each entity, in the order they come.
+     * Grouping them in batches, sorting the ids and writing the file are left to
+     * the streamer.
+     */
+    struct RegionStage {
+        /** Components, then the type table, on the stream of a snapshot. */
+        std::vector<char> data;
+        /** Position of the type table on the stream. */
+        size_t table;
+        /** Entities. */
+        std::vector<EntityId> ids;
+        /** The entity is active, by entity. */
+        std::vector<unsigned char> active;
+        /** First component of each entity, and one past the last one. */
+        std::vector<unsigned int> firsts;
+        /** Component type of each component, in type order for each entity. */
+        std::vector<unsigned int> types;
+        /** Position of each component on the stream, and one past the last one. Tags have no bytes. */
+        std::vector<size_t> offsets;
+        /** Position on the type table, by component type. */
+        std::vector<unsigned int> positions;
+    };
+
+    /**
+     * \brief Background thread reading and writing region files.
+     *
+     * Jobs run in order, so a region read after being written gets the new file.
+     * Read files are checked on the thread, and staged until taken by the engine.
+     * Files are encoded on the thread from the components copied by the engine.
+     */
+    class RegionStreamer {
+    public:
+        /**
+         * \brief Start the thread.
+         * \param directory Directory of the region files.
+         */
+        RegionStreamer(const std::string & directory);
+        /**
+         * \brief Default destructor. Runs the queued jobs and stops the thread.
+         */
+        ~RegionStreamer();
+        /**
+         * \brief Get the path of the file of a region.
+         */
+        std::string get_path(unsigned int region) const;
+        /**
+         * \brief Queue the read of a region file.
+         */
+        void read(unsigned int region);
+        /**
+         * \brief Queue the encoding and write of a region file.
+         * \param stage Entities of the region. Taken, left empty.
+         */
+        void write(unsigned int region, RegionStage & stage);
+        /**
+         * \brief Take the result of a finished job: a read file, or a failed write.
+         * \param region Gets the region.
+         * \param data Gets the read file. Empty if the job failed.
+         * \param write Gets if the job was a write. Only failed writes are reported.
+         * \return false if no job has finished.
+         */
+        bool take(unsigned int & region, std::vector<char> & data, bool & write);
+        /**
+         * \brief Wait until all the queued jobs are done.
+         */
+        void wait();
+    private:
+        RegionStreamer(const RegionStreamer &);
+        RegionStreamer & operator=(const RegionStreamer &);
+        struct _Job {
+            unsigned int region;
+            bool write;
+            std::vector<char> data;
+            RegionStage stage;
+        };
+        /**
+         * \brief Loop of the thread.
+         */
+        void _work();
+        /**
+         * \brief Run a job outside the lock.
+         * \return true if it succeeded.
+         */
+        bool _run(_Job & job);
+        /**
+         * \brief Write a region file from the entities copied by the engine.
+         * Entities with the same status and components are grouped in batches.
+         */
+        static void _encode(const RegionStage & stage, std::vector<char> & out);
+        /**
+         * \brief Directory of the region files.
+         */
+        std::string _directory;
+        /**
+         * \brief Queued jobs.
+         */
+        std::deque<_Job> _jobs;
+        /**
+         * \brief Finished reads and failed writes.
+         */
+        std::deque<_Job> _done;
+        /**
+         * \brief Is the thread running a job?
+         */
+        bool _busy;
+        /**
+         * \brief Is the thread stopping?
+         */
+        bool _stopping;
+        /**
+         * \brief Protects _jobs, _done, _busy and _stopping.
+         */
+        std::mutex _mutex;
+        /**
+         * \brief Signaled when a job is queued or the thread stops.
+         */
+        std::condition_variable _queued;
+        /**
+         * \brief Signaled when a job is done.
+         */
+        std::condition_variable _finished;
+        /**
+         * \brief I/O thread.
+         */
+        std::thread _thread;
+    };
+}
+
+#endif //__CASHLEY_STREAMING_H
@@ -0,0 +1,248 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_TASK_H
+#define __CASHLEY_TASK_H
+
+#if __cplusplus < 202002L
+#error "task.h needs C++20 coroutines."
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+
+#include "component.h"
+#include "entity.h"
+#include "exceptions.h"
+#include "processor.h"
+#include "taskqueue.h"
+#include "typeid.h"
+
+namespace CAshley {
+
+    /**
+     * \brief A coroutine scheduled by a TaskQueue.
+     *
+     * A task does not start until it is spawned with Engine::spawn or
+     * CoroutineProcessor::spawn. The coroutine frame is destroyed when it finishes.
+     * Inside a task, use co_await with next_tick(), delay() or component_changed().
+     */
+    class Task {
+    public:
+        /**
+         * \brief Promise of the coroutine. The TaskNode lives inside the frame.
+         */
+        class promise_type : public TaskNode {
+        public:
+            /**
+             * \brief Awaiter for the end of the task. Hands the frame back to the queue.
+             */
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    promise_type & p = h.promise();
+                    if (p._queue) {
+                        p._queue->finish(&p);
+                    }
+                }
+                void await_resume() noexcept {}
+            };
+
+            Task get_return_object() {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+            FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+            void return_void() {}
+            void unhandled_exception() { _exception = std::current_exception(); }
+            virtual void resume() { std::coroutine_handle<promise_type>::from_promise(*this).resume(); }
+            virtual void destroy() { std::coroutine_handle<promise_type>::from_promise(*this).destroy(); }
+        };
+
+        Task(Task && t) noexcept : _handle(t._handle) {
+            t._handle = std::coroutine_handle<promise_type>();
+        }
+        Task(const Task &) = delete;
+        Task & operator=(const Task &) = delete;
+        /**
+         * \brief Default destructor. Destroys the coroutine if it was never spawned.
+         */
+        ~Task() {
+            if (_handle) {
+                _handle.destroy();
+            }
+        }
+        /**
+         * \brief Give up ownership of the coroutine to a TaskQueue.
+         * \return Node of the task.
+         */
+        TaskNode * release() {
+            if (!_handle) {
+                TaskError e("Task already released.");
+                throw e;
+            }
+            TaskNode * n = &_handle.promise();
+            _handle = std::coroutine_handle<promise_type>();
+            return n;
+        }
+    private:
+        explicit Task(std::coroutine_handle<promise_type> h) : _handle(h) {}
+        /**
+         * \brief The coroutine, until it is released.
+         */
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+    /**
+     * \brief Awaiter for the next run of the task queue.
+     */
+    struct NextTick {
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<Task::promise_type> h) {
+            Task::promise_type & p = h.promise();
+            p._queue->wait_next_run(&p);
+        }
+        void await_resume() noexcept {}
+    };
+
+    /**
+     * \brief Awaiter for a clock delay.
+     */
+    struct Delay {
+        unsigned long long delay;
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<Task::promise_type> h) {
+            Task::promise_type & p = h.promise();
+            p._queue->wait_delay(&p, delay);
+        }
+        void await_resume() noexcept {}
+    };
+
+    /**
+     * \brief Awaiter for a component change on an Entity.
+     * co_await returns false if the Entity was removed instead.
+     */
+    struct ComponentChanged {
+        Entity * entity;
+        unsigned int component;
+        TaskNode * node;
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<Task::promise_type> h) {
+            node = &h.promise();
+            node->_queue->wait_component(node, entity, component);
+        }
+        bool await_resume() noexcept { return node->_result; }
+    };
+
+    /**
+     * \brief Suspend the task until the next run of its queue.
+     * For engine tasks, the next Engine::run_tick.
+     */
+    inline NextTick next_tick() {
+        return NextTick();
+    }
+
+    /**
+     * \brief Suspend the task until the clock advances a delay.
+     * \param d Delay, in the units passed to Engine::run_tick.
+     */
+    inline Delay delay(unsigned long long d) {
+        Delay r;
+        r.delay = d;
+        return r;
+    }
+
+    /**
+     * \brief Suspend the task until a component T is added to or removed from an Entity.
+     * \param e Entity to wait on.
+     */
+    template <class T>
+    ComponentChanged component_changed(Entity * e) {
+        if (! std::is_base_of<Component, T>::value) {
+            ComponentError err("Invalid component class");
+            throw err;
+        }
+        ComponentChanged r;
+        r.entity = e;
+        r.component = TypeId<Component, T>::get();
+        r.node = NULL;
+        return r;
+    }
+
+    /**
+     * \brief Class to inherit for processors written as a coroutine.
+     *
+     * run() is spawned on the first tick the processor runs. The processor owns a
+     * TaskQueue that is run on each of its ticks, so its tasks follow the processor
+     * priority and schedule, and next_tick() waits until the next run of the processor.
+     */
+    class CoroutineProcessor : public Processor {
+    public:
+        CoroutineProcessor() : _started(false), _delay(0) {}
+        /**
+         * \brief Body of the processor.
+         */
+        virtual Task run() = 0;
+        /**
+         * \brief Run a tick, resuming the ready tasks of the processor.
+         * \param delay Delay passed to engine.
+         */
+        virtual void run_tick(unsigned int delay) {
+            _delay = delay;
+            if (!_started) {
+                _started = true;
+                _queue.spawn(run().release());
+            }
+            _queue.run(_engine->get_clock());
+        }
+        /**
+         * \brief Run another task on this processor.
+         * \param t Task to run.
+         */
+        void spawn(Task t) {
+            _queue.spawn(t.release());
+        }
+        /**
+         * \brief Get the delay of the current run.
+         */
+        inline unsigned int get_delay() { return _delay; }
+        /**
+         * \brief Get the count of live tasks of the processor.
+         */
+        inline unsigned int get_task_count() { return _queue.size(); }
+    private:
+        /**
+         * \brief Has run() been spawned?
+         */
+        bool _started;
+        /**
+         * \brief Delay of the current run.
+         */
+        unsigned int _delay;
+        /**
+         * \brief Tasks of the processor.
+         */
+        TaskQueue _queue;
+    };
+
+}
+
+#endif //__CASHLEY_TASK_H
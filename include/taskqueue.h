@@ -0,0 +1,184 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_TASKQUEUE_H
+#define __CASHLEY_TASKQUEUE_H
+
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace CAshley {
+
+    class Entity;
+    class TaskQueue;
+
+    /**
+     * \brief A suspended task.
+     *
+     * The node is stored inside the task itself (see Task in task.h), and linked
+     * into the queue lists, so suspending and resuming a task never allocates.
+     */
+    class TaskNode {
+    public:
+        TaskNode();
+        virtual ~TaskNode();
+        /**
+         * \brief Resume the task until its next suspension point.
+         */
+        virtual void resume() = 0;
+        /**
+         * \brief Destroy the task.
+         */
+        virtual void destroy() = 0;
+
+        /**
+         * \brief Queue owning the task.
+         */
+        TaskQueue * _queue;
+        /**
+         * \brief Next node on the list the task is waiting on.
+         */
+        TaskNode * _next;
+        /**
+         * \brief Previous and next node on the list of live tasks of the queue.
+         */
+        TaskNode * _prev_task, * _next_task;
+        /**
+         * \brief Clock when a delayed task has to be resumed.
+         */
+        unsigned long long _wake;
+        /**
+         * \brief Entity the task is waiting on, if any.
+         */
+        Entity * _entity;
+        /**
+         * \brief Type of the component the task is waiting on, TypeId<Component, T>.
+         */
+        unsigned int _component;
+        /**
+         * \brief Result of the last wait. false if the waited Entity was removed.
+         */
+        bool _result;
+        /**
+         * \brief Exception thrown by the task, if any.
+         */
+        std::exception_ptr _exception;
+    };
+
+    /**
+     * \brief Scheduler of tasks.
+     *
+     * Tasks wait on the next run of the queue, on a clock, or on a component
+     * change of an Entity. Each TaskQueue::run call resumes the tasks that are
+     * ready. The Engine owns a queue run at the start of each tick, and every
+     * CoroutineProcessor owns a queue run on its own schedule.
+     */
+    class TaskQueue {
+    public:
+        TaskQueue();
+        /**
+         * \brief Default destructor. Destroys the tasks that did not finish.
+         */
+        ~TaskQueue();
+        /**
+         * \brief Take ownership of a task and resume it on the next run.
+         * \param t Task to run.
+         */
+        void spawn(TaskNode * t);
+        /**
+         * \brief Resume all the tasks ready at a clock.
+         * Tasks waiting the next run, tasks whose delay expired and tasks woken up by
+         * a component change are resumed, until all of them are suspended again.
+         * If a task throws, the exception is rethrown after it is destroyed.
+         * \param clock Current clock.
+         */
+        void run(unsigned long long clock);
+        /**
+         * \brief Suspend a task until the next run.
+         */
+        void wait_next_run(TaskNode * t);
+        /**
+         * \brief Suspend a task for a delay.
+         * \param t Task.
+         * \param delay Clock to wait, since the current run.
+         */
+        void wait_delay(TaskNode * t, unsigned long long delay);
+        /**
+         * \brief Suspend a task until a component is added or removed from an Entity.
+         * The task is also woken up if the Entity is removed.
+         * \param t Task.
+         * \param e Entity.
+         * \param type Type of the component, TypeId<Component, T>.
+         */
+        void wait_component(TaskNode * t, Entity * e, unsigned int type);
+        /**
+         * \brief Put a task on the ready list.
+         */
+        void ready(TaskNode * t);
+        /**
+         * \brief Called by a finished task. Destroys it.
+         */
+        void finish(TaskNode * t);
+        /**
+         * \brief Get the count of live tasks.
+         * \return Tasks spawned and not finished.
+         */
+        inline unsigned int size() { return _size; }
+        /**
+         * \brief Get the clock of the last run.
+         */
+        inline unsigned long long get_clock() { return _clock; }
+    private:
+        /**
+         * \brief Heap order of _timers. Earliest wake up on top.
+         */
+        static bool _wakes_later(const TaskNode * a, const TaskNode * b);
+        /**
+         * \brief Ready tasks (head and tail).
+         */
+        TaskNode * _ready, * _ready_last;
+        /**
+         * \brief Tasks waiting the next run (head and tail).
+         */
+        TaskNode * _waiting, * _waiting_last;
+        /**
+         * \brief Delayed tasks (heap). Its capacity is reused between runs.
+         */
+        std::vector<TaskNode *> _timers;
+        /**
+         * \brief Live tasks.
+         */
+        TaskNode * _tasks;
+        /**
+         * \brief Count of live tasks.
+         */
+        unsigned int _size;
+        /**
+         * \brief Clock of the last run.
+         */
+        unsigned long long _clock;
+        /**
+         * \brief Exception thrown by a task during the current run.
+         */
+        std::exception_ptr _exception;
+    };
+
+}
+
+#endif //__CASHLEY_TASKQUEUE_H
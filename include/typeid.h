@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file */
+
+#ifndef __CASHLEY_TYPEID_H
+#define __CASHLEY_TYPEID_H
+
+#include <atomic>
+
+namespace CAshley {
+
+    /**
+     * \brief Counter of type identifiers of a category.
+     * \see TypeId.
+     */
+    template <class C>
+    class TypeCounter {
+    public:
+        /**
+         * \brief Get a new identifier for the category.
+         * \return Identifier, starting from 0.
+         */
+        static unsigned int next() {
+            static std::atomic<unsigned int> counter(0);
+            return counter++;
+        }
+    };
+
+    /**
+     * \brief Dense identifier of a type inside a category.
+     *
+     * Each category (events, components, resources...) numbers its types from 0,
+     * so identifiers can index flat arrays. Identifiers are given on first use and
+     * are not stable between runs.
+     */
+    template <class C, class T>
+    class TypeId {
+    public:
+        /**
+         * \brief Get the identifier of T in the category C.
+         * \return Identifier of T.
+         */
+        static unsigned int get() {
+            static const unsigned int id = TypeCounter<C>::next();
+            return id;
+        }
+    };
+}
+
+#endif //__CASHLEY_TYPEID_H
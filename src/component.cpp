@@ -17,6 +17,7 @@
  */
 
 #include "../include/component.h"
+#include "../include/snapshot.h"
 
 namespace CAshley {
 
@@ -44,6 +45,16 @@ namespace CAshley {
 
     }
 
+    void Component::save(SnapshotWriter &) {
+        SnapshotError e("Component can not be saved.");
+        throw e;
+    }
+
+    void Component::load(SnapshotReader &) {
+        SnapshotError e("Component can not be loaded.");
+        throw e;
+    }
+
     std::string Component::get_name() {
         std::string name = typeid(this).name();
         return name;
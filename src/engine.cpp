@@ -16,90 +16,328 @@
  * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
 #include "../include/engine.h"
 #include "../include/entity.h"
 #include "../include/family.h"
+#include "../include/journal.h"
+#include "../include/prefab.h"
 
 namespace CAshley {
 
     Engine::Engine() {
         _ticking = false;
+        _clock = 0;
+        _tick = 0;
+        _version = 1;
+        _delta_tick = 0;
+        _journal = NULL;
+        _journal_mute = 0;
+        _replaying = false;
+        _rollback = NULL;
+        _streamer = NULL;
+        _stream_budget = 0;
+        _processor_order = 0;
+        _pipeline = NULL;
+        _export = NULL;
+        _tag_count = 0;
     }
 
     Engine::~Engine() {
-
+        stop_pipeline();
+        stop_export();
+        stop_journal();
+        stop_rollback();
+        // Loads in progress are dropped, writes are finished by the streamer.
+        for (std::map<unsigned int, _Region>::iterator it = _regions.begin(); it != _regions.end(); it++) {
+            delete it->second.reader;
+            delete it->second.writer;
+        }
+        delete _streamer;
+        for (unsigned int i = 0; i < _registry.get_wrapped_count(); i++) {
+            Entity * e = _registry.get_wrapper(_registry.get_wrapped(i));
+            e->_engine = NULL;
+            e->_id = EntityId();
+        }
+        for (unsigned int i = 0; i < _component_types.size(); i++) {
+            delete _component_types[i].cache;
+        }
+        for (unsigned int i = 0; i < _prefabs.size(); i++) {
+            delete _prefabs[i];
+        }
+        for (unsigned int i = 0; i < _mappings.size(); i++) {
+            delete _mappings[i];
+        }
     }
 
     Component * Engine::get_component(std::string c, unsigned int uid) {
-        _Cache * _c;
-        if (_components.find(c) == _components.end()) {
+        unsigned int type = _find_component_type(c);
+        if (type == NO_COMPONENT) {
             ComponentError e("Component not found");
             throw e;
-        } else {
-            _c = _components.find(c)->second;
         }
-        return static_cast<Cache<Component> *>(_c)->get_block(uid);
+        return _component_types[type].get(_component_types[type].cache, uid);
+    }
+
+    Component * Engine::get_component(std::string c, EntityId id) {
+        _check_entity(id);
+        unsigned int type = _find_component_type(c);
+        if (type == NO_COMPONENT || !_has_component(type, id.index)) {
+            ComponentError e("Component not found");
+            throw e;
+        }
+        unsigned int uid = _component_types[type].tag == NO_COMPONENT ? _registry.get_slot(type, id.index) : 0;
+        return _component_types[type].get(_component_types[type].cache, uid);
+    }
+
+    std::vector<const ComponentSchema *> Engine::get_schemas() {
+        std::vector<const ComponentSchema *> r;
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            if (_component_types[type].cache) {
+                r.push_back(_component_types[type].schema);
+            }
+        }
+        return r;
     }
 
     void Engine::activate_component(std::string c, unsigned int uid) {
-        _Cache * cache;
-        if (_components.find(c) == _components.end()) {
+        unsigned int type = _find_component_type(c);
+        if (type == NO_COMPONENT) {
             ComponentError e("Unknown component type.");
             throw e;
-        } else {
-            cache = _components.find(c)->second;
         }
-        cache->block_activate(uid);
+        _component_types[type].cache->block_activate(uid);
+        _version++;
     }
 
     void Engine::deactivate_component(std::string c, unsigned int uid) {
-        _Cache * cache;
-        if (_components.find(c) == _components.end()) {
+        unsigned int type = _find_component_type(c);
+        if (type == NO_COMPONENT) {
             ComponentError e("Unknown component type.");
             throw e;
-        } else {
-            cache = _components.find(c)->second;
         }
-        cache->block_deactivate(uid);
+        _component_types[type].cache->block_deactivate(uid);
+        _version++;
     }
 
 
     void Engine::remove_component(std::string c, unsigned int uid) {
-        _Cache * cache;
-        if (_components.find(c) == _components.end()) {
+        unsigned int type = _find_component_type(c);
+        if (type == NO_COMPONENT) {
             ComponentError e("Unknown component type.");
             throw e;
-        } else {
-            cache = _components.find(c)->second;
         }
-        cache->block_free(uid);
+        _component_types[type].cache->block_free(uid);
+        _version++;
     }
 
     void Engine::add_entity(Entity *e) {
-        if (_entities.find(e) != _entities.end()) {
+        if (e->_engine) {
             EntityError e("Entity already added.");
             throw e;
         }
-        _entities.insert(e);
+        _version++;
         e->_engine = const_cast<CAshley::Engine *>(this);
+        e->_id = _registry.create();
+        _registry.set_wrapper(e->_id.index, e);
+        _registry.set_active(e->_id.index, e->_active);
+        _journal_entities(JOURNAL_CREATE, &e->_id, 1, e->_active);
         e->init();
         _call_listeners(e);
     }
 
     void Engine::remove_entity(Entity *e) {
-        if (_entities.find(e) == _entities.end()) {
+        if (e->_engine != this) {
             EntityError e("Entity not found.");
             throw e;
         }
+        _journal_entities(JOURNAL_DESTROY, &e->_id, 1);
+        _journal_mute++;
+        e->_wake_all_waiters();
         if (_ticking) {
             _entities_to_remove.push_back(e);
         } else {
             _remove_entity(e);
         }
+        _journal_mute--;
     }
 
     EntityArray Engine::get_entities_for(Family f) {
-        return f._filter_entities(_entities);
+        return f._filter_entities(_registry);
+    }
+
+    EntityIdArray Engine::get_ids_for(Family f) {
+        return f._filter_ids(*this);
+    }
+
+    EntityId Engine::create_entity() {
+        EntityId id = _registry.create();
+        _journal_entities(JOURNAL_CREATE, &id, 1);
+        _version++;
+        _call_listeners(Span<const EntityId>(&id, 1), NULL, 0);
+        return id;
+    }
+
+    void Engine::destroy_entity(EntityId id) {
+        despawn(Span<const EntityId>(&id, 1));
+    }
+
+    unsigned int Engine::add_prefab(const Prefab & p) {
+        _prefabs.push_back(new Prefab(p));
+        return _prefabs.size() - 1;
+    }
+
+    std::vector<EntityId> Engine::instantiate(unsigned int prefab, unsigned int count, bool active) {
+        if (prefab >= _prefabs.size()) {
+            CAshleyError e("Unknown prefab.");
+            throw e;
+        }
+        Prefab * p = _prefabs[prefab];
+        std::vector<EntityId> ids(count);
+        if (!count) {
+            return ids;
+        }
+        _registry.create_n(count, &ids[0], active);
+        std::vector<unsigned int> types(p->_entries.size() + 1, NO_COMPONENT);
+        _journal_mute++;
+        for (unsigned int i = 0; i < p->_entries.size(); i++) {
+            types[i] = p->_entries[i].instantiate(*this, p->_entries[i].value, &ids[0], count, active);
+        }
+        _journal_mute--;
+        if (_journaling()) {
+            SnapshotWriter & w = _journal->record(JOURNAL_INSTANTIATE);
+            w.write(prefab);
+            w.write((unsigned char)active);
+            w.write(count);
+            w.write(&ids[0], sizeof(EntityId) * count);
+        }
+        _version++;
+        _call_listeners(Span<const EntityId>(&ids[0], count), &types[0], p->_entries.size());
+        return ids;
+    }
+
+    void Engine::despawn(Span<const EntityId> ids) {
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            _check_entity(ids[i]);
+        }
+        _journal_entities(JOURNAL_DESTROY, ids.begin(), ids.size());
+        _journal_mute++;
+        std::vector<EntityId> plain;
+        plain.reserve(ids.size());
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            Entity * e = _registry.get_wrapper(ids[i].index);
+            if (e) {
+                remove_entity(e);
+            } else if (_ticking) {
+                _ids_to_remove.push_back(ids[i]);
+            } else {
+                plain.push_back(ids[i]);
+            }
+        }
+        // Removing a wrapper may have removed its descendants already.
+        unsigned int alive = 0;
+        for (unsigned int i = 0; i < plain.size(); i++) {
+            if (_registry.is_alive(plain[i])) {
+                plain[alive++] = plain[i];
+            }
+        }
+        if (alive) {
+            _despawn(Span<const EntityId>(&plain[0], alive));
+        }
+        _journal_mute--;
+    }
+
+    Entity * Engine::get_entity(EntityId id) {
+        _check_entity(id);
+        return _registry.get_wrapper(id.index);
+    }
+
+    void Engine::activate(EntityId id) {
+        _set_active(Span<const EntityId>(&id, 1), true);
+    }
+
+    void Engine::deactivate(EntityId id) {
+        _set_active(Span<const EntityId>(&id, 1), false);
+    }
+
+    void Engine::activate(Span<const EntityId> ids) {
+        _set_active(ids, true);
+    }
+
+    void Engine::activate(Span<Entity * const> entities) {
+        std::vector<EntityId> ids = _get_ids(entities);
+        _set_active(Span<const EntityId>(ids.data(), ids.size()), true);
+    }
+
+    void Engine::deactivate(Span<const EntityId> ids) {
+        _set_active(ids, false);
+    }
+
+    void Engine::deactivate(Span<Entity * const> entities) {
+        std::vector<EntityId> ids = _get_ids(entities);
+        _set_active(Span<const EntityId>(ids.data(), ids.size()), false);
+    }
+
+    void Engine::set_parent(EntityId child, EntityId parent) {
+        _check_entity(child);
+        _registry.mark_changed(child.index);
+        if (parent.is_null()) {
+            if (_journaling()) {
+                SnapshotWriter & w = _journal->record(JOURNAL_PARENT);
+                w.write(child);
+                w.write(parent);
+            }
+            _hierarchy.set_parent(child.index, NO_COMPONENT);
+            return;
+        }
+        _check_entity(parent);
+        if (child == parent || _hierarchy.is_ancestor(child.index, parent.index)) {
+            EntityError e("An entity can not descend from itself.");
+            throw e;
+        }
+        if (_journaling()) {
+            SnapshotWriter & w = _journal->record(JOURNAL_PARENT);
+            w.write(child);
+            w.write(parent);
+        }
+        _hierarchy.set_parent(child.index, parent.index);
+    }
+
+    EntityId Engine::get_parent(EntityId id) {
+        _check_entity(id);
+        unsigned int index = _hierarchy.get_parent(id.index);
+        return index == NO_COMPONENT ? EntityId() : _registry.get_id(index);
+    }
+
+    EntityId Engine::get_first_child(EntityId id) {
+        _check_entity(id);
+        unsigned int index = _hierarchy.get_first_child(id.index);
+        return index == NO_COMPONENT ? EntityId() : _registry.get_id(index);
+    }
+
+    EntityId Engine::get_next_sibling(EntityId id) {
+        _check_entity(id);
+        unsigned int index = _hierarchy.get_next_sibling(id.index);
+        return index == NO_COMPONENT ? EntityId() : _registry.get_id(index);
+    }
+
+    unsigned int Engine::get_depth(EntityId id) {
+        _check_entity(id);
+        return _hierarchy.get_depth(id.index);
+    }
+
+    void Engine::mark_dirty(EntityId id) {
+        _check_entity(id);
+        _hierarchy.mark_dirty(id.index);
+    }
+
+    bool Engine::is_active(EntityId id) {
+        _check_entity(id);
+        return _registry.is_active(id.index);
     }
 
     void Engine::add_listener(EntityListener * e, Family f, unsigned int priority) {
@@ -125,44 +363,1888 @@ namespace CAshley {
     }
 
     void Engine::run_tick(unsigned int delay) {
+        commit_regions();
+        if (_journal) {
+            _journal_flush();
+            _journal->tick(delay);
+        }
         _ticking = true;
-        std::multimap<unsigned int, Processor *>::iterator it, end = _processors.end();
-        for(it = _processors.begin(); it != end; it++) {
-            if (it->second->is_running()) {
-                it->second->run_tick(delay);
+        _tick++;
+        _clock += delay;
+        try {
+            _tasks.run(_clock);
+            _pop_due(_tick_queue, _tick, delay);
+            _pop_due(_time_queue, _clock, delay);
+            std::sort(_due.begin(), _due.end(), _run_before);
+            for (unsigned int i = 0; i < _due.size(); i++) {
+                for (unsigned int step = 0; step < _due[i].steps && _due[i].processor && _due[i].processor->_running; step++) {
+                    _due[i].processor->run_tick(_due[i].delay);
+                }
             }
+        } catch (...) {
+            // Due processors are already rescheduled: they must not run again next tick.
+            _due.clear();
+            _ticking = false;
+            throw;
         }
+        _due.clear();
+        _events.flip();
         _ticking = false;
         _remove_entities();
+        if (_rollback) {
+            _rollback_save();
+        }
+        if (_pipeline) {
+            _pipeline->publish(_tick, _clock, _extracted);
+        }
+        publish_export();
     }
 
-    void Engine::_remove_entities() {
-        Entity * e;
-        for (unsigned int i = 0; i < _entities_to_remove.size(); i++) {
-            e = _entities_to_remove[i];
-            _remove_entity(e);
+    void Engine::save_snapshot(std::vector<char> & out) {
+        SnapshotWriter w(out);
+        w.write(_clock);
+        w.write(_tick);
+        // Types first, so a loading engine can check them before changing anything.
+        _save_types(w);
+        _registry.save(w);
+        _hierarchy.save(w);
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            _ComponentType & t = _component_types[type];
+            if (!t.cache) {
+                continue;
+            }
+            if (t.tag != NO_COMPONENT) {
+                _registry.save_tag(t.tag, w);
+                continue;
+            }
+            t.cache->save(w);
+            _registry.save_slots(type, w);
+            if (t.shared) {
+                w.write_vector(t.refs);
+            }
         }
-        _entities_to_remove.clear();
+        w.finish();
     }
 
-    void Engine::_remove_entity(Entity * e) {
-        _call_listeners(e, false);
-        e->remove_components();
-        _entities.erase(e);
-        e->_engine = NULL;
+    void Engine::save_snapshot(const std::string & path) {
+        std::vector<char> data;
+        save_snapshot(data);
+        std::ofstream f(path.c_str(), std::ios::binary | std::ios::trunc);
+        f.write(data.data(), data.size());
+        if (!f) {
+            SnapshotError e("Can not write the snapshot file.");
+            throw e;
+        }
     }
 
-    void Engine::_call_listeners(Entity * e, bool add) {
-        std::multimap<unsigned int, std::pair<Family, EntityListener *> >::iterator it = _listeners.begin(), end=_listeners.end();
+    void Engine::load_snapshot(const char * data, size_t size) {
+        SnapshotReader r(data, size);
+        _load_snapshot(r);
+    }
+
+    void Engine::load_snapshot(const std::string & path) {
+        std::ifstream f(path.c_str(), std::ios::binary | std::ios::ate);
+        if (!f) {
+            SnapshotError e("Can not read the snapshot file.");
+            throw e;
+        }
+        std::vector<char> data((size_t)f.tellg());
+        f.seekg(0);
+        f.read(data.data(), data.size());
+        if (!f) {
+            SnapshotError e("Can not read the snapshot file.");
+            throw e;
+        }
+        load_snapshot(data.data(), data.size());
+    }
+
+    void Engine::map_snapshot(const std::string & path, bool verify) {
+        SnapshotMapping * m = new SnapshotMapping(path);
+        // Kept even if loading fails, caches may point to it.
+        _mappings.push_back(m);
+        SnapshotReader r(m->data(), m->size(), true, verify);
+        _load_snapshot(r);
+    }
+
+    void Engine::_load_snapshot(SnapshotReader & r) {
+        if (_registry.size()) {
+            SnapshotError e("Snapshots can only be loaded on an engine without entities.");
+            throw e;
+        }
+        unsigned long long clock = r.read<unsigned long long>();
+        unsigned long long tick = r.read<unsigned long long>();
+        std::vector<unsigned int> types = _load_types(r);
+        _registry.load(r);
+        _hierarchy.load(r);
+        for (unsigned int i = 0; i < types.size(); i++) {
+            _ComponentType & t = _component_types[types[i]];
+            if (t.tag != NO_COMPONENT) {
+                _registry.load_tag(t.tag, r);
+                continue;
+            }
+            t.cache->load(r);
+            _registry.load_slots(types[i], r);
+            if (t.shared) {
+                r.read_vector(t.refs);
+                _index_shared(types[i]);
+            }
+        }
+        _clock = clock;
+        _tick = tick;
+        _version++;
+        std::multimap<unsigned int, Processor *>::iterator it = _processors.begin(), end = _processors.end();
         for (; it != end; it++) {
-            if (it->second.first._filter_entity(e, false)) {
-                if (add) {
-                    it->second.second->entity_added(e);
-                } else {
-                    it->second.second->entity_removed(e);
+            it->second->_reschedule();
+        }
+    }
+
+    void Engine::track_changes(bool on) {
+        if (_rollback) {
+            RollbackError e("Changes are tracked for rollback.");
+            throw e;
+        }
+        _registry.set_tracking(on);
+        _delta_tick = _tick;
+    }
+
+    void Engine::save_delta(std::vector<char> & out) {
+        if (_rollback) {
+            RollbackError e("Deltas can not be saved while rollback is on.");
+            throw e;
+        }
+        if (!_registry.is_tracking()) {
+            SnapshotError e("Changes are not tracked.");
+            throw e;
+        }
+        _save_delta(out);
+    }
+
+    void Engine::_save_delta(std::vector<char> & out) {
+        SnapshotWriter w(out, DELTA_MAGIC);
+        w.write(_delta_tick);
+        w.write(_tick);
+        w.write(_clock);
+        _save_types(w);
+        // Position of each type on the table, and the tags.
+        std::vector<unsigned int> positions(_component_types.size(), NO_COMPONENT), tags;
+        for (unsigned int type = 0, n = 0; type < _component_types.size(); type++) {
+            if (_component_types[type].cache) {
+                positions[type] = n++;
+                if (_component_types[type].tag != NO_COMPONENT) {
+                    tags.push_back(type);
+                }
+            }
+        }
+        // Slot order, so equal changes give equal deltas.
+        std::vector<unsigned int> changed(_registry.get_changed());
+        std::sort(changed.begin(), changed.end());
+        w.write((unsigned int)changed.size());
+        std::vector<unsigned int> entity_tags;
+        for (unsigned int i = 0; i < changed.size(); i++) {
+            unsigned int index = changed[i];
+            bool alive = _registry.is_alive(index);
+            w.write(index);
+            w.write(_registry.get_id(index).generation);
+            w.write((unsigned char)alive);
+            if (!alive) {
+                continue;
+            }
+            w.write((unsigned char)_registry.is_active(index));
+            w.write(_hierarchy.get_parent(index));
+            entity_tags.clear();
+            for (unsigned int t = 0; t < tags.size(); t++) {
+                if (_registry.has_tag(_component_types[tags[t]].tag, index)) {
+                    entity_tags.push_back(positions[tags[t]]);
+                }
+            }
+            w.write_vector(entity_tags);
+        }
+        unsigned int count = 0;
+        for (unsigned int type = 0; type < _registry.get_changed_type_count(); type++) {
+            count += !_registry.get_changed(type).empty();
+        }
+        w.write(count);
+        for (unsigned int type = 0; type < _registry.get_changed_type_count(); type++) {
+            if (_registry.get_changed(type).empty()) {
+                continue;
+            }
+            _ComponentType & t = _component_types[type];
+            changed = _registry.get_changed(type);
+            std::sort(changed.begin(), changed.end());
+            w.write(positions[type]);
+            w.write((unsigned int)changed.size());
+            for (unsigned int i = 0; i < changed.size(); i++) {
+                unsigned int index = changed[i];
+                unsigned int uid = _registry.is_alive(index) ? _registry.get_slot(type, index) : NO_COMPONENT;
+                w.write(index);
+                w.write((unsigned char)(uid != NO_COMPONENT));
+                if (uid != NO_COMPONENT) {
+                    t.cache->save_block(uid, w);
                 }
             }
         }
+        w.finish();
+        _registry.clear_changes();
+        _delta_tick = _tick;
+    }
+
+    void Engine::apply_delta(const char * data, size_t size) {
+        SnapshotReader r(data, size, false, true, DELTA_MAGIC);
+        unsigned long long base = r.read<unsigned long long>();
+        unsigned long long tick = r.read<unsigned long long>();
+        unsigned long long clock = r.read<unsigned long long>();
+        if (base != _tick) {
+            SnapshotError e("Delta does not start at the tick of the engine.");
+            throw e;
+        }
+        std::vector<unsigned int> types = _load_types(r);
+        struct Record {
+            EntityId id;
+            bool alive;
+            bool active;
+            unsigned int parent;
+            std::vector<unsigned int> tags;
+        };
+        std::vector<Record> records(r.read<unsigned int>());
+        for (unsigned int i = 0; i < records.size(); i++) {
+            Record & record = records[i];
+            record.id.index = r.read<unsigned int>();
+            record.id.generation = r.read<unsigned int>();
+            record.alive = r.read<unsigned char>() != 0;
+            if (record.alive) {
+                record.active = r.read<unsigned char>() != 0;
+                record.parent = r.read<unsigned int>();
+                r.read_vector(record.tags);
+            }
+            for (unsigned int t = 0; t < record.tags.size(); t++) {
+                if (record.tags[t] >= types.size() || _component_types[types[record.tags[t]]].tag == NO_COMPONENT) {
+                    SnapshotError e("Delta is corrupt.");
+                    throw e;
+                }
+            }
+            if (record.id.is_null()) {
+                SnapshotError e("Delta is corrupt.");
+                throw e;
+            }
+        }
+        // Entities replaced or destroyed since the base, then the new ones.
+        std::vector<EntityId> gone;
+        for (unsigned int i = 0; i < records.size(); i++) {
+            unsigned int index = records[i].id.index;
+            if (_registry.is_alive(index) && (!records[i].alive || _registry.get_id(index) != records[i].id)) {
+                gone.push_back(_registry.get_id(index));
+            }
+        }
+        if (!gone.empty()) {
+            _destroy(Span<const EntityId>(&gone[0], gone.size()));
+        }
+        for (unsigned int i = 0; i < records.size(); i++) {
+            _registry.restore(records[i].id, records[i].alive);
+        }
+        for (unsigned int n = r.read<unsigned int>(); n; n--) {
+            unsigned int i = r.read<unsigned int>();
+            if (i >= types.size() || _component_types[types[i]].tag != NO_COMPONENT) {
+                SnapshotError e("Delta is corrupt.");
+                throw e;
+            }
+            unsigned int type = types[i];
+            _ComponentType & t = _component_types[type];
+            for (unsigned int count = r.read<unsigned int>(); count; count--) {
+                unsigned int index = r.read<unsigned int>();
+                bool present = r.read<unsigned char>() != 0;
+                if (!_registry.is_alive(index)) {
+                    if (present) {
+                        SnapshotError e("Delta is corrupt.");
+                        throw e;
+                    }
+                } else if (present) {
+                    t.load(*this, type, index, r);
+                } else if (_registry.get_slot(type, index) != NO_COMPONENT) {
+                    _detach_component(index, type);
+                }
+            }
+        }
+        // Links, tags and status, once all the entities and components exist.
+        std::vector<EntityId> activated, deactivated;
+        for (unsigned int i = 0; i < records.size(); i++) {
+            Record & record = records[i];
+            if (!record.alive) {
+                continue;
+            }
+            unsigned int index = record.id.index;
+            if (record.parent != _hierarchy.get_parent(index)) {
+                if (record.parent != NO_COMPONENT && !_registry.is_alive(record.parent)) {
+                    SnapshotError e("Delta is corrupt.");
+                    throw e;
+                }
+                _hierarchy.set_parent(index, record.parent);
+            }
+            for (unsigned int t = 0; t < types.size(); t++) {
+                unsigned int tag = _component_types[types[t]].tag;
+                if (tag == NO_COMPONENT) {
+                    continue;
+                }
+                bool on = std::find(record.tags.begin(), record.tags.end(), t) != record.tags.end();
+                if (_registry.has_tag(tag, index) != on) {
+                    _set_tag(index, types[t], on);
+                }
+            }
+            if (_registry.is_active(index) != record.active) {
+                (record.active ? activated : deactivated).push_back(record.id);
+            }
+        }
+        if (!activated.empty()) {
+            _set_active(Span<const EntityId>(&activated[0], activated.size()), true);
+        }
+        if (!deactivated.empty()) {
+            _set_active(Span<const EntityId>(&deactivated[0], deactivated.size()), false);
+        }
+        _clock = clock;
+        _tick = tick;
+        _version++;
+        std::multimap<unsigned int, Processor *>::iterator it = _processors.begin(), end = _processors.end();
+        for (; it != end; it++) {
+            it->second->_reschedule();
+        }
+    }
+
+    void Engine::start_rollback(unsigned int ticks) {
+        if (_rollback) {
+            RollbackError e("Rollback already started.");
+            throw e;
+        }
+        if (_ticking) {
+            RollbackError e("Rollback can not start during a tick.");
+            throw e;
+        }
+        if (_registry.is_tracking()) {
+            RollbackError e("Changes are already tracked for deltas.");
+            throw e;
+        }
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            _ComponentType & t = _component_types[type];
+            if (t.cache && t.tag == NO_COMPONENT && !t.size) {
+                RollbackError e("Components must be block copyable while rollback is on.");
+                throw e;
+            }
+        }
+        _rollback = new RollbackBuffer(ticks, _tick);
+        _rollback_grow();
+        // The whole world once, then only what changes.
+        RollbackWorld & w = _rollback->get_world();
+        for (unsigned int index = 0; index < _registry.capacity(); index++) {
+            RollbackEntity & e = w.entities[index];
+            e.generation = _registry.get_id(index).generation;
+            e.alive = _registry.is_alive(index);
+            e.active = e.alive && _registry.is_active(index);
+            e.parent = e.alive ? _hierarchy.get_parent(index) : NO_COMPONENT;
+            for (unsigned int word = 0; word < w.tags.size(); word++) {
+                w.tags[word][index] = _registry.get_tags(word, index);
+            }
+        }
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            _ComponentType & t = _component_types[type];
+            for (unsigned int index = 0; t.size && index < _registry.capacity(); index++) {
+                unsigned int uid = _registry.is_alive(index) ? _registry.get_slot(type, index) : NO_COMPONENT;
+                w.present[type][index] = uid != NO_COMPONENT;
+                if (uid != NO_COMPONENT) {
+                    t.copy(t.cache, uid, &w.data[type][(size_t)index * t.size]);
+                }
+            }
+        }
+        w.free = _registry.get_free();
+        w.slots = _registry.capacity();
+        w.clock = _clock;
+        _registry.set_tracking(true);
+        _delta_tick = _tick;
+    }
+
+    void Engine::stop_rollback() {
+        if (_rollback) {
+            delete _rollback;
+            _rollback = NULL;
+            _registry.set_tracking(false);
+        }
+    }
+
+    void Engine::rollback(unsigned long long tick) {
+        if (!_rollback) {
+            RollbackError e("Rollback is not on.");
+            throw e;
+        }
+        if (_ticking) {
+            RollbackError e("Can not roll back during a tick.");
+            throw e;
+        }
+        if (_journal) {
+            RollbackError e("A journal can not record a rollback.");
+            throw e;
+        }
+        if (tick < _rollback->get_first_tick() || tick > _rollback->get_last_tick()) {
+            RollbackError e("Tick is not on the rollback buffer.");
+            throw e;
+        }
+        // Changes since the last tick first, then the ticks, newest first.
+        _rollback_frame(_rollback->get_pending());
+        _rollback_apply(_rollback->get_pending());
+        while (_rollback->get_last_tick() > tick) {
+            _rollback_apply(_rollback->back());
+            _rollback->pop();
+        }
+        _registry.clear_changes();
+        _tick = tick;
+        _delta_tick = _tick;
+        _version++;
+        std::multimap<unsigned int, Processor *>::iterator it = _processors.begin(), end = _processors.end();
+        for (; it != end; it++) {
+            it->second->_reschedule();
+        }
+    }
+
+    unsigned long long Engine::get_rollback_tick() {
+        if (!_rollback) {
+            RollbackError e("Rollback is not on.");
+            throw e;
+        }
+        return _rollback->get_first_tick();
+    }
+
+    Engine * Engine::clone() {
+        if (_ticking) {
+            EngineError e("An engine can not be copied during a tick.");
+            throw e;
+        }
+        Engine * e = new Engine;
+        e->_clock = _clock;
+        e->_tick = _tick;
+        e->_registry.copy(_registry);
+        e->_hierarchy = _hierarchy;
+        e->_component_types = _component_types;
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            e->_component_types[type].cache = NULL;
+        }
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            if (_component_types[type].cache) {
+                e->_component_types[type].cache = _component_types[type].cache->clone();
+            }
+        }
+        e->_tag_count = _tag_count;
+        e->_component_ids = _component_ids;
+        _copy_setup(*e);
+        return e;
+    }
+
+    std::vector<Engine *> Engine::fork(unsigned int count) {
+        if (_ticking) {
+            EngineError e("An engine can not be copied during a tick.");
+            throw e;
+        }
+        const char * dir = getenv("TMPDIR");
+        std::string pattern = std::string(dir && *dir ? dir : "/tmp") + "/cashley-fork-XXXXXX";
+        std::vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        int fd = mkstemp(&name[0]);
+        if (fd < 0) {
+            EngineError e("Can not create the file of the copies.");
+            throw e;
+        }
+        close(fd);
+        std::string path(&name[0]);
+        save_snapshot(path);
+        std::vector<Engine *> forks(count);
+        for (unsigned int i = 0; i < count; i++) {
+            forks[i] = new Engine;
+            _declare_types(*forks[i]);
+            forks[i]->map_snapshot(path);
+            _copy_setup(*forks[i]);
+        }
+        // Mappings keep the pages.
+        unlink(path.c_str());
+        return forks;
+    }
+
+    void Engine::start_streaming(const std::string & directory, unsigned int budget) {
+        if (_streamer) {
+            StreamingError e("Streaming already started.");
+            throw e;
+        }
+        _streamer = new RegionStreamer(directory);
+        _stream_budget = budget;
+    }
+
+    void Engine::stop_streaming() {
+        if (!_streamer) {
+            return;
+        }
+        wait_regions();
+        delete _streamer;
+        _streamer = NULL;
+    }
+
+    void Engine::assign_region(unsigned int region, Span<const EntityId> ids) {
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            _check_entity(ids[i]);
+            if (_registry.get_wrapper(ids[i].index)) {
+                StreamingError e("Only plain entities can be streamed.");
+                throw e;
+            }
+        }
+        _Region & r = _regions[region];
+        if (r.state == REGION_LOADING || r.state == REGION_UNLOADING) {
+            StreamingError e("Region is being streamed.");
+            throw e;
+        }
+        r.ids.assign(ids.begin(), ids.end());
+        r.state = REGION_LOADED;
+    }
+
+    void Engine::load_region(unsigned int region) {
+        if (!_streamer) {
+            StreamingError e("Streaming is not started.");
+            throw e;
+        }
+        if (_journal || _rollback) {
+            StreamingError e("Regions can not be streamed with a journal or rollback.");
+            throw e;
+        }
+        _Region & r = _regions[region];
+        if (r.state != REGION_UNLOADED) {
+            StreamingError e("Region is not unloaded.");
+            throw e;
+        }
+        r.state = REGION_LOADING;
+        r.ids.clear();
+        _loading.push_back(region);
+        _streamer->read(region);
+    }
+
+    void Engine::unload_region(unsigned int region) {
+        if (!_streamer) {
+            StreamingError e("Streaming is not started.");
+            throw e;
+        }
+        if (_journal || _rollback) {
+            StreamingError e("Regions can not be streamed with a journal or rollback.");
+            throw e;
+        }
+        std::map<unsigned int, _Region>::iterator it = _regions.find(region);
+        if (it == _regions.end() || it->second.state != REGION_LOADED) {
+            StreamingError e("Region is not loaded.");
+            throw e;
+        }
+        it->second.state = REGION_UNLOADING;
+        it->second.next = 0;
+        _unloading.push_back(region);
     }
-}
 
+    RegionState Engine::get_region_state(unsigned int region) {
+        std::map<unsigned int, _Region>::iterator it = _regions.find(region);
+        return it == _regions.end() ? REGION_UNLOADED : it->second.state;
+    }
+
+    std::vector<EntityId> Engine::get_region(unsigned int region) {
+        std::map<unsigned int, _Region>::iterator it = _regions.find(region);
+        return it == _regions.end() ? std::vector<EntityId>() : it->second.ids;
+    }
+
+    void Engine::commit_regions() {
+        if (!_streamer || (_loading.empty() && _unloading.empty())) {
+            return;
+        }
+        _take_regions(false);
+        _commit_regions(_stream_budget);
+    }
+
+    void Engine::wait_regions() {
+        if (!_streamer) {
+            return;
+        }
+        // Unloads first, so the reads of their regions get the new files.
+        _commit_regions(0xFFFFFFFFu);
+        _take_regions(true);
+        _commit_regions(0xFFFFFFFFu);
+    }
+
+    void Engine::_take_regions(bool block) {
+        if (block) {
+            _streamer->wait();
+        }
+        unsigned int region;
+        std::vector<char> data;
+        bool write;
+        while (_streamer->take(region, data, write)) {
+            if (write) {
+                StreamingError e("Can not write the region file.");
+                throw e;
+            }
+            _Region & r = _regions[region];
+            if (data.empty()) {
+                r.state = REGION_UNLOADED;
+                _loading.erase(std::find(_loading.begin(), _loading.end(), region));
+                StreamingError e("Can not read the region file.");
+                throw e;
+            }
+            r.data.swap(data);
+        }
+    }
+
+    void Engine::_commit_regions(unsigned int budget) {
+        unsigned int done = 0;
+        while (!_loading.empty()) {
+            _Region & r = _regions[_loading.front()];
+            // Regions are committed in order: a later one waits for the read of the first.
+            if (r.data.empty()) {
+                break;
+            }
+            if (!r.reader) {
+                _open_region(r);
+            }
+            if (r.batch < r.sizes.size() && done && done + r.sizes[r.batch] > budget) {
+                return;
+            }
+            if (r.batch < r.sizes.size()) {
+                done += _commit_batch(r);
+            }
+            if (r.batch == r.sizes.size()) {
+                delete r.reader;
+                r.reader = NULL;
+                std::vector<char>().swap(r.data);
+                r.types.clear();
+                std::vector<RegionEntity>().swap(r.entities);
+                r.sizes.clear();
+                r.firsts.clear();
+                r.links.clear();
+                r.state = REGION_LOADED;
+                _loading.pop_front();
+            }
+        }
+        while (!_unloading.empty() && (!done || done < budget)) {
+            done += _stage_batch(_unloading.front(), done < budget ? std::min(REGION_BATCH, budget - done) : REGION_BATCH);
+        }
+    }
+
+    void Engine::_open_region(_Region & region) {
+        // Checked by the streamer.
+        region.reader = new SnapshotReader(region.data.data(), region.data.size(), false, false, REGION_MAGIC);
+        region.types = _load_types(*region.reader);
+        region.reader->read_vector(region.entities);
+        region.reader->read_vector(region.sizes);
+        region.firsts.resize(region.sizes.size());
+        unsigned int total = 0;
+        for (unsigned int b = 0; b < region.sizes.size(); b++) {
+            region.firsts[b] = total;
+            total += region.sizes[b];
+        }
+        if (total != region.entities.size()) {
+            SnapshotError e("Region is corrupt.");
+            throw e;
+        }
+        region.links.resize(region.sizes.size());
+        region.ids.clear();
+        region.ids.reserve(total);
+        region.batch = 0;
+    }
+
+    unsigned int Engine::_commit_batch(_Region & region) {
+        SnapshotReader & r = *region.reader;
+        bool active = r.read<unsigned char>() != 0;
+        std::vector<unsigned int> & types = region.batch_types;
+        r.read_vector(types);
+        unsigned int count = region.sizes[region.batch];
+        // Entities are created with their batch, so none is seen without its components.
+        unsigned int first = region.ids.size();
+        region.ids.resize(first + count);
+        _registry.create_n(count, &region.ids[first], false);
+        const EntityId * ids = &region.ids[first];
+        for (unsigned int i = 0; i < types.size(); i++) {
+            if (types[i] >= region.types.size()) {
+                SnapshotError e("Region is corrupt.");
+                throw e;
+            }
+            unsigned int type = types[i] = region.types[types[i]];
+            _ComponentType & t = _component_types[type];
+            // Shared values are found or stored as they are read.
+            if (!t.shared) {
+                t.spawn(*this, ids, count, active);
+            }
+            if (t.tag != NO_COMPONENT) {
+                continue;
+            }
+            for (unsigned int j = 0; j < count; j++) {
+                t.load(*this, type, ids[j].index, r);
+            }
+            if (t.shared) {
+                continue;
+            }
+            // References to entities of the region follow them to their new ids.
+            const ComponentSchema * schema = t.schema;
+            for (unsigned int f = 0; f < schema->fields.size(); f++) {
+                if (schema->fields[f].type != FIELD_ENTITY) {
+                    continue;
+                }
+                for (unsigned int j = 0; j < count; j++) {
+                    Component * c = t.get(t.cache, _registry.get_slot(type, ids[j].index));
+                    for (unsigned int k = 0; k < schema->fields[f].count; k++) {
+                        _RegionLink link;
+                        link.offset = (ptrdiff_t)schema->fields[f].offset - (ptrdiff_t)schema->base + (ptrdiff_t)(k * sizeof(EntityId));
+                        EntityId * ref = reinterpret_cast<EntityId *>((char *)c + link.offset);
+                        RegionEntity key;
+                        key.id = *ref;
+                        std::vector<RegionEntity>::iterator found = std::lower_bound(region.entities.begin(), region.entities.end(), key);
+                        if (found == region.entities.end() || found->id != *ref) {
+                            continue;
+                        }
+                        if (found->position < region.ids.size()) {
+                            *ref = region.ids[found->position];
+                            continue;
+                        }
+                        // Set once its batch is committed.
+                        *ref = EntityId();
+                        link.holder = ids[j];
+                        link.type = type;
+                        link.position = found->position;
+                        unsigned int batch = std::upper_bound(region.firsts.begin(), region.firsts.end(), found->position) - region.firsts.begin() - 1;
+                        region.links[batch].push_back(link);
+                    }
+                }
+            }
+        }
+        if (active) {
+            for (unsigned int j = 0; j < count; j++) {
+                _registry.set_active(ids[j].index, true);
+            }
+        }
+        std::vector<_RegionLink> & links = region.links[region.batch];
+        for (unsigned int i = 0; i < links.size(); i++) {
+            unsigned int uid = _registry.is_alive(links[i].holder) ? _registry.get_slot(links[i].type, links[i].holder.index) : NO_COMPONENT;
+            if (uid != NO_COMPONENT) {
+                _ComponentType & t = _component_types[links[i].type];
+                *reinterpret_cast<EntityId *>((char *)t.get(t.cache, uid) + links[i].offset) = region.ids[links[i].position];
+            }
+        }
+        std::vector<_RegionLink>().swap(links);
+        region.batch++;
+        _version++;
+        _call_listeners(Span<const EntityId>(ids, count), types.data(), types.size());
+        return count;
+    }
+
+    unsigned int Engine::_stage_batch(unsigned int region, unsigned int n) {
+        _Region & r = _regions[region];
+        RegionStage & s = r.stage;
+        if (!r.writer) {
+            r.writer = new SnapshotWriter(s.data, REGION_MAGIC);
+            s.offsets.assign(1, 0);
+            s.firsts.assign(1, 0);
+        }
+        SnapshotWriter & w = *r.writer;
+        // Only copies here: batches and the file are made by the streamer.
+        r.staged.clear();
+        while (r.next < r.ids.size() && r.staged.size() < n) {
+            EntityId id = r.ids[r.next++];
+            if (!_registry.is_alive(id)) {
+                continue;
+            }
+            s.ids.push_back(id);
+            s.active.push_back(_registry.is_active(id.index));
+            for (unsigned int type = 0; type < _component_types.size(); type++) {
+                _ComponentType & t = _component_types[type];
+                if (!t.cache || !_has_component(type, id.index)) {
+                    continue;
+                }
+                if (t.tag == NO_COMPONENT) {
+                    t.cache->save_block(_registry.get_slot(type, id.index), w);
+                }
+                s.types.push_back(type);
+                s.offsets.push_back(w.get_size());
+            }
+            s.firsts.push_back(s.types.size());
+            r.staged.push_back(id);
+        }
+        unsigned int count = r.staged.size();
+        if (count) {
+            despawn(Span<const EntityId>(r.staged.data(), count));
+        }
+        if (r.next == r.ids.size()) {
+            // Types known now, some may be newer than the first batch.
+            s.table = w.get_size();
+            _save_types(w);
+            s.positions.assign(_component_types.size(), NO_COMPONENT);
+            for (unsigned int type = 0, position = 0; type < _component_types.size(); type++) {
+                if (_component_types[type].cache) {
+                    s.positions[type] = position++;
+                }
+            }
+            w.finish();
+            delete r.writer;
+            r.writer = NULL;
+            _streamer->write(region, s);
+            r.ids.clear();
+            std::vector<EntityId>().swap(r.staged);
+            r.state = REGION_UNLOADED;
+            _unloading.pop_front();
+        }
+        return count;
+    }
+
+    void Engine::_copy_setup(Engine & e) {
+        e._resources.copy(_resources);
+        for (unsigned int i = 0; i < _prefabs.size(); i++) {
+            e._prefabs.push_back(new Prefab(*_prefabs[i]));
+        }
+        std::map<Processor *, Processor *> copies;
+        std::multimap<unsigned int, Processor *>::iterator it = _processors.begin(), end = _processors.end();
+        for (; it != end; it++) {
+            Processor * p = it->second->_clone();
+            p->_engine = &e;
+            // Entities of the engine are found again on first use.
+            p->_entities_version = 0;
+            copies[it->second] = p;
+            e._processors.insert(std::pair<unsigned int, Processor *>(it->first, p));
+        }
+        e._processor_order = _processor_order;
+        // Same schedule, so the copies are due when the originals are.
+        e._tick_queue = _tick_queue;
+        e._time_queue = _time_queue;
+        for (unsigned int i = 0; i < e._tick_queue.size(); i++) {
+            e._tick_queue[i].processor = copies[e._tick_queue[i].processor];
+        }
+        for (unsigned int i = 0; i < e._time_queue.size(); i++) {
+            e._time_queue[i].processor = copies[e._time_queue[i].processor];
+        }
+    }
+
+    void Engine::_declare_types(Engine & e) {
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            if (_component_types[type].cache && (type >= e._component_types.size() || !e._component_types[type].cache)) {
+                _component_types[type].declare(e);
+            }
+        }
+    }
+
+    void Engine::_rollback_save() {
+        _rollback_frame(_rollback->push(_tick));
+    }
+
+    void Engine::_rollback_frame(RollbackFrame & f) {
+        _rollback_grow();
+        RollbackWorld & w = _rollback->get_world();
+        f.clear();
+        f.clock = w.clock;
+        f.words = w.tags.size();
+        // Free slots are only pushed and popped at the end: the ones kept are common.
+        const std::vector<unsigned int> & free = _registry.get_free();
+        f.keep = _registry.get_free_kept();
+        f.free.assign(w.free.begin() + f.keep, w.free.end());
+        f.slots = w.slots;
+        w.free.resize(f.keep);
+        w.free.insert(w.free.end(), free.begin() + f.keep, free.end());
+        w.slots = _registry.capacity();
+        w.clock = _clock;
+        const std::vector<unsigned int> & changed = _registry.get_changed();
+        for (unsigned int i = 0; i < changed.size(); i++) {
+            unsigned int index = changed[i];
+            RollbackEntity & e = w.entities[index];
+            f.entities.push_back(e);
+            for (unsigned int word = 0; word < w.tags.size(); word++) {
+                f.tags.push_back(w.tags[word][index]);
+                w.tags[word][index] = _registry.get_tags(word, index);
+            }
+            bool alive = _registry.is_alive(index);
+            unsigned int generation = _registry.get_id(index).generation;
+            if (alive != e.alive || generation != e.generation) {
+                // Created or destroyed: all its components changed.
+                for (unsigned int type = 0; type < _component_types.size(); type++) {
+                    if (_component_types[type].size && (w.present[type][index] || _registry.get_slot(type, index) != NO_COMPONENT)) {
+                        _rollback_block(f, type, index);
+                    }
+                }
+                w.marks[index] = 1;
+            }
+            e.generation = generation;
+            e.alive = alive;
+            e.active = alive && _registry.is_active(index);
+            e.parent = alive ? _hierarchy.get_parent(index) : NO_COMPONENT;
+        }
+        for (unsigned int type = 0; type < _registry.get_changed_type_count() && type < _component_types.size(); type++) {
+            const std::vector<unsigned int> & slots = _registry.get_changed(type);
+            for (unsigned int i = 0; _component_types[type].size && i < slots.size(); i++) {
+                if (!w.marks[slots[i]]) {
+                    _rollback_block(f, type, slots[i]);
+                }
+            }
+        }
+        for (unsigned int i = 0; i < changed.size(); i++) {
+            w.marks[changed[i]] = 0;
+        }
+        _registry.clear_changes();
+    }
+
+    void Engine::_rollback_block(RollbackFrame & f, unsigned int type, unsigned int index) {
+        RollbackWorld & w = _rollback->get_world();
+        _ComponentType & t = _component_types[type];
+        if (type >= f.blocks.size()) {
+            f.blocks.resize(type + 1);
+        }
+        RollbackBlocks & b = f.blocks[type];
+        if (b.slots.empty()) {
+            f.types.push_back(type);
+        }
+        char * block = &w.data[type][(size_t)index * t.size];
+        b.slots.push_back(index);
+        b.present.push_back(w.present[type][index]);
+        if (w.present[type][index]) {
+            b.data.insert(b.data.end(), block, block + t.size);
+        }
+        unsigned int uid = _registry.is_alive(index) ? _registry.get_slot(type, index) : NO_COMPONENT;
+        w.present[type][index] = uid != NO_COMPONENT;
+        if (uid != NO_COMPONENT) {
+            t.copy(t.cache, uid, block);
+        }
+    }
+
+    void Engine::_rollback_grow() {
+        RollbackWorld & w = _rollback->get_world();
+        unsigned int n = _registry.capacity();
+        // New slots are free, as when the registry grows.
+        RollbackEntity e;
+        e.generation = 1;
+        e.alive = false;
+        e.active = false;
+        e.parent = NO_COMPONENT;
+        for (e.index = w.entities.size(); e.index < n; e.index++) {
+            w.entities.push_back(e);
+        }
+        w.marks.resize(n, 0);
+        w.tags.resize((_tag_count + 63) / 64);
+        for (unsigned int word = 0; word < w.tags.size(); word++) {
+            w.tags[word].resize(n, 0);
+        }
+        w.present.resize(_component_types.size());
+        w.data.resize(_component_types.size());
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            if (_component_types[type].size) {
+                w.present[type].resize(n, 0);
+                w.data[type].resize((size_t)n * _component_types[type].size);
+            }
+        }
+    }
+
+    void Engine::_rollback_apply(RollbackFrame & f) {
+        RollbackWorld & w = _rollback->get_world();
+        // Entities replaced or destroyed since, then the ones of the frame.
+        w.gone.clear();
+        for (unsigned int i = 0; i < f.entities.size(); i++) {
+            const RollbackEntity & e = f.entities[i];
+            if (_registry.is_alive(e.index) && (!e.alive || _registry.get_id(e.index).generation != e.generation)) {
+                w.gone.push_back(_registry.get_id(e.index));
+            }
+        }
+        if (!w.gone.empty()) {
+            _destroy(Span<const EntityId>(&w.gone[0], w.gone.size()));
+        }
+        for (unsigned int i = 0; i < f.entities.size(); i++) {
+            _registry.restore(EntityId(f.entities[i].index, f.entities[i].generation), f.entities[i].alive);
+        }
+        for (unsigned int i = 0; i < f.types.size(); i++) {
+            unsigned int type = f.types[i];
+            _ComponentType & t = _component_types[type];
+            RollbackBlocks & b = f.blocks[type];
+            size_t offset = 0;
+            for (unsigned int j = 0; j < b.slots.size(); j++) {
+                unsigned int index = b.slots[j];
+                w.present[type][index] = b.present[j];
+                if (b.present[j]) {
+                    memcpy(&w.data[type][(size_t)index * t.size], &b.data[offset], t.size);
+                    t.paste(*this, type, index, &b.data[offset]);
+                    offset += t.size;
+                } else if (_registry.is_alive(index) && _registry.get_slot(type, index) != NO_COMPONENT) {
+                    _detach_component(index, type);
+                }
+            }
+        }
+        // Links, tags and status, once all the entities and components exist.
+        w.activated.clear();
+        w.deactivated.clear();
+        for (unsigned int i = 0; i < f.entities.size(); i++) {
+            const RollbackEntity & e = f.entities[i];
+            const unsigned long long * tags = f.words ? &f.tags[(size_t)i * f.words] : NULL;
+            w.entities[e.index] = e;
+            for (unsigned int word = 0; word < w.tags.size(); word++) {
+                w.tags[word][e.index] = word < f.words ? tags[word] : 0;
+            }
+            if (!e.alive) {
+                continue;
+            }
+            if (e.parent != _hierarchy.get_parent(e.index)) {
+                _hierarchy.set_parent(e.index, e.parent);
+            }
+            for (unsigned int word = 0; word < w.tags.size(); word++) {
+                if (_registry.get_tags(word, e.index) == w.tags[word][e.index]) {
+                    continue;
+                }
+                for (unsigned int type = 0; type < _component_types.size(); type++) {
+                    unsigned int tag = _component_types[type].tag;
+                    if (tag != NO_COMPONENT && tag / 64 == word) {
+                        bool on = (w.tags[word][e.index] >> (tag % 64)) & 1;
+                        if (_registry.has_tag(tag, e.index) != on) {
+                            _set_tag(e.index, type, on);
+                        }
+                    }
+                }
+            }
+            if (_registry.is_active(e.index) != e.active) {
+                (e.active ? w.activated : w.deactivated).push_back(_registry.get_id(e.index));
+            }
+        }
+        if (!w.activated.empty()) {
+            _set_active(Span<const EntityId>(&w.activated[0], w.activated.size()), true);
+        }
+        if (!w.deactivated.empty()) {
+            _set_active(Span<const EntityId>(&w.deactivated[0], w.deactivated.size()), false);
+        }
+        _registry.rewind_free(f.keep, f.free.data(), f.free.size(), f.slots);
+        w.free.resize(f.keep);
+        w.free.insert(w.free.end(), f.free.begin(), f.free.end());
+        for (unsigned int index = _registry.capacity(); index-- > f.slots;) {
+            w.free.push_back(index);
+        }
+        w.slots = f.slots;
+        w.clock = f.clock;
+        _clock = f.clock;
+    }
+
+    void Engine::start_journal(const std::string & path, unsigned int buffer) {
+        if (_journal) {
+            JournalError e("Journal already started.");
+            throw e;
+        }
+        if (_ticking) {
+            JournalError e("A journal can not start during a tick.");
+            throw e;
+        }
+        std::vector<char> head;
+        save_snapshot(head);
+        _journal = new Journal(path, buffer);
+        _journal->write_head(head);
+    }
+
+    void Engine::stop_journal() {
+        if (_journal) {
+            _journal_flush();
+            delete _journal;
+            _journal = NULL;
+        }
+    }
+
+    void Engine::start_pipeline(OutputStage * stage, unsigned int depth, unsigned int threads) {
+        if (_pipeline) {
+            CAshleyError e("Pipeline already started.");
+            throw e;
+        }
+        _pipeline = new Pipeline(stage, depth, threads);
+    }
+
+    void Engine::stop_pipeline() {
+        if (_pipeline) {
+            delete _pipeline;
+            _pipeline = NULL;
+        }
+    }
+
+    void Engine::start_export(const std::string & name, unsigned int capacity) {
+        if (_export) {
+            CAshleyError e("Export already started.");
+            throw e;
+        }
+        std::vector<const ComponentSchema *> schemas;
+        _exported.clear();
+        for (unsigned int i = 0; i < _extracted.size(); i++) {
+            schemas.push_back(_component_types[_find_component_type(_extracted[i].first)].schema);
+            _exported.push_back(_extracted[i].second);
+        }
+        _export = new SharedExport(name, schemas, capacity);
+        publish_export();
+    }
+
+    void Engine::stop_export() {
+        if (_export) {
+            delete _export;
+            _export = NULL;
+            _exported.clear();
+        }
+    }
+
+    void Engine::publish_export() {
+        if (_export) {
+            _export->publish(_tick, _clock, get_entity_count(), _exported);
+        }
+    }
+
+    void Engine::flush_pipeline() {
+        if (_pipeline) {
+            _pipeline->flush();
+        }
+    }
+
+    bool Engine::_due_later(const _ScheduledProcessor & a, const _ScheduledProcessor & b) {
+        return a.due > b.due;
+    }
+
+    bool Engine::_run_before(const _DueProcessor & a, const _DueProcessor & b) {
+        if (a.processor->_priority != b.processor->_priority) {
+            return a.processor->_priority < b.processor->_priority;
+        }
+        return a.processor->_order < b.processor->_order;
+    }
+
+    void Engine::_schedule_processor(Processor * p) {
+        _ScheduledProcessor s;
+        s.processor = p;
+        p->_last_run = _clock;
+        switch (p->_mode) {
+            case SCHEDULE_EVERY_TICK:
+            case SCHEDULE_EVERY_N_TICKS:
+                p->_next_due = _tick + p->_period;
+                s.due = p->_next_due;
+                _tick_queue.push_back(s);
+                std::push_heap(_tick_queue.begin(), _tick_queue.end(), _due_later);
+                break;
+            case SCHEDULE_INTERVAL:
+            case SCHEDULE_FIXED_STEP:
+                p->_next_due = _clock + p->_period;
+                s.due = p->_next_due;
+                _time_queue.push_back(s);
+                std::push_heap(_time_queue.begin(), _time_queue.end(), _due_later);
+                break;
+        }
+    }
+
+    void Engine::_unschedule_processor(Processor * p) {
+        std::vector<_ScheduledProcessor> * queues[2] = {&_tick_queue, &_time_queue};
+        for (unsigned int q = 0; q < 2; q++) {
+            std::vector<_ScheduledProcessor> & queue = *queues[q];
+            unsigned int size = queue.size();
+            for (unsigned int i = 0; i < queue.size(); ) {
+                if (queue[i].processor == p) {
+                    queue[i] = queue.back();
+                    queue.pop_back();
+                } else {
+                    i++;
+                }
+            }
+            if (queue.size() != size) {
+                std::make_heap(queue.begin(), queue.end(), _due_later);
+            }
+        }
+        for (unsigned int i = 0; i < _due.size(); i++) {
+            if (_due[i].processor == p) {
+                _due[i].processor = NULL;
+            }
+        }
+    }
+
+    void Engine::_pop_due(std::vector<_ScheduledProcessor> & queue, unsigned long long now, unsigned int delay) {
+        unsigned int first = _due.size();
+        while (!queue.empty() && queue.front().due <= now) {
+            std::pop_heap(queue.begin(), queue.end(), _due_later);
+            Processor * p = queue.back().processor;
+            queue.pop_back();
+            _DueProcessor d;
+            d.processor = p;
+            d.delay = (unsigned int)(_clock - p->_last_run);
+            d.steps = 1;
+            switch (p->_mode) {
+                case SCHEDULE_EVERY_TICK:
+                    d.delay = delay;
+                    p->_next_due = now + 1;
+                    break;
+                case SCHEDULE_EVERY_N_TICKS:
+                case SCHEDULE_INTERVAL:
+                    p->_next_due += p->_period;
+                    break;
+                case SCHEDULE_FIXED_STEP:
+                    d.delay = p->_period;
+                    d.steps = 0;
+                    while (p->_next_due <= now && d.steps < p->_max_steps) {
+                        p->_next_due += p->_period;
+                        d.steps++;
+                    }
+                    break;
+            }
+            if (p->_next_due <= now) {
+                // Too far behind: drop the backlog, keeping the phase.
+                p->_next_due = now - (now - p->_next_due) % p->_period + p->_period;
+            }
+            p->_last_run = _clock;
+            _due.push_back(d);
+        }
+        // Requeue once all due processors are out, so none is popped twice.
+        for (unsigned int i = first; i < _due.size(); i++) {
+            _ScheduledProcessor s;
+            s.due = _due[i].processor->_next_due;
+            s.processor = _due[i].processor;
+            queue.push_back(s);
+            std::push_heap(queue.begin(), queue.end(), _due_later);
+        }
+    }
+
+    void Engine::_remove_entities() {
+        Entity * e;
+        for (unsigned int i = 0; i < _entities_to_remove.size(); i++) {
+            e = _entities_to_remove[i];
+            // It may have been removed with an ancestor.
+            if (e->_engine == this) {
+                _remove_entity(e);
+            }
+        }
+        _entities_to_remove.clear();
+        if (!_ids_to_remove.empty()) {
+            // The same id may have been queued twice, or removed with an ancestor.
+            std::vector<EntityId> ids;
+            ids.swap(_ids_to_remove);
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            unsigned int alive = 0;
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                if (_registry.is_alive(ids[i])) {
+                    ids[alive++] = ids[i];
+                }
+            }
+            if (alive) {
+                _despawn(Span<const EntityId>(&ids[0], alive));
+            }
+        }
+    }
+
+    void Engine::_remove_entity(Entity * e) {
+        _despawn(Span<const EntityId>(&e->_id, 1));
+    }
+
+    void Engine::_unlink_entity(Entity * e) {
+        _call_listeners(e, false);
+        e->remove_components();
+        _hierarchy.remove(e->_id.index);
+        _registry.destroy(e->_id);
+        e->_id = EntityId();
+        _version++;
+        e->_engine = NULL;
+    }
+
+    void Engine::_add_component_type(unsigned int type, const std::string & name, _Cache * cache, Component * (*get)(_Cache *, unsigned int), bool tag, bool shared) {
+        if (type >= _component_types.size()) {
+            _ComponentType t;
+            t.cache = NULL;
+            t.get = NULL;
+            t.tag = NO_COMPONENT;
+            t.shared = false;
+            t.layout = 0;
+            t.load = NULL;
+            t.add = NULL;
+            t.spawn = NULL;
+            t.declare = NULL;
+            t.schema = NULL;
+            t.size = 0;
+            t.copy = NULL;
+            t.paste = NULL;
+            _component_types.resize(type + 1, t);
+        }
+        _component_types[type].name = name;
+        _component_types[type].cache = cache;
+        _component_types[type].get = get;
+        _component_types[type].tag = tag ? _tag_count++ : NO_COMPONENT;
+        _component_types[type].shared = shared;
+        _component_ids[name] = type;
+    }
+
+    void Engine::_set_tag(unsigned int index, unsigned int type, bool on) {
+        _journal_component(on ? JOURNAL_ADD : JOURNAL_REMOVE, type, _registry.get_id(index));
+        unsigned long long version = _version;
+        _registry.set_tag(_component_types[type].tag, index, on);
+        _version++;
+        Entity * e = _registry.get_wrapper(index);
+        if (!e) {
+            return;
+        }
+        // Up to date processors move the entity instead of filtering all again.
+        std::multimap<unsigned int, Processor *>::iterator it = _processors.begin(), end = _processors.end();
+        for (; it != end; it++) {
+            Processor * p = it->second;
+            if (p->_entities_version == version) {
+                p->_family._update_entity(p->_entities, e);
+                p->_entities_version = _version;
+            }
+        }
+        e->_wake_waiters(type);
+    }
+
+    void Engine::_set_shared(unsigned int index, unsigned int type, unsigned int uid) {
+        unsigned int old = _registry.get_slot(type, index);
+        if (old == uid) {
+            return;
+        }
+        _journal_component(JOURNAL_VALUE, type, _registry.get_id(index), uid);
+        _component_types[type].refs[uid]++;
+        if (old == NO_COMPONENT) {
+            _attach_component(index, type, uid);
+            return;
+        }
+        _registry.set_slot(type, index, uid);
+        Entity * e = _registry.get_wrapper(index);
+        if (e) {
+            e->_components[e->_find_slot(type)].uid = uid;
+        }
+        _unshare(type, old);
+    }
+
+    void Engine::_unshare(unsigned int type, unsigned int uid) {
+        _ComponentType & t = _component_types[type];
+        if (--t.refs[uid]) {
+            return;
+        }
+        _unindex_shared(type, uid);
+        t.cache->block_free(uid);
+    }
+
+    void Engine::_unindex_shared(unsigned int type, unsigned int uid) {
+        _ComponentType & t = _component_types[type];
+        typedef std::unordered_multimap<unsigned long long, unsigned int>::iterator Iterator;
+        std::pair<Iterator, Iterator> found = t.values.equal_range(t.hashes[uid]);
+        for (Iterator it = found.first; it != found.second; it++) {
+            if (it->second == uid) {
+                t.values.erase(it);
+                break;
+            }
+        }
+    }
+
+    void Engine::_reindex_shared(unsigned int type, unsigned int index) {
+        unsigned int uid = _registry.get_slot(type, index);
+        if (uid == NO_COMPONENT) {
+            return;
+        }
+        _ComponentType & t = _component_types[type];
+        _unindex_shared(type, uid);
+        t.hashes[uid] = t.schema->value_hash(t.get(t.cache, uid));
+        t.values.insert(std::make_pair(t.hashes[uid], uid));
+    }
+
+    void Engine::_index_shared(unsigned int type) {
+        _ComponentType & t = _component_types[type];
+        t.values.clear();
+        t.hashes.assign(t.refs.size(), 0);
+        for (unsigned int uid = 0; uid < t.refs.size(); uid++) {
+            if (t.refs[uid]) {
+                t.hashes[uid] = t.schema->value_hash(t.get(t.cache, uid));
+                t.values.insert(std::make_pair(t.hashes[uid], uid));
+            }
+        }
+    }
+
+    void Engine::_remove_tags(unsigned int index) {
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            unsigned int tag = _component_types[type].tag;
+            if (tag != NO_COMPONENT && _registry.has_tag(tag, index)) {
+                _set_tag(index, type, false);
+            }
+        }
+    }
+
+    unsigned int Engine::_find_component_type(const std::string & c) {
+        std::map<std::string, unsigned int>::iterator it = _component_ids.find(c);
+        if (it == _component_ids.end()) {
+            return NO_COMPONENT;
+        }
+        return it->second;
+    }
+
+    void Engine::_check_entity(EntityId id) {
+        if (!_registry.is_alive(id)) {
+            EntityError e("Entity not found.");
+            throw e;
+        }
+    }
+
+    void Engine::_attach_component(unsigned int index, unsigned int type, unsigned int uid) {
+        _registry.set_slot(type, index, uid);
+        if (!_component_types[type].shared) {
+            EntityId id = _registry.get_id(index);
+            _journal_component(JOURNAL_ADD, type, id);
+            _journal_values(type, &id, 1);
+        }
+        // Shared values are not owned by an entity.
+        if (_registry.is_active(index) && !_component_types[type].shared) {
+            _component_types[type].cache->block_activate(uid);
+        }
+        _version++;
+        Entity * e = _registry.get_wrapper(index);
+        if (e) {
+            Entity::_ComponentSlot slot;
+            slot.type = type;
+            slot.uid = uid;
+            e->_components.push_back(slot);
+            e->_wake_waiters(type);
+        }
+    }
+
+    void Engine::_detach_component(unsigned int index, unsigned int type) {
+        _journal_component(JOURNAL_REMOVE, type, _registry.get_id(index));
+        unsigned int uid = _registry.get_slot(type, index);
+        _ComponentType & t = _component_types[type];
+        if (t.shared) {
+            _unshare(type, uid);
+        } else {
+            t.get(t.cache, uid)->shutdown();
+            t.cache->block_free(uid);
+        }
+        _registry.set_slot(type, index, NO_COMPONENT);
+        _version++;
+        Entity * e = _registry.get_wrapper(index);
+        if (e) {
+            e->_components.erase(e->_find_slot(type));
+            e->_wake_waiters(type);
+        }
+    }
+
+    void Engine::_save_types(SnapshotWriter & w) {
+        unsigned int count = 0;
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            count += _component_types[type].cache != NULL;
+        }
+        w.write(count);
+        for (unsigned int type = 0; type < _component_types.size(); type++) {
+            if (_component_types[type].cache) {
+                w.write_string(_component_types[type].name);
+                w.write(_snapshot_kind(type));
+                w.write(_component_types[type].cache->get_block_size());
+                w.write(_component_types[type].layout);
+                w.write(_component_types[type].schema->hash);
+            }
+        }
+    }
+
+    std::vector<unsigned int> Engine::_load_types(SnapshotReader & r) {
+        std::vector<unsigned int> types(r.read<unsigned int>());
+        for (unsigned int i = 0; i < types.size(); i++) {
+            std::string name = r.read_string();
+            unsigned char kind = r.read<unsigned char>();
+            unsigned int block_size = r.read<unsigned int>();
+            unsigned int layout = r.read<unsigned int>();
+            unsigned long long hash = r.read<unsigned long long>();
+            types[i] = _check_type(name, kind, block_size, layout, hash);
+        }
+        return types;
+    }
+
+    unsigned int Engine::_check_type(const std::string & name, unsigned char kind, unsigned int block_size, unsigned int layout, unsigned long long hash) {
+        unsigned int type = _find_component_type(name);
+        if (type == NO_COMPONENT) {
+            SnapshotError e("Unknown component type on snapshot.");
+            throw e;
+        }
+        _ComponentType & t = _component_types[type];
+        if (kind != _snapshot_kind(type) || block_size != t.cache->get_block_size() || layout != t.layout || hash != t.schema->hash) {
+            SnapshotError e("Component layout changed.");
+            throw e;
+        }
+        return type;
+    }
+
+    void Engine::_journal_entities(unsigned char record, const EntityId * ids, unsigned int n, bool flag) {
+        if (!_journaling()) {
+            return;
+        }
+        SnapshotWriter & w = _journal->record(record);
+        if (record != JOURNAL_DESTROY) {
+            w.write((unsigned char)flag);
+        }
+        w.write(n);
+        w.write(ids, sizeof(EntityId) * n);
+    }
+
+    void Engine::_journal_spawn(const EntityId * ids, unsigned int count, bool active, const unsigned int * types, unsigned int n) {
+        if (!_journaling()) {
+            return;
+        }
+        std::vector<unsigned int> local(n);
+        for (unsigned int i = 0; i < n; i++) {
+            local[i] = _journal_type(types[i]);
+        }
+        SnapshotWriter & w = _journal->record(JOURNAL_SPAWN);
+        w.write((unsigned char)active);
+        w.write(count);
+        w.write(ids, sizeof(EntityId) * count);
+        w.write_vector(local);
+    }
+
+    void Engine::_journal_component(unsigned char record, unsigned int type, EntityId id, unsigned int uid) {
+        if (!_journaling()) {
+            return;
+        }
+        unsigned int local = _journal_type(type);
+        SnapshotWriter & w = _journal->record(record);
+        w.write(local);
+        w.write(id);
+        if (record == JOURNAL_VALUE) {
+            _component_types[type].cache->save_block(uid == NO_COMPONENT ? _registry.get_slot(type, id.index) : uid, w);
+        }
+    }
+
+    void Engine::_journal_values(unsigned int type, const EntityId * ids, unsigned int n) {
+        if (!_journal || _ticking) {
+            return;
+        }
+        for (unsigned int i = 0; i < n; i++) {
+            _journal_pending.push_back(std::pair<unsigned int, EntityId>(type, ids[i]));
+        }
+    }
+
+    void Engine::_journal_flush() {
+        for (unsigned int i = 0; i < _journal_pending.size(); i++) {
+            unsigned int type = _journal_pending[i].first;
+            EntityId id = _journal_pending[i].second;
+            // It may have been removed since, and the same component be here twice.
+            if (!_registry.is_alive(id) || type >= _component_types.size() || !_component_types[type].cache) {
+                continue;
+            }
+            _ComponentType & t = _component_types[type];
+            unsigned int uid = _registry.get_slot(type, id.index);
+            if (t.tag != NO_COMPONENT || t.shared || uid == NO_COMPONENT) {
+                continue;
+            }
+            _journal_component(JOURNAL_VALUE, type, id, uid);
+        }
+        _journal_pending.clear();
+    }
+
+    unsigned int Engine::_journal_type(unsigned int type) {
+        unsigned int local = _journal->get_type(type);
+        if (local != NO_COMPONENT) {
+            return local;
+        }
+        local = _journal->add_type(type);
+        SnapshotWriter & w = _journal->record(JOURNAL_TYPE);
+        w.write(local);
+        w.write_string(_component_types[type].name);
+        w.write(_snapshot_kind(type));
+        w.write(_component_types[type].cache->get_block_size());
+        w.write(_component_types[type].layout);
+        w.write(_component_types[type].schema->hash);
+        return local;
+    }
+
+    void Engine::_replay(SnapshotReader & r, std::vector<unsigned int> & types) {
+        _replaying = true;
+        std::vector<EntityId> ids, created;
+        for (unsigned char record = r.read<unsigned char>(); record != JOURNAL_END; record = r.read<unsigned char>()) {
+            switch (record) {
+                case JOURNAL_TYPE: {
+                    unsigned int local = r.read<unsigned int>();
+                    std::string name = r.read_string();
+                    unsigned char kind = r.read<unsigned char>();
+                    unsigned int block_size = r.read<unsigned int>();
+                    unsigned int layout = r.read<unsigned int>();
+                    unsigned long long hash = r.read<unsigned long long>();
+                    if (local != types.size()) {
+                        JournalError e("Journal is corrupt.");
+                        throw e;
+                    }
+                    types.push_back(_check_type(name, kind, block_size, layout, hash));
+                    break;
+                }
+                case JOURNAL_CREATE: {
+                    bool active = r.read<unsigned char>() != 0;
+                    _replay_ids(r, ids);
+                    for (unsigned int i = 0; i < ids.size(); i++) {
+                        if (_registry.create() != ids[i]) {
+                            JournalError e("Replay diverged.");
+                            throw e;
+                        }
+                        _registry.set_active(ids[i].index, active);
+                    }
+                    _version++;
+                    break;
+                }
+                case JOURNAL_SPAWN: {
+                    bool active = r.read<unsigned char>() != 0;
+                    _replay_ids(r, ids);
+                    std::vector<unsigned int> spawned;
+                    r.read_vector(spawned);
+                    created.resize(ids.size());
+                    if (!ids.empty()) {
+                        _registry.create_n(ids.size(), &created[0], active);
+                    }
+                    if (created != ids) {
+                        JournalError e("Replay diverged.");
+                        throw e;
+                    }
+                    for (unsigned int i = 0; i < spawned.size(); i++) {
+                        if (spawned[i] >= types.size()) {
+                            JournalError e("Journal is corrupt.");
+                            throw e;
+                        }
+                        _component_types[types[spawned[i]]].spawn(*this, ids.data(), ids.size(), active);
+                    }
+                    _version++;
+                    break;
+                }
+                case JOURNAL_INSTANTIATE: {
+                    unsigned int prefab = r.read<unsigned int>();
+                    bool active = r.read<unsigned char>() != 0;
+                    _replay_ids(r, ids);
+                    if (instantiate(prefab, ids.size(), active) != ids) {
+                        JournalError e("Replay diverged.");
+                        throw e;
+                    }
+                    break;
+                }
+                case JOURNAL_DESTROY:
+                    _replay_ids(r, ids);
+                    despawn(Span<const EntityId>(ids.data(), ids.size()));
+                    break;
+                case JOURNAL_ADD:
+                case JOURNAL_REMOVE:
+                case JOURNAL_VALUE: {
+                    unsigned int local = r.read<unsigned int>();
+                    EntityId id = r.read<EntityId>();
+                    if (local >= types.size()) {
+                        JournalError e("Journal is corrupt.");
+                        throw e;
+                    }
+                    unsigned int type = types[local];
+                    _ComponentType & t = _component_types[type];
+                    // Added components must be missing, and removed ones there.
+                    if (!_registry.is_alive(id) || (record != JOURNAL_VALUE && _has_component(type, id.index) != (record == JOURNAL_REMOVE))) {
+                        JournalError e("Replay diverged.");
+                        throw e;
+                    }
+                    if (record == JOURNAL_ADD) {
+                        t.add(*this, type, id);
+                    } else if (record == JOURNAL_VALUE) {
+                        t.load(*this, type, id.index, r);
+                    } else if (t.tag != NO_COMPONENT) {
+                        _set_tag(id.index, type, false);
+                    } else {
+                        _detach_component(id.index, type);
+                    }
+                    break;
+                }
+                case JOURNAL_ACTIVE: {
+                    bool active = r.read<unsigned char>() != 0;
+                    _replay_ids(r, ids);
+                    _set_active(Span<const EntityId>(ids.data(), ids.size()), active);
+                    break;
+                }
+                case JOURNAL_PARENT: {
+                    EntityId child = r.read<EntityId>();
+                    EntityId parent = r.read<EntityId>();
+                    set_parent(child, parent);
+                    break;
+                }
+                default: {
+                    JournalError e("Journal is corrupt.");
+                    throw e;
+                }
+            }
+        }
+        _replaying = false;
+    }
+
+    void Engine::_replay_ids(SnapshotReader & r, std::vector<EntityId> & ids) {
+        unsigned int n = r.read<unsigned int>();
+        if (n > r.remaining() / sizeof(EntityId)) {
+            JournalError e("Journal is corrupt.");
+            throw e;
+        }
+        ids.resize(n);
+        if (n) {
+            r.read(&ids[0], sizeof(EntityId) * n);
+        }
+    }
+
+    unsigned char Engine::_snapshot_kind(unsigned int type) {
+        if (_component_types[type].tag != NO_COMPONENT) {
+            return 1;
+        }
+        return _component_types[type].shared ? 2 : 0;
+    }
+
+    void Engine::_set_active(Span<const EntityId> ids, bool active) {
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            _check_entity(ids[i]);
+        }
+        _journal_entities(JOURNAL_ACTIVE, ids.begin(), ids.size(), active);
+        // Entities that change, flagged as they are found to skip repetitions.
+        std::vector<unsigned int> changed;
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            if (_registry.is_active(ids[i].index) != active) {
+                _registry.set_active(ids[i].index, active);
+                changed.push_back(ids[i].index);
+            }
+        }
+        if (changed.empty()) {
+            return;
+        }
+        std::vector<unsigned int> uids;
+        for (unsigned int type = 0; type < _registry.get_type_count(); type++) {
+            if (_component_types[type].shared) {
+                continue;
+            }
+            uids.clear();
+            for (unsigned int i = 0; i < changed.size(); i++) {
+                unsigned int uid = _registry.get_slot(type, changed[i]);
+                if (uid != NO_COMPONENT) {
+                    uids.push_back(uid);
+                }
+            }
+            if (uids.empty()) {
+                continue;
+            }
+            if (active) {
+                _component_types[type].cache->block_activate_n(&uids[0], uids.size());
+            } else {
+                _component_types[type].cache->block_deactivate_n(&uids[0], uids.size());
+            }
+        }
+        for (unsigned int i = 0; i < changed.size(); i++) {
+            Entity * e = _registry.get_wrapper(changed[i]);
+            if (e) {
+                e->_active = active;
+            }
+        }
+        _version++;
+    }
+
+    std::vector<EntityId> Engine::_get_ids(Span<Entity * const> entities) {
+        std::vector<EntityId> ids(entities.size());
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            if (entities[i]->_engine != this) {
+                EntityError e("Entity not found.");
+                throw e;
+            }
+            ids[i] = entities[i]->_id;
+        }
+        return ids;
+    }
+
+    void Engine::_despawn(Span<const EntityId> ids) {
+        std::vector<unsigned int> descendants;
+        if (!_hierarchy.empty()) {
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                _hierarchy.get_descendants(ids[i].index, descendants);
+            }
+        }
+        if (descendants.empty()) {
+            _destroy(ids);
+            return;
+        }
+        std::vector<EntityId> all(ids.begin(), ids.end());
+        for (unsigned int i = 0; i < descendants.size(); i++) {
+            all.push_back(_registry.get_id(descendants[i]));
+        }
+        // Entities of the batch may descend from others of the batch.
+        std::sort(all.begin(), all.end());
+        all.erase(std::unique(all.begin(), all.end()), all.end());
+        _destroy(Span<const EntityId>(&all[0], all.size()));
+    }
+
+    void Engine::_destroy(Span<const EntityId> ids) {
+        std::vector<EntityId> plain;
+        plain.reserve(ids.size());
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            Entity * e = _registry.get_wrapper(ids[i].index);
+            if (e) {
+                e->_wake_all_waiters();
+                _unlink_entity(e);
+            } else {
+                plain.push_back(ids[i]);
+            }
+        }
+        if (!plain.empty()) {
+            _despawn_plain(Span<const EntityId>(&plain[0], plain.size()));
+        }
+    }
+
+    void Engine::_despawn_plain(Span<const EntityId> ids) {
+        _call_listeners(ids);
+        std::vector<unsigned int> uids;
+        for (unsigned int type = 0; type < _registry.get_type_count(); type++) {
+            _ComponentType & t = _component_types[type];
+            uids.clear();
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                unsigned int uid = _registry.get_slot(type, ids[i].index);
+                if (uid != NO_COMPONENT && t.shared) {
+                    _unshare(type, uid);
+                    _registry.set_slot(type, ids[i].index, NO_COMPONENT);
+                } else if (uid != NO_COMPONENT) {
+                    t.get(t.cache, uid)->shutdown();
+                    uids.push_back(uid);
+                    _registry.set_slot(type, ids[i].index, NO_COMPONENT);
+                }
+            }
+            if (!uids.empty()) {
+                t.cache->block_free_n(&uids[0], uids.size());
+            }
+        }
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            if (!_hierarchy.empty()) {
+                _hierarchy.remove(ids[i].index);
+            }
+            _registry.destroy(ids[i]);
+        }
+        _version++;
+    }
+
+    void Engine::_call_listeners(Entity * e, bool add) {
+        // Changes done by listeners are on the journal being replayed.
+        if (_replaying) {
+            return;
+        }
+        std::multimap<unsigned int, std::pair<Family, EntityListener *> >::iterator it = _listeners.begin(), end=_listeners.end();
+        for (; it != end; it++) {
+            if (it->second.first._filter_entity(e, false)) {
+                if (add) {
+                    it->second.second->entity_added(e);
+                } else {
+                    it->second.second->entity_removed(e);
+                }
+            }
+        }
+    }
+
+    void Engine::_call_listeners(Span<const EntityId> ids, const unsigned int * types, unsigned int n) {
+        if (ids.empty() || _replaying) {
+            return;
+        }
+        std::multimap<unsigned int, std::pair<Family, EntityListener *> >::iterator it = _listeners.begin(), end=_listeners.end();
+        for (; it != end; it++) {
+            Family::_Query q;
+            if (it->second.first._resolve(*this, q) && Family::_match(q, types, n, _registry, ids[0].index)) {
+                it->second.second->entities_added(ids);
+            }
+        }
+    }
+
+    void Engine::_call_listeners(Span<const EntityId> ids) {
+        if (_replaying) {
+            return;
+        }
+        std::multimap<unsigned int, std::pair<Family, EntityListener *> >::iterator it = _listeners.begin(), end=_listeners.end();
+        std::vector<EntityId> matched;
+        for (; it != end; it++) {
+            Family::_Query q;
+            if (!it->second.first._resolve(*this, q)) {
+                continue;
+            }
+            matched.clear();
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                if (Family::_match(_registry, q, ids[i].index)) {
+                    matched.push_back(ids[i]);
+                }
+            }
+            if (!matched.empty()) {
+                it->second.second->entities_removed(Span<const EntityId>(&matched[0], matched.size()));
+            }
+        }
+    }
+}
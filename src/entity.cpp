@@ -17,12 +17,14 @@
  */
 
 #include "../include/entity.h"
+#include "../include/taskqueue.h"
 
 namespace CAshley {
 
     Entity::Entity() {
         _engine = NULL;
         _active = false;
+        _waiters = NULL;
     }
 
     Entity::~Entity() {
@@ -35,42 +37,73 @@ namespace CAshley {
     }
 
     bool Entity::has_component(std::string c) {
-        return !(_components.find(c) == _components.end());
+        if (!_engine) {
+            return false;
+        }
+        unsigned int type = _engine->_find_component_type(c);
+        return type != NO_COMPONENT && _engine->_has_component(type, _id.index);
     }
 
     void Entity::activate() {
-        if (_active) {
-            return;
-        }
-        _active = true;
-        std::map<std::string, unsigned int>::iterator init = _components.begin(), end = _components.end();
-        for (; init != end; init++) {
-            _engine->activate_component(init->first, init->second);
+        if (_engine) {
+            _engine->activate(_id);
+        } else {
+            _active = true;
         }
     }
 
     void Entity::deactivate() {
-        if (!_active) {
-            return;
-        }
-        _active = false;
-        std::map<std::string, unsigned int>::iterator init = _components.begin(), end = _components.end();
-        for (; init != end; init++) {
-            _engine->deactivate_component(init->first, init->second);
+        if (_engine) {
+            _engine->deactivate(_id);
+        } else {
+            _active = false;
         }
     }
 
     void Entity::remove_components() {
-        std::map<std::string, unsigned int>::iterator init = _components.begin(), end = _components.end();
-        for (; init != end; init++) {
-            _remove_component(init->first);
+        while (!_components.empty()) {
+            _engine->_detach_component(_id.index, _components[_components.size() - 1].type);
         }
+        _engine->_remove_tags(_id.index);
+    }
+
+    void Entity::_wait(TaskNode * t) {
+        t->_next = _waiters;
+        _waiters = t;
     }
 
-    void Entity::_remove_component(std::string s) {
-        _engine->get_component(s, _components[s])->shutdown();
-        _engine->remove_component(s, _components[s]);
-        _components.erase(s);
+    void Entity::_unwait(TaskNode * t) {
+        TaskNode ** it = &_waiters;
+        for (; *it && *it != t; it = &(*it)->_next);
+        if (*it) {
+            *it = t->_next;
+        }
+        t->_entity = NULL;
+    }
+
+    void Entity::_wake_waiters(unsigned int type) {
+        TaskNode ** it = &_waiters;
+        while (*it) {
+            TaskNode * t = *it;
+            if (t->_component == type) {
+                *it = t->_next;
+                t->_entity = NULL;
+                t->_result = true;
+                t->_queue->ready(t);
+            } else {
+                it = &t->_next;
+            }
+        }
+    }
+
+    void Entity::_wake_all_waiters() {
+        while (_waiters) {
+            TaskNode * t = _waiters;
+            _waiters = t->_next;
+            t->_entity = NULL;
+            t->_result = false;
+            t->_queue->ready(t);
+        }
     }
 
 
@@ -56,6 +56,9 @@ namespace CAshley {
     ComponentError::ComponentError(const char *msg) noexcept : CAshleyError(msg) {
     }
 
+    EngineError::EngineError(const char *msg) noexcept : CAshleyError(msg) {
+    }
+
     EntityError::EntityError(const char *msg) noexcept : CAshleyError(msg) {
     }
 
@@ -67,4 +70,28 @@ namespace CAshley {
 
     EntityListenerError::EntityListenerError(const char *msg) noexcept : CAshleyError(msg) {
     }
+
+    ResourceError::ResourceError(const char *msg) noexcept : CAshleyError(msg) {
+    }
+
+    SnapshotError::SnapshotError(const char *msg) noexcept : CAshleyError(msg) {
+    }
+
+    JournalError::JournalError(const char *msg) noexcept : CAshleyError(msg) {
+    }
+
+    RollbackError::RollbackError(const char *msg) noexcept : CAshleyError(msg) {
+    }
+
+    ReplicationError::ReplicationError(const char *msg) noexcept : CAshleyError(msg) {
+    }
+
+    StreamingError::StreamingError(const char *msg) noexcept : CAshleyError(msg) {
+    }
+
+    ExportError::ExportError(const char *msg) noexcept : CAshleyError(msg) {
+    }
+
+    TaskError::TaskError(const char *msg) noexcept : CAshleyError(msg) {
+    }
 }
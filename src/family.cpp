@@ -16,19 +16,23 @@
  * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstring>
 #include "../include/family.h"
 #include "../include/entity.h"
+#include "../include/engine.h"
 
 namespace CAshley {
-    EntityArray Family::_filter_entities(const std::set<Entity *> & entities) {
+    EntityArray Family::_filter_entities(const EntityRegistry & registry) {
         EntityArray v;
-        std::set<Entity *>::iterator it = entities.begin(), end = entities.end();
-        for (; it != end; it++) {
-            if (_filter_entity(*it)) {
-                v._push_back(*it);
+        for (unsigned int i = 0; i < registry.get_wrapped_count(); i++) {
+            Entity * e = registry.get_wrapper(registry.get_wrapped(i));
+            if (_filter_entity(e)) {
+                v._push_back(e);
             }
         }
+        // Wrapped slots are kept in no order; _update_entity() searches by slot.
+        std::sort(v._v, v._v + v._size, _before);
         return v;
     }
 
@@ -57,4 +61,131 @@ namespace CAshley {
         }
         return ok;
     }
-}
\ No newline at end of file
+
+    void Family::_update_entity(EntityArray & entities, Entity * e) {
+        Entity ** end = entities._v + entities._size;
+        Entity ** it = std::lower_bound(entities._v, end, e, _before);
+        bool found = it != end && *it == e;
+        bool valid = _filter_entity(e);
+        if (valid && !found) {
+            entities._insert(it - entities._v, e);
+        } else if (!valid && found) {
+            entities._erase(it - entities._v);
+        }
+    }
+
+    bool Family::_before(Entity * a, Entity * b) {
+        return a->get_id().index < b->get_id().index;
+    }
+
+    EntityIdArray Family::_filter_ids(Engine & engine) {
+        EntityIdArray v;
+        _Query q;
+        if (!_resolve(engine, q)) {
+            return v;
+        }
+        const EntityRegistry & registry = engine._registry;
+        for (unsigned int index = 0; index < registry.capacity(); index++) {
+            if (registry.is_alive(index) && registry.is_active(index) && _match(registry, q, index)) {
+                v._push_back(registry.get_id(index));
+            }
+        }
+        return v;
+    }
+
+    bool Family::_resolve(Engine & engine, _Query & q) {
+        std::set<std::string>::iterator cond_it = _filter.begin(), cond_end = _filter.end();
+        for(; cond_it != cond_end; cond_it++) {
+            if (!_resolve(engine, *cond_it, q.filter, q.filter_tags)) {
+                return false;
+            }
+        }
+        cond_it = _exclude.begin();
+        cond_end = _exclude.end();
+        for(; cond_it != cond_end; cond_it++) {
+            _resolve(engine, *cond_it, q.exclude, q.exclude_tags);
+        }
+        for(unsigned int i = 0; i < _one.size(); i++) {
+            std::vector<unsigned int> types;
+            std::vector<unsigned long long> tags;
+            cond_it = _one[i].begin();
+            cond_end = _one[i].end();
+            for(; cond_it != cond_end; cond_it++) {
+                _resolve(engine, *cond_it, types, tags);
+            }
+            if (types.empty() && tags.empty()) {
+                return false;
+            }
+            q.one.push_back(types);
+            q.one_tags.push_back(tags);
+        }
+        return true;
+    }
+
+    bool Family::_resolve(Engine & engine, const std::string & c, std::vector<unsigned int> & types, std::vector<unsigned long long> & tags) {
+        unsigned int type = engine._find_component_type(c);
+        if (type == NO_COMPONENT) {
+            return false;
+        }
+        unsigned int tag = engine._component_types[type].tag;
+        if (tag == NO_COMPONENT) {
+            types.push_back(type);
+        } else {
+            if (tags.size() <= tag / 64) {
+                tags.resize(tag / 64 + 1, 0);
+            }
+            tags[tag / 64] |= 1ull << (tag % 64);
+        }
+        return true;
+    }
+
+    bool Family::_match_tags(const EntityRegistry & registry, const std::vector<unsigned long long> & tags, unsigned int index, bool all) {
+        for (unsigned int word = 0; word < tags.size(); word++) {
+            unsigned long long bits = registry.get_tags(word, index) & tags[word];
+            if (all && bits != tags[word]) {
+                return false;
+            }
+            if (!all && bits) {
+                return true;
+            }
+        }
+        return all;
+    }
+
+    bool Family::_match(const EntityRegistry & registry, const _Query & q, unsigned int index) {
+        bool ok = _match_tags(registry, q.filter_tags, index, true) && !_match_tags(registry, q.exclude_tags, index, false);
+        for (unsigned int i = 0; i < q.filter.size() && ok; i++) {
+            ok = registry.get_slot(q.filter[i], index) != NO_COMPONENT;
+        }
+        for (unsigned int i = 0; i < q.exclude.size() && ok; i++) {
+            ok = registry.get_slot(q.exclude[i], index) == NO_COMPONENT;
+        }
+        for (unsigned int i = 0; i < q.one.size() && ok; i++) {
+            bool one_ok = _match_tags(registry, q.one_tags[i], index, false);
+            for (unsigned int j = 0; j < q.one[i].size() && !one_ok; j++) {
+                one_ok = registry.get_slot(q.one[i][j], index) != NO_COMPONENT;
+            }
+            ok = one_ok;
+        }
+        return ok;
+    }
+
+    bool Family::_match(const _Query & q, const unsigned int * types, unsigned int n, const EntityRegistry & registry, unsigned int index) {
+        const unsigned int * end = types + n;
+        bool ok = _match_tags(registry, q.filter_tags, index, true) && !_match_tags(registry, q.exclude_tags, index, false);
+        for (unsigned int i = 0; i < q.filter.size() && ok; i++) {
+            ok = std::find(types, end, q.filter[i]) != end;
+        }
+        for (unsigned int i = 0; i < q.exclude.size() && ok; i++) {
+            ok = std::find(types, end, q.exclude[i]) == end;
+        }
+        for (unsigned int i = 0; i < q.one.size() && ok; i++) {
+            bool one_ok = _match_tags(registry, q.one_tags[i], index, false);
+            for (unsigned int j = 0; j < q.one[i].size() && !one_ok; j++) {
+                one_ok = std::find(types, end, q.one[i][j]) != end;
+            }
+            ok = one_ok;
+        }
+        return ok;
+    }
+}
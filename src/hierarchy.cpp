@@ -0,0 +1,200 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/hierarchy.h"
+
+namespace CAshley {
+
+    Hierarchy::Hierarchy() {
+        _links = 0;
+        _changed = false;
+    }
+
+    void Hierarchy::set_parent(unsigned int child, unsigned int parent) {
+        unsigned int old = get_parent(child);
+        if (old == parent) {
+            return;
+        }
+        _reserve(child);
+        if (old != NO_COMPONENT) {
+            // Unlink from the old parent.
+            if (_prev_sibling[child] != NO_COMPONENT) {
+                _next_sibling[_prev_sibling[child]] = _next_sibling[child];
+            } else {
+                _first_child[old] = _next_sibling[child];
+            }
+            if (_next_sibling[child] != NO_COMPONENT) {
+                _prev_sibling[_next_sibling[child]] = _prev_sibling[child];
+            }
+            _parent[child] = NO_COMPONENT;
+            _next_sibling[child] = NO_COMPONENT;
+            _prev_sibling[child] = NO_COMPONENT;
+            _links--;
+        }
+        if (parent != NO_COMPONENT) {
+            _reserve(parent);
+            if (_parent[parent] == NO_COMPONENT && _first_child[parent] == NO_COMPONENT) {
+                // A new root has to be visited too.
+                _dirty[parent] = 1;
+            }
+            _parent[child] = parent;
+            _next_sibling[child] = _first_child[parent];
+            if (_first_child[parent] != NO_COMPONENT) {
+                _prev_sibling[_first_child[parent]] = child;
+            }
+            _first_child[parent] = child;
+            _links++;
+        }
+        // The moved subtree has to be visited under its new parent.
+        _dirty[child] = 1;
+        _changed = true;
+    }
+
+    void Hierarchy::remove(unsigned int index) {
+        if (index >= _parent.size()) {
+            return;
+        }
+        set_parent(index, NO_COMPONENT);
+        while (_first_child[index] != NO_COMPONENT) {
+            set_parent(_first_child[index], NO_COMPONENT);
+        }
+        _dirty[index] = 0;
+        _dirty_tree[index] = 0;
+    }
+
+    bool Hierarchy::is_ancestor(unsigned int ancestor, unsigned int index) const {
+        for (index = get_parent(index); index != NO_COMPONENT; index = get_parent(index)) {
+            if (index == ancestor) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned int Hierarchy::get_depth(unsigned int index) const {
+        unsigned int depth = 0;
+        for (index = get_parent(index); index != NO_COMPONENT; index = get_parent(index)) {
+            depth++;
+        }
+        return depth;
+    }
+
+    void Hierarchy::get_descendants(unsigned int index, std::vector<unsigned int> & out) const {
+        unsigned int first = out.size();
+        for (unsigned int c = get_first_child(index); c != NO_COMPONENT; c = _next_sibling[c]) {
+            out.push_back(c);
+        }
+        for (unsigned int i = first; i < out.size(); i++) {
+            for (unsigned int c = get_first_child(out[i]); c != NO_COMPONENT; c = _next_sibling[c]) {
+                out.push_back(c);
+            }
+        }
+    }
+
+    void Hierarchy::mark_dirty(unsigned int index) {
+        _reserve(index);
+        _dirty[index] = 1;
+        _dirty_tree[_root(index)] = 1;
+    }
+
+    void Hierarchy::update() {
+        if (!_changed) {
+            return;
+        }
+        _order.clear();
+        _roots.clear();
+        _root_begin.clear();
+        for (unsigned int index = 0; index < _parent.size(); index++) {
+            if (_parent[index] != NO_COMPONENT || _first_child[index] == NO_COMPONENT) {
+                continue;
+            }
+            _roots.push_back(index);
+            _root_begin.push_back(_order.size());
+            _Node node;
+            node.index = index;
+            node.parent = NO_COMPONENT;
+            node.visit = false;
+            _order.push_back(node);
+            if (_dirty[index]) {
+                _dirty_tree[index] = 1;
+            }
+            // Breadth first: the run is sorted by depth.
+            for (unsigned int pos = _root_begin.back(); pos < _order.size(); pos++) {
+                for (unsigned int c = _first_child[_order[pos].index]; c != NO_COMPONENT; c = _next_sibling[c]) {
+                    node.index = c;
+                    node.parent = pos;
+                    _order.push_back(node);
+                    if (_dirty[c]) {
+                        _dirty_tree[index] = 1;
+                    }
+                }
+            }
+        }
+        _root_begin.push_back(_order.size());
+        _changed = false;
+    }
+
+    void Hierarchy::save(SnapshotWriter & w) const {
+        w.write_vector(_parent);
+        w.write_vector(_first_child);
+        w.write_vector(_next_sibling);
+        w.write_vector(_prev_sibling);
+        w.write(_links);
+    }
+
+    void Hierarchy::load(SnapshotReader & r) {
+        std::vector<unsigned int> parent, first_child, next_sibling, prev_sibling;
+        r.read_vector(parent);
+        r.read_vector(first_child);
+        r.read_vector(next_sibling);
+        r.read_vector(prev_sibling);
+        unsigned int links = r.read<unsigned int>();
+        unsigned int n = parent.size();
+        if (first_child.size() != n || next_sibling.size() != n || prev_sibling.size() != n) {
+            SnapshotError e("Snapshot is corrupt.");
+            throw e;
+        }
+        _parent.swap(parent);
+        _first_child.swap(first_child);
+        _next_sibling.swap(next_sibling);
+        _prev_sibling.swap(prev_sibling);
+        _links = links;
+        _dirty.assign(n, 1);
+        _dirty_tree.assign(n, 0);
+        _changed = true;
+    }
+
+    void Hierarchy::_reserve(unsigned int index) {
+        if (index < _parent.size()) {
+            return;
+        }
+        _parent.resize(index + 1, NO_COMPONENT);
+        _first_child.resize(index + 1, NO_COMPONENT);
+        _next_sibling.resize(index + 1, NO_COMPONENT);
+        _prev_sibling.resize(index + 1, NO_COMPONENT);
+        _dirty.resize(index + 1, 0);
+        _dirty_tree.resize(index + 1, 0);
+    }
+
+    unsigned int Hierarchy::_root(unsigned int index) const {
+        while (get_parent(index) != NO_COMPONENT) {
+            index = get_parent(index);
+        }
+        return index;
+    }
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "../include/journal.h"
+#include "../include/engine.h"
+
+namespace CAshley {
+
+    Journal::Journal(const std::string & path, unsigned int buffer) : _file(path.c_str(), std::ios::binary | std::ios::trunc) {
+        if (!_file) {
+            JournalError e("Can not write the journal file.");
+            throw e;
+        }
+        _buffer_size = buffer;
+        _buffer.reserve(buffer);
+        _writer = NULL;
+        _type_count = 0;
+    }
+
+    Journal::~Journal() {
+        flush();
+    }
+
+    void Journal::write_head(const std::vector<char> & snapshot) {
+        _append(snapshot);
+    }
+
+    SnapshotWriter & Journal::record(unsigned char record) {
+        if (_writer && !_delays.empty()) {
+            _close_frame();
+        }
+        if (!_writer) {
+            _frame.clear();
+            _writer = new SnapshotWriter(_frame, JOURNAL_MAGIC);
+        }
+        _writer->write(record);
+        return *_writer;
+    }
+
+    void Journal::tick(unsigned int delay) {
+        if (!_writer) {
+            _frame.clear();
+            _writer = new SnapshotWriter(_frame, JOURNAL_MAGIC);
+        }
+        _delays.push_back(delay);
+        // Long runs of ticks without changes are split, to bound the memory.
+        if (_delays.size() * sizeof(unsigned int) >= _buffer_size) {
+            _close_frame();
+        }
+    }
+
+    void Journal::flush() {
+        if (_writer) {
+            _close_frame();
+        }
+        _write();
+        _file.flush();
+    }
+
+    unsigned int Journal::add_type(unsigned int type) {
+        if (type >= _types.size()) {
+            _types.resize(type + 1, NO_COMPONENT);
+        }
+        _types[type] = _type_count++;
+        return _types[type];
+    }
+
+    void Journal::_append(const std::vector<char> & data) {
+        unsigned long long size = data.size();
+        _buffer.insert(_buffer.end(), (const char *)&size, (const char *)&size + sizeof(size));
+        _buffer.insert(_buffer.end(), data.begin(), data.end());
+        if (_buffer.size() >= _buffer_size) {
+            _write();
+        }
+    }
+
+    void Journal::_close_frame() {
+        _writer->write((unsigned char)JOURNAL_END);
+        _writer->write_vector(_delays);
+        _writer->finish();
+        delete _writer;
+        _writer = NULL;
+        _delays.clear();
+        _append(_frame);
+    }
+
+    void Journal::_write() {
+        if (_buffer.empty()) {
+            return;
+        }
+        _file.write(_buffer.data(), _buffer.size());
+        _buffer.clear();
+        if (!_file) {
+            JournalError e("Can not write the journal file.");
+            throw e;
+        }
+    }
+
+    Replay::Replay(const std::string & path) {
+        std::ifstream f(path.c_str(), std::ios::binary | std::ios::ate);
+        if (!f) {
+            JournalError e("Can not read the journal file.");
+            throw e;
+        }
+        _data.resize((size_t)f.tellg());
+        f.seekg(0);
+        f.read(_data.data(), _data.size());
+        if (!f) {
+            JournalError e("Can not read the journal file.");
+            throw e;
+        }
+        _pos = 0;
+        _engine = NULL;
+        _tick = 0;
+    }
+
+    void Replay::start(Engine & engine) {
+        size_t size;
+        _pos = 0;
+        size_t head = _next(size);
+        engine.load_snapshot(_data.data() + head, size);
+        _engine = &engine;
+        _types.clear();
+        _delays.clear();
+        _tick = 0;
+    }
+
+    bool Replay::step() {
+        if (!_engine) {
+            JournalError e("Replay not started.");
+            throw e;
+        }
+        while (_tick == _delays.size()) {
+            if (_pos == _data.size()) {
+                return false;
+            }
+            size_t size;
+            size_t frame = _next(size);
+            SnapshotReader r(_data.data() + frame, size, false, true, JOURNAL_MAGIC);
+            _engine->_replay(r, _types);
+            r.read_vector(_delays);
+            _tick = 0;
+        }
+        _engine->run_tick(_delays[_tick++]);
+        return true;
+    }
+
+    unsigned long long Replay::run(unsigned long long ticks) {
+        unsigned long long done = 0;
+        while (done < ticks && step()) {
+            done++;
+        }
+        return done;
+    }
+
+    size_t Replay::_next(size_t & size) {
+        unsigned long long n;
+        if (_data.size() - _pos < sizeof(n)) {
+            JournalError e("Journal is truncated.");
+            throw e;
+        }
+        memcpy(&n, _data.data() + _pos, sizeof(n));
+        _pos += sizeof(n);
+        if (n > _data.size() - _pos) {
+            JournalError e("Journal is truncated.");
+            throw e;
+        }
+        size = n;
+        size_t start = _pos;
+        _pos += size;
+        return start;
+    }
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "../include/pipeline.h"
+#include "../include/exceptions.h"
+
+namespace CAshley {
+
+    Snapshot::Snapshot() {
+        _tick = 0;
+        _clock = 0;
+    }
+
+    Snapshot::~Snapshot() {
+        for (unsigned int i = 0; i < _sections.size(); i++) {
+            delete [] _sections[i].data;
+        }
+    }
+
+    void Snapshot::_fill(unsigned long long tick, unsigned long long clock,
+                         const std::vector<std::pair<std::string, _Cache *> > & caches) {
+        _tick = tick;
+        _clock = clock;
+        while (_sections.size() < caches.size()) {
+            _Section s;
+            s.count = 0;
+            s.size = 0;
+            s.capacity = 0;
+            s.data = NULL;
+            _sections.push_back(s);
+        }
+        for (unsigned int i = 0; i < caches.size(); i++) {
+            _Section & s = _sections[i];
+            s.name = caches[i].first;
+            s.count = 0;
+            s.size = 0;
+            if (!caches[i].second || !caches[i].second->get_active_blocks().second) {
+                continue;
+            }
+            std::pair<void *, unsigned int> blocks = caches[i].second->get_active_blocks();
+            s.count = blocks.second;
+            s.size = blocks.second * caches[i].second->get_block_size();
+            if (s.size > s.capacity) {
+                delete [] s.data;
+                s.capacity = s.size + s.size / 2;
+                s.data = new unsigned char[s.capacity];
+            }
+            memcpy(s.data, blocks.first, s.size);
+        }
+    }
+
+    Pipeline::Pipeline(OutputStage * stage, unsigned int depth, unsigned int threads) {
+        if (!stage || !depth || !threads) {
+            CAshleyError e("A pipeline needs a stage, a depth and a thread.");
+            throw e;
+        }
+        _stage = stage;
+        _head = 0;
+        _queued = 0;
+        _stopping = false;
+        _queue.resize(depth, NULL);
+        for (unsigned int i = 0; i < depth; i++) {
+            _snapshots.push_back(new Snapshot);
+        }
+        _free = _snapshots;
+        for (unsigned int i = 0; i < threads; i++) {
+            _threads.push_back(std::thread(&Pipeline::_work, this));
+        }
+    }
+
+    Pipeline::~Pipeline() {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _published.notify_all();
+        for (unsigned int i = 0; i < _threads.size(); i++) {
+            _threads[i].join();
+        }
+        for (unsigned int i = 0; i < _snapshots.size(); i++) {
+            delete _snapshots[i];
+        }
+    }
+
+    void Pipeline::publish(unsigned long long tick, unsigned long long clock,
+                           const std::vector<std::pair<std::string, _Cache *> > & caches) {
+        Snapshot * s;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_free.empty()) {
+                _consumed.wait(lock);
+            }
+            _rethrow();
+            s = _free.back();
+            _free.pop_back();
+        }
+        // The copy is done outside the lock: the snapshot is ours until published.
+        s->_fill(tick, clock, caches);
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _queue[(_head + _queued) % _queue.size()] = s;
+            _queued++;
+        }
+        _published.notify_one();
+    }
+
+    void Pipeline::flush() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_free.size() != _snapshots.size()) {
+            _consumed.wait(lock);
+        }
+        _rethrow();
+    }
+
+    void Pipeline::_rethrow() {
+        if (_exception) {
+            std::exception_ptr e = _exception;
+            _exception = std::exception_ptr();
+            std::rethrow_exception(e);
+        }
+    }
+
+    void Pipeline::_work() {
+        while (true) {
+            Snapshot * s;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (!_stopping && !_queued) {
+                    _published.wait(lock);
+                }
+                if (!_queued) {
+                    return;
+                }
+                s = _queue[_head];
+                _head = (_head + 1) % _queue.size();
+                _queued--;
+            }
+            // An exception escaping the thread would terminate the process.
+            std::exception_ptr e;
+            try {
+                _stage->consume(*s);
+            } catch (...) {
+                e = std::current_exception();
+            }
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (e && !_exception) {
+                    _exception = e;
+                }
+                _free.push_back(s);
+            }
+            _consumed.notify_all();
+        }
+    }
+
+}
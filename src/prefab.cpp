@@ -0,0 +1,62 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/prefab.h"
+
+namespace CAshley {
+
+    Prefab::Prefab() {
+    }
+
+    Prefab::Prefab(const Prefab & p) {
+        *this = p;
+    }
+
+    Prefab & Prefab::operator=(const Prefab & p) {
+        if (this == &p) {
+            return *this;
+        }
+        _clear();
+        for (unsigned int i = 0; i < p._entries.size(); i++) {
+            _Entry entry = p._entries[i];
+            entry.value = entry.clone(entry.value);
+            _entries.push_back(entry);
+        }
+        return *this;
+    }
+
+    Prefab::~Prefab() {
+        _clear();
+    }
+
+    unsigned int Prefab::_find(unsigned int type) const {
+        for (unsigned int i = 0; i < _entries.size(); i++) {
+            if (_entries[i].type == type) {
+                return i;
+            }
+        }
+        return NO_COMPONENT;
+    }
+
+    void Prefab::_clear() {
+        for (unsigned int i = 0; i < _entries.size(); i++) {
+            _entries[i].destroy(_entries[i].value);
+        }
+        _entries.clear();
+    }
+}
@@ -16,12 +16,23 @@
  * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include "../include/processor.h"
+#include "../include/engine.h"
 
 namespace CAshley {
 
     Processor::Processor() {
+        _engine = NULL;
         _running = false;
+        _mode = SCHEDULE_EVERY_TICK;
+        _period = 1;
+        _max_steps = 1;
+        _next_due = 0;
+        _last_run = 0;
+        _priority = 0;
+        _order = 0;
+        _entities_version = 0;
     }
 
     Processor::~Processor() {
@@ -29,17 +40,117 @@ namespace CAshley {
     }
 
     void Processor::activate() {
+        if (_running) {
+            return;
+        }
         _running = true;
+        if (_engine) {
+            _engine->_schedule_processor(this);
+        }
     }
 
     void Processor::deactivate() {
+        if (!_running) {
+            return;
+        }
         _running = false;
+        if (_engine) {
+            _engine->_unschedule_processor(this);
+        }
     }
 
     bool Processor::is_running() {
         return _running;
     }
 
+    void Processor::schedule_every_tick() {
+        _mode = SCHEDULE_EVERY_TICK;
+        _period = 1;
+        _max_steps = 1;
+        _reschedule();
+    }
+
+    void Processor::schedule_interval(unsigned int interval) {
+        if (!interval) {
+            ProcessorError e("Interval must be greater than zero.");
+            throw e;
+        }
+        _mode = SCHEDULE_INTERVAL;
+        _period = interval;
+        _max_steps = 1;
+        _reschedule();
+    }
+
+    void Processor::schedule_fixed_step(unsigned int step, unsigned int max_steps) {
+        if (!step || !max_steps) {
+            ProcessorError e("Step and max steps must be greater than zero.");
+            throw e;
+        }
+        _mode = SCHEDULE_FIXED_STEP;
+        _period = step;
+        _max_steps = max_steps;
+        _reschedule();
+    }
+
+    void Processor::schedule_every_n_ticks(unsigned int n) {
+        if (!n) {
+            ProcessorError e("Tick count must be greater than zero.");
+            throw e;
+        }
+        _mode = SCHEDULE_EVERY_N_TICKS;
+        _period = n;
+        _max_steps = 1;
+        _reschedule();
+    }
+
+    ScheduleMode Processor::get_schedule() {
+        return _mode;
+    }
+
+    void Processor::set_family(Family f) {
+        _family = f;
+        _entities_version = 0;
+    }
+
+    EntityArray & Processor::get_entities() {
+        if (!_engine) {
+            ProcessorError e("Processor not installed on an engine.");
+            throw e;
+        }
+        if (_entities_version != _engine->_version) {
+            _entities = _engine->get_entities_for(_family);
+            _entities_version = _engine->_version;
+        }
+        return _entities;
+    }
+
+    bool Processor::conflicts_with(const Processor & p) const {
+        for (unsigned int i = 0; i < _writes.size(); i++) {
+            if (std::find(p._reads.begin(), p._reads.end(), _writes[i]) != p._reads.end() ||
+                std::find(p._writes.begin(), p._writes.end(), _writes[i]) != p._writes.end()) {
+                return true;
+            }
+        }
+        for (unsigned int i = 0; i < p._writes.size(); i++) {
+            if (std::find(_reads.begin(), _reads.end(), p._writes[i]) != _reads.end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Processor::_reschedule() {
+        if (_running && _engine) {
+            _engine->_unschedule_processor(this);
+            _engine->_schedule_processor(this);
+        }
+    }
+
+    Processor * Processor::_clone() {
+        ProcessorError e("Processor can not be cloned.");
+        throw e;
+    }
+
     std::string Processor::get_name() {
         std::string name = typeid(this).name();
         return name;
@@ -0,0 +1,374 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "../include/registry.h"
+
+namespace CAshley {
+
+    EntityRegistry::EntityRegistry() {
+        _alive = 0;
+        _tracking = false;
+        _free_kept = 0;
+    }
+
+    EntityId EntityRegistry::create() {
+        // Entries of slots taken by restore() are skipped.
+        while (!_free.empty() && _flags[_free.back()]) {
+            _free.pop_back();
+        }
+        unsigned int index;
+        if (_free.empty()) {
+            index = _generations.size();
+            _generations.push_back(1);
+            _flags.push_back(0);
+        } else {
+            index = _free.back();
+            _free.pop_back();
+        }
+        _free_kept = std::min<unsigned int>(_free_kept, _free.size());
+        _flags[index] = _ALIVE;
+        _alive++;
+        mark_changed(index);
+        return EntityId(index, _generations[index]);
+    }
+
+    void EntityRegistry::create_n(unsigned int n, EntityId * ids, bool active) {
+        unsigned char flags = active ? _ALIVE | _ACTIVE : _ALIVE;
+        unsigned int i = 0;
+        while (i < n && !_free.empty()) {
+            unsigned int index = _free.back();
+            _free.pop_back();
+            if (_flags[index]) {
+                continue;
+            }
+            _flags[index] = flags;
+            ids[i++] = EntityId(index, _generations[index]);
+        }
+        _free_kept = std::min<unsigned int>(_free_kept, _free.size());
+        unsigned int first = _generations.size();
+        _generations.resize(first + n - i, 1);
+        _flags.resize(first + n - i, flags);
+        for (unsigned int index = first; i < n; i++, index++) {
+            ids[i] = EntityId(index, 1);
+        }
+        _alive += n;
+        if (_tracking) {
+            for (i = 0; i < n; i++) {
+                mark_changed(ids[i].index);
+            }
+        }
+    }
+
+    void EntityRegistry::destroy(EntityId id) {
+        if (!is_alive(id)) {
+            return;
+        }
+        for (unsigned int type = 0; type < _slots.size(); type++) {
+            if (id.index < _slots[type].size()) {
+                _slots[type][id.index] = NO_COMPONENT;
+            }
+        }
+        clear_tags(id.index);
+        set_wrapper(id.index, NULL);
+        _flags[id.index] = 0;
+        // Generation 0 is reserved for null ids.
+        _generations[id.index]++;
+        if (!_generations[id.index]) {
+            _generations[id.index] = 1;
+        }
+        _free.push_back(id.index);
+        _alive--;
+        mark_changed(id.index);
+    }
+
+    void EntityRegistry::restore(EntityId id, bool alive) {
+        while (id.index >= _generations.size()) {
+            _free.push_back(_generations.size());
+            _generations.push_back(1);
+            _flags.push_back(0);
+        }
+        if (alive && !_flags[id.index]) {
+            // Its entry in the free list is skipped when reached.
+            _flags[id.index] = _ALIVE;
+            _alive++;
+        }
+        _generations[id.index] = id.generation;
+        mark_changed(id.index);
+    }
+
+    void EntityRegistry::copy(const EntityRegistry & o) {
+        _generations = o._generations;
+        _flags = o._flags;
+        _free = o._free;
+        _slots = o._slots;
+        _tags = o._tags;
+        _alive = o._alive;
+        _wrappers.clear();
+        _wrapped.clear();
+        _wrapped_at.clear();
+        set_tracking(false);
+    }
+
+    void EntityRegistry::rewind_free(unsigned int keep, const unsigned int * tail, unsigned int n, unsigned int slots) {
+        _free.resize(keep);
+        _free_kept = std::min(_free_kept, keep);
+        _free.insert(_free.end(), tail, tail + n);
+        // Taken from the back, so the lowest slot first, like when growing.
+        for (unsigned int index = _generations.size(); index-- > slots;) {
+            _free.push_back(index);
+        }
+    }
+
+    void EntityRegistry::set_active(unsigned int index, bool active) {
+        mark_changed(index);
+        if (active) {
+            _flags[index] |= _ACTIVE;
+        } else {
+            _flags[index] &= ~_ACTIVE;
+        }
+    }
+
+    void EntityRegistry::set_slot(unsigned int type, unsigned int index, unsigned int uid) {
+        mark_changed(type, index);
+        if (type >= _slots.size()) {
+            if (uid == NO_COMPONENT) {
+                return;
+            }
+            _slots.resize(type + 1);
+        }
+        std::vector<unsigned int> & slots = _slots[type];
+        if (index >= slots.size()) {
+            if (uid == NO_COMPONENT) {
+                return;
+            }
+            if (slots.capacity() < _generations.capacity()) {
+                slots.reserve(_generations.capacity());
+            }
+            slots.resize(index + 1, NO_COMPONENT);
+        }
+        slots[index] = uid;
+    }
+
+    void EntityRegistry::set_tag(unsigned int tag, unsigned int index, bool on) {
+        mark_changed(index);
+        unsigned int word = tag / 64;
+        unsigned long long bit = 1ull << (tag % 64);
+        if (word >= _tags.size() || index >= _tags[word].size()) {
+            if (!on) {
+                return;
+            }
+            if (word >= _tags.size()) {
+                _tags.resize(word + 1);
+            }
+            if (_tags[word].capacity() < _generations.capacity()) {
+                _tags[word].reserve(_generations.capacity());
+            }
+            _tags[word].resize(index + 1, 0);
+        }
+        if (on) {
+            _tags[word][index] |= bit;
+        } else {
+            _tags[word][index] &= ~bit;
+        }
+    }
+
+    bool EntityRegistry::clear_tags(unsigned int index) {
+        bool had = false;
+        for (unsigned int word = 0; word < _tags.size(); word++) {
+            if (index < _tags[word].size() && _tags[word][index]) {
+                _tags[word][index] = 0;
+                had = true;
+            }
+        }
+        return had;
+    }
+
+    void EntityRegistry::set_wrapper(unsigned int index, Entity * e) {
+        if (index >= _wrappers.size()) {
+            if (!e) {
+                return;
+            }
+            _wrappers.resize(index + 1, NULL);
+            _wrapped_at.resize(index + 1, 0);
+        }
+        if (e && !_wrappers[index]) {
+            _wrapped_at[index] = _wrapped.size();
+            _wrapped.push_back(index);
+        } else if (!e && _wrappers[index]) {
+            // The last wrapped slot takes its position.
+            unsigned int last = _wrapped.back();
+            _wrapped[_wrapped_at[index]] = last;
+            _wrapped_at[last] = _wrapped_at[index];
+            _wrapped.pop_back();
+        }
+        _wrappers[index] = e;
+    }
+
+    void EntityRegistry::reserve(unsigned int n) {
+        _generations.reserve(n);
+        _flags.reserve(n);
+    }
+
+    void EntityRegistry::save(SnapshotWriter & w) const {
+        // Drop the entries of restored slots, and their duplicates.
+        std::vector<unsigned int> free;
+        std::vector<unsigned char> seen(_generations.size(), 0);
+        free.reserve(_free.size());
+        for (unsigned int i = 0; i < _free.size(); i++) {
+            if (!_flags[_free[i]] && !seen[_free[i]]) {
+                seen[_free[i]] = 1;
+                free.push_back(_free[i]);
+            }
+        }
+        w.write_vector(_generations);
+        w.write_vector(_flags);
+        w.write_vector(free);
+        w.write(_alive);
+    }
+
+    void EntityRegistry::load(SnapshotReader & r) {
+        std::vector<unsigned int> generations, free;
+        std::vector<unsigned char> flags;
+        r.read_vector(generations);
+        r.read_vector(flags);
+        r.read_vector(free);
+        unsigned int alive = r.read<unsigned int>();
+        if (flags.size() != generations.size() || alive + free.size() != generations.size()) {
+            SnapshotError e("Snapshot is corrupt.");
+            throw e;
+        }
+        for (unsigned int i = 0; i < free.size(); i++) {
+            if (free[i] >= flags.size() || flags[free[i]]) {
+                SnapshotError e("Snapshot is corrupt.");
+                throw e;
+            }
+        }
+        _generations.swap(generations);
+        _flags.swap(flags);
+        _free.swap(free);
+        _alive = alive;
+        _slots.clear();
+        _tags.clear();
+        _wrappers.clear();
+        _wrapped.clear();
+        _wrapped_at.clear();
+        set_tracking(_tracking);
+    }
+
+    void EntityRegistry::save_slots(unsigned int type, SnapshotWriter & w) const {
+        if (type < _slots.size()) {
+            w.write_vector(_slots[type]);
+        } else {
+            w.write_vector(std::vector<unsigned int>());
+        }
+    }
+
+    void EntityRegistry::load_slots(unsigned int type, SnapshotReader & r) {
+        std::vector<unsigned int> slots;
+        r.read_vector(slots);
+        if (slots.size() > _generations.size()) {
+            SnapshotError e("Snapshot is corrupt.");
+            throw e;
+        }
+        if (slots.empty()) {
+            if (type < _slots.size()) {
+                _slots[type].clear();
+            }
+            return;
+        }
+        if (type >= _slots.size()) {
+            _slots.resize(type + 1);
+        }
+        _slots[type].swap(slots);
+    }
+
+    void EntityRegistry::save_tag(unsigned int tag, SnapshotWriter & w) const {
+        std::vector<unsigned long long> bits((_generations.size() + 63) / 64, 0);
+        unsigned int word = tag / 64;
+        unsigned long long bit = 1ull << (tag % 64);
+        if (word < _tags.size()) {
+            for (unsigned int index = 0; index < _tags[word].size(); index++) {
+                if (_tags[word][index] & bit) {
+                    bits[index / 64] |= 1ull << (index % 64);
+                }
+            }
+        }
+        w.write_vector(bits);
+    }
+
+    void EntityRegistry::load_tag(unsigned int tag, SnapshotReader & r) {
+        std::vector<unsigned long long> bits;
+        r.read_vector(bits);
+        if (bits.size() > (_generations.size() + 63) / 64) {
+            SnapshotError e("Snapshot is corrupt.");
+            throw e;
+        }
+        for (unsigned int index = 0; index < bits.size() * 64; index++) {
+            if ((bits[index / 64] >> (index % 64)) & 1) {
+                set_tag(tag, index, true);
+            }
+        }
+    }
+
+    void EntityRegistry::set_tracking(bool on) {
+        _tracking = on;
+        _changed.clear();
+        _changed_marks.clear();
+        _changed_slots.clear();
+        _changed_slot_marks.clear();
+        _free_kept = _free.size();
+    }
+
+    void EntityRegistry::mark_changed(unsigned int type, unsigned int index) {
+        if (!_tracking) {
+            return;
+        }
+        if (type >= _changed_slots.size()) {
+            _changed_slots.resize(type + 1);
+            _changed_slot_marks.resize(type + 1);
+        }
+        std::vector<unsigned char> & marks = _changed_slot_marks[type];
+        if (index >= marks.size() || !marks[index]) {
+            _mark(_changed_slots[type], marks, index);
+        }
+    }
+
+    void EntityRegistry::clear_changes() {
+        for (unsigned int i = 0; i < _changed.size(); i++) {
+            _changed_marks[_changed[i]] = 0;
+        }
+        _changed.clear();
+        for (unsigned int type = 0; type < _changed_slots.size(); type++) {
+            for (unsigned int i = 0; i < _changed_slots[type].size(); i++) {
+                _changed_slot_marks[type][_changed_slots[type][i]] = 0;
+            }
+            _changed_slots[type].clear();
+        }
+        _free_kept = _free.size();
+    }
+
+    void EntityRegistry::_mark(std::vector<unsigned int> & list, std::vector<unsigned char> & marks, unsigned int index) {
+        if (index >= marks.size()) {
+            marks.resize(std::max<size_t>(index + 1, _generations.size()), 0);
+        }
+        marks[index] = 1;
+        list.push_back(index);
+    }
+}
@@ -0,0 +1,678 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+#include "../include/replication.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Bounds checked reader of a replication packet.
+     */
+    struct _PacketReader {
+        const char * data;
+        size_t pos;
+        size_t size;
+
+        unsigned long long varint() {
+            unsigned long long v = 0;
+            for (unsigned int shift = 0; shift < 64; shift += 7) {
+                unsigned char b = byte();
+                v |= (unsigned long long)(b & 0x7F) << shift;
+                if (!(b & 0x80)) {
+                    return v;
+                }
+            }
+            corrupt();
+            return 0;
+        }
+
+        unsigned char byte() {
+            if (pos >= size) {
+                corrupt();
+            }
+            return data[pos++];
+        }
+
+        const char * bytes(size_t n) {
+            if (n > size - pos) {
+                corrupt();
+            }
+            pos += n;
+            return data + pos - n;
+        }
+
+        void corrupt() {
+            ReplicationError e("Replication packet is corrupt.");
+            throw e;
+        }
+    };
+
+    static void _write_varint(std::vector<char> & out, unsigned long long v) {
+        while (v >= 0x80) {
+            out.push_back((char)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((char)v);
+    }
+
+    static unsigned long long _zigzag(long long v) {
+        return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+    }
+
+    static long long _unzigzag(unsigned long long v) {
+        return (long long)(v >> 1) ^ -(long long)(v & 1);
+    }
+
+    static inline unsigned long long _key(EntityId id) {
+        return ((unsigned long long)id.index << 32) | id.generation;
+    }
+
+    static inline EntityId _id(unsigned long long key) {
+        return EntityId((unsigned int)(key >> 32), (unsigned int)key);
+    }
+
+    static inline unsigned long long _all_fields(const ComponentSchema * schema) {
+        return schema->fields.size() == 64 ? ~0ull : (1ull << schema->fields.size()) - 1;
+    }
+
+    static inline const char * _at(const ComponentSchema * schema, const Component * c, unsigned int field) {
+        return (const char *)c - schema->base + schema->fields[field].offset;
+    }
+
+    /**
+     * \brief Size of the slot of an element of a field.
+     * Strings keep a hash, and quantized fields a count of steps.
+     */
+    static inline size_t _slot_size(const SchemaField & f, double step) {
+        return f.type == FIELD_STRING || step > 0 ? sizeof(unsigned long long) : f.size;
+    }
+
+    static inline bool _is_signed(FieldType t) {
+        return t == FIELD_INT16 || t == FIELD_INT32 || t == FIELD_INT64;
+    }
+
+    static inline bool _is_varint(FieldType t) {
+        return t == FIELD_INT16 || t == FIELD_UINT16 || t == FIELD_INT32 || t == FIELD_UINT32 || t == FIELD_INT64 || t == FIELD_UINT64;
+    }
+
+    /**
+     * \brief Read an integer of 2, 4 or 8 bytes, sign extended when signed.
+     */
+    static unsigned long long _load_int(const char * p, size_t size, bool sign) {
+        switch (size) {
+            case 2: {
+                unsigned short v;
+                memcpy(&v, p, 2);
+                return sign ? (unsigned long long)(long long)(short)v : v;
+            }
+            case 4: {
+                unsigned int v;
+                memcpy(&v, p, 4);
+                return sign ? (unsigned long long)(long long)(int)v : v;
+            }
+            default: {
+                unsigned long long v;
+                memcpy(&v, p, 8);
+                return v;
+            }
+        }
+    }
+
+    /**
+     * \brief Write the low bytes of an integer to a field of 2, 4 or 8 bytes.
+     */
+    static void _store_int(char * p, size_t size, unsigned long long v) {
+        switch (size) {
+            case 2: {
+                unsigned short x = (unsigned short)v;
+                memcpy(p, &x, 2);
+                break;
+            }
+            case 4: {
+                unsigned int x = (unsigned int)v;
+                memcpy(p, &x, 4);
+                break;
+            }
+            default:
+                memcpy(p, &v, 8);
+        }
+    }
+
+    static double _number(const ComponentSchema * schema, const Component * c, unsigned int field) {
+        const char * p = _at(schema, c, field);
+        switch (schema->fields[field].type) {
+            case FIELD_FLOAT: {
+                float v;
+                memcpy(&v, p, sizeof(v));
+                return v;
+            }
+            case FIELD_DOUBLE: {
+                double v;
+                memcpy(&v, p, sizeof(v));
+                return v;
+            }
+            case FIELD_INT8: return *(const signed char *)p;
+            case FIELD_UINT8: return *(const unsigned char *)p;
+            default: {
+                FieldType t = schema->fields[field].type;
+                unsigned long long v = _load_int(p, schema->fields[field].size, _is_signed(t));
+                return _is_signed(t) ? (double)(long long)v : (double)v;
+            }
+        }
+    }
+
+    ReplicationSet::ReplicationSet() {
+        _record = 0;
+    }
+
+    unsigned int ReplicationSet::find(const ComponentSchema & schema) const {
+        for (unsigned int i = 0; i < _types.size(); i++) {
+            if (_types[i].schema == &schema) {
+                return i;
+            }
+        }
+        return NO_COMPONENT;
+    }
+
+    void ReplicationSet::_add_type(const ComponentSchema & schema, _Type & t) {
+        if (find(schema) != NO_COMPONENT) {
+            ReplicationError e("Component already replicated.");
+            throw e;
+        }
+        if (_types.size() == 64 || schema.fields.size() > 64) {
+            ReplicationError e("Too many replicated types or fields.");
+            throw e;
+        }
+        t.schema = &schema;
+        t.steps.assign(schema.fields.size(), 0);
+        _types.push_back(t);
+        _layout();
+    }
+
+    void ReplicationSet::_layout() {
+        _record = 0;
+        for (unsigned int i = 0; i < _types.size(); i++) {
+            _Type & t = _types[i];
+            t.offset = _record;
+            t.slots.clear();
+            size_t size = 1;
+            for (unsigned int j = 0; j < t.schema->fields.size(); j++) {
+                t.slots.push_back(size);
+                size += _slot_size(t.schema->fields[j], t.steps[j]) * t.schema->fields[j].count;
+            }
+            _record += size;
+        }
+    }
+
+    void ReplicationSet::_quantize(const ComponentSchema & schema, const std::string & field, double step) {
+        unsigned int type = find(schema);
+        if (type == NO_COMPONENT) {
+            ReplicationError e("Component is not replicated.");
+            throw e;
+        }
+        unsigned int f = schema.find(field);
+        if (f == FIELD_NONE || (schema.fields[f].type != FIELD_FLOAT && schema.fields[f].type != FIELD_DOUBLE) || !(step > 0)) {
+            ReplicationError e("Only float and double fields can be quantized, by a positive step.");
+            throw e;
+        }
+        _types[type].steps[f] = step;
+        _layout();
+    }
+
+    void Replicator::_store(const ReplicationSet::_Type & t, const Component * c, char * record, const std::vector<unsigned long long> & keys) {
+        const ComponentSchema * schema = t.schema;
+        for (unsigned int i = 0; i < schema->fields.size(); i++) {
+            const SchemaField & f = schema->fields[i];
+            const char * from = _at(schema, c, i);
+            char * slot = record + t.slots[i];
+            for (unsigned int j = 0; j < f.count; j++, from += f.size, slot += _slot_size(f, t.steps[i])) {
+                if (f.type == FIELD_STRING) {
+                    const std::string & s = *reinterpret_cast<const std::string *>(from);
+                    unsigned long long h = snapshot_checksum(s.data(), s.size());
+                    memcpy(slot, &h, sizeof(h));
+                } else if (f.type == FIELD_ENTITY) {
+                    EntityId id;
+                    memcpy(&id, from, sizeof(id));
+                    if (!std::binary_search(keys.begin(), keys.end(), _key(id))) {
+                        id = EntityId();
+                    }
+                    memcpy(slot, &id, sizeof(id));
+                } else if (t.steps[i] > 0 && f.type == FIELD_FLOAT) {
+                    float v;
+                    memcpy(&v, from, sizeof(v));
+                    long long q = llround(v / t.steps[i]);
+                    memcpy(slot, &q, sizeof(q));
+                } else if (t.steps[i] > 0) {
+                    double v;
+                    memcpy(&v, from, sizeof(v));
+                    long long q = llround(v / t.steps[i]);
+                    memcpy(slot, &q, sizeof(q));
+                } else {
+                    memcpy(slot, from, f.size);
+                }
+            }
+        }
+    }
+
+    void Replicator::_write_field(std::vector<char> & out, const ReplicationSet::_Type & t, unsigned int field, const Component * c, const char * record) {
+        const SchemaField & f = t.schema->fields[field];
+        const char * from = _at(t.schema, c, field);
+        const char * slot = record + t.slots[field];
+        for (unsigned int j = 0; j < f.count; j++, from += f.size, slot += _slot_size(f, t.steps[field])) {
+            if (f.type == FIELD_STRING) {
+                const std::string & s = *reinterpret_cast<const std::string *>(from);
+                _write_varint(out, s.size());
+                out.insert(out.end(), s.begin(), s.end());
+            } else if (f.type == FIELD_ENTITY) {
+                EntityId id;
+                memcpy(&id, slot, sizeof(id));
+                _write_varint(out, id.index);
+                _write_varint(out, id.generation);
+            } else if (t.steps[field] > 0) {
+                long long q;
+                memcpy(&q, slot, sizeof(q));
+                _write_varint(out, _zigzag(q));
+            } else if (_is_varint(f.type)) {
+                unsigned long long v = _load_int(slot, f.size, _is_signed(f.type));
+                _write_varint(out, _is_signed(f.type) ? _zigzag((long long)v) : v);
+            } else {
+                out.insert(out.end(), slot, slot + f.size);
+            }
+        }
+    }
+
+    Replicator::Replicator(Engine & engine, const ReplicationSet & set) : _engine(engine), _set(set) {
+    }
+
+    unsigned int Replicator::add_observer(const Family & f) {
+        _Observer o;
+        o.family = f;
+        o.area = NO_COMPONENT;
+        o.x = o.y = 0;
+        o.cx = o.cy = o.radius = 0;
+        o.states.push_back(_State());
+        o.states.back().seq = 0;
+        _observers.push_back(o);
+        return _observers.size() - 1;
+    }
+
+    void Replicator::_set_area(unsigned int observer, const ComponentSchema & schema, const std::string & x, const std::string & y, double radius) {
+        _Observer & o = _get_observer(observer);
+        unsigned int type = _set.find(schema);
+        if (type == NO_COMPONENT) {
+            ReplicationError e("Component is not replicated.");
+            throw e;
+        }
+        unsigned int fx = schema.find(x), fy = schema.find(y);
+        if (fx == FIELD_NONE || fy == FIELD_NONE || schema.fields[fx].type > FIELD_DOUBLE || schema.fields[fy].type > FIELD_DOUBLE || schema.fields[fx].type == FIELD_BOOL || schema.fields[fy].type == FIELD_BOOL) {
+            ReplicationError e("Area coordinates must be number fields.");
+            throw e;
+        }
+        o.area = type;
+        o.x = fx;
+        o.y = fy;
+        o.radius = radius;
+    }
+
+    void Replicator::set_center(unsigned int observer, double x, double y) {
+        _Observer & o = _get_observer(observer);
+        o.cx = x;
+        o.cy = y;
+    }
+
+    Replicator::_Observer & Replicator::_get_observer(unsigned int observer) {
+        if (observer >= _observers.size()) {
+            ReplicationError e("Observer not found.");
+            throw e;
+        }
+        return _observers[observer];
+    }
+
+    void Replicator::_capture(_Observer & o, _State & s) {
+        EntityIdArray ids = _engine.get_ids_for(o.family);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            if (o.area != NO_COMPONENT) {
+                const ReplicationSet::_Type & t = _set._types[o.area];
+                Component * c = t.find(_engine, ids[i]);
+                if (!c) {
+                    continue;
+                }
+                double dx = _number(t.schema, c, o.x) - o.cx;
+                double dy = _number(t.schema, c, o.y) - o.cy;
+                if (dx * dx + dy * dy > o.radius * o.radius) {
+                    continue;
+                }
+            }
+            s.keys.push_back(_key(ids[i]));
+        }
+        std::sort(s.keys.begin(), s.keys.end());
+        s.records.assign(s.keys.size() * _set._record, 0);
+        for (unsigned int i = 0; i < s.keys.size(); i++) {
+            char * record = &s.records[i * _set._record];
+            for (unsigned int type = 0; type < _set._types.size(); type++) {
+                const ReplicationSet::_Type & t = _set._types[type];
+                Component * c = t.find(_engine, _id(s.keys[i]));
+                if (c) {
+                    record[t.offset] = 1;
+                    _store(t, c, record + t.offset, s.keys);
+                }
+            }
+        }
+    }
+
+    unsigned long long Replicator::_changes(unsigned int type, const char * record, const std::vector<const char *> & refs, bool & presence) {
+        const ReplicationSet::_Type & t = _set._types[type];
+        const ComponentSchema * schema = t.schema;
+        const char * current = record + t.offset;
+        unsigned long long mask = 0;
+        presence = false;
+        for (unsigned int r = 0; r < refs.size(); r++) {
+            const char * old = refs[r] + t.offset;
+            if (*old != *current) {
+                presence = true;
+                if (*current) {
+                    return _all_fields(schema);
+                }
+                continue;
+            }
+            if (!*current) {
+                continue;
+            }
+            for (unsigned int i = 0; i < schema->fields.size(); i++) {
+                size_t size = _slot_size(schema->fields[i], t.steps[i]) * schema->fields[i].count;
+                if (memcmp(current + t.slots[i], old + t.slots[i], size)) {
+                    mask |= 1ull << i;
+                }
+            }
+        }
+        return mask;
+    }
+
+    unsigned long long Replicator::encode(unsigned int observer, std::vector<char> & out) {
+        _Observer & o = _get_observer(observer);
+        _State s;
+        s.seq = o.states.back().seq + 1;
+        _capture(o, s);
+
+        // Entities missing from a state that may be on the replica enter, and the
+        // ones missing from the current state leave.
+        unsigned int n = o.states.size();
+        std::vector<size_t> cursors(n, 0);
+        std::vector<bool> entering(s.keys.size(), false);
+        std::vector<unsigned long long> enter, leave;
+        for (unsigned int i = 0; i < s.keys.size(); i++) {
+            for (unsigned int r = 0; r < n; r++) {
+                const std::vector<unsigned long long> & keys = o.states[r].keys;
+                size_t & c = cursors[r];
+                while (c < keys.size() && keys[c] < s.keys[i]) {
+                    c++;
+                }
+                if (c == keys.size() || keys[c] != s.keys[i]) {
+                    entering[i] = true;
+                }
+            }
+            if (entering[i]) {
+                enter.push_back(s.keys[i]);
+            }
+        }
+        for (unsigned int r = 0; r < n; r++) {
+            const std::vector<unsigned long long> & keys = o.states[r].keys;
+            std::set_difference(keys.begin(), keys.end(), s.keys.begin(), s.keys.end(), std::back_inserter(leave));
+        }
+        std::sort(leave.begin(), leave.end());
+        leave.erase(std::unique(leave.begin(), leave.end()), leave.end());
+
+        _write_varint(out, s.seq);
+        _write_varint(out, o.states.front().seq);
+        const std::vector<unsigned long long> * lists[2] = {&enter, &leave};
+        for (unsigned int l = 0; l < 2; l++) {
+            _write_varint(out, lists[l]->size());
+            unsigned int index = 0;
+            for (unsigned int i = 0; i < lists[l]->size(); i++) {
+                EntityId id = _id((*lists[l])[i]);
+                _write_varint(out, id.index - index);
+                _write_varint(out, id.generation);
+                index = id.index;
+            }
+        }
+
+        std::vector<char> body;
+        std::vector<const char *> refs(n);
+        std::vector<unsigned long long> masks(_set._types.size());
+        unsigned int updates = 0, index = 0;
+        cursors.assign(n, 0);
+        for (unsigned int i = 0; i < s.keys.size(); i++) {
+            const char * record = &s.records[i * _set._record];
+            for (unsigned int r = 0; r < n && !entering[i]; r++) {
+                const std::vector<unsigned long long> & keys = o.states[r].keys;
+                size_t & c = cursors[r];
+                while (keys[c] < s.keys[i]) {
+                    c++;
+                }
+                refs[r] = &o.states[r].records[c * _set._record];
+            }
+            unsigned long long touched = 0, present = 0;
+            for (unsigned int type = 0; type < _set._types.size(); type++) {
+                const ReplicationSet::_Type & t = _set._types[type];
+                bool presence = false;
+                masks[type] = entering[i] ? (record[t.offset] ? _all_fields(t.schema) : 0) : _changes(type, record, refs, presence);
+                if (record[t.offset]) {
+                    present |= 1ull << type;
+                }
+                if (masks[type] || presence || (entering[i] && record[t.offset])) {
+                    touched |= 1ull << type;
+                }
+            }
+            if (!touched) {
+                continue;
+            }
+            EntityId id = _id(s.keys[i]);
+            _write_varint(body, id.index - index);
+            _write_varint(body, id.generation);
+            _write_varint(body, touched);
+            _write_varint(body, present);
+            index = id.index;
+            updates++;
+            for (unsigned int type = 0; type < _set._types.size(); type++) {
+                if (!(touched & present & (1ull << type))) {
+                    continue;
+                }
+                const ReplicationSet::_Type & t = _set._types[type];
+                Component * c = t.find(_engine, id);
+                _write_varint(body, masks[type]);
+                for (unsigned int f = 0; f < t.schema->fields.size(); f++) {
+                    if (masks[type] & (1ull << f)) {
+                        _write_field(body, t, f, c, record + t.offset);
+                    }
+                }
+            }
+        }
+        _write_varint(out, updates);
+        out.insert(out.end(), body.begin(), body.end());
+        o.states.push_back(s);
+        return s.seq;
+    }
+
+    void Replicator::ack(unsigned int observer, unsigned long long seq) {
+        _Observer & o = _get_observer(observer);
+        if (seq <= o.states.front().seq || seq > o.states.back().seq) {
+            return;
+        }
+        while (o.states.front().seq != seq) {
+            o.states.pop_front();
+        }
+    }
+
+    unsigned int Replicator::get_pending(unsigned int observer) {
+        return _get_observer(observer).states.size() - 1;
+    }
+
+    Replica::Replica(Engine & engine, const ReplicationSet & set) : _engine(engine), _set(set) {
+        _last = 0;
+    }
+
+    unsigned long long Replica::apply(const char * data, size_t size) {
+        _PacketReader r;
+        r.data = data;
+        r.pos = 0;
+        r.size = size;
+        unsigned long long seq = r.varint();
+        unsigned long long baseline = r.varint();
+        if (seq <= _last) {
+            return _last;
+        }
+        if (baseline > _last) {
+            r.corrupt();
+        }
+        for (unsigned int l = 0; l < 2; l++) {
+            unsigned long long count = r.varint();
+            unsigned int index = 0;
+            for (unsigned long long i = 0; i < count; i++) {
+                index += r.varint();
+                unsigned long long key = ((unsigned long long)index << 32) | (unsigned int)r.varint();
+                std::map<unsigned long long, EntityId>::iterator it = _local.find(key);
+                if (!l && it == _local.end()) {
+                    EntityId id = _engine.create_entity();
+                    _engine.activate(id);
+                    _local[key] = id;
+                } else if (l && it != _local.end()) {
+                    _engine.destroy_entity(it->second);
+                    _local.erase(it);
+                }
+            }
+        }
+        unsigned long long updates = r.varint();
+        unsigned int index = 0;
+        for (unsigned long long i = 0; i < updates; i++) {
+            index += r.varint();
+            unsigned long long key = ((unsigned long long)index << 32) | (unsigned int)r.varint();
+            std::map<unsigned long long, EntityId>::iterator it = _local.find(key);
+            if (it == _local.end()) {
+                r.corrupt();
+            }
+            EntityId id = it->second;
+            unsigned long long touched = r.varint();
+            unsigned long long present = r.varint();
+            for (unsigned int type = 0; type < _set._types.size(); type++) {
+                if (!(touched & (1ull << type))) {
+                    continue;
+                }
+                const ReplicationSet::_Type & t = _set._types[type];
+                Component * c = t.find(_engine, id);
+                if (!(present & (1ull << type))) {
+                    if (c) {
+                        t.remove(_engine, id);
+                    }
+                    continue;
+                }
+                if (!c) {
+                    c = t.add(_engine, id);
+                }
+                unsigned long long mask = r.varint();
+                if (mask & ~_all_fields(t.schema)) {
+                    r.corrupt();
+                }
+                for (unsigned int field = 0; field < t.schema->fields.size(); field++) {
+                    if (!(mask & (1ull << field))) {
+                        continue;
+                    }
+                    const SchemaField & f = t.schema->fields[field];
+                    char * to = (char *)c - t.schema->base + f.offset;
+                    for (unsigned int j = 0; j < f.count; j++, to += f.size) {
+                        if (f.type == FIELD_STRING) {
+                            size_t length = r.varint();
+                            reinterpret_cast<std::string *>(to)->assign(r.bytes(length), length);
+                        } else if (f.type == FIELD_ENTITY) {
+                            unsigned int ref = r.varint();
+                            unsigned long long ref_key = ((unsigned long long)ref << 32) | (unsigned int)r.varint();
+                            std::map<unsigned long long, EntityId>::iterator target = _local.find(ref_key);
+                            EntityId local = target == _local.end() ? EntityId() : target->second;
+                            memcpy(to, &local, sizeof(local));
+                        } else if (t.steps[field] > 0 && f.type == FIELD_FLOAT) {
+                            float v = (float)(_unzigzag(r.varint()) * t.steps[field]);
+                            memcpy(to, &v, sizeof(v));
+                        } else if (t.steps[field] > 0) {
+                            double v = _unzigzag(r.varint()) * t.steps[field];
+                            memcpy(to, &v, sizeof(v));
+                        } else if (_is_varint(f.type)) {
+                            unsigned long long v = r.varint();
+                            if (_is_signed(f.type)) {
+                                v = (unsigned long long)_unzigzag(v);
+                            }
+                            _store_int(to, f.size, v);
+                        } else {
+                            memcpy(to, r.bytes(f.size), f.size);
+                        }
+                    }
+                }
+            }
+        }
+        _last = seq;
+        return seq;
+    }
+
+    EntityId Replica::get_local(EntityId id) {
+        std::map<unsigned long long, EntityId>::iterator it = _local.find(_key(id));
+        return it == _local.end() ? EntityId() : it->second;
+    }
+
+    unsigned int Replica::size() {
+        return _local.size();
+    }
+
+    LoopbackChannel::LoopbackChannel() {
+        _bytes = 0;
+        _packets = 0;
+    }
+
+    void LoopbackChannel::send(const std::vector<char> & packet) {
+        _queue.push_back(packet);
+        _bytes += packet.size();
+        _packets++;
+    }
+
+    bool LoopbackChannel::receive(std::vector<char> & packet) {
+        if (_queue.empty()) {
+            return false;
+        }
+        packet.swap(_queue.front());
+        _queue.pop_front();
+        return true;
+    }
+
+    void LoopbackChannel::drop() {
+        _queue.clear();
+    }
+
+    unsigned int LoopbackChannel::size() {
+        return _queue.size();
+    }
+
+    unsigned long long LoopbackChannel::get_bytes() {
+        return _bytes;
+    }
+
+    unsigned long long LoopbackChannel::get_packets() {
+        return _packets;
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/rollback.h"
+#include "../include/exceptions.h"
+
+namespace CAshley {
+
+    void RollbackFrame::clear() {
+        entities.clear();
+        tags.clear();
+        for (unsigned int i = 0; i < types.size(); i++) {
+            RollbackBlocks & b = blocks[types[i]];
+            b.slots.clear();
+            b.present.clear();
+            b.data.clear();
+        }
+        types.clear();
+        free.clear();
+    }
+
+    RollbackBuffer::RollbackBuffer(unsigned int ticks, unsigned long long tick) : _frames(ticks) {
+        if (!ticks) {
+            RollbackError e("A rollback buffer needs at least one tick.");
+            throw e;
+        }
+        _first = 0;
+        _count = 0;
+        _last = tick;
+        _world.slots = 0;
+        _world.clock = 0;
+    }
+
+    RollbackFrame & RollbackBuffer::push(unsigned long long tick) {
+        if (_count == _frames.size()) {
+            _first = (_first + 1) % _frames.size();
+            _count--;
+        }
+        _count++;
+        _last = tick;
+        return back();
+    }
+
+    RollbackFrame & RollbackBuffer::back() {
+        if (!_count) {
+            RollbackError e("Rollback buffer is empty.");
+            throw e;
+        }
+        return _frames[(_first + _count - 1) % _frames.size()];
+    }
+
+    void RollbackBuffer::pop() {
+        if (!_count) {
+            RollbackError e("Rollback buffer is empty.");
+            throw e;
+        }
+        _count--;
+        _last--;
+    }
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include "../include/schema.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Storage of the SchemaRegistry. Schemas never move once kept.
+     */
+    struct _Schemas {
+        std::mutex mutex;
+        std::deque<ComponentSchema> schemas;
+        std::map<std::string, const ComponentSchema *> names;
+    };
+
+    static _Schemas & _schemas() {
+        static _Schemas s;
+        return s;
+    }
+
+    static void _hash_bytes(std::string & out, const void * data, size_t size) {
+        out.append((const char *)data, size);
+    }
+
+    unsigned int ComponentSchema::find(const std::string & field) const {
+        for (unsigned int i = 0; i < fields.size(); i++) {
+            if (fields[i].name == field) {
+                return i;
+            }
+        }
+        return FIELD_NONE;
+    }
+
+    bool ComponentSchema::equal(const Component * a, const Component * b, unsigned int field) const {
+        const SchemaField & f = fields[field];
+        if (f.type == FIELD_STRING) {
+            const std::string * x = reinterpret_cast<const std::string *>(_field(a, field));
+            const std::string * y = reinterpret_cast<const std::string *>(_field(b, field));
+            for (unsigned int i = 0; i < f.count; i++) {
+                if (x[i] != y[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        return !memcmp(_field(a, field), _field(b, field), f.size * f.count);
+    }
+
+    bool ComponentSchema::equal(const Component * a, const Component * b) const {
+        for (unsigned int i = 0; i < fields.size(); i++) {
+            if (!equal(a, b, i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    unsigned long long ComponentSchema::value_hash(const Component * c) const {
+        unsigned long long h = 0xcbf29ce484222325ull;
+        for (unsigned int i = 0; i < fields.size(); i++) {
+            const SchemaField & f = fields[i];
+            const char * from = _field(c, i);
+            for (unsigned int j = 0; j < f.count; j++, from += f.size) {
+                unsigned long long v;
+                if (f.type == FIELD_STRING) {
+                    const std::string & s = *reinterpret_cast<const std::string *>(from);
+                    v = snapshot_checksum(s.data(), s.size());
+                } else {
+                    v = snapshot_checksum(from, f.size);
+                }
+                h = (h ^ v) * 0x100000001b3ull;
+            }
+        }
+        return h;
+    }
+
+    unsigned int ComponentSchema::diff(const Component * a, const Component * b, std::vector<unsigned int> & changed) const {
+        changed.clear();
+        for (unsigned int i = 0; i < fields.size(); i++) {
+            if (!equal(a, b, i)) {
+                changed.push_back(i);
+            }
+        }
+        return changed.size();
+    }
+
+    void ComponentSchema::copy(Component * to, const Component * from, unsigned int field) const {
+        const SchemaField & f = fields[field];
+        if (f.type == FIELD_STRING) {
+            std::string * x = reinterpret_cast<std::string *>(_field(to, field));
+            const std::string * y = reinterpret_cast<const std::string *>(_field(from, field));
+            for (unsigned int i = 0; i < f.count; i++) {
+                x[i] = y[i];
+            }
+            return;
+        }
+        memmove(_field(to, field), _field(from, field), f.size * f.count);
+    }
+
+    void ComponentSchema::save(SnapshotWriter & w, const Component * c) const {
+        for (unsigned int i = 0; i < fields.size(); i++) {
+            const SchemaField & f = fields[i];
+            if (f.type == FIELD_STRING) {
+                const std::string * x = reinterpret_cast<const std::string *>(_field(c, i));
+                for (unsigned int j = 0; j < f.count; j++) {
+                    w.write_string(x[j]);
+                }
+            } else {
+                w.write(_field(c, i), f.size * f.count);
+            }
+        }
+    }
+
+    void ComponentSchema::load(SnapshotReader & r, Component * c) const {
+        for (unsigned int i = 0; i < fields.size(); i++) {
+            const SchemaField & f = fields[i];
+            if (f.type == FIELD_STRING) {
+                std::string * x = reinterpret_cast<std::string *>(_field(c, i));
+                for (unsigned int j = 0; j < f.count; j++) {
+                    x[j] = r.read_string();
+                }
+            } else {
+                r.read(_field(c, i), f.size * f.count);
+            }
+        }
+    }
+
+    std::string ComponentSchema::to_string(const Component * c) const {
+        std::ostringstream out;
+        out << name << "{";
+        for (unsigned int i = 0; i < fields.size(); i++) {
+            const SchemaField & f = fields[i];
+            out << (i ? ", " : "") << f.name << "=";
+            if (f.count > 1) {
+                out << "[";
+            }
+            for (unsigned int j = 0; j < f.count; j++) {
+                const char * x = _field(c, i) + j * f.size;
+                out << (j ? ", " : "");
+                switch (f.type) {
+                    case FIELD_BOOL: out << (*(const bool *)x ? "true" : "false"); break;
+                    case FIELD_INT8: out << (int)*(const signed char *)x; break;
+                    case FIELD_UINT8: out << (unsigned int)*(const unsigned char *)x; break;
+                    case FIELD_INT16: out << *(const short *)x; break;
+                    case FIELD_UINT16: out << *(const unsigned short *)x; break;
+                    case FIELD_INT32: out << *(const int *)x; break;
+                    case FIELD_UINT32: out << *(const unsigned int *)x; break;
+                    case FIELD_INT64: out << *(const long long *)x; break;
+                    case FIELD_UINT64: out << *(const unsigned long long *)x; break;
+                    case FIELD_FLOAT: out << *(const float *)x; break;
+                    case FIELD_DOUBLE: out << *(const double *)x; break;
+                    case FIELD_ENTITY: {
+                        const EntityId * id = (const EntityId *)x;
+                        out << id->index << ":" << id->generation;
+                        break;
+                    }
+                    case FIELD_STRING: out << '"' << *(const std::string *)x << '"'; break;
+                    case FIELD_BYTES: out << "<" << f.size << " bytes>"; break;
+                }
+            }
+            if (f.count > 1) {
+                out << "]";
+            }
+        }
+        out << "}";
+        return out.str();
+    }
+
+    const ComponentSchema & SchemaRegistry::add(const ComponentSchema & schema) {
+        _Schemas & s = _schemas();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.names.count(schema.name)) {
+            ComponentError e("Component name already in use.");
+            throw e;
+        }
+        s.schemas.push_back(schema);
+        ComponentSchema & kept = s.schemas.back();
+        std::string key;
+        unsigned long long size = kept.size;
+        _hash_bytes(key, kept.name.data(), kept.name.size());
+        _hash_bytes(key, &size, sizeof(size));
+        for (unsigned int i = 0; i < kept.fields.size(); i++) {
+            const SchemaField & f = kept.fields[i];
+            unsigned long long layout[4] = {(unsigned long long)f.type, f.offset, f.size, f.count};
+            _hash_bytes(key, f.name.data(), f.name.size() + 1);
+            _hash_bytes(key, layout, sizeof(layout));
+        }
+        kept.hash = snapshot_checksum(key.data(), key.size());
+        s.names[kept.name] = &kept;
+        return kept;
+    }
+
+    const ComponentSchema * SchemaRegistry::find(const std::string & name) {
+        _Schemas & s = _schemas();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        std::map<std::string, const ComponentSchema *>::iterator it = s.names.find(name);
+        return it == s.names.end() ? NULL : it->second;
+    }
+
+    std::vector<const ComponentSchema *> SchemaRegistry::list() {
+        _Schemas & s = _schemas();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        std::vector<const ComponentSchema *> r;
+        for (unsigned int i = 0; i < s.schemas.size(); i++) {
+            r.push_back(&s.schemas[i]);
+        }
+        return r;
+    }
+}
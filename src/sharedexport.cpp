@@ -0,0 +1,189 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "../include/sharedexport.h"
+#include "../include/exceptions.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Round a size up to EXPORT_ALIGNMENT.
+     */
+    static inline unsigned long long _align(unsigned long long size) {
+        return (size + EXPORT_ALIGNMENT - 1) / EXPORT_ALIGNMENT * EXPORT_ALIGNMENT;
+    }
+
+    /**
+     * \brief Copy a name, truncated to EXPORT_NAME.
+     */
+    static inline void _copy_name(char * to, const std::string & from) {
+        size_t n = from.size() < EXPORT_NAME - 1 ? from.size() : EXPORT_NAME - 1;
+        memcpy(to, from.data(), n);
+        to[n] = '\0';
+    }
+
+    SharedExport::SharedExport(const std::string & name, const std::vector<const ComponentSchema *> & types, unsigned int capacity) {
+        unsigned long long size = _align(sizeof(ExportHeader) + sizeof(ExportType) * types.size());
+        std::vector<unsigned long long> offsets(types.size());
+        for (unsigned int i = 0; i < types.size(); i++) {
+            offsets[i] = size;
+            size += _align((unsigned long long)types[i]->size * capacity);
+        }
+        // A segment left by a crashed run is replaced. Its readers keep the old one.
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+            ExportError e("Can not create the shared memory segment.");
+            throw e;
+        }
+        void * data = MAP_FAILED;
+        if (!ftruncate(fd, size)) {
+            data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            ExportError e("Can not map the shared memory segment.");
+            throw e;
+        }
+        _name = name;
+        // The segment is zero filled.
+        _header = new (data) ExportHeader;
+        _header->version = EXPORT_VERSION;
+        _header->sequence.store(0, std::memory_order_relaxed);
+        _header->size = size;
+        _header->type_count = types.size();
+        ExportType * t = reinterpret_cast<ExportType *>(_header + 1);
+        for (unsigned int i = 0; i < types.size(); i++) {
+            _copy_name(t[i].name, types[i]->name);
+            t[i].offset = offsets[i];
+            t[i].block_size = types[i]->size;
+            t[i].capacity = capacity;
+            t[i].field_count = types[i]->fields.size() < EXPORT_FIELDS ? types[i]->fields.size() : EXPORT_FIELDS;
+            for (unsigned int f = 0; f < t[i].field_count; f++) {
+                const SchemaField & field = types[i]->fields[f];
+                _copy_name(t[i].fields[f].name, field.name);
+                t[i].fields[f].type = field.type;
+                t[i].fields[f].offset = field.offset;
+                t[i].fields[f].size = field.size;
+                t[i].fields[f].count = field.count;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        _header->magic = EXPORT_MAGIC;
+    }
+
+    SharedExport::~SharedExport() {
+        munmap(_header, _header->size);
+        shm_unlink(_name.c_str());
+    }
+
+    void SharedExport::publish(unsigned long long tick, unsigned long long clock, unsigned int entities,
+                               const std::vector<_Cache *> & caches) {
+        ExportType * t = reinterpret_cast<ExportType *>(_header + 1);
+        unsigned long long sequence = _header->sequence.load(std::memory_order_relaxed);
+        _header->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _header->tick = tick;
+        _header->clock = clock;
+        _header->entities = entities;
+        for (unsigned int i = 0; i < caches.size() && i < _header->type_count; i++) {
+            std::pair<void *, unsigned int> blocks = caches[i]->get_active_blocks();
+            t[i].active = blocks.second;
+            t[i].count = blocks.second < t[i].capacity ? blocks.second : t[i].capacity;
+            if (t[i].count) {
+                memcpy((char *)_header + t[i].offset, blocks.first, (size_t)t[i].block_size * t[i].count);
+            }
+        }
+        _header->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    SharedExportReader::SharedExportReader(const std::string & name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizeof(ExportHeader)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            ExportError e("Can not open the shared memory segment.");
+            throw e;
+        }
+        _size = st.st_size;
+        void * data = mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            ExportError e("Can not map the shared memory segment.");
+            throw e;
+        }
+        _header = static_cast<const ExportHeader *>(data);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_header->magic != EXPORT_MAGIC || _header->version != EXPORT_VERSION || _header->size > _size) {
+            munmap(data, _size);
+            ExportError e("Shared memory segment is not an export.");
+            throw e;
+        }
+    }
+
+    SharedExportReader::~SharedExportReader() {
+        munmap(const_cast<ExportHeader *>(_header), _size);
+    }
+
+    const ExportType * SharedExportReader::get_type(unsigned int i) const {
+        if (i >= _header->type_count) {
+            ExportError e("Unknown exported type.");
+            throw e;
+        }
+        return reinterpret_cast<const ExportType *>(_header + 1) + i;
+    }
+
+    unsigned int SharedExportReader::find_type(const std::string & name) const {
+        for (unsigned int i = 0; i < _header->type_count; i++) {
+            if (name == get_type(i)->name) {
+                return i;
+            }
+        }
+        return FIELD_NONE;
+    }
+
+    const char * SharedExportReader::get_blocks(unsigned int i) const {
+        return (const char *)_header + get_type(i)->offset;
+    }
+
+    unsigned long long SharedExportReader::read_begin() const {
+        while (true) {
+            unsigned long long sequence = _header->sequence.load(std::memory_order_acquire);
+            if (!(sequence & 1)) {
+                return sequence;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    bool SharedExportReader::read_retry(unsigned long long sequence) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _header->sequence.load(std::memory_order_relaxed) != sequence;
+    }
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+
+#include "../include/slicedprocessor.h"
+#include "../include/engine.h"
+#include "../include/entity.h"
+
+namespace CAshley {
+
+    SlicedProcessor::SlicedProcessor() {
+        _entity_budget = 0;
+        _time_budget = 0;
+        _min_entities = 1;
+        _cursor = NO_COMPONENT;
+        _passes = 0;
+        _last_mark = 0;
+    }
+
+    void SlicedProcessor::set_entity_budget(unsigned int entities) {
+        _entity_budget = entities;
+    }
+
+    void SlicedProcessor::set_time_budget(unsigned int microseconds, unsigned int min_entities) {
+        if (!min_entities) {
+            ProcessorError e("At least one entity has to be processed per tick.");
+            throw e;
+        }
+        _time_budget = microseconds;
+        _min_entities = min_entities;
+    }
+
+    void SlicedProcessor::run_tick(unsigned int delay) {
+        EntityArray & entities = get_entities();
+        unsigned int size = entities.size();
+        if (!size) {
+            return;
+        }
+        // Entities are ordered by slot, so find the first one after the cursor.
+        unsigned int i = 0;
+        if (_cursor != NO_COMPONENT) {
+            unsigned int hi = size;
+            while (i < hi) {
+                unsigned int mid = i + (hi - i) / 2;
+                if (entities[mid]->get_id().index <= _cursor) {
+                    i = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+        }
+        std::chrono::steady_clock::time_point start;
+        if (_time_budget) {
+            start = std::chrono::steady_clock::now();
+        }
+        unsigned int processed = 0;
+        bool mark = true;
+        // Never process an entity twice on the same tick.
+        while (processed < size) {
+            if (_entity_budget && processed == _entity_budget) {
+                break;
+            }
+            if (_time_budget && processed >= _min_entities && !(processed & 7)) {
+                std::chrono::microseconds spent = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start);
+                if (spent.count() >= _time_budget) {
+                    break;
+                }
+            }
+            if (i == size) {
+                _new_pass();
+                i = 0;
+                mark = true;
+            }
+            Entity * e = entities[i];
+            unsigned int index = e->get_id().index;
+            if (mark) {
+                _marks.push_back(std::pair<unsigned int, unsigned long long>(index, _engine->get_clock()));
+                mark = false;
+            }
+            process_entity(e, _entity_delay(index, delay));
+            _cursor = index;
+            i++;
+            processed++;
+        }
+        if (i == size) {
+            _new_pass();
+        }
+    }
+
+    void SlicedProcessor::_new_pass() {
+        _last_marks.swap(_marks);
+        _marks.clear();
+        _last_mark = 0;
+        _cursor = NO_COMPONENT;
+        _passes++;
+    }
+
+    unsigned int SlicedProcessor::_entity_delay(unsigned int index, unsigned int delay) {
+        if (_last_marks.empty() || index < _last_marks[0].first) {
+            return delay;
+        }
+        while (_last_mark + 1 < _last_marks.size() && _last_marks[_last_mark + 1].first <= index) {
+            _last_mark++;
+        }
+        return (unsigned int)(_engine->get_clock() - _last_marks[_last_mark].second);
+    }
+
+}
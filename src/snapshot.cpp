@@ -0,0 +1,226 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/snapshot.h"
+
+namespace CAshley {
+
+    /**
+     * \brief Fixed header of a snapshot.
+     */
+    struct _SnapshotHeader {
+        /** SNAPSHOT_MAGIC. */
+        unsigned int magic;
+        /** SNAPSHOT_VERSION. */
+        unsigned int version;
+        /** Position of the stream. */
+        unsigned long long stream;
+        /** Count of bytes of the stream. */
+        unsigned long long stream_size;
+        /** Checksum of the stream. */
+        unsigned long long checksum;
+        /** Count of blobs, listed at the end of the stream. */
+        unsigned long long blobs;
+    };
+
+    /**
+     * \brief Entry of the list of blobs of a snapshot.
+     */
+    struct _SnapshotBlob {
+        /** Position of the blob. */
+        unsigned long long offset;
+        /** Count of bytes of the blob. */
+        unsigned long long size;
+        /** Checksum of the blob. */
+        unsigned long long checksum;
+    };
+
+    unsigned long long snapshot_checksum(const void * data, size_t size) {
+        const unsigned char * bytes = static_cast<const unsigned char *>(data);
+        unsigned long long h = 0xcbf29ce484222325ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            unsigned long long word;
+            memcpy(&word, bytes + i, 8);
+            h = (h ^ word) * 0x100000001b3ull;
+            h ^= h >> 29;
+        }
+        for (; i < size; i++) {
+            h = (h ^ bytes[i]) * 0x100000001b3ull;
+        }
+        return h ^ (h >> 32);
+    }
+
+    SnapshotWriter::SnapshotWriter(std::vector<char> & out, unsigned int magic) : _out(out), _magic(magic) {
+        _start = _out.size();
+        _out.resize(_start + sizeof(_SnapshotHeader), 0);
+    }
+
+    void SnapshotWriter::write(const void * data, size_t size) {
+        const char * bytes = static_cast<const char *>(data);
+        _stream.insert(_stream.end(), bytes, bytes + size);
+    }
+
+    void SnapshotWriter::write_string(const std::string & s) {
+        write((unsigned int)s.size());
+        write(s.data(), s.size());
+    }
+
+    char * SnapshotWriter::write_blob(const void * data, size_t size) {
+        size_t pad = (SNAPSHOT_ALIGNMENT - (_out.size() - _start) % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT;
+        _out.resize(_out.size() + pad, 0);
+        unsigned long long offset = _out.size() - _start;
+        const char * bytes = static_cast<const char *>(data);
+        _out.insert(_out.end(), bytes, bytes + size);
+        write(offset);
+        write((unsigned long long)size);
+        _blobs.push_back(std::pair<size_t, size_t>(offset, size));
+        return &_out[_start + offset];
+    }
+
+    void SnapshotWriter::finish() {
+        // Checksums are taken now, the caller may have changed the blobs.
+        for (unsigned int i = 0; i < _blobs.size(); i++) {
+            _SnapshotBlob blob;
+            blob.offset = _blobs[i].first;
+            blob.size = _blobs[i].second;
+            blob.checksum = snapshot_checksum(&_out[_start + blob.offset], blob.size);
+            write(blob);
+        }
+        _SnapshotHeader header;
+        header.magic = _magic;
+        header.version = SNAPSHOT_VERSION;
+        header.stream = _out.size() - _start;
+        header.stream_size = _stream.size();
+        header.checksum = snapshot_checksum(_stream.data(), _stream.size());
+        header.blobs = _blobs.size();
+        memcpy(&_out[_start], &header, sizeof(header));
+        _out.insert(_out.end(), _stream.begin(), _stream.end());
+        _stream.clear();
+        _blobs.clear();
+    }
+
+    SnapshotReader::SnapshotReader(const char * data, size_t size, bool mapped, bool verify, unsigned int magic) {
+        _data = data;
+        _size = size;
+        _mapped = mapped;
+        _SnapshotHeader header;
+        if (size < sizeof(header)) {
+            SnapshotError e("Snapshot is truncated.");
+            throw e;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != magic) {
+            SnapshotError e(magic == DELTA_MAGIC ? "Not a delta." : "Not a snapshot.");
+            throw e;
+        }
+        if (header.version != SNAPSHOT_VERSION) {
+            SnapshotError e("Unsupported snapshot version.");
+            throw e;
+        }
+        if (header.stream > size || header.stream_size > size - header.stream) {
+            SnapshotError e("Snapshot is truncated.");
+            throw e;
+        }
+        _pos = header.stream;
+        _end = header.stream + header.stream_size;
+        if (snapshot_checksum(data + _pos, header.stream_size) != header.checksum) {
+            SnapshotError e("Snapshot checksum mismatch.");
+            throw e;
+        }
+        // Blobs are checked before anything is loaded.
+        if (header.blobs > header.stream_size / sizeof(_SnapshotBlob)) {
+            SnapshotError e("Snapshot is corrupt.");
+            throw e;
+        }
+        _end -= header.blobs * sizeof(_SnapshotBlob);
+        for (size_t i = 0; i < header.blobs; i++) {
+            _SnapshotBlob blob;
+            memcpy(&blob, data + _end + i * sizeof(blob), sizeof(blob));
+            if (blob.offset > size || blob.size > size - blob.offset) {
+                SnapshotError e("Snapshot is corrupt.");
+                throw e;
+            }
+            if (verify && snapshot_checksum(data + blob.offset, blob.size) != blob.checksum) {
+                SnapshotError e("Snapshot checksum mismatch.");
+                throw e;
+            }
+        }
+    }
+
+    void SnapshotReader::read(void * data, size_t size) {
+        _check(size);
+        memcpy(data, _data + _pos, size);
+        _pos += size;
+    }
+
+    std::string SnapshotReader::read_string() {
+        unsigned int n = read<unsigned int>();
+        _check(n);
+        std::string s(_data + _pos, n);
+        _pos += n;
+        return s;
+    }
+
+    const char * SnapshotReader::read_blob(size_t size) {
+        unsigned long long offset = read<unsigned long long>();
+        unsigned long long length = read<unsigned long long>();
+        if (length != size || offset > _size || length > _size - offset) {
+            SnapshotError e("Snapshot is corrupt.");
+            throw e;
+        }
+        return _data + offset;
+    }
+
+    void SnapshotReader::_check(size_t size) {
+        if (size > _end - _pos) {
+            SnapshotError e("Snapshot is truncated.");
+            throw e;
+        }
+    }
+
+    SnapshotMapping::SnapshotMapping(const std::string & path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) || !st.st_size) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            SnapshotError e("Can not read the snapshot file.");
+            throw e;
+        }
+        _size = st.st_size;
+        void * data = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            SnapshotError e("Can not map the snapshot file.");
+            throw e;
+        }
+        _data = static_cast<char *>(data);
+    }
+
+    SnapshotMapping::~SnapshotMapping() {
+        munmap(_data, _size);
+    }
+}
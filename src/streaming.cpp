@@ -0,0 +1,226 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#include "../include/streaming.h"
+#include "../include/exceptions.h"
+#include "../include/snapshot.h"
+
+namespace CAshley {
+
+    RegionStreamer::RegionStreamer(const std::string & directory) {
+        _directory = directory;
+        _busy = false;
+        _stopping = false;
+        _thread = std::thread(&RegionStreamer::_work, this);
+    }
+
+    RegionStreamer::~RegionStreamer() {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _queued.notify_all();
+        _thread.join();
+    }
+
+    std::string RegionStreamer::get_path(unsigned int region) const {
+        std::ostringstream path;
+        path << _directory << "/region-" << region << ".bin";
+        return path.str();
+    }
+
+    void RegionStreamer::read(unsigned int region) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobs.push_back(_Job());
+            _jobs.back().region = region;
+            _jobs.back().write = false;
+        }
+        _queued.notify_one();
+    }
+
+    void RegionStreamer::write(unsigned int region, RegionStage & stage) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobs.push_back(_Job());
+            _jobs.back().region = region;
+            _jobs.back().write = true;
+            std::swap(_jobs.back().stage, stage);
+        }
+        _queued.notify_one();
+    }
+
+    bool RegionStreamer::take(unsigned int & region, std::vector<char> & data, bool & write) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_done.empty()) {
+            return false;
+        }
+        region = _done.front().region;
+        write = _done.front().write;
+        data.swap(_done.front().data);
+        _done.pop_front();
+        return true;
+    }
+
+    void RegionStreamer::wait() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_jobs.empty() || _busy) {
+            _finished.wait(lock);
+        }
+    }
+
+    void RegionStreamer::_work() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            while (_jobs.empty() && !_stopping) {
+                _queued.wait(lock);
+            }
+            // Queued jobs are run before stopping, so no write is lost.
+            if (_jobs.empty()) {
+                return;
+            }
+            _Job job;
+            job.region = _jobs.front().region;
+            job.write = _jobs.front().write;
+            job.data.swap(_jobs.front().data);
+            std::swap(job.stage, _jobs.front().stage);
+            _jobs.pop_front();
+            _busy = true;
+            lock.unlock();
+            bool ok = _run(job);
+            lock.lock();
+            _busy = false;
+            if (!job.write || !ok) {
+                if (!ok) {
+                    job.data.clear();
+                }
+                _done.push_back(_Job());
+                _done.back().region = job.region;
+                _done.back().write = job.write;
+                _done.back().data.swap(job.data);
+            }
+            _finished.notify_all();
+        }
+    }
+
+    bool RegionStreamer::_run(_Job & job) {
+        std::string path = get_path(job.region);
+        if (job.write) {
+            try {
+                _encode(job.stage, job.data);
+            } catch (SnapshotError &) {
+                return false;
+            }
+            // Written aside and renamed, so a crash never leaves half a region.
+            std::string temp = path + ".tmp";
+            FILE * f = fopen(temp.c_str(), "wb");
+            if (!f) {
+                return false;
+            }
+            bool ok = fwrite(job.data.data(), 1, job.data.size(), f) == job.data.size();
+            ok = !fclose(f) && ok;
+            return ok && !rename(temp.c_str(), path.c_str());
+        }
+        FILE * f = fopen(path.c_str(), "rb");
+        if (!f) {
+            return false;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        job.data.resize(size > 0 ? size : 0);
+        bool ok = size > 0 && fread(job.data.data(), 1, size, f) == (size_t)size;
+        fclose(f);
+        if (!ok) {
+            return false;
+        }
+        // Checksums are checked here, off the simulation thread.
+        try {
+            SnapshotReader r(job.data.data(), job.data.size(), false, true, REGION_MAGIC);
+        } catch (SnapshotError &) {
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * \brief Order of the entities of a region on its file: by status and components.
+     */
+    struct _StageOrder {
+        const RegionStage & stage;
+        _StageOrder(const RegionStage & s) : stage(s) {}
+        bool operator()(unsigned int a, unsigned int b) const {
+            if (stage.active[a] != stage.active[b]) {
+                return stage.active[a] > stage.active[b];
+            }
+            const unsigned int * types = stage.types.data();
+            return std::lexicographical_compare(types + stage.firsts[a], types + stage.firsts[a + 1], types + stage.firsts[b], types + stage.firsts[b + 1]);
+        }
+    };
+
+    void RegionStreamer::_encode(const RegionStage & stage, std::vector<char> & out) {
+        SnapshotReader r(stage.data.data(), stage.data.size(), false, false, REGION_MAGIC);
+        std::vector<char> stream(r.remaining());
+        r.read(stream.data(), stream.size());
+        // Entities with the same status and components are batched together.
+        std::vector<unsigned int> order(stage.ids.size());
+        for (unsigned int i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        _StageOrder less(stage);
+        std::stable_sort(order.begin(), order.end(), less);
+        std::vector<RegionEntity> entities(order.size());
+        std::vector<unsigned int> sizes;
+        for (unsigned int i = 0; i < order.size(); i++) {
+            entities[i].id = stage.ids[order[i]];
+            entities[i].position = i;
+            if (!i || sizes.back() == REGION_BATCH || less(order[i - 1], order[i])) {
+                sizes.push_back(0);
+            }
+            sizes.back()++;
+        }
+        std::sort(entities.begin(), entities.end());
+        SnapshotWriter w(out, REGION_MAGIC);
+        w.write(stream.data() + stage.table, stream.size() - stage.table);
+        w.write_vector(entities);
+        w.write_vector(sizes);
+        std::vector<unsigned int> positions;
+        for (unsigned int b = 0, first = 0; b < sizes.size(); first += sizes[b++]) {
+            unsigned int e = order[first];
+            unsigned int n = stage.firsts[e + 1] - stage.firsts[e];
+            positions.clear();
+            for (unsigned int c = stage.firsts[e]; c < stage.firsts[e + 1]; c++) {
+                positions.push_back(stage.positions[stage.types[c]]);
+            }
+            w.write(stage.active[e]);
+            w.write_vector(positions);
+            // Components by type, as they are committed.
+            for (unsigned int c = 0; c < n; c++) {
+                for (unsigned int i = first; i < first + sizes[b]; i++) {
+                    unsigned int k = stage.firsts[order[i]] + c;
+                    w.write(stream.data() + stage.offsets[k], stage.offsets[k + 1] - stage.offsets[k]);
+                }
+            }
+        }
+        w.finish();
+    }
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "../include/taskqueue.h"
+#include "../include/entity.h"
+
+namespace CAshley {
+
+    TaskNode::TaskNode() {
+        _queue = NULL;
+        _next = NULL;
+        _prev_task = NULL;
+        _next_task = NULL;
+        _wake = 0;
+        _entity = NULL;
+        _component = 0;
+        _result = true;
+    }
+
+    TaskNode::~TaskNode() {
+
+    }
+
+    TaskQueue::TaskQueue() {
+        _ready = NULL;
+        _ready_last = NULL;
+        _waiting = NULL;
+        _waiting_last = NULL;
+        _tasks = NULL;
+        _size = 0;
+        _clock = 0;
+    }
+
+    TaskQueue::~TaskQueue() {
+        while (_tasks) {
+            TaskNode * t = _tasks;
+            _tasks = t->_next_task;
+            if (t->_entity) {
+                t->_entity->_unwait(t);
+            }
+            t->destroy();
+        }
+    }
+
+    void TaskQueue::spawn(TaskNode * t) {
+        if (t->_queue) {
+            TaskError e("Task already spawned.");
+            throw e;
+        }
+        t->_queue = this;
+        t->_prev_task = NULL;
+        t->_next_task = _tasks;
+        if (_tasks) {
+            _tasks->_prev_task = t;
+        }
+        _tasks = t;
+        _size++;
+        ready(t);
+    }
+
+    void TaskQueue::run(unsigned long long clock) {
+        _clock = clock;
+        // Tasks waiting this run.
+        if (_waiting) {
+            if (_ready_last) {
+                _ready_last->_next = _waiting;
+            } else {
+                _ready = _waiting;
+            }
+            _ready_last = _waiting_last;
+            _waiting = NULL;
+            _waiting_last = NULL;
+        }
+        // Expired delays.
+        while (!_timers.empty() && _timers.front()->_wake <= clock) {
+            std::pop_heap(_timers.begin(), _timers.end(), _wakes_later);
+            TaskNode * t = _timers.back();
+            _timers.pop_back();
+            ready(t);
+        }
+        // Tasks suspended again during this run wait on the lists above,
+        // so this ends once every ready task is suspended.
+        while (_ready) {
+            TaskNode * t = _ready;
+            _ready = t->_next;
+            if (!_ready) {
+                _ready_last = NULL;
+            }
+            t->_next = NULL;
+            t->resume();
+            if (_exception) {
+                std::exception_ptr e = _exception;
+                _exception = std::exception_ptr();
+                std::rethrow_exception(e);
+            }
+        }
+    }
+
+    void TaskQueue::wait_next_run(TaskNode * t) {
+        t->_next = NULL;
+        if (_waiting_last) {
+            _waiting_last->_next = t;
+        } else {
+            _waiting = t;
+        }
+        _waiting_last = t;
+    }
+
+    void TaskQueue::wait_delay(TaskNode * t, unsigned long long delay) {
+        t->_wake = _clock + delay;
+        _timers.push_back(t);
+        std::push_heap(_timers.begin(), _timers.end(), _wakes_later);
+    }
+
+    void TaskQueue::wait_component(TaskNode * t, Entity * e, unsigned int type) {
+        t->_component = type;
+        t->_entity = e;
+        t->_result = true;
+        e->_wait(t);
+    }
+
+    void TaskQueue::ready(TaskNode * t) {
+        t->_next = NULL;
+        if (_ready_last) {
+            _ready_last->_next = t;
+        } else {
+            _ready = t;
+        }
+        _ready_last = t;
+    }
+
+    void TaskQueue::finish(TaskNode * t) {
+        if (t->_prev_task) {
+            t->_prev_task->_next_task = t->_next_task;
+        } else {
+            _tasks = t->_next_task;
+        }
+        if (t->_next_task) {
+            t->_next_task->_prev_task = t->_prev_task;
+        }
+        _size--;
+        if (t->_exception) {
+            _exception = t->_exception;
+        }
+        t->destroy();
+    }
+
+    bool TaskQueue::_wakes_later(const TaskNode * a, const TaskNode * b) {
+        return a->_wake > b->_wake;
+    }
+
+}
@@ -164,6 +164,117 @@ public:
         cache.block_deactivate(b2);
         TS_ASSERT(cache.get_active_blocks().second == 0);
     }
+
+    void test_cache_growable(void) {
+        CAshley::Cache<unsigned int> cache(2, true);
+        unsigned int b[5];
+        for (unsigned int i = 0; i < 5; i++) {
+            TS_ASSERT_THROWS_NOTHING(b[i] = cache.block_alloc());
+            *cache.get_block(b[i]) = i;
+        }
+        TS_ASSERT(cache._size == 8);
+        TS_ASSERT(cache._allocated == 5);
+        cache.block_activate(b[3]);
+        for (unsigned int i = 0; i < 5; i++) {
+            TS_ASSERT(*cache.get_block(b[i]) == i);
+        }
+        // Freed UIDs are reused.
+        cache.block_free(b[1]);
+        TS_ASSERT(cache.block_alloc() == b[1]);
+        TS_ASSERT(cache._allocated == 5);
+    }
+
+    void test_cache_block_n(void) {
+        CAshley::Cache<unsigned int> cache(8);
+        unsigned int inactive[3], active[4];
+        cache.block_alloc_n(3, inactive);
+        unsigned int * blocks = cache.block_alloc_n(4, active, true);
+        TS_ASSERT(cache._allocated == 7);
+        TS_ASSERT(cache._active == 4);
+        TS_ASSERT(blocks == cache._cache);
+        for (unsigned int i = 0; i < 4; i++) {
+            TS_ASSERT(cache._block_is_active(active[i]));
+            blocks[i] = 10 + i;
+        }
+        for (unsigned int i = 0; i < 3; i++) {
+            TS_ASSERT(!cache._block_is_active(inactive[i]));
+            *cache.get_block(inactive[i]) = 20 + i;
+        }
+        TS_ASSERT_THROWS(cache.block_alloc_n(2, active), CAshley::CacheError);
+        unsigned int freed[3] = {active[0], inactive[1], active[2]};
+        cache.block_free_n(freed, 3);
+        TS_ASSERT(cache._allocated == 4);
+        TS_ASSERT(cache._active == 2);
+        TS_ASSERT(*cache.get_block(active[1]) == 11);
+        TS_ASSERT(*cache.get_block(active[3]) == 13);
+        TS_ASSERT(cache._block_is_active(active[3]));
+        TS_ASSERT(*cache.get_block(inactive[0]) == 20);
+        TS_ASSERT(*cache.get_block(inactive[2]) == 22);
+        TS_ASSERT(!cache._block_is_active(inactive[2]));
+        TS_ASSERT_THROWS(cache.get_block(active[0]), CAshley::CacheError);
+        TS_ASSERT_THROWS(cache.block_free_n(freed, 1), CAshley::CacheError);
+    }
+
+    void test_cache_block_activate_n(void) {
+        CAshley::Cache<unsigned int> cache(10);
+        unsigned int b[10];
+        cache.block_alloc_n(10, b);
+        for (unsigned int i = 0; i < 10; i++) {
+            *cache.get_block(b[i]) = i;
+        }
+        unsigned int on[5] = {b[9], b[0], b[5], b[9], b[3]};
+        cache.block_activate_n(on, 5);
+        TS_ASSERT(cache._active == 4);
+        TS_ASSERT(cache._allocated == 10);
+        for (unsigned int i = 0; i < 10; i++) {
+            TS_ASSERT(*cache.get_block(b[i]) == i);
+            TS_ASSERT(cache._block_is_active(b[i]) == (i == 0 || i == 3 || i == 5 || i == 9));
+        }
+        // Active ones are skipped.
+        unsigned int more[2] = {b[0], b[7]};
+        cache.block_activate_n(more, 2);
+        TS_ASSERT(cache._active == 5);
+        unsigned int off[3] = {b[0], b[7], b[1]};
+        cache.block_deactivate_n(off, 3);
+        TS_ASSERT(cache._active == 3);
+        for (unsigned int i = 0; i < 10; i++) {
+            TS_ASSERT(*cache.get_block(b[i]) == i);
+            TS_ASSERT(cache._block_is_active(b[i]) == (i == 3 || i == 5 || i == 9));
+        }
+        unsigned int unknown = 42;
+        TS_ASSERT_THROWS(cache.block_activate_n(&unknown, 1), CAshley::CacheError);
+    }
+
+    void test_stable_cache(void) {
+        CAshley::StableCache<unsigned int> cache(2, true);
+        unsigned int b[5];
+        unsigned int * p[5];
+        for (unsigned int i = 0; i < 5; i++) {
+            b[i] = cache.block_alloc();
+            p[i] = cache.get_block(b[i]);
+            *p[i] = i;
+        }
+        cache.block_activate(b[0]);
+        cache.block_activate(b[4]);
+        TS_ASSERT_EQUALS(cache.get_active_count(), 2u);
+        TS_ASSERT(cache.get_active_blocks().first == NULL);
+        unsigned int more[10];
+        cache.block_alloc_n(10, more, true);
+        cache.block_free(b[2]);
+        TS_ASSERT_THROWS(cache.get_block(b[2]), CAshley::CacheError);
+        // Pointers survive growth, activation and freeing other blocks.
+        for (unsigned int i = 0; i < 5; i++) {
+            if (i != 2) {
+                TS_ASSERT(cache.get_block(b[i]) == p[i]);
+                TS_ASSERT_EQUALS(*p[i], i);
+            }
+        }
+        TS_ASSERT_EQUALS(cache.get_active_count(), 12u);
+        TS_ASSERT_EQUALS(cache.block_alloc(), b[2]);
+        CAshley::StableCache<unsigned int> fixed(1);
+        fixed.block_alloc();
+        TS_ASSERT_THROWS(fixed.block_alloc(), CAshley::CacheError);
+    }
 };
 
 
@@ -0,0 +1,270 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_CLONETESTS_H
+#define __CASHLEY_CLONETESTS_H
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class CloneTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        int x, y;
+        PositionComponent() : x(0), y(0) {}
+        void init() { x = y = 0; }
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+    };
+
+    class NameComponent : public CAshley::Component {
+    public:
+        std::string name;
+        void save(CAshley::SnapshotWriter & w) { w.write_string(name); }
+        void load(CAshley::SnapshotReader & r) { name = r.read_string(); }
+        CASHLEY_COMPONENT
+    };
+
+    class EnemyTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(EnemyTag)
+    };
+
+    class MeshComponent : public CAshley::Component {
+    public:
+        int mesh;
+        MeshComponent() : mesh(0) {}
+        MeshComponent(int m) : mesh(m) {}
+        bool operator==(const MeshComponent & o) const { return mesh == o.mesh; }
+        CASHLEY_COMPONENT
+        CASHLEY_SHARED(MeshComponent)
+        CASHLEY_BLOCK_COPYABLE(MeshComponent)
+    };
+
+    class AnchorComponent : public CAshley::Component {
+    public:
+        int anchor;
+        AnchorComponent() : anchor(0) {}
+        CASHLEY_COMPONENT
+        CASHLEY_STABLE(AnchorComponent)
+        CASHLEY_BLOCK_COPYABLE(AnchorComponent)
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+    };
+
+    struct Wind {
+        int speed;
+    };
+
+    // Moves positions by the wind, and counts its runs.
+    class WindProcessor : public CAshley::Processor {
+    public:
+        unsigned int runs;
+        WindProcessor() : runs(0) {
+            CAshley::Family f;
+            f.filter<PositionComponent>();
+            set_family(f);
+        }
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            runs++;
+            int speed = _engine->resource<Wind>().speed;
+            CAshley::Family f;
+            f.filter<PositionComponent>();
+            CAshley::EntityIdArray ids = _engine->get_ids_for(f);
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                _engine->get_component<PositionComponent>(ids[i])->x += speed;
+            }
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    class CloningProcessor : public CAshley::Processor {
+    public:
+        bool tried;
+        CloningProcessor() : tried(false) {}
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            TS_ASSERT_THROWS(_engine->clone(), CAshley::EngineError);
+            tried = true;
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    void build(CAshley::Engine & engine, std::vector<CAshley::EntityId> & ids) {
+        engine.set_resource(Wind());
+        engine.resource<Wind>().speed = 2;
+        engine.add_processor<WindProcessor>();
+        engine.get_processor<WindProcessor>()->schedule_every_n_ticks(2);
+        engine.get_processor<WindProcessor>()->activate();
+        ids = engine.spawn_n<PositionComponent, AnchorComponent>(500);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = i;
+            engine.get_component<AnchorComponent>(ids[i])->anchor = 3 * i;
+        }
+        engine.despawn(CAshley::Span<const CAshley::EntityId>(&ids[50], 50));
+        engine.deactivate(CAshley::Span<const CAshley::EntityId>(&ids[100], 20));
+        engine.add_component<NameComponent>(ids[0])->name = "a name too long for the small string buffer";
+        engine.add_component<EnemyTag>(ids[1]);
+        engine.set_shared(ids[2], MeshComponent(5));
+        engine.set_parent(ids[3], ids[2]);
+        CAshley::Prefab prefab;
+        prefab.add<PositionComponent>()->y = 8;
+        engine.add_prefab(prefab);
+        engine.run_tick(1);
+    }
+
+    void test_clone_copies_world(void) {
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids;
+        build(engine, ids);
+        TestEntity * wrapper = new TestEntity;
+        engine.add_entity(wrapper);
+        wrapper->add_component<PositionComponent>();
+        wrapper->get_component<PositionComponent>()->y = 4;
+        CAshley::EntityId wrapped = wrapper->get_id();
+
+        CAshley::Engine * copy = engine.clone();
+        TS_ASSERT_EQUALS(copy->get_entity_count(), engine.get_entity_count());
+        TS_ASSERT_EQUALS(copy->get_tick(), engine.get_tick());
+        TS_ASSERT_EQUALS(copy->get_clock(), engine.get_clock());
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            TS_ASSERT_EQUALS(copy->is_alive(ids[i]), engine.is_alive(ids[i]));
+            if (!engine.is_alive(ids[i])) {
+                continue;
+            }
+            TS_ASSERT_EQUALS(copy->is_active(ids[i]), engine.is_active(ids[i]));
+            TS_ASSERT_EQUALS(copy->get_component<PositionComponent>(ids[i])->x, engine.get_component<PositionComponent>(ids[i])->x);
+            TS_ASSERT_EQUALS(copy->get_component<AnchorComponent>(ids[i])->anchor, (int)(3 * i));
+        }
+        TS_ASSERT_EQUALS(copy->get_component<NameComponent>(ids[0])->name, engine.get_component<NameComponent>(ids[0])->name);
+        TS_ASSERT(copy->has_component<EnemyTag>(ids[1]));
+        TS_ASSERT_EQUALS(copy->get_component<MeshComponent>(ids[2])->mesh, 5);
+        TS_ASSERT(copy->get_parent(ids[3]) == ids[2]);
+        TS_ASSERT_EQUALS(copy->resource<Wind>().speed, 2);
+        // Entity objects are copied as plain entities.
+        TS_ASSERT_EQUALS(copy->get_component<PositionComponent>(wrapped)->y, 4);
+        TS_ASSERT(copy->get_component<PositionComponent>(wrapped)->get_owner() == NULL);
+        std::vector<CAshley::EntityId> made = copy->instantiate(0, 3);
+        TS_ASSERT_EQUALS(copy->get_component<PositionComponent>(made[2])->y, 8);
+
+        // Both sides are independent.
+        WindProcessor * p = copy->get_processor<WindProcessor>();
+        TS_ASSERT(p != engine.get_processor<WindProcessor>());
+        TS_ASSERT(p->is_running());
+        TS_ASSERT_EQUALS(p->get_schedule(), CAshley::SCHEDULE_EVERY_N_TICKS);
+        copy->get_component<PositionComponent>(ids[5])->x = -1;
+        copy->resource<Wind>().speed = 10;
+        copy->destroy_entity(ids[6]);
+        TS_ASSERT_EQUALS(engine.get_component<PositionComponent>(ids[5])->x, 5);
+        TS_ASSERT_EQUALS(engine.resource<Wind>().speed, 2);
+        TS_ASSERT(engine.is_alive(ids[6]));
+        engine.remove_component<NameComponent>(ids[0]);
+        TS_ASSERT(copy->has_component<NameComponent>(ids[0]));
+
+        // The schedule is copied: both run the processor on the same ticks.
+        unsigned int runs = engine.get_processor<WindProcessor>()->runs;
+        TS_ASSERT_EQUALS(p->runs, runs);
+        for (unsigned int i = 0; i < 4; i++) {
+            engine.run_tick(1);
+            copy->run_tick(1);
+        }
+        TS_ASSERT_EQUALS(p->runs, engine.get_processor<WindProcessor>()->runs);
+        TS_ASSERT_EQUALS(copy->get_component<PositionComponent>(ids[7])->x - engine.get_component<PositionComponent>(ids[7])->x, 2 * (10 - 2));
+        delete copy;
+        TS_ASSERT_EQUALS(engine.get_component<PositionComponent>(wrapped)->get_owner(), wrapper);
+    }
+
+    void test_clone_threads(void) {
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids;
+        build(engine, ids);
+        std::vector<CAshley::Engine *> copies;
+        for (unsigned int i = 0; i < 4; i++) {
+            copies.push_back(engine.clone());
+            copies[i]->resource<Wind>().speed = i;
+        }
+        std::vector<std::thread> threads;
+        for (unsigned int i = 0; i < copies.size(); i++) {
+            CAshley::Engine * copy = copies[i];
+            threads.push_back(std::thread([copy]() {
+                for (unsigned int t = 0; t < 100; t++) {
+                    copy->spawn_n<PositionComponent>(2);
+                    copy->run_tick(1);
+                }
+            }));
+        }
+        for (unsigned int i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        for (unsigned int i = 0; i < copies.size(); i++) {
+            TS_ASSERT_EQUALS(copies[i]->get_entity_count(), engine.get_entity_count() + 200);
+            TS_ASSERT_EQUALS(copies[i]->get_component<PositionComponent>(ids[10])->x, engine.get_component<PositionComponent>(ids[10])->x + (int)(50 * i));
+            delete copies[i];
+        }
+    }
+
+    void test_fork(void) {
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids;
+        build(engine, ids);
+        std::vector<CAshley::Engine *> forks = engine.fork(3);
+        TS_ASSERT_EQUALS(forks.size(), 3u);
+        for (unsigned int i = 0; i < forks.size(); i++) {
+            TS_ASSERT_EQUALS(forks[i]->get_entity_count(), engine.get_entity_count());
+            TS_ASSERT_EQUALS(forks[i]->get_component<PositionComponent>(ids[10])->x, 10);
+            TS_ASSERT_EQUALS(forks[i]->get_component<NameComponent>(ids[0])->name, engine.get_component<NameComponent>(ids[0])->name);
+            TS_ASSERT(forks[i]->get_processor<WindProcessor>()->is_running());
+        }
+        // A write is only seen by its fork.
+        forks[0]->get_component<PositionComponent>(ids[10])->x = 99;
+        TS_ASSERT_EQUALS(forks[1]->get_component<PositionComponent>(ids[10])->x, 10);
+        TS_ASSERT_EQUALS(engine.get_component<PositionComponent>(ids[10])->x, 10);
+        forks[1]->resource<Wind>().speed = 5;
+        for (unsigned int t = 0; t < 2; t++) {
+            forks[1]->run_tick(1);
+            forks[2]->run_tick(1);
+        }
+        TS_ASSERT_EQUALS(forks[1]->get_component<PositionComponent>(ids[10])->x, 15);
+        TS_ASSERT_EQUALS(forks[2]->get_component<PositionComponent>(ids[10])->x, 12);
+        TS_ASSERT_EQUALS(forks[0]->get_component<PositionComponent>(ids[10])->x, 99);
+        for (unsigned int i = 0; i < forks.size(); i++) {
+            delete forks[i];
+        }
+        TS_ASSERT_EQUALS(engine.get_component<PositionComponent>(ids[10])->x, 10);
+    }
+
+    void test_clone_during_tick(void) {
+        CAshley::Engine engine;
+        engine.add_processor<CloningProcessor>();
+        engine.get_processor<CloningProcessor>()->activate();
+        engine.run_tick(1);
+        TS_ASSERT(engine.get_processor<CloningProcessor>()->tried);
+    }
+};
+
+#endif //__CASHLEY_CLONETESTS_H
@@ -54,6 +54,21 @@ public:
         }
         CASHLEY_PROCESSOR
     };
+    struct Clock {
+        unsigned long long ticks;
+        Clock() : ticks(0) {}
+    };
+    class ClockProcessor : public CAshley::Processor {
+    public:
+        ClockProcessor() {
+            writes<Clock>();
+        }
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            _engine->resource<Clock>().ticks++;
+        }
+        CASHLEY_PROCESSOR
+    };
     class TestEntityListener : public CAshley::EntityListener {
     public:
         void entity_added(CAshley::Entity * e) { UNREFERENCED_PARAMETER(e); }
@@ -283,6 +298,26 @@ public:
         engine->run_tick(1);
         TS_ASSERT(x == 20 || x == 11);
     }
+
+    void test_engine_resources() {
+        TS_ASSERT(!engine->has_resource<Clock>());
+        TS_ASSERT_THROWS(engine->resource<Clock>(), CAshley::ResourceError);
+        engine->set_resource<Clock>();
+        engine->set_resource<std::string>("config");
+        engine->add_processor<ClockProcessor>();
+        engine->get_processor<ClockProcessor>()->activate();
+        engine->run_tick(1);
+        engine->run_tick(1);
+        TS_ASSERT_EQUALS(engine->resource<Clock>().ticks, 2u);
+        TS_ASSERT_EQUALS(engine->resource<std::string>(), "config");
+        Clock c;
+        c.ticks = 10;
+        engine->set_resource(c);
+        TS_ASSERT_EQUALS(engine->resource<Clock>().ticks, 10u);
+        engine->remove_resource<Clock>();
+        TS_ASSERT(!engine->has_resource<Clock>());
+        TS_ASSERT(engine->has_resource<std::string>());
+    }
 };
 
 #endif //__CASHLEY_ENGINETESTS_H
@@ -36,6 +36,17 @@ public:
         void entity_added(CAshley::Entity * e) { UNREFERENCED_PARAMETER(e); add_counter++; }
         void entity_removed(CAshley::Entity * e) { UNREFERENCED_PARAMETER(e); remove_counter++; }
     };
+    class TestComponent : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+    };
+    class TestBatchListener : public TestEntityListener {
+    public:
+        unsigned int add_calls, add_ids, remove_calls, remove_ids;
+        TestBatchListener() : add_calls(0), add_ids(0), remove_calls(0), remove_ids(0) {}
+        void entities_added(CAshley::Span<const CAshley::EntityId> ids) { add_calls++; add_ids += ids.size(); }
+        void entities_removed(CAshley::Span<const CAshley::EntityId> ids) { remove_calls++; remove_ids += ids.size(); }
+    };
 
     void test_entitylistener_entity_add(void) {
         CAshley::Engine engine;
@@ -73,6 +84,35 @@ public:
         engine.remove_listener(el);
         delete el;
     }
+
+    void test_entitylistener_batch(void) {
+        CAshley::Engine engine;
+        TestBatchListener all, filtered;
+        CAshley::Family f;
+        f.filter<TestComponent>();
+        engine.add_listener(&all);
+        engine.add_listener(&filtered, f);
+        std::vector<CAshley::EntityId> a = engine.spawn_n<TestComponent>(1000);
+        std::vector<CAshley::EntityId> b = engine.spawn_n<>(500);
+        TS_ASSERT_EQUALS(all.add_calls, 2u);
+        TS_ASSERT_EQUALS(all.add_ids, 1500u);
+        TS_ASSERT_EQUALS(filtered.add_calls, 1u);
+        TS_ASSERT_EQUALS(filtered.add_ids, 1000u);
+        TS_ASSERT_EQUALS(all.add_counter, 0u);
+        // A mixed batch: only the entities of the family reach the filtered listener.
+        std::vector<CAshley::EntityId> mixed(a.begin(), a.begin() + 10);
+        mixed.insert(mixed.end(), b.begin(), b.begin() + 20);
+        engine.despawn(CAshley::Span<const CAshley::EntityId>(&mixed[0], mixed.size()));
+        TS_ASSERT_EQUALS(all.remove_calls, 1u);
+        TS_ASSERT_EQUALS(all.remove_ids, 30u);
+        TS_ASSERT_EQUALS(filtered.remove_calls, 1u);
+        TS_ASSERT_EQUALS(filtered.remove_ids, 10u);
+        engine.destroy_entity(b[100]);
+        TS_ASSERT_EQUALS(all.remove_calls, 2u);
+        TS_ASSERT_EQUALS(filtered.remove_calls, 1u);
+        engine.remove_listener(&all);
+        engine.remove_listener(&filtered);
+    }
 };
 
 
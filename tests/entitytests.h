@@ -137,5 +137,25 @@ public:
         engine->run_tick(1);
         TS_ASSERT(entity2->get_component<TestComponent>()->counter == 1);
     }
+    void test_entity_activate_batch() {
+        CAshley::Entity * entities[3] = {new TestEntity2, new TestEntity2, new TestEntity2};
+        for (unsigned int i = 0; i < 3; i++) {
+            engine->add_entity(entities[i]);
+        }
+        engine->activate(CAshley::Span<CAshley::Entity * const>(entities, 3));
+        CAshley::Family f;
+        f.filter<TestComponent>();
+        TS_ASSERT_EQUALS(engine->get_entities_for(f).size(), 3u);
+        TS_ASSERT(entities[1]->is_active());
+        engine->deactivate(CAshley::Span<CAshley::Entity * const>(entities, 2));
+        TS_ASSERT_EQUALS(engine->get_entities_for(f).size(), 1u);
+        TS_ASSERT(!entities[1]->is_active());
+        TS_ASSERT(entities[2]->is_active());
+        CAshley::Entity * unlinked = entity1;
+        TS_ASSERT_THROWS(engine->activate(CAshley::Span<CAshley::Entity * const>(&unlinked, 1)), CAshley::EntityError);
+        for (unsigned int i = 0; i < 3; i++) {
+            delete entities[i];
+        }
+    }
 };
 #endif //__CASHLEY_ENTITYTESTS_H
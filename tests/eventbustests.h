@@ -0,0 +1,183 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_EVENTBUSTESTS_H
+#define __CASHLEY_EVENTBUSTESTS_H
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class EventBusTestSuite : public CxxTest::TestSuite {
+public:
+    struct DamageEvent {
+        unsigned int target;
+        unsigned int amount;
+    };
+
+    struct NameEvent {
+        std::string name;
+    };
+
+    class EmitterProcessor : public CAshley::Processor {
+    public:
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            for (unsigned int i = 0; i < 3000; i++) {
+                DamageEvent e;
+                e.target = i;
+                e.amount = 2;
+                _engine->emit(e);
+            }
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    class ConsumerProcessor : public CAshley::Processor {
+    public:
+        unsigned int current, last;
+        ConsumerProcessor() : current(0), last(0) {}
+        static unsigned int total(CAshley::EventQueue<DamageEvent> & q) {
+            unsigned int t = 0;
+            for (unsigned int i = 0; i < q.spans(); i++) {
+                CAshley::Span<DamageEvent> s = q.span(i);
+                for (DamageEvent * e = s.begin(); e != s.end(); e++) {
+                    t += e->amount;
+                }
+            }
+            return t;
+        }
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            current = total(_engine->get_events<DamageEvent>());
+            last = total(_engine->get_last_events<DamageEvent>());
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    void test_eventqueue_push(void) {
+        CAshley::EventQueue<DamageEvent> q;
+        TS_ASSERT(q.size() == 0);
+        TS_ASSERT(q.spans() == 0);
+        for (unsigned int i = 0; i < 5000; i++) {
+            DamageEvent e;
+            e.target = i;
+            e.amount = 1;
+            q.push(e);
+        }
+        TS_ASSERT(q.size() == 5000);
+        // Blocks of 1024, 2048 and 4096 events.
+        TS_ASSERT(q.spans() == 3);
+        TS_ASSERT(q.span(0).size() == 1024);
+        TS_ASSERT(q.span(1).size() == 2048);
+        TS_ASSERT(q.span(2).size() == 5000 - 3072);
+        TS_ASSERT(q.span(2)[0].target == 3072);
+        TS_ASSERT(q[4999].target == 4999);
+        DamageEvent * first = q.span(1).data();
+        q.clear();
+        TS_ASSERT(q.size() == 0);
+        for (unsigned int i = 0; i < 2000; i++) {
+            DamageEvent e;
+            e.target = i;
+            e.amount = 1;
+            q.push(e);
+        }
+        // Blocks are reused.
+        TS_ASSERT(q.span(1).data() == first);
+    }
+
+    void test_eventqueue_full(void) {
+        // Blocks of 1024 and 2048 events.
+        CAshley::EventQueue<DamageEvent> q(2);
+        DamageEvent e;
+        e.target = 0;
+        e.amount = 1;
+        for (unsigned int i = 0; i < 3072; i++) {
+            q.push(e);
+        }
+        TS_ASSERT_THROWS(q.push(e), CAshley::CAshleyError);
+        TS_ASSERT_THROWS(q.push(e), CAshley::CAshleyError);
+        TS_ASSERT(q.size() == 3072);
+        TS_ASSERT(q.spans() == 2);
+        q.clear();
+        q.push(e);
+        TS_ASSERT(q.size() == 1);
+    }
+
+    void test_eventqueue_non_trivial(void) {
+        CAshley::EventQueue<NameEvent> q;
+        NameEvent e;
+        e.name = "a name long enough to not fit in the small string buffer";
+        q.push(e);
+        q.push(e);
+        TS_ASSERT(q[1].name == e.name);
+        q.clear();
+        TS_ASSERT(q.size() == 0);
+    }
+
+    void test_eventqueue_threads(void) {
+        CAshley::EventQueue<DamageEvent> q;
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < 4; t++) {
+            threads.push_back(std::thread([&q, t]() {
+                for (unsigned int i = 0; i < 20000; i++) {
+                    DamageEvent e;
+                    e.target = t;
+                    e.amount = i;
+                    q.push(e);
+                }
+            }));
+        }
+        for (unsigned int t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+        TS_ASSERT(q.size() == 80000);
+        unsigned long long sum = 0;
+        for (unsigned int i = 0; i < q.size(); i++) {
+            sum += q[i].amount;
+        }
+        TS_ASSERT(sum == 4ull * (19999ull * 20000ull / 2));
+    }
+
+    void test_engine_events(void) {
+        CAshley::Engine engine;
+        engine.add_processor<ConsumerProcessor>(1);
+        engine.add_processor<EmitterProcessor>(2);
+        ConsumerProcessor * c = engine.get_processor<ConsumerProcessor>();
+        c->activate();
+        engine.get_processor<EmitterProcessor>()->activate();
+        engine.run_tick(1);
+        // The consumer runs before the emitter.
+        TS_ASSERT(c->current == 0);
+        TS_ASSERT(c->last == 0);
+        engine.run_tick(1);
+        TS_ASSERT(c->current == 0);
+        TS_ASSERT(c->last == 6000);
+        TS_ASSERT(engine.get_last_events<DamageEvent>().size() == 3000);
+        engine.get_processor<EmitterProcessor>()->deactivate();
+        engine.run_tick(1);
+        TS_ASSERT(c->last == 6000);
+        engine.run_tick(1);
+        TS_ASSERT(c->last == 0);
+    }
+};
+
+#endif //__CASHLEY_EVENTBUSTESTS_H
@@ -37,6 +37,29 @@ public:
     public:
         CASHLEY_COMPONENT
     };
+    class FrozenTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(FrozenTag)
+    };
+    class EnemyTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(EnemyTag)
+    };
+    class FrozenProcessor : public CAshley::Processor {
+    public:
+        FrozenProcessor() {
+            CAshley::Family f;
+            f.filter<TestComponent1>();
+            f.exclude<FrozenTag>();
+            set_family(f);
+        }
+        void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+        }
+        CASHLEY_PROCESSOR
+    };
     class TestEntity1 : public CAshley::Entity {
     public:
         CASHLEY_ENTITY
@@ -300,6 +323,63 @@ public:
         sf7.insert(entities[6]);
         TS_ASSERT(make_set(v) == sf7);
     }
+
+    void test_family_tags(void) {
+        TS_ASSERT(CAshley::is_tag<FrozenTag>::value);
+        TS_ASSERT(!CAshley::is_tag<TestComponent1>::value);
+        entities[0]->add_component<FrozenTag>();
+        entities[3]->add_component<FrozenTag>();
+        entities[3]->add_component<EnemyTag>();
+        entities[1]->add_component<EnemyTag>();
+        TS_ASSERT_THROWS(entities[0]->add_component<FrozenTag>(), CAshley::EntityError);
+        TS_ASSERT(entities[0]->has_component<FrozenTag>());
+        TS_ASSERT(entities[0]->has_component(entities[0]->get_component<FrozenTag>()->get_name()));
+        TS_ASSERT(!entities[2]->has_component<FrozenTag>());
+        TS_ASSERT_THROWS(entities[2]->get_component<FrozenTag>(), CAshley::ComponentError);
+        CAshley::Family f1, f2, f3;
+        f1.filter<FrozenTag>();
+        f2.filter<TestComponent1>();
+        f2.exclude<FrozenTag>();
+        f3.one<EnemyTag, TestComponent3>();
+        std::set<CAshley::Entity *> sf1;
+        sf1.insert(entities[0]);
+        sf1.insert(entities[3]);
+        TS_ASSERT(make_set(engine->get_entities_for(f1)) == sf1);
+        std::set<CAshley::Entity *> sf2;
+        sf2.insert(entities[4]);
+        sf2.insert(entities[6]);
+        TS_ASSERT(make_set(engine->get_entities_for(f2)) == sf2);
+        TS_ASSERT_EQUALS(engine->get_entities_for(f3).size(), 6u);
+        TS_ASSERT_EQUALS(engine->get_ids_for(f1).size(), 2u);
+        entities[3]->remove_component<FrozenTag>();
+        TS_ASSERT_THROWS(entities[3]->remove_component<FrozenTag>(), CAshley::ComponentError);
+        TS_ASSERT_EQUALS(engine->get_entities_for(f1).size(), 1u);
+        entities[0]->remove_components();
+        TS_ASSERT(!entities[0]->has_component<FrozenTag>());
+        TS_ASSERT_EQUALS(engine->get_entities_for(f1).size(), 0u);
+    }
+
+    void test_family_tags_processor(void) {
+        engine->add_processor<FrozenProcessor>();
+        FrozenProcessor * p = engine->get_processor<FrozenProcessor>();
+        TS_ASSERT_EQUALS(p->get_entities().size(), 4u);
+        entities[6]->add_component<FrozenTag>();
+        entities[0]->add_component<FrozenTag>();
+        entities[4]->add_component<EnemyTag>();
+        CAshley::EntityArray & v = p->get_entities();
+        TS_ASSERT_EQUALS(v.size(), 2u);
+        std::set<CAshley::Entity *> s;
+        s.insert(entities[3]);
+        s.insert(entities[4]);
+        TS_ASSERT(make_set(v) == s);
+        entities[6]->remove_component<FrozenTag>();
+        s.insert(entities[6]);
+        TS_ASSERT(make_set(p->get_entities()) == s);
+        CAshley::Family f;
+        f.filter<TestComponent1>();
+        f.exclude<FrozenTag>();
+        TS_ASSERT(make_set(p->get_entities()) == make_set(engine->get_entities_for(f)));
+    }
 };
 
 #endif //__CASHLEY_FAMILYTESTS_H
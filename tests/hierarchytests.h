@@ -0,0 +1,198 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_HIERARCHYTESTS_H
+#define __CASHLEY_HIERARCHYTESTS_H
+
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+
+class HierarchyTestSuite : public CxxTest::TestSuite {
+public:
+    class TransformComponent : public CAshley::Component {
+    public:
+        int local;
+        int world;
+        unsigned int visits;
+        TransformComponent() : local(0), world(0), visits(0) {}
+        CASHLEY_COMPONENT
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+    };
+
+    class DestroyProcessor : public CAshley::Processor {
+    public:
+        CAshley::EntityId id;
+        bool alive;
+        DestroyProcessor() : alive(false) {}
+        void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            _engine->destroy_entity(id);
+            alive = _engine->is_alive(_engine->get_first_child(id));
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    static void compose(TransformComponent & node, const TransformComponent * parent) {
+        node.world = node.local + (parent ? parent->world : 0);
+        node.visits++;
+    }
+
+    CAshley::Engine * engine;
+
+    void setUp() {
+        engine = new CAshley::Engine;
+    }
+
+    void tearDown() {
+        delete engine;
+    }
+
+    CAshley::EntityId create(int local) {
+        CAshley::EntityId id = engine->create_entity();
+        engine->add_component<TransformComponent>(id)->local = local;
+        return id;
+    }
+
+    void test_hierarchy_links(void) {
+        CAshley::EntityId a = engine->create_entity();
+        CAshley::EntityId b = engine->create_entity();
+        CAshley::EntityId c = engine->create_entity();
+        engine->set_parent(b, a);
+        engine->set_parent(c, a);
+        TS_ASSERT(engine->get_parent(a).is_null());
+        TS_ASSERT(engine->get_parent(b) == a);
+        unsigned int children = 0;
+        for (CAshley::EntityId i = engine->get_first_child(a); !i.is_null(); i = engine->get_next_sibling(i)) {
+            TS_ASSERT(i == b || i == c);
+            children++;
+        }
+        TS_ASSERT_EQUALS(children, 2u);
+        engine->set_parent(c, b);
+        TS_ASSERT_EQUALS(engine->get_depth(c), 2u);
+        TS_ASSERT(engine->get_first_child(a) == b);
+        TS_ASSERT(engine->get_next_sibling(b).is_null());
+        engine->set_parent(c, CAshley::EntityId());
+        TS_ASSERT(engine->get_parent(c).is_null());
+        TS_ASSERT(engine->get_first_child(b).is_null());
+    }
+
+    void test_hierarchy_cycles(void) {
+        CAshley::EntityId a = engine->create_entity();
+        CAshley::EntityId b = engine->create_entity();
+        CAshley::EntityId c = engine->create_entity();
+        engine->set_parent(b, a);
+        engine->set_parent(c, b);
+        TS_ASSERT_THROWS(engine->set_parent(a, c), CAshley::EntityError);
+        TS_ASSERT_THROWS(engine->set_parent(a, a), CAshley::EntityError);
+        engine->destroy_entity(c);
+        TS_ASSERT_THROWS(engine->set_parent(c, a), CAshley::EntityError);
+        TS_ASSERT(engine->get_parent(a).is_null());
+    }
+
+    void test_hierarchy_propagate(void) {
+        CAshley::EntityId root = create(1);
+        CAshley::EntityId plain = engine->create_entity();
+        CAshley::EntityId leaf = create(100);
+        CAshley::EntityId mid = create(10);
+        // Linked deepest first, so the creation order is not the walk order.
+        engine->set_parent(leaf, mid);
+        engine->set_parent(plain, leaf);
+        engine->set_parent(mid, root);
+        CAshley::EntityId tail = create(1000);
+        engine->set_parent(tail, plain);
+        engine->propagate<TransformComponent>(compose);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(root)->world, 1);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(mid)->world, 11);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(leaf)->world, 111);
+        // Entities without the component pass the parent over.
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(tail)->world, 1000);
+        // Nothing changed: nothing is visited.
+        engine->propagate<TransformComponent>(compose);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(root)->visits, 1u);
+        // Only the dirty subtree is visited.
+        engine->get_component<TransformComponent>(mid)->local = 20;
+        engine->mark_dirty(mid);
+        engine->propagate<TransformComponent>(compose);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(root)->visits, 1u);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(mid)->visits, 2u);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(leaf)->world, 121);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(tail)->visits, 2u);
+    }
+
+    void test_hierarchy_propagate_root(void) {
+        CAshley::EntityId a = create(1);
+        CAshley::EntityId b = create(2);
+        CAshley::EntityId c = create(3);
+        CAshley::EntityId d = create(4);
+        engine->set_parent(b, a);
+        engine->set_parent(d, c);
+        engine->update_hierarchy();
+        TS_ASSERT_EQUALS(engine->get_root_count(), 2u);
+        engine->propagate_root<TransformComponent>(0, compose);
+        engine->propagate_root<TransformComponent>(1, compose);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(b)->world, 3);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(d)->world, 7);
+        engine->mark_dirty(c);
+        engine->propagate<TransformComponent>(compose);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(a)->visits, 1u);
+        TS_ASSERT_EQUALS(engine->get_component<TransformComponent>(d)->visits, 2u);
+    }
+
+    void test_hierarchy_cascade(void) {
+        CAshley::EntityId root = create(1);
+        std::vector<CAshley::EntityId> children = engine->spawn_n<TransformComponent>(100);
+        TestEntity * e = new TestEntity;
+        engine->add_entity(e);
+        for (unsigned int i = 0; i < children.size(); i++) {
+            engine->set_parent(children[i], i ? children[i / 2] : root);
+        }
+        engine->set_parent(e->get_id(), children[99]);
+        CAshley::EntityId other = create(2);
+        engine->destroy_entity(root);
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 1u);
+        TS_ASSERT(engine->is_alive(other));
+        TS_ASSERT(e->get_id().is_null());
+        delete e;
+        // Freed slots are reused without stale links.
+        CAshley::EntityId reused = create(3);
+        TS_ASSERT(engine->get_parent(reused).is_null());
+        TS_ASSERT(engine->get_first_child(reused).is_null());
+    }
+
+    void test_hierarchy_cascade_during_tick(void) {
+        engine->add_processor<DestroyProcessor>();
+        DestroyProcessor * p = engine->get_processor<DestroyProcessor>();
+        p->id = create(1);
+        CAshley::EntityId child = create(2);
+        engine->set_parent(child, p->id);
+        engine->set_parent(create(3), child);
+        p->activate();
+        engine->run_tick(1);
+        TS_ASSERT(p->alive);
+        TS_ASSERT(!engine->is_alive(child));
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 0u);
+    }
+};
+
+#endif //__CASHLEY_HIERARCHYTESTS_H
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_JOURNALTESTS_H
+#define __CASHLEY_JOURNALTESTS_H
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class JournalTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        int x, y;
+        PositionComponent() : x(0), y(0) {}
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+    };
+
+    class VelocityComponent : public CAshley::Component {
+    public:
+        int dx;
+        VelocityComponent() : dx(1) {}
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(VelocityComponent)
+    };
+
+    class EnemyTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(EnemyTag)
+    };
+
+    class MeshComponent : public CAshley::Component {
+    public:
+        int mesh;
+        MeshComponent() : mesh(0) {}
+        MeshComponent(int m) : mesh(m) {}
+        bool operator==(const MeshComponent & o) const { return mesh == o.mesh; }
+        CASHLEY_COMPONENT
+        CASHLEY_SHARED(MeshComponent)
+        CASHLEY_BLOCK_COPYABLE(MeshComponent)
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+        void init() {
+            add_component<PositionComponent>();
+            get_component<PositionComponent>()->y = 7;
+        }
+    };
+
+    // Moves every position, spawns entities every few ticks and despawns the far ones.
+    // It only depends on the world, so a replay makes the same changes.
+    class DriftProcessor : public CAshley::Processor {
+    public:
+        unsigned int runs;
+        DriftProcessor() : runs(0) {}
+        virtual void run_tick(unsigned int delay) {
+            runs++;
+            CAshley::Family f;
+            f.filter<PositionComponent>();
+            CAshley::EntityIdArray ids = _engine->get_ids_for(f);
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                PositionComponent * p = _engine->get_component<PositionComponent>(ids[i]);
+                int dx = 1;
+                if (_engine->has_component<VelocityComponent>(ids[i])) {
+                    dx = _engine->get_component<VelocityComponent>(ids[i])->dx;
+                }
+                p->x += dx * delay;
+                if (p->x > 60) {
+                    CAshley::EntityId id = ids[i];
+                    _engine->despawn(CAshley::Span<const CAshley::EntityId>(&id, 1));
+                }
+            }
+            if (_engine->get_tick() % 4 == 0) {
+                std::vector<CAshley::EntityId> spawned = _engine->spawn_n<PositionComponent>(2);
+                _engine->get_component<PositionComponent>(spawned[1])->y = _engine->get_tick();
+            }
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    std::string path;
+
+    void setUp() {
+        path = "cashley_journal_test.bin";
+    }
+
+    void tearDown() {
+        std::remove(path.c_str());
+    }
+
+    void prepare(CAshley::Engine & engine) {
+        engine.register_component<PositionComponent>();
+        engine.register_component<VelocityComponent>();
+        engine.register_component<EnemyTag>();
+        engine.register_component<MeshComponent>();
+        engine.add_processor<DriftProcessor>();
+        engine.get_processor<DriftProcessor>()->activate();
+    }
+
+    // Runs a session mixing commands and ticks, with 30 ticks recorded.
+    void record(CAshley::Engine & engine) {
+        prepare(engine);
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(20);
+        engine.run_tick(1);
+        engine.start_journal(path, 256);
+        for (unsigned int i = 0; i < 30; i++) {
+            switch (i) {
+            case 2:
+                engine.add_component<VelocityComponent>(ids[3])->dx = 5;
+                break;
+            case 4:
+                engine.get_component<PositionComponent>(ids[4])->y = 44;
+                engine.mark_changed<PositionComponent>(ids[4]);
+                break;
+            case 6:
+                engine.remove_component<PositionComponent>(ids[5]);
+                break;
+            case 8:
+                engine.deactivate(ids[6]);
+                break;
+            case 10:
+                engine.activate(ids[6]);
+                engine.set_parent(ids[8], ids[7]);
+                break;
+            case 14:
+                engine.despawn(CAshley::Span<const CAshley::EntityId>(&ids[7], 1));
+                break;
+            case 16: {
+                CAshley::EntityId boss = engine.create_entity();
+                engine.add_component<EnemyTag>(boss);
+                engine.set_shared(boss, MeshComponent(3));
+                engine.add_component<PositionComponent>(boss)->y = -1;
+                std::vector<CAshley::EntityId> more = engine.spawn_n<PositionComponent, VelocityComponent>(3);
+                engine.get_component<VelocityComponent>(more[2])->dx = 2;
+                break;
+            }
+            case 18:
+                engine.add_entity(new TestEntity);
+                break;
+            }
+            engine.run_tick(i % 3 + 1);
+        }
+        engine.stop_journal();
+    }
+
+    void check_same(CAshley::Engine & engine, CAshley::Engine & replayed) {
+        TS_ASSERT_EQUALS(replayed.get_tick(), engine.get_tick());
+        TS_ASSERT_EQUALS(replayed.get_clock(), engine.get_clock());
+        TS_ASSERT_EQUALS(replayed.get_entity_count(), engine.get_entity_count());
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        CAshley::EntityIdArray ids = engine.get_ids_for(f);
+        TS_ASSERT_EQUALS(replayed.get_ids_for(f).size(), ids.size());
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            TS_ASSERT(replayed.is_alive(ids[i]));
+            TS_ASSERT_EQUALS(replayed.get_component<PositionComponent>(ids[i])->x, engine.get_component<PositionComponent>(ids[i])->x);
+            TS_ASSERT_EQUALS(replayed.get_component<PositionComponent>(ids[i])->y, engine.get_component<PositionComponent>(ids[i])->y);
+            TS_ASSERT_EQUALS(replayed.has_component<VelocityComponent>(ids[i]), engine.has_component<VelocityComponent>(ids[i]));
+            TS_ASSERT_EQUALS(replayed.has_component<EnemyTag>(ids[i]), engine.has_component<EnemyTag>(ids[i]));
+        }
+    }
+
+    void test_journal_replay(void) {
+        CAshley::Engine engine;
+        record(engine);
+        TS_ASSERT_EQUALS(engine.get_tick(), 31u);
+
+        CAshley::Engine replayed;
+        prepare(replayed);
+        CAshley::Replay replay(path);
+        replay.start(replayed);
+        TS_ASSERT_EQUALS(replayed.get_tick(), 1u);
+        TS_ASSERT_EQUALS(replay.run(), 30u);
+        TS_ASSERT(!replay.step());
+        check_same(engine, replayed);
+        TS_ASSERT_EQUALS(replayed.get_processor<DriftProcessor>()->runs, 30u);
+        // The replayed world keeps working.
+        std::vector<CAshley::EntityId> more = replayed.spawn_n<PositionComponent>(5);
+        TS_ASSERT(replayed.has_component<PositionComponent>(more[4]));
+    }
+
+    void test_journal_step(void) {
+        CAshley::Engine engine;
+        record(engine);
+
+        CAshley::Engine replayed;
+        prepare(replayed);
+        CAshley::Replay replay(path);
+        TS_ASSERT_THROWS(replay.step(), CAshley::JournalError);
+        replay.start(replayed);
+        TS_ASSERT_EQUALS(replay.run(10), 10u);
+        TS_ASSERT_EQUALS(replayed.get_tick(), 11u);
+        unsigned int steps = 0;
+        while (replay.step()) {
+            steps++;
+        }
+        TS_ASSERT_EQUALS(steps, 20u);
+        check_same(engine, replayed);
+    }
+
+    void test_journal_errors(void) {
+        CAshley::Engine engine;
+        prepare(engine);
+        engine.spawn_n<PositionComponent>(4);
+        engine.start_journal(path);
+        TS_ASSERT_THROWS(engine.start_journal(path), CAshley::JournalError);
+        engine.spawn_n<PositionComponent>(4);
+        engine.run_tick(1);
+        engine.stop_journal();
+        // Stopping twice does nothing.
+        TS_ASSERT_THROWS_NOTHING(engine.stop_journal());
+        TS_ASSERT_THROWS(CAshley::Replay("cashley_missing_journal.bin"), CAshley::JournalError);
+
+        std::vector<char> data;
+        {
+            std::ifstream f(path.c_str(), std::ios::binary);
+            data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        }
+        // A damaged frame fails its checksum.
+        std::vector<char> damaged(data);
+        damaged[damaged.size() - 12] ^= 0x5a;
+        {
+            std::ofstream f(path.c_str(), std::ios::binary | std::ios::trunc);
+            f.write(damaged.data(), damaged.size());
+        }
+        CAshley::Engine replayed;
+        prepare(replayed);
+        CAshley::Replay broken(path);
+        broken.start(replayed);
+        TS_ASSERT_THROWS(broken.run(), CAshley::SnapshotError);
+        // A truncated file is detected before reading past its end.
+        {
+            std::ofstream f(path.c_str(), std::ios::binary | std::ios::trunc);
+            f.write(data.data(), data.size() - 3);
+        }
+        CAshley::Engine truncated;
+        prepare(truncated);
+        CAshley::Replay cut(path);
+        cut.start(truncated);
+        TS_ASSERT_THROWS(cut.run(), CAshley::JournalError);
+    }
+};
+
+#endif //__CASHLEY_JOURNALTESTS_H
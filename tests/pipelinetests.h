@@ -0,0 +1,175 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_PIPELINETESTS_H
+#define __CASHLEY_PIPELINETESTS_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class PipelineTestSuite : public CxxTest::TestSuite {
+public:
+    class ValueComponent : public CAshley::Component {
+    public:
+        unsigned int value;
+        ValueComponent() : value(0) {}
+        CASHLEY_COMPONENT
+    };
+
+    class OtherComponent : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+        void init() {
+            add_component<ValueComponent>();
+        }
+    };
+
+    class IncrementProcessor : public CAshley::Processor {
+    public:
+        IncrementProcessor() {
+            CAshley::Family f;
+            f.filter<ValueComponent>();
+            set_family(f);
+        }
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            CAshley::EntityArray & v = get_entities();
+            for (unsigned int i = 0; i < v.size(); i++) {
+                v[i]->get_component<ValueComponent>()->value++;
+            }
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    class RecordStage : public CAshley::OutputStage {
+    public:
+        std::mutex mutex;
+        std::vector<unsigned long long> ticks;
+        std::vector<unsigned int> sums;
+        std::atomic<bool> gate;
+        unsigned int others;
+        RecordStage() : gate(true), others(0) {}
+        virtual void consume(const CAshley::Snapshot & s) {
+            while (!gate) {
+                std::this_thread::yield();
+            }
+            CAshley::Span<const ValueComponent> values = s.get<ValueComponent>();
+            unsigned int sum = 0;
+            for (unsigned int i = 0; i < values.size(); i++) {
+                sum += values[i].value;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            ticks.push_back(s.get_tick());
+            sums.push_back(sum);
+            others += s.get<OtherComponent>().size();
+        }
+    };
+
+    class ThrowingStage : public CAshley::OutputStage {
+    public:
+        virtual void consume(const CAshley::Snapshot & s) {
+            if (s.get_tick() == 2) {
+                CAshley::CAshleyError e("Output failed.");
+                throw e;
+            }
+        }
+    };
+
+    CAshley::Engine * engine;
+    std::vector<CAshley::Entity *> entities;
+
+    void setUp() {
+        engine = new CAshley::Engine;
+        engine->add_processor<IncrementProcessor>();
+        engine->get_processor<IncrementProcessor>()->activate();
+        for (unsigned int i = 0; i < 5; i++) {
+            entities.push_back(new TestEntity);
+            engine->add_entity(entities.back());
+            entities.back()->activate();
+        }
+    }
+
+    void tearDown() {
+        engine->stop_pipeline();
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            delete entities[i];
+        }
+        entities.clear();
+        delete engine;
+    }
+
+    void test_pipeline_snapshots(void) {
+        RecordStage stage;
+        engine->extract<ValueComponent>();
+        engine->extract<OtherComponent>();
+        engine->start_pipeline(&stage, 3);
+        TS_ASSERT_THROWS(engine->start_pipeline(&stage), CAshley::CAshleyError);
+        for (unsigned int i = 0; i < 10; i++) {
+            engine->run_tick(1);
+        }
+        engine->flush_pipeline();
+        TS_ASSERT(stage.ticks.size() == 10);
+        for (unsigned int i = 0; i < stage.ticks.size(); i++) {
+            TS_ASSERT(stage.ticks[i] == i + 1);
+            // Each tick adds 1 to 5 components.
+            TS_ASSERT(stage.sums[i] == 5 * (i + 1));
+        }
+        TS_ASSERT(stage.others == 0);
+    }
+
+    void test_pipeline_depth(void) {
+        RecordStage stage;
+        stage.gate = false;
+        engine->extract<ValueComponent>();
+        engine->start_pipeline(&stage, 2);
+        // The stage is stuck: one snapshot in the stage, one queued.
+        engine->run_tick(1);
+        engine->run_tick(1);
+        TS_ASSERT(stage.ticks.size() == 0);
+        stage.gate = true;
+        engine->run_tick(1);
+        engine->stop_pipeline();
+        TS_ASSERT(stage.ticks.size() == 3);
+        TS_ASSERT(stage.sums[2] == 15);
+    }
+
+    void test_pipeline_exception(void) {
+        ThrowingStage stage;
+        engine->extract<ValueComponent>();
+        engine->start_pipeline(&stage, 2);
+        engine->run_tick(1);
+        engine->run_tick(1);
+        // Rethrown once, on the simulation thread.
+        TS_ASSERT_THROWS(engine->flush_pipeline(), CAshley::CAshleyError);
+        engine->flush_pipeline();
+        engine->run_tick(1);
+        engine->flush_pipeline();
+    }
+};
+
+#endif //__CASHLEY_PIPELINETESTS_H
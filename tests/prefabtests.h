@@ -0,0 +1,126 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_PREFABTESTS_H
+#define __CASHLEY_PREFABTESTS_H
+
+#include <vector>
+
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+
+class PrefabTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        float x, y;
+        PositionComponent() : x(0), y(0) {}
+        void init() { inits++; }
+        static unsigned int inits;
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+    };
+
+    class NamedPositionComponent : public PositionComponent {
+    public:
+        CASHLEY_COMPONENT
+    };
+
+    class PathComponent : public CAshley::Component {
+    public:
+        std::vector<int> points;
+        PathComponent() {}
+        PathComponent(const PathComponent & p) : CAshley::Component(p), points(p.points) { copies++; }
+        static unsigned int copies;
+        CASHLEY_COMPONENT
+    };
+
+    CAshley::Engine * engine;
+
+    void setUp() {
+        engine = new CAshley::Engine;
+        PositionComponent::inits = 0;
+        PathComponent::copies = 0;
+    }
+
+    void tearDown() {
+        delete engine;
+    }
+
+    void test_prefab_block_copyable(void) {
+        TS_ASSERT(CAshley::is_block_copyable<PositionComponent>::value);
+        TS_ASSERT(!CAshley::is_block_copyable<NamedPositionComponent>::value);
+        TS_ASSERT(!CAshley::is_block_copyable<PathComponent>::value);
+        TS_ASSERT(CAshley::is_block_copyable<unsigned int>::value);
+    }
+
+    void test_prefab_add(void) {
+        CAshley::Prefab p;
+        TS_ASSERT(!p.has<PositionComponent>());
+        p.add<PositionComponent>()->x = 3;
+        TS_ASSERT_EQUALS(PositionComponent::inits, 1u);
+        TS_ASSERT(p.has<PositionComponent>());
+        TS_ASSERT_EQUALS(p.get<PositionComponent>()->x, 3);
+        TS_ASSERT_THROWS(p.add<PositionComponent>(), CAshley::ComponentError);
+        TS_ASSERT_THROWS(p.get<PathComponent>(), CAshley::ComponentError);
+        CAshley::Prefab q(p);
+        q.get<PositionComponent>()->x = 4;
+        TS_ASSERT_EQUALS(p.get<PositionComponent>()->x, 3);
+        TS_ASSERT_EQUALS(q.size(), 1u);
+    }
+
+    void test_prefab_instantiate(void) {
+        CAshley::Prefab p;
+        PositionComponent * position = p.add<PositionComponent>();
+        position->x = 1.5;
+        position->y = -2;
+        p.add<PathComponent>()->points.push_back(42);
+        unsigned int id = engine->add_prefab(p);
+        // The engine keeps its own copy.
+        p.get<PositionComponent>()->x = 0;
+        PositionComponent::inits = 0;
+        PathComponent::copies = 0;
+        std::vector<CAshley::EntityId> ids = engine->instantiate(id, 1000);
+        TS_ASSERT_EQUALS(ids.size(), 1000u);
+        TS_ASSERT_EQUALS(PositionComponent::inits, 0u);
+        TS_ASSERT_EQUALS(PathComponent::copies, 1000u);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            TS_ASSERT(engine->is_active(ids[i]));
+            TS_ASSERT_EQUALS(engine->get_component<PositionComponent>(ids[i])->x, 1.5);
+            TS_ASSERT_EQUALS(engine->get_component<PositionComponent>(ids[i])->y, -2);
+            TS_ASSERT(engine->get_component<PositionComponent>(ids[i])->get_owner() == NULL);
+            TS_ASSERT_EQUALS(engine->get_component<PathComponent>(ids[i])->points.size(), 1u);
+        }
+        CAshley::Family f;
+        f.filter<PathComponent>();
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 1000u);
+        std::vector<CAshley::EntityId> inactive = engine->instantiate(id, 7, false);
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 1000u);
+        TS_ASSERT_EQUALS(engine->get_component<PositionComponent>(inactive[6])->x, 1.5);
+        engine->despawn(CAshley::Span<const CAshley::EntityId>(&ids[0], ids.size()));
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 7u);
+        TS_ASSERT_THROWS(engine->instantiate(id + 1, 1), CAshley::CAshleyError);
+    }
+};
+
+unsigned int PrefabTestSuite::PositionComponent::inits = 0;
+unsigned int PrefabTestSuite::PathComponent::copies = 0;
+
+#endif //__CASHLEY_PREFABTESTS_H
@@ -35,6 +35,74 @@ public:
         CASHLEY_PROCESSOR
     };
 
+    class ScheduledProcessor : public CAshley::Processor {
+    public:
+        unsigned int runs, last_delay, total_delay;
+        ScheduledProcessor() : runs(0), last_delay(0), total_delay(0) {}
+        virtual void run_tick(unsigned int delay) {
+            runs++;
+            last_delay = delay;
+            total_delay += delay;
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    class EagerProcessor : public CAshley::Processor {
+    public:
+        unsigned int runs;
+        EagerProcessor() : runs(0) {
+            activate();
+        }
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            runs++;
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    class FailingProcessor : public CAshley::Processor {
+    public:
+        bool fail;
+        FailingProcessor() : fail(true) {}
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            if (fail) {
+                fail = false;
+                CAshley::ProcessorError e("Failed.");
+                throw e;
+            }
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    class TestComponent : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+        void init() {
+            add_component<TestComponent>();
+        }
+    };
+
+    class FamilyProcessor : public CAshley::Processor {
+    public:
+        unsigned int seen;
+        FamilyProcessor() : seen(0) {
+            CAshley::Family f;
+            f.filter<TestComponent>();
+            set_family(f);
+        }
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            seen = get_entities().size();
+        }
+        CASHLEY_PROCESSOR
+    };
+
     CAshley::Engine * engine;
 
     void setUp() {
@@ -68,6 +136,28 @@ public:
         TS_ASSERT(engine->get_processor<TestProcessor>()->counter == 2);
     }
 
+    void test_processor_activate_in_constructor(void) {
+        engine->add_processor<EagerProcessor>();
+        TS_ASSERT(engine->get_processor<EagerProcessor>()->is_running());
+        engine->run_tick(1);
+        engine->run_tick(1);
+        TS_ASSERT_EQUALS(engine->get_processor<EagerProcessor>()->runs, 2u);
+    }
+
+    void test_processor_throws(void) {
+        engine->add_processor<FailingProcessor>(0);
+        engine->add_processor<ScheduledProcessor>(1);
+        engine->get_processor<FailingProcessor>()->activate();
+        engine->get_processor<ScheduledProcessor>()->activate();
+        TS_ASSERT_THROWS(engine->run_tick(1), CAshley::ProcessorError);
+        TS_ASSERT_EQUALS(engine->get_processor<ScheduledProcessor>()->runs, 0u);
+        // The tick is over, and its due processors are not run again.
+        CAshley::Engine * copy = engine->clone();
+        delete copy;
+        engine->run_tick(1);
+        TS_ASSERT_EQUALS(engine->get_processor<ScheduledProcessor>()->runs, 1u);
+    }
+
     void test_processor_deactivate(void) {
         TS_ASSERT(engine->get_processor<TestProcessor>()->counter == 0);
         engine->get_processor<TestProcessor>()->deactivate();
@@ -86,6 +176,109 @@ public:
         engine->run_tick(1);
         TS_ASSERT(engine->get_processor<TestProcessor>()->counter == 1);
     }
+
+    void test_processor_schedule_interval(void) {
+        engine->add_processor<ScheduledProcessor>();
+        ScheduledProcessor * p = engine->get_processor<ScheduledProcessor>();
+        p->schedule_interval(100);
+        TS_ASSERT(p->get_schedule() == CAshley::SCHEDULE_INTERVAL);
+        p->activate();
+        for (unsigned int i = 0; i < 6; i++) {
+            engine->run_tick(16);
+        }
+        TS_ASSERT(p->runs == 0);
+        engine->run_tick(16);
+        TS_ASSERT(p->runs == 1);
+        TS_ASSERT(p->last_delay == 112);
+        for (unsigned int i = 0; i < 6; i++) {
+            engine->run_tick(16);
+        }
+        TS_ASSERT(p->runs == 2);
+        TS_ASSERT(p->last_delay == 96);
+        TS_ASSERT(p->total_delay == engine->get_clock());
+        TS_ASSERT_THROWS(p->schedule_interval(0), CAshley::ProcessorError);
+    }
+
+    void test_processor_schedule_fixed_step(void) {
+        engine->add_processor<ScheduledProcessor>();
+        ScheduledProcessor * p = engine->get_processor<ScheduledProcessor>();
+        p->schedule_fixed_step(10, 3);
+        p->activate();
+        engine->run_tick(25);
+        TS_ASSERT(p->runs == 2);
+        TS_ASSERT(p->last_delay == 10);
+        engine->run_tick(100);
+        TS_ASSERT(p->runs == 5);
+        engine->run_tick(4);
+        TS_ASSERT(p->runs == 5);
+        engine->run_tick(1);
+        TS_ASSERT(p->runs == 6);
+    }
+
+    void test_processor_schedule_every_n_ticks(void) {
+        engine->add_processor<ScheduledProcessor>();
+        ScheduledProcessor * p = engine->get_processor<ScheduledProcessor>();
+        p->schedule_every_n_ticks(3);
+        p->activate();
+        engine->run_tick(1);
+        engine->run_tick(2);
+        TS_ASSERT(p->runs == 0);
+        engine->run_tick(3);
+        TS_ASSERT(p->runs == 1);
+        TS_ASSERT(p->last_delay == 6);
+        p->deactivate();
+        for (unsigned int i = 0; i < 6; i++) {
+            engine->run_tick(1);
+        }
+        TS_ASSERT(p->runs == 1);
+        p->activate();
+        engine->run_tick(1);
+        engine->run_tick(1);
+        engine->run_tick(1);
+        TS_ASSERT(p->runs == 2);
+        TS_ASSERT(p->last_delay == 3);
+        p->schedule_every_tick();
+        engine->run_tick(5);
+        TS_ASSERT(p->runs == 3);
+        TS_ASSERT(p->last_delay == 5);
+    }
+
+    void test_processor_get_entities(void) {
+        engine->add_processor<FamilyProcessor>();
+        FamilyProcessor * p = engine->get_processor<FamilyProcessor>();
+        p->activate();
+        TestEntity * e1 = new TestEntity, * e2 = new TestEntity;
+        engine->add_entity(e1);
+        engine->add_entity(e2);
+        engine->run_tick(1);
+        TS_ASSERT(p->seen == 0);
+        e1->activate();
+        engine->run_tick(1);
+        TS_ASSERT(p->seen == 1);
+        e2->activate();
+        engine->run_tick(1);
+        TS_ASSERT(p->seen == 2);
+        delete e1;
+        engine->run_tick(1);
+        TS_ASSERT(p->seen == 1);
+        delete e2;
+    }
+
+    void test_processor_conflicts(void) {
+        TestProcessor reader1, reader2, writer, other;
+        reader1.reads<int>();
+        reader2.reads<int>();
+        reader2.reads<float>();
+        writer.writes<int>();
+        other.writes<float>();
+        TS_ASSERT(!reader1.conflicts_with(reader2));
+        TS_ASSERT(reader1.conflicts_with(writer));
+        TS_ASSERT(writer.conflicts_with(reader2));
+        TS_ASSERT(writer.conflicts_with(writer));
+        TS_ASSERT(!writer.conflicts_with(other));
+        TS_ASSERT(other.conflicts_with(reader2));
+        TS_ASSERT(!other.conflicts_with(reader1));
+    }
 };
 
 #endif //__CASHLEY_PROCESSORTESTS_H
@@ -0,0 +1,448 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_REGISTRYTESTS_H
+#define __CASHLEY_REGISTRYTESTS_H
+
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+
+class RegistryTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        int x;
+        PositionComponent() : x(0) {}
+        void init() { x = 7; }
+        CASHLEY_COMPONENT
+    };
+
+    class VelocityComponent : public CAshley::Component {
+    public:
+        int v;
+        VelocityComponent() : v(0) {}
+        CASHLEY_COMPONENT
+    };
+
+    class EnemyTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(EnemyTag)
+    };
+
+    class MeshComponent : public CAshley::Component {
+    public:
+        int mesh;
+        MeshComponent() : mesh(0) {}
+        MeshComponent(int m) : mesh(m) {}
+        void init() { mesh = -1; }
+        bool operator==(const MeshComponent & o) const { return mesh == o.mesh; }
+        CASHLEY_COMPONENT
+        CASHLEY_SHARED(MeshComponent)
+        CASHLEY_FIELDS(MeshComponent) {
+            CASHLEY_FIELD(mesh);
+        }
+    };
+
+    class AnchorComponent : public CAshley::Component {
+    public:
+        int anchor;
+        AnchorComponent() : anchor(0) {}
+        CASHLEY_COMPONENT
+        CASHLEY_STABLE(AnchorComponent)
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+    };
+
+    class DestroyProcessor : public CAshley::Processor {
+    public:
+        CAshley::EntityId id;
+        bool alive;
+        DestroyProcessor() : alive(false) {}
+        void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            _engine->destroy_entity(id);
+            _engine->destroy_entity(id);
+            alive = _engine->is_alive(id);
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    CAshley::Engine * engine;
+
+    void setUp() {
+        engine = new CAshley::Engine;
+    }
+
+    void tearDown() {
+        delete engine;
+    }
+
+    void test_registry_entity_id(void) {
+        CAshley::EntityId null;
+        TS_ASSERT(null.is_null());
+        CAshley::EntityId id(12, 5);
+        TS_ASSERT(!id.is_null());
+        TS_ASSERT(CAshley::EntityId::from_number(id.to_number()) == id);
+        TS_ASSERT(id != CAshley::EntityId(12, 6));
+    }
+
+    void test_registry_create_destroy(void) {
+        CAshley::EntityId a = engine->create_entity(), b = engine->create_entity();
+        TS_ASSERT(engine->is_alive(a));
+        TS_ASSERT(engine->is_alive(b));
+        TS_ASSERT(a != b);
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 2u);
+        engine->destroy_entity(a);
+        TS_ASSERT(!engine->is_alive(a));
+        TS_ASSERT_THROWS(engine->destroy_entity(a), CAshley::EntityError);
+        // The slot is reused with a new generation: the stale id stays dead.
+        CAshley::EntityId c = engine->create_entity();
+        TS_ASSERT_EQUALS(c.index, a.index);
+        TS_ASSERT(c.generation != a.generation);
+        TS_ASSERT(!engine->is_alive(a));
+        TS_ASSERT(engine->is_alive(c));
+        TS_ASSERT(!engine->is_alive(CAshley::EntityId()));
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 2u);
+    }
+
+    void test_registry_components(void) {
+        CAshley::EntityId a = engine->create_entity();
+        TS_ASSERT(!engine->has_component<PositionComponent>(a));
+        PositionComponent * p = engine->add_component<PositionComponent>(a);
+        TS_ASSERT_EQUALS(p->x, 7);
+        TS_ASSERT(p->get_owner() == NULL);
+        TS_ASSERT(engine->has_component<PositionComponent>(a));
+        TS_ASSERT(!engine->has_component<VelocityComponent>(a));
+        TS_ASSERT_THROWS(engine->add_component<PositionComponent>(a), CAshley::EntityError);
+        TS_ASSERT_THROWS(engine->get_component<VelocityComponent>(a), CAshley::ComponentError);
+        engine->get_component<PositionComponent>(a)->x = 3;
+        TS_ASSERT_EQUALS(engine->get_component<PositionComponent>(a)->x, 3);
+        engine->remove_component<PositionComponent>(a);
+        TS_ASSERT(!engine->has_component<PositionComponent>(a));
+        TS_ASSERT_THROWS(engine->remove_component<PositionComponent>(a), CAshley::ComponentError);
+        engine->add_component<PositionComponent>(a);
+        engine->destroy_entity(a);
+        TS_ASSERT(!engine->has_component<PositionComponent>(a));
+        TS_ASSERT_THROWS(engine->add_component<PositionComponent>(a), CAshley::EntityError);
+    }
+
+    void test_registry_get_ids_for(void) {
+        CAshley::EntityId ids[4];
+        for (unsigned int i = 0; i < 4; i++) {
+            ids[i] = engine->create_entity();
+            engine->add_component<PositionComponent>(ids[i]);
+        }
+        engine->add_component<VelocityComponent>(ids[1]);
+        engine->add_component<VelocityComponent>(ids[2]);
+        engine->activate(ids[0]);
+        engine->activate(ids[1]);
+        engine->activate(ids[2]);
+        TS_ASSERT(engine->is_active(ids[0]));
+        TS_ASSERT(!engine->is_active(ids[3]));
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        CAshley::EntityIdArray v = engine->get_ids_for(f);
+        TS_ASSERT_EQUALS(v.size(), 3u);
+        f.exclude<VelocityComponent>();
+        v = engine->get_ids_for(f);
+        TS_ASSERT_EQUALS(v.size(), 1u);
+        TS_ASSERT(v[0] == ids[0]);
+        engine->deactivate(ids[1]);
+        CAshley::Family g;
+        g.filter<VelocityComponent>();
+        v = engine->get_ids_for(g);
+        TS_ASSERT_EQUALS(v.size(), 1u);
+        TS_ASSERT(v[0] == ids[2]);
+    }
+
+    void test_registry_entity_wrapper(void) {
+        TestEntity * e = new TestEntity;
+        TS_ASSERT(e->get_id().is_null());
+        engine->add_entity(e);
+        CAshley::EntityId id = e->get_id();
+        TS_ASSERT(engine->is_alive(id));
+        TS_ASSERT(engine->get_entity(id) == e);
+        e->add_component<PositionComponent>();
+        TS_ASSERT(engine->has_component<PositionComponent>(id));
+        TS_ASSERT(engine->get_component<PositionComponent>(id) == e->get_component<PositionComponent>());
+        engine->add_component<VelocityComponent>(id);
+        TS_ASSERT(e->has_component<VelocityComponent>());
+        TS_ASSERT(e->get_component<VelocityComponent>()->get_owner() == e);
+        engine->activate(id);
+        TS_ASSERT(e->is_active());
+        CAshley::Family f;
+        f.filter<VelocityComponent>();
+        TS_ASSERT_EQUALS(engine->get_entities_for(f).size(), 1u);
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 1u);
+        engine->destroy_entity(id);
+        TS_ASSERT(!engine->is_alive(id));
+        TS_ASSERT(e->get_id().is_null());
+        TS_ASSERT(!e->has_component<PositionComponent>());
+        delete e;
+    }
+
+    void test_registry_entity_wrappers(void) {
+        std::vector<TestEntity *> entities;
+        for (unsigned int i = 0; i < 4; i++) {
+            entities.push_back(new TestEntity);
+            engine->add_entity(entities[i]);
+            entities[i]->add_component<PositionComponent>();
+            engine->activate(entities[i]->get_id());
+        }
+        // Plain entities are not walked for wrappers.
+        engine->spawn_n<PositionComponent>(100);
+        engine->destroy_entity(entities[1]->get_id());
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        CAshley::EntityArray all = engine->get_entities_for(f);
+        // Ordered by slot.
+        TS_ASSERT_EQUALS(all.size(), 3u);
+        TS_ASSERT(all[0] == entities[0]);
+        TS_ASSERT(all[1] == entities[2]);
+        TS_ASSERT(all[2] == entities[3]);
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            delete entities[i];
+        }
+    }
+
+    void test_registry_destroy_during_tick(void) {
+        engine->add_processor<DestroyProcessor>();
+        DestroyProcessor * p = engine->get_processor<DestroyProcessor>();
+        p->id = engine->create_entity();
+        engine->add_component<PositionComponent>(p->id);
+        p->activate();
+        engine->run_tick(1);
+        TS_ASSERT(p->alive);
+        TS_ASSERT(!engine->is_alive(p->id));
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 0u);
+    }
+
+    void test_registry_tags(void) {
+        std::vector<CAshley::EntityId> ids = engine->spawn_n<PositionComponent, EnemyTag>(100);
+        CAshley::EntityId id = engine->create_entity();
+        engine->add_component<EnemyTag>(id);
+        engine->activate(id);
+        TS_ASSERT(engine->has_component<EnemyTag>(ids[0]));
+        TS_ASSERT(engine->get_component<EnemyTag>(id) == engine->get_component<EnemyTag>(ids[0]));
+        TS_ASSERT_THROWS(engine->get_component<EnemyTag>(), CAshley::ComponentError);
+        CAshley::Family f;
+        f.filter<EnemyTag>();
+        f.exclude<VelocityComponent>();
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 101u);
+        engine->remove_component<EnemyTag>(ids[0]);
+        TS_ASSERT(!engine->has_component<EnemyTag>(ids[0]));
+        TS_ASSERT_THROWS(engine->remove_component<EnemyTag>(ids[0]), CAshley::ComponentError);
+        engine->destroy_entity(id);
+        // The slot is reused without the tag.
+        CAshley::EntityId reused = engine->create_entity();
+        TS_ASSERT_EQUALS(reused.index, id.index);
+        TS_ASSERT(!engine->has_component<EnemyTag>(reused));
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 99u);
+    }
+
+    void test_registry_shared(void) {
+        std::vector<CAshley::EntityId> ids = engine->spawn_n<PositionComponent>(1000);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine->set_shared(ids[i], MeshComponent(i % 200));
+        }
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 200u);
+        TS_ASSERT(engine->get_component<MeshComponent>(ids[3]) == engine->get_component<MeshComponent>(ids[203]));
+        TS_ASSERT_EQUALS(engine->get_component<MeshComponent>(ids[3])->mesh, 3);
+        unsigned int groups = 0, total = 0;
+        bool grouped = true;
+        engine->each_shared<MeshComponent>([&](MeshComponent & m, CAshley::Span<const CAshley::EntityId> group) {
+            groups++;
+            total += group.size();
+            for (unsigned int i = 0; i < group.size(); i++) {
+                grouped = grouped && group[i].index % 200 == (unsigned int)m.mesh;
+            }
+        });
+        TS_ASSERT_EQUALS(groups, 200u);
+        TS_ASSERT_EQUALS(total, 1000u);
+        TS_ASSERT(grouped);
+        // Moving every entity of a value away releases it.
+        for (unsigned int i = 0; i < ids.size(); i += 200) {
+            engine->set_shared(ids[i], MeshComponent(1));
+        }
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 199u);
+        engine->remove_component<MeshComponent>(ids[1]);
+        TS_ASSERT(!engine->has_component<MeshComponent>(ids[1]));
+        engine->despawn(CAshley::Span<const CAshley::EntityId>(&ids[0], 400));
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 199u);
+        engine->despawn(CAshley::Span<const CAshley::EntityId>(&ids[400], 600));
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 0u);
+    }
+
+    void test_registry_shared_batch(void) {
+        std::vector<CAshley::EntityId> ids = engine->spawn_n<MeshComponent>(100);
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 1u);
+        TS_ASSERT_EQUALS(engine->get_component<MeshComponent>(ids[50])->mesh, -1);
+        MeshComponent * m = engine->set_shared(CAshley::Span<const CAshley::EntityId>(&ids[0], 50), MeshComponent(7));
+        TS_ASSERT_EQUALS(m->mesh, 7);
+        TS_ASSERT(engine->get_component<MeshComponent>(ids[0]) == m);
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 2u);
+        TestEntity * e = new TestEntity;
+        engine->add_entity(e);
+        e->add_component<MeshComponent>();
+        TS_ASSERT(e->get_component<MeshComponent>() == engine->get_component<MeshComponent>(ids[99]));
+        engine->set_shared(e->get_id(), MeshComponent(7));
+        TS_ASSERT(e->get_component<MeshComponent>() == m);
+        e->remove_component<MeshComponent>();
+        TS_ASSERT_THROWS(engine->add_component<MeshComponent>(ids[0]), CAshley::EntityError);
+        delete e;
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 2u);
+    }
+
+    void test_registry_shared_write(void) {
+        std::vector<CAshley::EntityId> ids = engine->spawn_n<MeshComponent>(2);
+        engine->set_shared(ids[0], MeshComponent(3))->mesh = 8;
+        engine->mark_changed<MeshComponent>(ids[0]);
+        // Found by its new value, and no longer by the old one.
+        engine->set_shared(ids[1], MeshComponent(8));
+        TS_ASSERT(engine->get_component<MeshComponent>(ids[1]) == engine->get_component<MeshComponent>(ids[0]));
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 1u);
+        engine->set_shared(ids[1], MeshComponent(3));
+        TS_ASSERT(engine->get_component<MeshComponent>(ids[1]) != engine->get_component<MeshComponent>(ids[0]));
+        TS_ASSERT_EQUALS(engine->get_component<MeshComponent>(ids[1])->mesh, 3);
+        TS_ASSERT_EQUALS(engine->get_component<MeshComponent>(ids[0])->mesh, 8);
+        TS_ASSERT_EQUALS(engine->get_shared_count<MeshComponent>(), 2u);
+    }
+
+    void test_registry_spawn_n(void) {
+        std::vector<CAshley::EntityId> inactive = engine->spawn_n<PositionComponent>(10, false);
+        std::vector<CAshley::EntityId> ids = engine->spawn_n<PositionComponent, VelocityComponent>(50000);
+        TS_ASSERT_EQUALS(ids.size(), 50000u);
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 50010u);
+        TS_ASSERT(!engine->is_active(inactive[0]));
+        TS_ASSERT(engine->is_active(ids[0]));
+        TS_ASSERT_EQUALS(engine->get_component<PositionComponent>(ids[123])->x, 7);
+        TS_ASSERT(engine->has_component<VelocityComponent>(ids[49999]));
+        TS_ASSERT(!engine->has_component<VelocityComponent>(inactive[0]));
+        // Components of a batch are contiguous.
+        PositionComponent * first = engine->get_component<PositionComponent>(ids[0]);
+        TS_ASSERT(engine->get_component<PositionComponent>(ids[49999]) == first + 49999);
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 50000u);
+        engine->activate(inactive[3]);
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 50001u);
+        TS_ASSERT_EQUALS(engine->get_component<PositionComponent>(inactive[3])->x, 7);
+    }
+
+    void test_registry_despawn(void) {
+        std::vector<CAshley::EntityId> ids = engine->spawn_n<PositionComponent, VelocityComponent>(1000);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine->get_component<VelocityComponent>(ids[i])->v = i;
+        }
+        engine->despawn(CAshley::Span<const CAshley::EntityId>(&ids[0], 500));
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 500u);
+        TS_ASSERT(!engine->is_alive(ids[0]));
+        TS_ASSERT(engine->is_alive(ids[500]));
+        for (unsigned int i = 500; i < ids.size(); i++) {
+            TS_ASSERT_EQUALS(engine->get_component<VelocityComponent>(ids[i])->v, (int)i);
+        }
+        CAshley::Family f;
+        f.filter<VelocityComponent>();
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 500u);
+        TS_ASSERT_THROWS(engine->despawn(CAshley::Span<const CAshley::EntityId>(&ids[0], 1)), CAshley::EntityError);
+        // Slots and components are reused.
+        std::vector<CAshley::EntityId> again = engine->spawn_n<VelocityComponent>(500);
+        TS_ASSERT_EQUALS(engine->get_entity_count(), 1000u);
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 1000u);
+    }
+
+    void test_registry_activate_batch(void) {
+        std::vector<CAshley::EntityId> ids = engine->spawn_n<PositionComponent, VelocityComponent>(20000, false);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine->get_component<VelocityComponent>(ids[i])->v = i;
+        }
+        std::vector<CAshley::EntityId> even;
+        for (unsigned int i = 0; i < ids.size(); i += 2) {
+            even.push_back(ids[i]);
+        }
+        engine->activate(CAshley::Span<const CAshley::EntityId>(&even[0], even.size()));
+        CAshley::Family f;
+        f.filter<VelocityComponent>();
+        CAshley::EntityIdArray v = engine->get_ids_for(f);
+        TS_ASSERT_EQUALS(v.size(), 10000u);
+        for (unsigned int i = 0; i < v.size(); i++) {
+            TS_ASSERT_EQUALS(engine->get_component<VelocityComponent>(v[i])->v % 2, 0);
+        }
+        engine->deactivate(CAshley::Span<const CAshley::EntityId>(&ids[0], 5000));
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 7500u);
+        TS_ASSERT(!engine->is_active(ids[4998]));
+        TS_ASSERT(engine->is_active(ids[5000]));
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            TS_ASSERT_EQUALS(engine->get_component<VelocityComponent>(ids[i])->v, (int)i);
+        }
+    }
+
+    void test_registry_entity_lookup(void) {
+        TestEntity * e = new TestEntity;
+        engine->add_entity(e);
+        TS_ASSERT_THROWS(engine->add_entity(e), CAshley::EntityError);
+        CAshley::EntityId id = e->get_id();
+        TS_ASSERT(engine->get_entity(CAshley::EntityId::from_number(id.to_number())) == e);
+        CAshley::Engine other;
+        TS_ASSERT_THROWS(other.remove_entity(e), CAshley::EntityError);
+        engine->remove_entity(e);
+        TS_ASSERT(!engine->is_alive(id));
+        TS_ASSERT_THROWS(engine->remove_entity(e), CAshley::EntityError);
+        delete e;
+    }
+
+    void test_registry_stable_components(void) {
+        CAshley::EntityId first = engine->create_entity();
+        AnchorComponent * a = engine->add_component<AnchorComponent>(first);
+        a->anchor = 5;
+        engine->activate(first);
+        std::vector<CAshley::EntityId> ids = engine->spawn_n<AnchorComponent, PositionComponent>(1000);
+        engine->despawn(CAshley::Span<const CAshley::EntityId>(&ids[0], 500));
+        TS_ASSERT(engine->get_component<AnchorComponent>(first) == a);
+        TS_ASSERT_EQUALS(a->anchor, 5);
+        CAshley::Family f;
+        f.filter<AnchorComponent>();
+        TS_ASSERT_EQUALS(engine->get_ids_for(f).size(), 501u);
+    }
+
+    void test_registry_many_entities(void) {
+        const unsigned int n = 100000;
+        engine->reserve_entities(n);
+        for (unsigned int i = 0; i < n; i++) {
+            CAshley::EntityId id = engine->create_entity();
+            if (i % 2) {
+                engine->add_component<VelocityComponent>(id)->v = i;
+                engine->activate(id);
+            }
+        }
+        TS_ASSERT_EQUALS(engine->get_entity_count(), n);
+        CAshley::Family f;
+        f.filter<VelocityComponent>();
+        CAshley::EntityIdArray v = engine->get_ids_for(f);
+        TS_ASSERT_EQUALS(v.size(), n / 2);
+        TS_ASSERT_EQUALS(engine->get_component<VelocityComponent>(v[10])->v, 21);
+    }
+};
+
+#endif //__CASHLEY_REGISTRYTESTS_H
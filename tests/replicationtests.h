@@ -0,0 +1,345 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_REPLICATIONTESTS_H
+#define __CASHLEY_REPLICATIONTESTS_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class ReplicationTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        float x, y;
+        PositionComponent() : x(0), y(0) {}
+        void init() { x = y = 0; }
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+        CASHLEY_SCHEMA(PositionComponent, "replication.Position")
+        CASHLEY_FIELDS(PositionComponent) {
+            CASHLEY_FIELD(x);
+            CASHLEY_FIELD(y);
+        }
+    };
+
+    class UnitComponent : public CAshley::Component {
+    public:
+        int hp;
+        short armor[2];
+        double mana;
+        std::string name;
+        CAshley::EntityId target;
+        UnitComponent() : hp(0), mana(0) {
+            armor[0] = armor[1] = 0;
+        }
+        CASHLEY_COMPONENT
+        CASHLEY_STABLE(UnitComponent)
+        CASHLEY_SCHEMA(UnitComponent, "replication.Unit")
+        CASHLEY_FIELDS(UnitComponent) {
+            CASHLEY_FIELD(hp);
+            CASHLEY_FIELD(armor);
+            CASHLEY_FIELD(mana);
+            CASHLEY_FIELD(name);
+            CASHLEY_FIELD(target);
+        }
+    };
+
+    class FrozenTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(FrozenTag)
+        CASHLEY_SCHEMA(FrozenTag, "replication.Frozen")
+    };
+
+    class SecretComponent : public CAshley::Component {
+    public:
+        int code;
+        CASHLEY_COMPONENT
+    };
+
+    CAshley::ReplicationSet types() {
+        CAshley::ReplicationSet set;
+        set.add<PositionComponent>();
+        set.add<UnitComponent>();
+        set.add<FrozenTag>();
+        set.quantize<PositionComponent>("x", 0.01);
+        set.quantize<PositionComponent>("y", 0.01);
+        return set;
+    }
+
+    // Sends an update through the channel, applies what arrives and acknowledges it.
+    unsigned long long sync(CAshley::Replicator & server, unsigned int observer, CAshley::LoopbackChannel & channel, CAshley::Replica & client, bool lose=false) {
+        std::vector<char> packet;
+        server.encode(observer, packet);
+        channel.send(packet);
+        if (lose) {
+            channel.drop();
+            return 0;
+        }
+        unsigned long long seq = 0;
+        while (channel.receive(packet)) {
+            seq = client.apply(packet.data(), packet.size());
+        }
+        server.ack(observer, seq);
+        return seq;
+    }
+
+    void check_same(CAshley::Engine & server, CAshley::Replica & client, CAshley::Engine & replica, const std::vector<CAshley::EntityId> & ids) {
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            CAshley::EntityId local = client.get_local(ids[i]);
+            if (!server.is_alive(ids[i]) || !server.is_active(ids[i])) {
+                TS_ASSERT(local.is_null());
+                continue;
+            }
+            TS_ASSERT(replica.is_alive(local));
+            TS_ASSERT_EQUALS(replica.has_component<PositionComponent>(local), server.has_component<PositionComponent>(ids[i]));
+            TS_ASSERT_EQUALS(replica.has_component<UnitComponent>(local), server.has_component<UnitComponent>(ids[i]));
+            TS_ASSERT_EQUALS(replica.has_component<FrozenTag>(local), server.has_component<FrozenTag>(ids[i]));
+            TS_ASSERT(!replica.has_component<SecretComponent>(local));
+            if (server.has_component<PositionComponent>(ids[i])) {
+                TS_ASSERT_DELTA(replica.get_component<PositionComponent>(local)->x, server.get_component<PositionComponent>(ids[i])->x, 0.0051);
+                TS_ASSERT_DELTA(replica.get_component<PositionComponent>(local)->y, server.get_component<PositionComponent>(ids[i])->y, 0.0051);
+            }
+            if (server.has_component<UnitComponent>(ids[i])) {
+                UnitComponent * a = server.get_component<UnitComponent>(ids[i]);
+                UnitComponent * b = replica.get_component<UnitComponent>(local);
+                TS_ASSERT_EQUALS(a->hp, b->hp);
+                TS_ASSERT_EQUALS(a->armor[1], b->armor[1]);
+                TS_ASSERT_EQUALS(a->mana, b->mana);
+                TS_ASSERT_EQUALS(a->name, b->name);
+                TS_ASSERT(b->target == client.get_local(a->target));
+            }
+        }
+    }
+
+    void build(CAshley::Engine & engine, std::vector<CAshley::EntityId> & ids) {
+        ids = engine.spawn_n<PositionComponent>(200);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = i * 0.5f;
+            engine.get_component<PositionComponent>(ids[i])->y = -(float)i;
+            if (i % 4 == 0) {
+                UnitComponent * u = engine.add_component<UnitComponent>(ids[i]);
+                u->hp = 100 - i;
+                u->armor[1] = -(short)i;
+                u->mana = i / 3.0;
+                u->name = std::string("unit with a long enough name ") + std::to_string(i);
+                u->target = ids[(i + 7) % ids.size()];
+            }
+            if (i % 10 == 0) {
+                engine.add_component<FrozenTag>(ids[i]);
+                engine.add_component<SecretComponent>(ids[i]);
+            }
+        }
+    }
+
+    void test_replicate(void) {
+        CAshley::Engine engine, replica;
+        std::vector<CAshley::EntityId> ids;
+        build(engine, ids);
+        CAshley::Replicator server(engine, types());
+        CAshley::Replica client(replica, types());
+        CAshley::LoopbackChannel channel;
+        CAshley::Family all;
+        unsigned int observer = server.add_observer(all);
+
+        TS_ASSERT_EQUALS(sync(server, observer, channel, client), 1u);
+        TS_ASSERT_EQUALS(client.size(), 200u);
+        TS_ASSERT_EQUALS(server.get_pending(observer), 0u);
+        check_same(engine, client, replica, ids);
+        unsigned long long full = channel.get_bytes();
+
+        // Nothing changed: only the header is sent.
+        sync(server, observer, channel, client);
+        TS_ASSERT_LESS_THAN(channel.get_bytes() - full, 8u);
+
+        // Changes below the step are not sent.
+        engine.get_component<PositionComponent>(ids[3])->x += 0.001f;
+        unsigned long long before = channel.get_bytes();
+        sync(server, observer, channel, client);
+        TS_ASSERT_LESS_THAN(channel.get_bytes() - before, 8u);
+
+        engine.get_component<PositionComponent>(ids[5])->y = 12.5f;
+        engine.get_component<UnitComponent>(ids[8])->name = "renamed";
+        engine.get_component<UnitComponent>(ids[8])->armor[0] = 3;
+        engine.remove_component<FrozenTag>(ids[10]);
+        engine.add_component<FrozenTag>(ids[11]);
+        engine.remove_component<UnitComponent>(ids[12]);
+        engine.add_component<UnitComponent>(ids[13])->target = ids[8];
+        engine.destroy_entity(ids[7]);
+        engine.deactivate(ids[9]);
+        std::vector<CAshley::EntityId> more = engine.spawn_n<PositionComponent, UnitComponent>(3);
+        engine.get_component<UnitComponent>(more[0])->target = more[2];
+        ids.insert(ids.end(), more.begin(), more.end());
+        before = channel.get_bytes();
+        sync(server, observer, channel, client);
+        TS_ASSERT_LESS_THAN(channel.get_bytes() - before, full / 10);
+        TS_ASSERT_EQUALS(client.size(), 201u);
+        check_same(engine, client, replica, ids);
+        TS_ASSERT(client.get_local(ids[0]) != client.get_local(ids[1]));
+    }
+
+    void test_replicate_lossy(void) {
+        CAshley::Engine engine, replica;
+        std::vector<CAshley::EntityId> ids;
+        build(engine, ids);
+        CAshley::Replicator server(engine, types());
+        CAshley::Replica client(replica, types());
+        CAshley::LoopbackChannel channel;
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        unsigned int observer = server.add_observer(f);
+
+        // The first packets are lost.
+        sync(server, observer, channel, client, true);
+        engine.get_component<PositionComponent>(ids[1])->x = 40;
+        sync(server, observer, channel, client, true);
+        TS_ASSERT_EQUALS(server.get_pending(observer), 2u);
+        sync(server, observer, channel, client);
+        TS_ASSERT_EQUALS(server.get_pending(observer), 0u);
+        check_same(engine, client, replica, ids);
+
+        // Applied but not acknowledged, then changed back: the replica is fixed too.
+        float x = engine.get_component<PositionComponent>(ids[2])->x;
+        engine.get_component<PositionComponent>(ids[2])->x = 77;
+        engine.destroy_entity(ids[3]);
+        std::vector<char> packet;
+        server.encode(observer, packet);
+        unsigned long long seq = client.apply(packet.data(), packet.size());
+        engine.get_component<PositionComponent>(ids[2])->x = x;
+        std::vector<CAshley::EntityId> more = engine.spawn_n<PositionComponent>(1);
+        ids.push_back(more[0]);
+        std::vector<char> next;
+        server.encode(observer, next);
+        TS_ASSERT_EQUALS(server.get_pending(observer), 2u);
+        TS_ASSERT_EQUALS(client.apply(next.data(), next.size()), seq + 1);
+        // A late packet is ignored.
+        TS_ASSERT_EQUALS(client.apply(packet.data(), packet.size()), seq + 1);
+        server.ack(observer, seq + 1);
+        server.ack(observer, seq);
+        TS_ASSERT_EQUALS(server.get_pending(observer), 0u);
+        check_same(engine, client, replica, ids);
+        TS_ASSERT_EQUALS(replica.get_component<PositionComponent>(client.get_local(ids[2]))->x, x);
+    }
+
+    void test_replicate_area(void) {
+        CAshley::Engine engine, replica;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(100);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = i;
+        }
+        engine.add_component<UnitComponent>(engine.create_entity());
+        CAshley::Replicator server(engine, types());
+        CAshley::Replica client(replica, types());
+        CAshley::LoopbackChannel channel;
+        CAshley::Family all;
+        unsigned int observer = server.add_observer(all);
+        server.set_area<PositionComponent>(observer, "x", "y", 10);
+        server.set_center(observer, 20, 0);
+        sync(server, observer, channel, client);
+        TS_ASSERT_EQUALS(client.size(), 21u);
+        TS_ASSERT(client.get_local(ids[9]).is_null());
+        TS_ASSERT(!client.get_local(ids[30]).is_null());
+
+        server.set_center(observer, 60, 0);
+        engine.get_component<PositionComponent>(ids[5])->x = 55;
+        sync(server, observer, channel, client);
+        TS_ASSERT_EQUALS(client.size(), 22u);
+        TS_ASSERT(client.get_local(ids[30]).is_null());
+        TS_ASSERT_EQUALS(replica.get_component<PositionComponent>(client.get_local(ids[5]))->x, 55);
+        TS_ASSERT_EQUALS(replica.get_entity_count(), 22u);
+
+        TS_ASSERT_THROWS(server.set_area<SecretComponent>(observer, "code", "code", 1), CAshley::ReplicationError);
+        TS_ASSERT_THROWS(server.set_area<UnitComponent>(observer, "name", "hp", 1), CAshley::ReplicationError);
+        TS_ASSERT_THROWS(server.set_center(observer + 1, 0, 0), CAshley::ReplicationError);
+    }
+
+    void test_replicate_quantize_range(void) {
+        CAshley::Engine engine, replica;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(2);
+        // 1e8 / 0.01 steps does not fit in 32 bits.
+        engine.get_component<PositionComponent>(ids[0])->x = 1e8f;
+        engine.get_component<PositionComponent>(ids[1])->x = -1e8f;
+        CAshley::Replicator server(engine, types());
+        CAshley::Replica client(replica, types());
+        CAshley::LoopbackChannel channel;
+        CAshley::Family all;
+        unsigned int observer = server.add_observer(all);
+        sync(server, observer, channel, client);
+        TS_ASSERT_EQUALS(replica.get_component<PositionComponent>(client.get_local(ids[0]))->x, 1e8f);
+        TS_ASSERT_EQUALS(replica.get_component<PositionComponent>(client.get_local(ids[1]))->x, -1e8f);
+        engine.get_component<PositionComponent>(ids[0])->x = 3e8f;
+        sync(server, observer, channel, client);
+        TS_ASSERT_EQUALS(replica.get_component<PositionComponent>(client.get_local(ids[0]))->x, 3e8f);
+    }
+
+    void test_replicate_errors(void) {
+        CAshley::ReplicationSet set;
+        TS_ASSERT_THROWS(set.add<SecretComponent>(), CAshley::ReplicationError);
+        TS_ASSERT_THROWS(set.quantize<PositionComponent>("x", 0.1), CAshley::ReplicationError);
+        set.add<PositionComponent>();
+        TS_ASSERT_THROWS(set.add<PositionComponent>(), CAshley::ReplicationError);
+        set.add<UnitComponent>();
+        TS_ASSERT_THROWS(set.quantize<UnitComponent>("hp", 0.1), CAshley::ReplicationError);
+        TS_ASSERT_THROWS(set.quantize<PositionComponent>("x", 0), CAshley::ReplicationError);
+        set.quantize<UnitComponent>("mana", 0.5);
+
+        CAshley::Engine engine, replica;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent, UnitComponent>(10);
+        CAshley::Replicator server(engine, set);
+        CAshley::Replica client(replica, set);
+        CAshley::Family all;
+        std::vector<char> packet;
+        TS_ASSERT_THROWS(server.encode(1, packet), CAshley::ReplicationError);
+        server.encode(server.add_observer(all), packet);
+        std::vector<char> cut(packet.begin(), packet.begin() + packet.size() / 2);
+        TS_ASSERT_THROWS(client.apply(cut.data(), cut.size()), CAshley::ReplicationError);
+        // A delta from a state the replica never had.
+        std::vector<char> bad = packet;
+        bad[1] = 5;
+        CAshley::Replica other(replica, set);
+        TS_ASSERT_THROWS(other.apply(bad.data(), bad.size()), CAshley::ReplicationError);
+    }
+
+    void test_replicate_traffic(void) {
+        CAshley::Engine engine, replica;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(10000);
+        CAshley::Replicator server(engine, types());
+        CAshley::Replica client(replica, types());
+        CAshley::LoopbackChannel channel;
+        CAshley::Family all;
+        unsigned int observer = server.add_observer(all);
+        sync(server, observer, channel, client);
+        unsigned long long start = channel.get_bytes();
+        // 1% of the entities move each tick.
+        for (unsigned int tick = 0; tick < 10; tick++) {
+            for (unsigned int i = tick; i < ids.size(); i += 100) {
+                engine.get_component<PositionComponent>(ids[i])->x += 1.5f;
+            }
+            sync(server, observer, channel, client);
+        }
+        TS_ASSERT_LESS_THAN((channel.get_bytes() - start) / 10, 100u * 8);
+        TS_ASSERT_EQUALS(replica.get_component<PositionComponent>(client.get_local(ids[205]))->x, 1.5f);
+    }
+};
+
+#endif //__CASHLEY_REPLICATIONTESTS_H
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_ROLLBACKTESTS_H
+#define __CASHLEY_ROLLBACKTESTS_H
+
+#include <string>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class RollbackTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        int x, y;
+        PositionComponent() : x(0), y(0) {}
+        void init() { x = y = 0; }
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+    };
+
+    class VelocityComponent : public CAshley::Component {
+    public:
+        int dx;
+        VelocityComponent() : dx(1) {}
+        void init() { dx = 1; }
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(VelocityComponent)
+    };
+
+    class NameComponent : public CAshley::Component {
+    public:
+        std::string name;
+        void init() { name.clear(); }
+        CASHLEY_COMPONENT
+        CASHLEY_STABLE(NameComponent)
+    };
+
+    class EnemyTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(EnemyTag)
+    };
+
+    // Moves every position, spawns entities every few ticks and despawns the far ones.
+    class DriftProcessor : public CAshley::Processor {
+    public:
+        virtual void run_tick(unsigned int delay) {
+            CAshley::Family f;
+            f.filter<PositionComponent>();
+            CAshley::EntityIdArray ids = _engine->get_ids_for(f);
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                PositionComponent * p = _engine->get_component<PositionComponent>(ids[i]);
+                int dx = 1;
+                if (_engine->has_component<VelocityComponent>(ids[i])) {
+                    dx = _engine->get_component<VelocityComponent>(ids[i])->dx;
+                }
+                p->x += dx * delay;
+                _engine->mark_changed<PositionComponent>(ids[i]);
+                if (p->x > 40) {
+                    CAshley::EntityId id = ids[i];
+                    _engine->despawn(CAshley::Span<const CAshley::EntityId>(&id, 1));
+                }
+            }
+            if (_engine->get_tick() % 3 == 0) {
+                std::vector<CAshley::EntityId> spawned = _engine->spawn_n<PositionComponent, VelocityComponent>(2);
+                _engine->get_component<VelocityComponent>(spawned[1])->dx = 3;
+            }
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    void prepare(CAshley::Engine & engine) {
+        engine.register_component<PositionComponent>();
+        engine.register_component<VelocityComponent>();
+        engine.register_component<EnemyTag>();
+        engine.add_processor<DriftProcessor>();
+        engine.get_processor<DriftProcessor>()->activate();
+    }
+
+    void check_same(CAshley::Engine & engine, CAshley::Engine & other) {
+        TS_ASSERT_EQUALS(other.get_tick(), engine.get_tick());
+        TS_ASSERT_EQUALS(other.get_clock(), engine.get_clock());
+        TS_ASSERT_EQUALS(other.get_entity_count(), engine.get_entity_count());
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        CAshley::EntityIdArray ids = engine.get_ids_for(f);
+        TS_ASSERT_EQUALS(other.get_ids_for(f).size(), ids.size());
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            TS_ASSERT(other.is_alive(ids[i]));
+            TS_ASSERT_EQUALS(other.get_component<PositionComponent>(ids[i])->x, engine.get_component<PositionComponent>(ids[i])->x);
+            TS_ASSERT_EQUALS(other.get_component<PositionComponent>(ids[i])->y, engine.get_component<PositionComponent>(ids[i])->y);
+            TS_ASSERT_EQUALS(other.has_component<VelocityComponent>(ids[i]), engine.has_component<VelocityComponent>(ids[i]));
+            if (engine.has_component<VelocityComponent>(ids[i]) && other.has_component<VelocityComponent>(ids[i])) {
+                TS_ASSERT_EQUALS(other.get_component<VelocityComponent>(ids[i])->dx, engine.get_component<VelocityComponent>(ids[i])->dx);
+            }
+            TS_ASSERT_EQUALS(other.has_component<EnemyTag>(ids[i]), engine.has_component<EnemyTag>(ids[i]));
+            TS_ASSERT_EQUALS(other.is_active(ids[i]), engine.is_active(ids[i]));
+            TS_ASSERT(other.get_parent(ids[i]) == engine.get_parent(ids[i]));
+        }
+    }
+
+    void test_rollback_resimulate(void) {
+        CAshley::Engine engine;
+        prepare(engine);
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(30);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = i;
+        }
+        engine.start_rollback(16);
+        for (unsigned int i = 0; i < 5; i++) {
+            engine.run_tick(1);
+        }
+        // The world at tick 5, kept apart.
+        std::vector<char> data;
+        engine.save_snapshot(data);
+        CAshley::Engine reference;
+        prepare(reference);
+        reference.load_snapshot(data.data(), data.size());
+
+        // Commands between ticks are undone too.
+        engine.add_component<VelocityComponent>(ids[2])->dx = 4;
+        engine.mark_changed<VelocityComponent>(ids[2]);
+        engine.add_component<EnemyTag>(ids[3]);
+        engine.set_parent(ids[4], ids[3]);
+        engine.deactivate(ids[5]);
+        engine.remove_component<PositionComponent>(ids[6]);
+        for (unsigned int i = 0; i < 5; i++) {
+            engine.run_tick(2);
+        }
+        CAshley::EntityId late = engine.create_entity();
+        engine.add_component<PositionComponent>(late)->y = 9;
+        TS_ASSERT_EQUALS(engine.get_tick(), 10u);
+
+        engine.rollback(5);
+        TS_ASSERT(!engine.is_alive(late));
+        TS_ASSERT(!engine.has_component<EnemyTag>(ids[3]));
+        TS_ASSERT(engine.get_parent(ids[4]).is_null());
+        check_same(reference, engine);
+
+        // Running the same ticks again gives the same world, with the same ids.
+        for (unsigned int i = 0; i < 8; i++) {
+            engine.run_tick(i % 2 + 1);
+            reference.run_tick(i % 2 + 1);
+        }
+        check_same(reference, engine);
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        CAshley::EntityIdArray a = engine.get_ids_for(f), b = reference.get_ids_for(f);
+        for (unsigned int i = 0; i < a.size() && i < b.size(); i++) {
+            TS_ASSERT(a[i] == b[i]);
+        }
+        TS_ASSERT(engine.create_entity() == reference.create_entity());
+    }
+
+    void test_rollback_pending(void) {
+        CAshley::Engine engine;
+        prepare(engine);
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(4);
+        engine.start_rollback(2);
+        engine.run_tick(1);
+        int x = engine.get_component<PositionComponent>(ids[0])->x;
+        engine.get_component<PositionComponent>(ids[0])->x = 100;
+        engine.mark_changed<PositionComponent>(ids[0]);
+        CAshley::EntityId created = engine.create_entity();
+        engine.destroy_entity(ids[1]);
+        // Only the changes since the last tick are undone.
+        engine.rollback(engine.get_tick());
+        TS_ASSERT_EQUALS(engine.get_tick(), 1u);
+        TS_ASSERT_EQUALS(engine.get_component<PositionComponent>(ids[0])->x, x);
+        TS_ASSERT(engine.is_alive(ids[1]));
+        TS_ASSERT(engine.has_component<PositionComponent>(ids[1]));
+        TS_ASSERT(!engine.is_alive(created));
+        TS_ASSERT(engine.create_entity() == created);
+    }
+
+    void test_rollback_window(void) {
+        CAshley::Engine engine;
+        prepare(engine);
+        engine.spawn_n<PositionComponent>(10);
+        engine.start_rollback(4);
+        TS_ASSERT_EQUALS(engine.get_rollback_tick(), 0u);
+        for (unsigned int i = 0; i < 10; i++) {
+            engine.run_tick(1);
+        }
+        TS_ASSERT_EQUALS(engine.get_rollback_tick(), 6u);
+        TS_ASSERT_THROWS(engine.rollback(5), CAshley::RollbackError);
+        TS_ASSERT_THROWS(engine.rollback(11), CAshley::RollbackError);
+        engine.rollback(7);
+        TS_ASSERT_EQUALS(engine.get_tick(), 7u);
+        TS_ASSERT_EQUALS(engine.get_clock(), 7u);
+        // Undone ticks are dropped.
+        TS_ASSERT_THROWS(engine.rollback(8), CAshley::RollbackError);
+        engine.rollback(6);
+        TS_ASSERT_EQUALS(engine.get_rollback_tick(), 6u);
+        for (unsigned int i = 0; i < 10; i++) {
+            engine.run_tick(1);
+        }
+        TS_ASSERT_EQUALS(engine.get_rollback_tick(), 12u);
+        engine.rollback(12);
+        TS_ASSERT_EQUALS(engine.get_tick(), 12u);
+    }
+
+    void test_rollback_errors(void) {
+        CAshley::Engine engine;
+        prepare(engine);
+        std::vector<char> data;
+        TS_ASSERT_THROWS(engine.rollback(0), CAshley::RollbackError);
+        TS_ASSERT_THROWS(engine.get_rollback_tick(), CAshley::RollbackError);
+        TS_ASSERT_THROWS(engine.start_rollback(0), CAshley::RollbackError);
+        engine.start_rollback(8);
+        TS_ASSERT_THROWS(engine.start_rollback(8), CAshley::RollbackError);
+        TS_ASSERT_THROWS(engine.save_delta(data), CAshley::RollbackError);
+        TS_ASSERT_THROWS(engine.track_changes(false), CAshley::RollbackError);
+        engine.stop_rollback();
+        TS_ASSERT_THROWS(engine.save_delta(data), CAshley::SnapshotError);
+        engine.track_changes();
+        TS_ASSERT_THROWS(engine.start_rollback(8), CAshley::RollbackError);
+        engine.track_changes(false);
+        // Components are copied bytewise.
+        engine.start_rollback(8);
+        TS_ASSERT_THROWS(engine.register_component<NameComponent>(), CAshley::RollbackError);
+        engine.stop_rollback();
+        engine.register_component<NameComponent>();
+        TS_ASSERT_THROWS(engine.start_rollback(8), CAshley::RollbackError);
+    }
+};
+
+#endif //__CASHLEY_ROLLBACKTESTS_H
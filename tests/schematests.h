@@ -0,0 +1,233 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_SCHEMATESTS_H
+#define __CASHLEY_SCHEMATESTS_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class SchemaTestSuite : public CxxTest::TestSuite {
+public:
+    enum class Team : unsigned char {
+        RED,
+        BLUE
+    };
+
+    class PositionComponent : public CAshley::Component {
+    public:
+        int x, y;
+        PositionComponent() : x(0), y(0) {}
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+        CASHLEY_SCHEMA(PositionComponent, "test.Position")
+        CASHLEY_FIELDS(PositionComponent) {
+            CASHLEY_FIELD(x);
+            CASHLEY_FIELD(y);
+        }
+    };
+
+    // Not block copyable, and without save() nor load(): saved by its schema.
+    class BodyComponent : public CAshley::Component {
+    public:
+        float speed;
+        int hits[3];
+        CAshley::EntityId target;
+        std::string label;
+        Team team;
+        bool alive;
+        BodyComponent() : speed(0), team(Team::RED), alive(false) {
+            hits[0] = hits[1] = hits[2] = 0;
+        }
+        CASHLEY_COMPONENT
+        CASHLEY_SCHEMA(BodyComponent, "test.Body")
+        CASHLEY_FIELDS(BodyComponent) {
+            CASHLEY_FIELD(speed);
+            CASHLEY_FIELD(hits);
+            CASHLEY_FIELD(target);
+            CASHLEY_FIELD(label);
+            CASHLEY_FIELD(team);
+            CASHLEY_FIELD(alive);
+        }
+    };
+
+    class FrozenTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(FrozenTag)
+        CASHLEY_SCHEMA(FrozenTag, "test.Frozen")
+    };
+
+    class PlainComponent : public CAshley::Component {
+    public:
+        int value;
+        CASHLEY_COMPONENT
+    };
+
+    class ImpostorComponent : public CAshley::Component {
+    public:
+        int z;
+        CASHLEY_COMPONENT
+        CASHLEY_SCHEMA(ImpostorComponent, "test.Position")
+        CASHLEY_FIELDS(ImpostorComponent) {
+            CASHLEY_FIELD(z);
+        }
+    };
+
+    void test_schema_fields(void) {
+        const CAshley::ComponentSchema & s = CAshley::component_schema<BodyComponent>();
+        TS_ASSERT_EQUALS(s.name, "test.Body");
+        TS_ASSERT_EQUALS(s.size, sizeof(BodyComponent));
+        TS_ASSERT_EQUALS(s.alignment, alignof(BodyComponent));
+        TS_ASSERT(s.described);
+        TS_ASSERT(!s.block_copyable);
+        TS_ASSERT(!s.tag);
+        TS_ASSERT_EQUALS(s.fields.size(), 6u);
+        BodyComponent b;
+        const char * base = (const char *)&b;
+        TS_ASSERT_EQUALS(s.fields[0].name, "speed");
+        TS_ASSERT_EQUALS(s.fields[0].type, CAshley::FIELD_FLOAT);
+        TS_ASSERT_EQUALS(s.fields[0].offset, (size_t)((const char *)&b.speed - base));
+        TS_ASSERT_EQUALS(s.fields[1].type, CAshley::FIELD_INT32);
+        TS_ASSERT_EQUALS(s.fields[1].count, 3u);
+        TS_ASSERT_EQUALS(s.fields[1].size, sizeof(int));
+        TS_ASSERT_EQUALS(s.fields[1].offset, (size_t)((const char *)b.hits - base));
+        TS_ASSERT_EQUALS(s.fields[2].type, CAshley::FIELD_ENTITY);
+        TS_ASSERT_EQUALS(s.fields[3].type, CAshley::FIELD_STRING);
+        TS_ASSERT_EQUALS(s.fields[3].offset, (size_t)((const char *)&b.label - base));
+        TS_ASSERT_EQUALS(s.fields[4].type, CAshley::FIELD_UINT8);
+        TS_ASSERT_EQUALS(s.fields[5].type, CAshley::FIELD_BOOL);
+        TS_ASSERT_EQUALS(s.find("label"), 3u);
+        TS_ASSERT_EQUALS(s.find("mana"), FIELD_NONE);
+
+        *s.get<float>(&b, 0) = 2.5f;
+        s.get<int>(&b, 1)[2] = 7;
+        TS_ASSERT_EQUALS(b.speed, 2.5f);
+        TS_ASSERT_EQUALS(b.hits[2], 7);
+        TS_ASSERT_THROWS(s.get<int>(&b, 0), CAshley::ComponentError);
+        TS_ASSERT_THROWS(s.get<float>(&b, 9), CAshley::ComponentError);
+
+        const CAshley::ComponentSchema & tag = CAshley::component_schema<FrozenTag>();
+        TS_ASSERT(tag.tag);
+        TS_ASSERT(tag.fields.empty());
+        const CAshley::ComponentSchema & plain = CAshley::component_schema<PlainComponent>();
+        TS_ASSERT(!plain.described);
+        TS_ASSERT(plain.fields.empty());
+        TS_ASSERT_EQUALS(plain.name, PlainComponent().get_name());
+
+        TS_ASSERT_EQUALS(CAshley::SchemaRegistry::find("test.Body"), &s);
+        TS_ASSERT(CAshley::SchemaRegistry::find("test.Nothing") == NULL);
+        TS_ASSERT(CAshley::component_schema<PositionComponent>().hash != s.hash);
+    }
+
+    void test_schema_names(void) {
+        TS_ASSERT_EQUALS(PositionComponent().get_name(), "test.Position");
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(3);
+        engine.add_component<FrozenTag>(ids[1]);
+        engine.get_component<PositionComponent>(ids[2])->x = 4;
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        f.exclude<FrozenTag>();
+        TS_ASSERT_EQUALS(engine.get_ids_for(f).size(), 2u);
+
+        CAshley::Component * c = engine.get_component("test.Position", ids[2]);
+        TS_ASSERT_EQUALS(c, engine.get_component<PositionComponent>(ids[2]));
+        const CAshley::ComponentSchema * s = CAshley::SchemaRegistry::find("test.Position");
+        TS_ASSERT_EQUALS(*s->get<int>(c, s->find("x")), 4);
+        TS_ASSERT(engine.get_component("test.Frozen", ids[1]) != NULL);
+        TS_ASSERT_THROWS(engine.get_component("test.Frozen", ids[0]), CAshley::ComponentError);
+        TS_ASSERT_THROWS(engine.get_component("test.Nothing", ids[0]), CAshley::ComponentError);
+
+        std::vector<const CAshley::ComponentSchema *> schemas = engine.get_schemas();
+        TS_ASSERT_EQUALS(schemas.size(), 2u);
+        TS_ASSERT(std::find(schemas.begin(), schemas.end(), s) != schemas.end());
+
+        // A name can only be taken by one component type.
+        TS_ASSERT_THROWS(engine.register_component<ImpostorComponent>(), CAshley::ComponentError);
+        TS_ASSERT_EQUALS(engine.get_schemas().size(), 2u);
+        TS_ASSERT_EQUALS(engine.get_component<PositionComponent>(ids[2])->x, 4);
+    }
+
+    void test_schema_diff(void) {
+        const CAshley::ComponentSchema & s = CAshley::component_schema<BodyComponent>();
+        BodyComponent a, b;
+        a.label = "a label longer than the small string buffer";
+        b.label = a.label;
+        TS_ASSERT(s.equal(&a, &b));
+        b.hits[1] = 3;
+        b.team = Team::BLUE;
+        b.label += "!";
+        std::vector<unsigned int> changed;
+        TS_ASSERT_EQUALS(s.diff(&a, &b, changed), 3u);
+        TS_ASSERT_EQUALS(changed[0], 1u);
+        TS_ASSERT_EQUALS(changed[1], 3u);
+        TS_ASSERT_EQUALS(changed[2], 4u);
+        for (unsigned int i = 0; i < changed.size(); i++) {
+            s.copy(&a, &b, changed[i]);
+        }
+        TS_ASSERT(s.equal(&a, &b));
+        TS_ASSERT_EQUALS(a.label, b.label);
+
+        PositionComponent p;
+        p.x = 1;
+        p.y = -2;
+        TS_ASSERT_EQUALS(CAshley::component_schema<PositionComponent>().to_string(&p), "test.Position{x=1, y=-2}");
+        a.target = CAshley::EntityId(5, 1);
+        a.alive = true;
+        TS_ASSERT_EQUALS(s.to_string(&a), "test.Body{speed=0, hits=[0, 3, 0], target=5:1, label=\"" + b.label + "\", team=1, alive=true}");
+    }
+
+    void test_schema_snapshot(void) {
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent, BodyComponent>(40);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = i;
+            BodyComponent * b = engine.get_component<BodyComponent>(ids[i]);
+            b->speed = i * 0.5f;
+            b->hits[i % 3] = i;
+            b->target = ids[(i + 1) % ids.size()];
+            b->label = std::string(i, 'a');
+            b->alive = i % 2;
+        }
+        engine.add_component<FrozenTag>(ids[3]);
+        std::vector<char> out;
+        engine.save_snapshot(out);
+        // Types are recorded by their stable names.
+        std::string name = "test.Body";
+        TS_ASSERT(std::search(out.begin(), out.end(), name.begin(), name.end()) != out.end());
+
+        CAshley::Engine loaded;
+        loaded.register_component<BodyComponent>();
+        loaded.register_component<FrozenTag>();
+        loaded.register_component<PositionComponent>();
+        loaded.load_snapshot(out.data(), out.size());
+        const CAshley::ComponentSchema & s = CAshley::component_schema<BodyComponent>();
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            TS_ASSERT(s.equal(loaded.get_component<BodyComponent>(ids[i]), engine.get_component<BodyComponent>(ids[i])));
+            TS_ASSERT_EQUALS(loaded.get_component<PositionComponent>(ids[i])->x, (int)i);
+        }
+        TS_ASSERT(loaded.has_component<FrozenTag>(ids[3]));
+    }
+};
+
+#endif //__CASHLEY_SCHEMATESTS_H
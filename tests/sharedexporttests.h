@@ -0,0 +1,161 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_SHAREDEXPORTTESTS_H
+#define __CASHLEY_SHAREDEXPORTTESTS_H
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class SharedExportTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        float x, y;
+        PositionComponent() : x(0), y(0) {}
+        void init() { x = y = 0; }
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+        CASHLEY_SCHEMA(PositionComponent, "export.Position")
+        CASHLEY_FIELDS(PositionComponent) {
+            CASHLEY_FIELD(x);
+            CASHLEY_FIELD(y);
+        }
+    };
+
+    // Sets both fields of every position to the tick.
+    class CounterProcessor : public CAshley::Processor {
+    public:
+        virtual void run_tick(unsigned int delay) {
+            UNREFERENCED_PARAMETER(delay);
+            CAshley::Family f;
+            f.filter<PositionComponent>();
+            CAshley::EntityIdArray ids = _engine->get_ids_for(f);
+            for (unsigned int i = 0; i < ids.size(); i++) {
+                PositionComponent * p = _engine->get_component<PositionComponent>(ids[i]);
+                p->x += 1;
+                p->y = p->x;
+            }
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    static float field(const CAshley::SharedExportReader & reader, unsigned int type, unsigned int block, const char * name) {
+        const CAshley::ExportType * t = reader.get_type(type);
+        for (unsigned int f = 0; f < t->field_count; f++) {
+            if (!strcmp(t->fields[f].name, name)) {
+                float v;
+                memcpy(&v, reader.get_blocks(type) + (size_t)block * t->block_size + t->fields[f].offset, sizeof(v));
+                return v;
+            }
+        }
+        return -1;
+    }
+
+    void test_export_layout(void) {
+        CAshley::Engine engine;
+        engine.extract<PositionComponent>();
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(3);
+        engine.spawn_n<PositionComponent>(1, false);
+        for (unsigned int i = 0; i < 3; i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = (float)i;
+        }
+        engine.start_export("/cashley-export-test", 2);
+        TS_ASSERT_THROWS(engine.start_export("/cashley-export-test"), CAshley::CAshleyError);
+        engine.run_tick(5);
+        CAshley::SharedExportReader reader("/cashley-export-test");
+        const CAshley::ExportHeader * h = reader.get_header();
+        TS_ASSERT_EQUALS(h->type_count, 1u);
+        TS_ASSERT_EQUALS(h->tick, 1u);
+        TS_ASSERT_EQUALS(h->clock, 5u);
+        TS_ASSERT_EQUALS(h->entities, 4u);
+        TS_ASSERT_EQUALS(h->sequence.load() % 2, 0u);
+        unsigned int type = reader.find_type("export.Position");
+        TS_ASSERT_EQUALS(type, 0u);
+        TS_ASSERT_EQUALS(reader.find_type("export.Unknown"), FIELD_NONE);
+        const CAshley::ExportType * t = reader.get_type(type);
+        TS_ASSERT_EQUALS(t->block_size, sizeof(PositionComponent));
+        TS_ASSERT_EQUALS(t->field_count, 2u);
+        TS_ASSERT_EQUALS(t->fields[0].type, (unsigned int)CAshley::FIELD_FLOAT);
+        // Active components only, up to the capacity.
+        TS_ASSERT_EQUALS(t->active, 3u);
+        TS_ASSERT_EQUALS(t->count, 2u);
+        TS_ASSERT_EQUALS(t->offset % EXPORT_ALIGNMENT, 0u);
+        float sum = field(reader, type, 0, "x") + field(reader, type, 1, "x");
+        TS_ASSERT(sum == 1 || sum == 2 || sum == 3);
+        // Changes are seen on the next publish.
+        engine.despawn(CAshley::Span<const CAshley::EntityId>(&ids[0], 3));
+        TS_ASSERT_EQUALS(t->active, 3u);
+        engine.publish_export();
+        TS_ASSERT_EQUALS(t->active, 0u);
+        TS_ASSERT_EQUALS(h->entities, 1u);
+        TS_ASSERT_EQUALS(reader.get_type(type)->count, 0u);
+        TS_ASSERT_THROWS(reader.get_type(1), CAshley::ExportError);
+        engine.stop_export();
+        TS_ASSERT_THROWS(CAshley::SharedExportReader("/cashley-export-test"), CAshley::ExportError);
+    }
+
+    void test_export_concurrent_reader(void) {
+        CAshley::Engine engine;
+        engine.extract<PositionComponent>();
+        engine.spawn_n<PositionComponent>(200);
+        engine.add_processor<CounterProcessor>();
+        engine.get_processor<CounterProcessor>()->activate();
+        engine.start_export("/cashley-export-race");
+        CAshley::SharedExportReader reader("/cashley-export-race");
+        std::atomic<bool> done(false);
+        unsigned int torn = 0;
+        std::atomic<unsigned int> reads(0);
+        std::thread t([&]() {
+            std::vector<char> copy;
+            while (!done) {
+                unsigned long long seq;
+                unsigned long long tick;
+                do {
+                    seq = reader.read_begin();
+                    tick = reader.get_header()->tick;
+                    const CAshley::ExportType * type = reader.get_type(0);
+                    copy.assign(reader.get_blocks(0), reader.get_blocks(0) + (size_t)type->count * type->block_size);
+                } while (reader.read_retry(seq));
+                // A consistent read sees every component of the same tick.
+                const PositionComponent * p = reinterpret_cast<const PositionComponent *>(copy.data());
+                for (unsigned int i = 0; i < copy.size() / sizeof(PositionComponent); i++) {
+                    torn += p[i].x != (float)tick || p[i].y != (float)tick;
+                }
+                reads++;
+            }
+        });
+        // Ticks until the reader got some reads in.
+        for (unsigned int i = 0; i < 1000 || reads < 10; i++) {
+            engine.run_tick(1);
+        }
+        done = true;
+        t.join();
+        TS_ASSERT_EQUALS(torn, 0u);
+        TS_ASSERT(reads >= 10u);
+        engine.stop_export();
+    }
+};
+
+#endif //__CASHLEY_SHAREDEXPORTTESTS_H
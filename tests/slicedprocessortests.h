@@ -0,0 +1,154 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_SLICEDPROCESSORTESTS_H
+#define __CASHLEY_SLICEDPROCESSORTESTS_H
+
+#include <map>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class SlicedProcessorTestSuite : public CxxTest::TestSuite {
+public:
+    class TestComponent : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+        void init() {
+            add_component<TestComponent>();
+        }
+    };
+
+    class TestProcessor : public CAshley::SlicedProcessor {
+    public:
+        unsigned int processed;
+        std::map<CAshley::Entity *, unsigned int> visits;
+        std::map<CAshley::Entity *, unsigned int> delays;
+        TestProcessor() : processed(0) {
+            CAshley::Family f;
+            f.filter<TestComponent>();
+            set_family(f);
+        }
+        virtual void process_entity(CAshley::Entity * e, unsigned int delay) {
+            processed++;
+            visits[e]++;
+            delays[e] = delay;
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    CAshley::Engine * engine;
+    TestProcessor * processor;
+    std::vector<CAshley::Entity *> entities;
+
+    void setUp() {
+        engine = new CAshley::Engine;
+        engine->add_processor<TestProcessor>();
+        processor = engine->get_processor<TestProcessor>();
+        processor->activate();
+        for (unsigned int i = 0; i < 10; i++) {
+            entities.push_back(new TestEntity);
+            engine->add_entity(entities.back());
+            entities.back()->activate();
+        }
+    }
+
+    void tearDown() {
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            delete entities[i];
+        }
+        entities.clear();
+        delete engine;
+    }
+
+    void test_slicedprocessor_no_budget(void) {
+        engine->run_tick(1);
+        TS_ASSERT(processor->processed == 10);
+        TS_ASSERT(processor->get_passes() == 1);
+    }
+
+    void test_slicedprocessor_entity_budget(void) {
+        processor->set_entity_budget(5);
+        engine->run_tick(2);
+        TS_ASSERT(processor->processed == 5);
+        TS_ASSERT(processor->get_passes() == 0);
+        engine->run_tick(2);
+        TS_ASSERT(processor->processed == 10);
+        TS_ASSERT(processor->get_passes() == 1);
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            TS_ASSERT(processor->visits[entities[i]] == 1);
+        }
+        engine->run_tick(2);
+        engine->run_tick(2);
+        TS_ASSERT(processor->get_passes() == 2);
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            TS_ASSERT(processor->visits[entities[i]] == 2);
+            TS_ASSERT(processor->delays[entities[i]] == 4);
+        }
+    }
+
+    void test_slicedprocessor_uneven_budget(void) {
+        // Slices go on with the next pass, so every tick does the same work.
+        processor->set_entity_budget(3);
+        for (unsigned int i = 0; i < 10; i++) {
+            engine->run_tick(1);
+            TS_ASSERT(processor->processed == 3 * (i + 1));
+        }
+        TS_ASSERT(processor->get_passes() == 3);
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            TS_ASSERT(processor->visits[entities[i]] == 3);
+        }
+    }
+
+    void test_slicedprocessor_changing_set(void) {
+        processor->set_entity_budget(4);
+        engine->run_tick(1);
+        // Remove some entities and add others in the middle of a pass.
+        delete entities[0];
+        delete entities[9];
+        entities.erase(entities.begin() + 9);
+        entities.erase(entities.begin());
+        for (unsigned int i = 0; i < 4; i++) {
+            entities.push_back(new TestEntity);
+            engine->add_entity(entities.back());
+            entities.back()->activate();
+        }
+        // 12 entities, budget 4: everyone visited within 3 + 1 ticks.
+        for (unsigned int i = 0; i < 4; i++) {
+            engine->run_tick(1);
+        }
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            TS_ASSERT(processor->visits[entities[i]] >= 1);
+        }
+    }
+
+    void test_slicedprocessor_time_budget(void) {
+        processor->set_time_budget(1000000, 2);
+        engine->run_tick(1);
+        TS_ASSERT(processor->processed == 10);
+        processor->set_time_budget(0, 2);
+        TS_ASSERT_THROWS(processor->set_time_budget(10, 0), CAshley::ProcessorError);
+    }
+};
+
+#endif //__CASHLEY_SLICEDPROCESSORTESTS_H
@@ -0,0 +1,375 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_SNAPSHOTTESTS_H
+#define __CASHLEY_SNAPSHOTTESTS_H
+
+#include <cstdio>
+#include <string>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class SnapshotTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        int x, y;
+        PositionComponent() : x(0), y(0) {}
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+    };
+
+    class NameComponent : public CAshley::Component {
+    public:
+        std::string name;
+        void save(CAshley::SnapshotWriter & w) { w.write_string(name); }
+        void load(CAshley::SnapshotReader & r) { name = r.read_string(); }
+        CASHLEY_COMPONENT
+    };
+
+    class OpaqueComponent : public CAshley::Component {
+    public:
+        std::string data;
+        CASHLEY_COMPONENT
+    };
+
+    class EnemyTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(EnemyTag)
+    };
+
+    class MeshComponent : public CAshley::Component {
+    public:
+        int mesh;
+        MeshComponent() : mesh(0) {}
+        MeshComponent(int m) : mesh(m) {}
+        bool operator==(const MeshComponent & o) const { return mesh == o.mesh; }
+        CASHLEY_COMPONENT
+        CASHLEY_SHARED(MeshComponent)
+        CASHLEY_BLOCK_COPYABLE(MeshComponent)
+        CASHLEY_FIELDS(MeshComponent) {
+            CASHLEY_FIELD(mesh);
+        }
+    };
+
+    class AnchorComponent : public CAshley::Component {
+    public:
+        int anchor;
+        AnchorComponent() : anchor(0) {}
+        CASHLEY_COMPONENT
+        CASHLEY_STABLE(AnchorComponent)
+        CASHLEY_BLOCK_COPYABLE(AnchorComponent)
+    };
+
+    class VersionedComponent : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_LAYOUT_VERSION(3)
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+    };
+
+    void register_components(CAshley::Engine & engine) {
+        engine.register_component<PositionComponent>();
+        engine.register_component<NameComponent>();
+        engine.register_component<EnemyTag>();
+        engine.register_component<MeshComponent>();
+        engine.register_component<AnchorComponent>();
+    }
+
+    void test_snapshot_round_trip(void) {
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent, AnchorComponent>(1000);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = i;
+            engine.get_component<AnchorComponent>(ids[i])->anchor = 2 * i;
+        }
+        engine.despawn(CAshley::Span<const CAshley::EntityId>(&ids[100], 100));
+        engine.deactivate(CAshley::Span<const CAshley::EntityId>(&ids[200], 50));
+        CAshley::EntityId named = engine.create_entity();
+        engine.add_component<NameComponent>(named)->name = "boss";
+        engine.add_component<EnemyTag>(named);
+        engine.set_shared(named, MeshComponent(4));
+        engine.set_shared(ids[0], MeshComponent(4));
+        engine.set_parent(named, ids[0]);
+        TestEntity * e = new TestEntity;
+        engine.add_entity(e);
+        e->add_component<PositionComponent>();
+        e->get_component<PositionComponent>()->y = 9;
+        e->activate();
+        CAshley::EntityId wrapped = e->get_id();
+        engine.run_tick(5);
+        std::vector<char> data;
+        engine.save_snapshot(data);
+
+        CAshley::Engine loaded;
+        register_components(loaded);
+        loaded.load_snapshot(data.data(), data.size());
+        TS_ASSERT_EQUALS(loaded.get_entity_count(), engine.get_entity_count());
+        TS_ASSERT_EQUALS(loaded.get_clock(), 5u);
+        TS_ASSERT_EQUALS(loaded.get_tick(), 1u);
+        TS_ASSERT(!loaded.is_alive(ids[100]));
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            if (i >= 100 && i < 200) {
+                continue;
+            }
+            TS_ASSERT_EQUALS(loaded.get_component<PositionComponent>(ids[i])->x, (int)i);
+            TS_ASSERT_EQUALS(loaded.get_component<AnchorComponent>(ids[i])->anchor, (int)(2 * i));
+            TS_ASSERT_EQUALS(loaded.is_active(ids[i]), i < 200 || i >= 250);
+        }
+        TS_ASSERT(loaded.get_component<PositionComponent>(ids[0])->get_owner() == NULL);
+        TS_ASSERT_EQUALS(loaded.get_component<NameComponent>(named)->name, "boss");
+        TS_ASSERT(loaded.has_component<EnemyTag>(named));
+        TS_ASSERT(!loaded.has_component<EnemyTag>(ids[0]));
+        TS_ASSERT_EQUALS(loaded.get_shared_count<MeshComponent>(), 1u);
+        TS_ASSERT(loaded.get_component<MeshComponent>(named) == loaded.get_component<MeshComponent>(ids[0]));
+        // Loaded values are found again.
+        loaded.set_shared(ids[1], MeshComponent(4));
+        TS_ASSERT_EQUALS(loaded.get_shared_count<MeshComponent>(), 1u);
+        TS_ASSERT(loaded.get_parent(named) == ids[0]);
+        // Entity objects come back as plain entities.
+        TS_ASSERT(loaded.get_entity(wrapped) == NULL);
+        TS_ASSERT_EQUALS(loaded.get_component<PositionComponent>(wrapped)->y, 9);
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        TS_ASSERT_EQUALS(loaded.get_ids_for(f).size(), engine.get_ids_for(f).size());
+        // The loaded world keeps working.
+        loaded.despawn(CAshley::Span<const CAshley::EntityId>(&ids[0], 10));
+        TS_ASSERT(!loaded.is_alive(named));
+        std::vector<CAshley::EntityId> more = loaded.spawn_n<PositionComponent>(10);
+        TS_ASSERT_EQUALS(loaded.get_entity_count(), engine.get_entity_count() - 1);
+        TS_ASSERT(loaded.has_component<PositionComponent>(more[9]));
+        TS_ASSERT_EQUALS(loaded.get_component<PositionComponent>(ids[500])->x, 500);
+        delete e;
+    }
+
+    void test_snapshot_file(void) {
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(10);
+        engine.get_component<PositionComponent>(ids[3])->y = 33;
+        std::string path = "cashley_snapshot_test.bin";
+        engine.save_snapshot(path);
+        CAshley::Engine loaded;
+        register_components(loaded);
+        loaded.load_snapshot(path);
+        std::remove(path.c_str());
+        TS_ASSERT_EQUALS(loaded.get_component<PositionComponent>(ids[3])->y, 33);
+        TS_ASSERT_THROWS(loaded.load_snapshot(path), CAshley::SnapshotError);
+    }
+
+    void test_snapshot_mapped(void) {
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent, AnchorComponent>(5000);
+        for (unsigned int i = 0; i < ids.size(); i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = i;
+        }
+        engine.add_component<NameComponent>(ids[7])->name = "seven";
+        std::string path = "cashley_snapshot_mapped.bin";
+        engine.save_snapshot(path);
+        {
+            CAshley::Engine mapped;
+            register_components(mapped);
+            mapped.map_snapshot(path, true);
+            TS_ASSERT_EQUALS(mapped.get_entity_count(), 5000u);
+            TS_ASSERT_EQUALS(mapped.get_component<PositionComponent>(ids[4999])->x, 4999);
+            TS_ASSERT_EQUALS(mapped.get_component<NameComponent>(ids[7])->name, "seven");
+            // Writes stay in memory, and the cache leaves the mapping when it grows.
+            mapped.get_component<PositionComponent>(ids[1])->x = -1;
+            mapped.spawn_n<PositionComponent>(100);
+            TS_ASSERT_EQUALS(mapped.get_component<PositionComponent>(ids[1])->x, -1);
+            TS_ASSERT_EQUALS(mapped.get_component<PositionComponent>(ids[2])->x, 2);
+            mapped.despawn(CAshley::Span<const CAshley::EntityId>(&ids[0], 10));
+        }
+        CAshley::Engine loaded;
+        register_components(loaded);
+        loaded.load_snapshot(path);
+        std::remove(path.c_str());
+        TS_ASSERT_EQUALS(loaded.get_component<PositionComponent>(ids[1])->x, 1);
+    }
+
+    void test_snapshot_mapped_cache(void) {
+        CAshley::Cache<unsigned int> cache(4, true);
+        unsigned int b[4];
+        cache.block_alloc_n(4, b, true);
+        for (unsigned int i = 0; i < 4; i++) {
+            *cache.get_block(b[i]) = 10 + i;
+        }
+        cache.block_free(b[1]);
+        std::vector<char> data;
+        CAshley::SnapshotWriter w(data);
+        cache.save(w);
+        w.finish();
+        std::string path = "cashley_snapshot_cache.bin";
+        FILE * f = fopen(path.c_str(), "wb");
+        fwrite(data.data(), 1, data.size(), f);
+        fclose(f);
+        CAshley::SnapshotMapping m(path);
+        std::remove(path.c_str());
+        CAshley::SnapshotReader r(m.data(), m.size(), true);
+        CAshley::Cache<unsigned int> loaded(1, true);
+        loaded.load(r);
+        TS_ASSERT(loaded._mapped);
+        TS_ASSERT_EQUALS(loaded._allocated, 3u);
+        TS_ASSERT_EQUALS(loaded._active, 3u);
+        TS_ASSERT(loaded.get_block(b[0]) >= (unsigned int *)m.data() && loaded.get_block(b[0]) < (unsigned int *)(m.data() + m.size()));
+        TS_ASSERT_EQUALS(*loaded.get_block(b[3]), 13u);
+        TS_ASSERT_EQUALS(loaded.block_alloc(), b[1]);
+        TS_ASSERT(!loaded._mapped);
+        TS_ASSERT_EQUALS(*loaded.get_block(b[2]), 12u);
+        TS_ASSERT_THROWS(loaded.get_block(7), CAshley::CacheError);
+    }
+
+    void test_snapshot_checksums(void) {
+        CAshley::Engine engine;
+        engine.spawn_n<PositionComponent>(100);
+        std::vector<char> data;
+        engine.save_snapshot(data);
+        // The first blob starts after the header.
+        data[SNAPSHOT_ALIGNMENT + 20] ^= 1;
+        CAshley::Engine loaded;
+        register_components(loaded);
+        TS_ASSERT_THROWS(loaded.load_snapshot(data.data(), data.size()), CAshley::SnapshotError);
+        data[SNAPSHOT_ALIGNMENT + 20] ^= 1;
+        data[data.size() - 1] ^= 1;
+        TS_ASSERT_THROWS(loaded.load_snapshot(data.data(), data.size()), CAshley::SnapshotError);
+        TS_ASSERT_EQUALS(loaded.get_entity_count(), 0u);
+        TS_ASSERT_EQUALS(CAshley::layout_version<PositionComponent>::value, 0u);
+        TS_ASSERT_EQUALS(CAshley::layout_version<VersionedComponent>::value, 3u);
+    }
+
+    void test_snapshot_deltas(void) {
+        CAshley::Engine engine;
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent, AnchorComponent>(1000);
+        CAshley::EntityId named = engine.create_entity();
+        engine.add_component<NameComponent>(named)->name = "boss";
+        engine.add_component<EnemyTag>(named);
+        std::vector<char> base;
+        engine.save_snapshot(base);
+        engine.track_changes();
+
+        engine.get_component<PositionComponent>(ids[5])->x = 55;
+        engine.mark_changed<PositionComponent>(ids[5]);
+        engine.despawn(CAshley::Span<const CAshley::EntityId>(&ids[10], 10));
+        std::vector<CAshley::EntityId> spawned = engine.spawn_n<PositionComponent>(5);
+        engine.remove_component<PositionComponent>(ids[30]);
+        engine.remove_component<AnchorComponent>(ids[31]);
+        engine.set_shared(ids[32], MeshComponent(7));
+        engine.add_component<EnemyTag>(ids[33]);
+        engine.deactivate(ids[34]);
+        engine.set_parent(ids[35], ids[36]);
+        engine.run_tick(5);
+        std::vector<char> first;
+        engine.save_delta(first);
+
+        engine.remove_component<EnemyTag>(named);
+        engine.get_component<NameComponent>(named)->name = "ghost";
+        engine.mark_changed<NameComponent>(named);
+        engine.destroy_entity(engine.create_entity());
+        engine.despawn(CAshley::Span<const CAshley::EntityId>(&spawned[0], 1));
+        engine.run_tick(3);
+        std::vector<char> second;
+        engine.save_delta(second);
+        // Only the changes are written.
+        TS_ASSERT_LESS_THAN(second.size(), 1024u);
+
+        CAshley::Engine loaded;
+        register_components(loaded);
+        loaded.load_snapshot(base.data(), base.size());
+        TS_ASSERT_THROWS(loaded.apply_delta(second.data(), second.size()), CAshley::SnapshotError);
+        loaded.apply_delta(first.data(), first.size());
+        TS_ASSERT_EQUALS(loaded.get_tick(), 1u);
+        TS_ASSERT_EQUALS(loaded.get_clock(), 5u);
+        TS_ASSERT_EQUALS(loaded.get_component<PositionComponent>(ids[5])->x, 55);
+        TS_ASSERT(!loaded.is_alive(ids[10]));
+        for (unsigned int i = 0; i < spawned.size(); i++) {
+            TS_ASSERT(loaded.has_component<PositionComponent>(spawned[i]));
+            TS_ASSERT(!loaded.has_component<AnchorComponent>(spawned[i]));
+        }
+        TS_ASSERT(!loaded.has_component<PositionComponent>(ids[30]));
+        TS_ASSERT(!loaded.has_component<AnchorComponent>(ids[31]));
+        TS_ASSERT_EQUALS(loaded.get_component<MeshComponent>(ids[32])->mesh, 7);
+        TS_ASSERT(loaded.has_component<EnemyTag>(ids[33]));
+        TS_ASSERT(!loaded.is_active(ids[34]));
+        TS_ASSERT(loaded.get_parent(ids[35]) == ids[36]);
+        TS_ASSERT(loaded.has_component<EnemyTag>(named));
+
+        loaded.apply_delta(second.data(), second.size());
+        TS_ASSERT_EQUALS(loaded.get_tick(), 2u);
+        TS_ASSERT_EQUALS(loaded.get_entity_count(), engine.get_entity_count());
+        TS_ASSERT(!loaded.has_component<EnemyTag>(named));
+        TS_ASSERT_EQUALS(loaded.get_component<NameComponent>(named)->name, "ghost");
+        TS_ASSERT(!loaded.is_alive(spawned[0]));
+        TS_ASSERT(loaded.is_alive(spawned[1]));
+        CAshley::Family f;
+        f.filter<PositionComponent>();
+        TS_ASSERT_EQUALS(loaded.get_ids_for(f).size(), engine.get_ids_for(f).size());
+        // The rebuilt world keeps working.
+        std::vector<CAshley::EntityId> more = loaded.spawn_n<PositionComponent>(20);
+        TS_ASSERT_EQUALS(loaded.get_entity_count(), engine.get_entity_count() + 20);
+        TS_ASSERT(loaded.has_component<PositionComponent>(more[19]));
+    }
+
+    void test_snapshot_delta_errors(void) {
+        CAshley::Engine engine;
+        engine.spawn_n<PositionComponent>(10);
+        std::vector<char> data;
+        TS_ASSERT_THROWS(engine.save_delta(data), CAshley::SnapshotError);
+        engine.save_snapshot(data);
+        CAshley::Engine loaded;
+        register_components(loaded);
+        // A snapshot is not a delta.
+        TS_ASSERT_THROWS(loaded.apply_delta(data.data(), data.size()), CAshley::SnapshotError);
+        engine.track_changes();
+        engine.run_tick(1);
+        engine.track_changes(false);
+        TS_ASSERT_THROWS(engine.save_delta(data), CAshley::SnapshotError);
+    }
+
+    void test_snapshot_errors(void) {
+        CAshley::Engine engine;
+        engine.spawn_n<PositionComponent>(10);
+        std::vector<char> data;
+        engine.save_snapshot(data);
+        CAshley::Engine unknown;
+        TS_ASSERT_THROWS(unknown.load_snapshot(data.data(), data.size()), CAshley::SnapshotError);
+        TS_ASSERT_EQUALS(unknown.get_entity_count(), 0u);
+        CAshley::Engine truncated;
+        register_components(truncated);
+        TS_ASSERT_THROWS(truncated.load_snapshot(data.data(), data.size() - 8), CAshley::SnapshotError);
+        CAshley::Engine used;
+        register_components(used);
+        used.create_entity();
+        TS_ASSERT_THROWS(used.load_snapshot(data.data(), data.size()), CAshley::SnapshotError);
+        data[0] = 'X';
+        CAshley::Engine bad;
+        register_components(bad);
+        TS_ASSERT_THROWS(bad.load_snapshot(data.data(), data.size()), CAshley::SnapshotError);
+        // Components neither block copyable nor with a save() can not be saved.
+        CAshley::Engine opaque;
+        opaque.add_component<OpaqueComponent>(opaque.create_entity());
+        data.clear();
+        TS_ASSERT_THROWS(opaque.save_snapshot(data), CAshley::SnapshotError);
+    }
+};
+
+#endif //__CASHLEY_SNAPSHOTTESTS_H
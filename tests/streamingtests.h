@@ -0,0 +1,209 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_STREAMINGTESTS_H
+#define __CASHLEY_STREAMINGTESTS_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class StreamingTestSuite : public CxxTest::TestSuite {
+public:
+    class PositionComponent : public CAshley::Component {
+    public:
+        float x, y;
+        PositionComponent() : x(0), y(0) {}
+        void init() { x = y = 0; }
+        CASHLEY_COMPONENT
+        CASHLEY_BLOCK_COPYABLE(PositionComponent)
+        CASHLEY_SCHEMA(PositionComponent, "streaming.Position")
+    };
+
+    class FollowComponent : public CAshley::Component {
+    public:
+        CAshley::EntityId leader;
+        std::string name;
+        void init() { leader = CAshley::EntityId(); name.clear(); }
+        CASHLEY_COMPONENT
+        CASHLEY_STABLE(FollowComponent)
+        CASHLEY_SCHEMA(FollowComponent, "streaming.Follow")
+        CASHLEY_FIELDS(FollowComponent) {
+            CASHLEY_FIELD(leader);
+            CASHLEY_FIELD(name);
+        }
+    };
+
+    class SleepingTag : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+        CASHLEY_TAG(SleepingTag)
+        CASHLEY_SCHEMA(SleepingTag, "streaming.Sleeping")
+    };
+
+    void test_streaming_round_trip(void) {
+        CAshley::Engine engine;
+        engine.start_streaming(".");
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(3);
+        std::vector<CAshley::EntityId> followers = engine.spawn_n<PositionComponent, FollowComponent, SleepingTag>(2, false);
+        CAshley::EntityId outside = engine.spawn_n<PositionComponent>(1)[0];
+        for (unsigned int i = 0; i < 3; i++) {
+            engine.get_component<PositionComponent>(ids[i])->x = (float)i;
+        }
+        engine.get_component<FollowComponent>(followers[0])->leader = ids[2];
+        engine.get_component<FollowComponent>(followers[0])->name = "scout";
+        engine.get_component<FollowComponent>(followers[1])->leader = outside;
+        ids.insert(ids.end(), followers.begin(), followers.end());
+        engine.assign_region(7, CAshley::Span<const CAshley::EntityId>(&ids[0], ids.size()));
+        TS_ASSERT_EQUALS(engine.get_region_state(7), CAshley::REGION_LOADED);
+        engine.unload_region(7);
+        TS_ASSERT_EQUALS(engine.get_region_state(7), CAshley::REGION_UNLOADING);
+        TS_ASSERT(engine.is_alive(ids[0]));
+        engine.wait_regions();
+        TS_ASSERT_EQUALS(engine.get_region_state(7), CAshley::REGION_UNLOADED);
+        TS_ASSERT_EQUALS(engine.get_entity_count(), 1u);
+        TS_ASSERT(!engine.is_alive(ids[0]));
+        // The region is loaded at once.
+        engine.load_region(7);
+        TS_ASSERT_EQUALS(engine.get_region_state(7), CAshley::REGION_LOADING);
+        engine.wait_regions();
+        TS_ASSERT_EQUALS(engine.get_region_state(7), CAshley::REGION_LOADED);
+        std::vector<CAshley::EntityId> loaded = engine.get_region(7);
+        TS_ASSERT_EQUALS(loaded.size(), 5u);
+        TS_ASSERT_EQUALS(engine.get_entity_count(), 6u);
+        unsigned int sleeping = 0;
+        float sum = 0;
+        for (unsigned int i = 0; i < loaded.size(); i++) {
+            TS_ASSERT(engine.has_component<PositionComponent>(loaded[i]));
+            sum += engine.get_component<PositionComponent>(loaded[i])->x;
+            if (engine.has_component<SleepingTag>(loaded[i])) {
+                sleeping++;
+                TS_ASSERT(!engine.is_active(loaded[i]));
+                FollowComponent * f = engine.get_component<FollowComponent>(loaded[i]);
+                if (f->name == "scout") {
+                    // Moved with its region.
+                    TS_ASSERT(engine.is_alive(f->leader));
+                    TS_ASSERT_EQUALS(engine.get_component<PositionComponent>(f->leader)->x, 2);
+                } else {
+                    TS_ASSERT_EQUALS(f->leader, outside);
+                }
+            } else {
+                TS_ASSERT(engine.is_active(loaded[i]));
+            }
+        }
+        TS_ASSERT_EQUALS(sleeping, 2u);
+        TS_ASSERT_EQUALS(sum, 3);
+        engine.stop_streaming();
+        std::remove("./region-7.bin");
+    }
+
+    void test_streaming_budget(void) {
+        CAshley::Engine engine;
+        engine.start_streaming(".", REGION_BATCH);
+        std::vector<CAshley::EntityId> ids = engine.spawn_n<PositionComponent>(3 * REGION_BATCH);
+        engine.assign_region(1, CAshley::Span<const CAshley::EntityId>(&ids[0], ids.size()));
+        // One batch copied and despawned per tick.
+        engine.unload_region(1);
+        unsigned int ticks = 0;
+        while (engine.get_region_state(1) == CAshley::REGION_UNLOADING) {
+            engine.run_tick(1);
+            ticks++;
+            TS_ASSERT_EQUALS(engine.get_entity_count(), (3 - ticks) * REGION_BATCH);
+        }
+        TS_ASSERT_EQUALS(ticks, 3u);
+        TS_ASSERT_EQUALS(engine.get_region_state(1), CAshley::REGION_UNLOADED);
+        engine.load_region(1);
+        // Waits for the read, then one batch per tick, created with their components.
+        while (engine.get_region_state(1) == CAshley::REGION_LOADING && engine.get_entity_count() == 0) {
+            engine.run_tick(1);
+        }
+        ticks = 1;
+        TS_ASSERT_EQUALS(engine.get_entity_count(), REGION_BATCH);
+        std::vector<CAshley::EntityId> loaded = engine.get_region(1);
+        TS_ASSERT_EQUALS(loaded.size(), REGION_BATCH);
+        for (unsigned int i = 0; i < loaded.size(); i++) {
+            TS_ASSERT(engine.has_component<PositionComponent>(loaded[i]));
+        }
+        while (engine.get_region_state(1) == CAshley::REGION_LOADING) {
+            engine.run_tick(1);
+            ticks++;
+        }
+        TS_ASSERT_EQUALS(ticks, 3u);
+        TS_ASSERT_EQUALS(engine.get_entity_count(), 3 * REGION_BATCH);
+        loaded = engine.get_region(1);
+        TS_ASSERT_EQUALS(loaded.size(), 3 * REGION_BATCH);
+        TS_ASSERT(engine.has_component<PositionComponent>(loaded[3 * REGION_BATCH - 1]));
+        engine.stop_streaming();
+        std::remove("./region-1.bin");
+    }
+
+    void test_streaming_forward_links(void) {
+        CAshley::Engine engine;
+        engine.start_streaming(".", 1);
+        CAshley::EntityId leader = engine.spawn_n<PositionComponent>(1, false)[0];
+        CAshley::EntityId follower = engine.spawn_n<PositionComponent, FollowComponent>(1)[0];
+        engine.get_component<PositionComponent>(leader)->x = 5;
+        engine.get_component<FollowComponent>(follower)->leader = leader;
+        CAshley::EntityId ids[] = {leader, follower};
+        engine.assign_region(5, CAshley::Span<const CAshley::EntityId>(ids, 2));
+        engine.unload_region(5);
+        engine.wait_regions();
+        engine.load_region(5);
+        // Active entities come first: the leader is on a later batch.
+        while (engine.get_entity_count() == 0) {
+            engine.run_tick(1);
+        }
+        std::vector<CAshley::EntityId> loaded = engine.get_region(5);
+        TS_ASSERT_EQUALS(loaded.size(), 1u);
+        TS_ASSERT(engine.get_component<FollowComponent>(loaded[0])->leader.is_null());
+        engine.run_tick(1);
+        TS_ASSERT_EQUALS(engine.get_region_state(5), CAshley::REGION_LOADED);
+        loaded = engine.get_region(5);
+        TS_ASSERT_EQUALS(loaded.size(), 2u);
+        CAshley::EntityId found = engine.get_component<FollowComponent>(loaded[0])->leader;
+        TS_ASSERT(found == loaded[1]);
+        TS_ASSERT_EQUALS(engine.get_component<PositionComponent>(found)->x, 5);
+        engine.stop_streaming();
+        std::remove("./region-5.bin");
+    }
+
+    void test_streaming_errors(void) {
+        CAshley::Engine engine;
+        TS_ASSERT_THROWS(engine.load_region(3), CAshley::StreamingError);
+        engine.start_streaming(".");
+        TS_ASSERT_THROWS(engine.start_streaming("."), CAshley::StreamingError);
+        TS_ASSERT_THROWS(engine.unload_region(3), CAshley::StreamingError);
+        CAshley::Entity * e = new CAshley::Entity;
+        engine.add_entity(e);
+        CAshley::EntityId id = e->get_id();
+        TS_ASSERT_THROWS(engine.assign_region(3, CAshley::Span<const CAshley::EntityId>(&id, 1)), CAshley::StreamingError);
+        std::remove("./region-3.bin");
+        engine.load_region(3);
+        TS_ASSERT_THROWS(engine.load_region(3), CAshley::StreamingError);
+        TS_ASSERT_THROWS(engine.wait_regions(), CAshley::StreamingError);
+        TS_ASSERT_EQUALS(engine.get_region_state(3), CAshley::REGION_UNLOADED);
+        engine.stop_streaming();
+        engine.remove_entity(e);
+        delete e;
+    }
+};
+
+#endif //__CASHLEY_STREAMINGTESTS_H
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2016 Roberto García Carvajal
+ *
+ * This file is part of CAshley.
+ * CAshley is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * CAshley is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with CAshley. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CASHLEY_TASKTESTS_H
+#define __CASHLEY_TASKTESTS_H
+
+#include <stdexcept>
+#include <vector>
+#include <cxxtest/TestSuite.h>
+#include "../include/cashley.h"
+#include "common.h"
+
+class TaskTestSuite : public CxxTest::TestSuite {
+public:
+    class TestComponent : public CAshley::Component {
+    public:
+        CASHLEY_COMPONENT
+    };
+
+    class TestEntity : public CAshley::Entity {
+    public:
+        CASHLEY_ENTITY
+    };
+
+    class TestProcessor : public CAshley::CoroutineProcessor {
+    public:
+        std::vector<unsigned int> steps;
+        CAshley::Task run() {
+            for (unsigned int i = 0; i < 3; i++) {
+                steps.push_back(get_delay());
+                co_await CAshley::next_tick();
+            }
+        }
+        CASHLEY_PROCESSOR
+    };
+
+    static CAshley::Task count_ticks(unsigned int * counter, unsigned int n) {
+        for (unsigned int i = 0; i < n; i++) {
+            (*counter)++;
+            co_await CAshley::next_tick();
+        }
+    }
+
+    static CAshley::Task wait_delay(unsigned int * done, unsigned int d) {
+        co_await CAshley::delay(d);
+        *done = 1;
+    }
+
+    static CAshley::Task wait_component(CAshley::Entity * e, int * result) {
+        bool changed = co_await CAshley::component_changed<TestComponent>(e);
+        *result = changed ? 1 : 2;
+    }
+
+    static CAshley::Task fail() {
+        co_await CAshley::next_tick();
+        throw std::runtime_error("task failed");
+    }
+
+    CAshley::Engine * engine;
+
+    void setUp() {
+        engine = new CAshley::Engine;
+    }
+
+    void tearDown() {
+        delete engine;
+    }
+
+    void test_task_next_tick(void) {
+        unsigned int counter = 0;
+        engine->spawn(count_ticks(&counter, 3));
+        TS_ASSERT(counter == 0);
+        TS_ASSERT(engine->get_tasks().size() == 1);
+        engine->run_tick(1);
+        TS_ASSERT(counter == 1);
+        engine->run_tick(1);
+        engine->run_tick(1);
+        TS_ASSERT(counter == 3);
+        TS_ASSERT(engine->get_tasks().size() == 1);
+        engine->run_tick(1);
+        TS_ASSERT(engine->get_tasks().size() == 0);
+    }
+
+    void test_task_delay(void) {
+        unsigned int done = 0;
+        engine->spawn(wait_delay(&done, 50));
+        engine->run_tick(20);
+        engine->run_tick(20);
+        TS_ASSERT(done == 0);
+        engine->run_tick(20);
+        TS_ASSERT(done == 0);
+        engine->run_tick(20);
+        TS_ASSERT(done == 1);
+        TS_ASSERT(engine->get_tasks().size() == 0);
+    }
+
+    void test_task_component_changed(void) {
+        TestEntity * e = new TestEntity;
+        engine->add_entity(e);
+        int result = 0;
+        engine->spawn(wait_component(e, &result));
+        engine->run_tick(1);
+        engine->run_tick(1);
+        TS_ASSERT(result == 0);
+        e->add_component<TestComponent>();
+        TS_ASSERT(result == 0);
+        engine->run_tick(1);
+        TS_ASSERT(result == 1);
+        engine->spawn(wait_component(e, &result));
+        engine->run_tick(1);
+        delete e;
+        engine->run_tick(1);
+        TS_ASSERT(result == 2);
+    }
+
+    void test_task_pending_on_destroy(void) {
+        TestEntity * e = new TestEntity;
+        engine->add_entity(e);
+        int result = 0;
+        unsigned int counter = 0;
+        engine->spawn(wait_component(e, &result));
+        engine->spawn(count_ticks(&counter, 100));
+        engine->run_tick(1);
+        delete engine;
+        engine = new CAshley::Engine;
+        TS_ASSERT(result == 0);
+    }
+
+    void test_task_exception(void) {
+        engine->spawn(fail());
+        engine->run_tick(1);
+        TS_ASSERT_THROWS(engine->run_tick(1), std::runtime_error);
+        TS_ASSERT(engine->get_tasks().size() == 0);
+    }
+
+    void test_coroutine_processor(void) {
+        engine->add_processor<TestProcessor>();
+        TestProcessor * p = engine->get_processor<TestProcessor>();
+        p->schedule_every_n_ticks(2);
+        p->activate();
+        for (unsigned int i = 0; i < 8; i++) {
+            engine->run_tick(3);
+        }
+        TS_ASSERT(p->steps.size() == 3);
+        TS_ASSERT(p->steps[0] == 6);
+        TS_ASSERT(p->steps[2] == 6);
+        TS_ASSERT(p->get_task_count() == 0);
+    }
+};
+
+#endif //__CASHLEY_TASKTESTS_H